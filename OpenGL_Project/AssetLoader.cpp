@@ -0,0 +1,312 @@
+#include "AssetLoader.hpp"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+
+namespace gps
+{
+	typedef std::chrono::high_resolution_clock clock;
+
+	static double MillisecondsSince(clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+	}
+
+	class ModelJob : public LoadJob
+	{
+	public:
+		ModelJob(const std::string& fileName, const std::string& basePath, std::shared_ptr<AssetState<Model3D> > state)
+			: LoadJob(fileName), basePath(basePath), state(state)
+		{
+		}
+
+		void Decode()
+		{
+			Model3D::Decode(name, basePath, data);
+		}
+
+		bool UploadStep()
+		{
+			bool complete = model.UploadStep(data);
+			//the bounds are enough to draw a placeholder while the meshes arrive
+			if (state->asset.Bounds().IsEmpty())
+				state->asset.SetBounds(model.Bounds(), model.Sphere());
+			return complete;
+		}
+
+		void Publish()
+		{
+			state->asset = std::move(model);
+			state->ready.store(true, std::memory_order_release);
+		}
+
+	private:
+		std::string basePath;
+		ModelData data;
+		//built here and moved into the handle once complete, so it is never drawn half uploaded
+		Model3D model;
+		std::shared_ptr<AssetState<Model3D> > state;
+	};
+
+	class SkyBoxJob : public LoadJob
+	{
+	public:
+		SkyBoxJob(const std::vector<const GLchar*>& faces, std::shared_ptr<AssetState<SkyBox> > state)
+			: LoadJob(faces.empty() ? std::string("skybox") : std::string(faces[0])), faces(faces), state(state)
+		{
+		}
+
+		void Decode()
+		{
+			SkyBox::Decode(faces, data);
+		}
+
+		bool UploadStep()
+		{
+			bool complete = skybox.UploadStep(data);
+			//the smallest levels are enough to draw the sky, the larger ones sharpen it as they arrive
+			if (!complete && skybox.IsDrawable() && !state->asset.IsDrawable())
+				state->asset = skybox;
+			return complete;
+		}
+
+		void Publish()
+		{
+			state->asset = skybox;
+			state->ready.store(true, std::memory_order_release);
+		}
+
+	private:
+		std::vector<const GLchar*> faces;
+		SkyBoxData data;
+		SkyBox skybox;
+		std::shared_ptr<AssetState<SkyBox> > state;
+	};
+
+	AssetLoader::AssetLoader()
+		: stopping(false), viewerPosition(0.0f), current(nullptr), startTime(clock::now()), pending(0), requested(0), frame(0)
+	{
+	}
+
+	AssetLoader::~AssetLoader()
+	{
+		Stop();
+	}
+
+	void AssetLoader::Start(unsigned int workerCount)
+	{
+		if (workerCount == 0)
+		{
+			unsigned int hardwareThreads = std::thread::hardware_concurrency();
+			workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		}
+
+		stopping = false;
+		startTime = clock::now();
+		for (size_t i = 0; i < requests.size(); i++)
+			requests[i]->requestedAt = 0.0;
+		for (unsigned int i = 0; i < workerCount; i++)
+			workers.push_back(std::thread(&AssetLoader::WorkerLoop, this));
+	}
+
+	void AssetLoader::Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			stopping = true;
+		}
+		requestCondition.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+
+		for (size_t i = 0; i < requests.size(); i++)
+			delete requests[i];
+		requests.clear();
+		LoadJob* job;
+		while (decoded.Pop(job))
+			delete job;
+		for (size_t i = 0; i < uploads.size(); i++)
+			delete uploads[i];
+		uploads.clear();
+		delete current;
+		current = nullptr;
+		pending.store(0, std::memory_order_release);
+	}
+
+	AssetHandle<Model3D> AssetLoader::LoadModel(const std::string& fileName, const std::string& basePath)
+	{
+		std::shared_ptr<AssetState<Model3D> > state = std::make_shared<AssetState<Model3D> >();
+		Enqueue(new ModelJob(fileName, basePath, state));
+		return AssetHandle<Model3D>(state);
+	}
+
+	AssetHandle<Model3D> AssetLoader::LoadModel(const std::string& fileName, const std::string& basePath, const glm::vec3& position)
+	{
+		std::shared_ptr<AssetState<Model3D> > state = std::make_shared<AssetState<Model3D> >();
+		ModelJob* job = new ModelJob(fileName, basePath, state);
+		job->position = position;
+		job->positioned = true;
+		Enqueue(job);
+		return AssetHandle<Model3D>(state);
+	}
+
+	AssetHandle<SkyBox> AssetLoader::LoadSkyBox(const std::vector<const GLchar*>& faces)
+	{
+		std::shared_ptr<AssetState<SkyBox> > state = std::make_shared<AssetState<SkyBox> >();
+		Enqueue(new SkyBoxJob(faces, state));
+		return AssetHandle<SkyBox>(state);
+	}
+
+	void AssetLoader::SetViewerPosition(const glm::vec3& position)
+	{
+		std::lock_guard<std::mutex> lock(requestMutex);
+		viewerPosition = position;
+	}
+
+	double AssetLoader::Now() const
+	{
+		return MillisecondsSince(startTime);
+	}
+
+	LoadJob* AssetLoader::TakeNearest(std::deque<LoadJob*>& jobs, const glm::vec3& viewer)
+	{
+		//a handful of jobs at most, a linear scan is fine
+		std::deque<LoadJob*>::iterator nearest = jobs.begin();
+		float nearestDistance = 0.0f;
+		for (std::deque<LoadJob*>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+		{
+			float distance = (*it)->positioned ? glm::length((*it)->position - viewer) : 0.0f;
+			if (it == jobs.begin() || distance < nearestDistance)
+			{
+				nearest = it;
+				nearestDistance = distance;
+			}
+		}
+		LoadJob* job = *nearest;
+		jobs.erase(nearest);
+		job->distance = nearestDistance;
+		return job;
+	}
+
+	void AssetLoader::Enqueue(LoadJob* job)
+	{
+		job->requestedAt = Now();
+		requested++;
+		pending.fetch_add(1, std::memory_order_acq_rel);
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			requests.push_back(job);
+		}
+		requestCondition.notify_one();
+	}
+
+	void AssetLoader::WorkerLoop()
+	{
+		for (;;)
+		{
+			LoadJob* job;
+			{
+				std::unique_lock<std::mutex> lock(requestMutex);
+				requestCondition.wait(lock, [this] { return stopping || !requests.empty(); });
+				if (stopping)
+					return;
+				job = TakeNearest(requests, viewerPosition);
+			}
+
+			clock::time_point decodeStart = clock::now();
+			job->decodeStartedAt = Now();
+			job->Decode();
+			job->decodeTime = MillisecondsSince(decodeStart);
+			job->decodeEndedAt = Now();
+
+			//the render thread drains the queue every frame, so a full queue only needs a short wait
+			while (!decoded.Push(job))
+			{
+				if (stopping)
+				{
+					delete job;
+					return;
+				}
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void AssetLoader::ProcessUploads(double budgetMs)
+	{
+		clock::time_point frameStart = clock::now();
+		frame++;
+
+		LoadJob* job;
+		while (decoded.Pop(job))
+			uploads.push_back(job);
+		glm::vec3 viewer;
+		{
+			std::lock_guard<std::mutex> lock(requestMutex);
+			viewer = viewerPosition;
+		}
+
+		do
+		{
+			if (!current)
+			{
+				if (uploads.empty())
+					break;
+				current = TakeNearest(uploads, viewer);
+			}
+			if (current->firstUploadAt < 0.0)
+				current->firstUploadAt = Now();
+
+			if (current->lastFrame != frame)
+			{
+				current->lastFrame = frame;
+				current->uploadFrames++;
+			}
+
+			clock::time_point stepStart = clock::now();
+			bool complete = current->UploadStep();
+			current->uploadTime += MillisecondsSince(stepStart);
+
+			if (complete)
+			{
+				current->Publish();
+				AssetTimelineEntry entry;
+				entry.name = current->name;
+				entry.distance = current->distance;
+				entry.requestedAt = current->requestedAt;
+				entry.decodeStartedAt = current->decodeStartedAt;
+				entry.decodeEndedAt = current->decodeEndedAt;
+				entry.firstUploadAt = current->firstUploadAt;
+				entry.residentAt = Now();
+				timeline.push_back(entry);
+				std::cout << current->name << ": decoded in " << current->decodeTime << " ms, uploaded in "
+					<< current->uploadTime << " ms over " << current->uploadFrames << " frame(s)" << std::endl;
+				delete current;
+				current = nullptr;
+				pending.fetch_sub(1, std::memory_order_acq_rel);
+			}
+		} while (MillisecondsSince(frameStart) < budgetMs);
+	}
+
+	void AssetLoader::Finish()
+	{
+		while (PendingCount() > 0)
+		{
+			ProcessUploads(1000.0);
+			if (!current && PendingCount() > 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+
+	void AssetLoader::PrintTimeline() const
+	{
+		printf("%-40s %8s %9s %9s %9s %9s %9s\n", "asset", "distance", "requested", "decoding", "decoded", "uploading", "resident");
+		for (size_t i = 0; i < timeline.size(); i++)
+		{
+			const AssetTimelineEntry& entry = timeline[i];
+			printf("%-40s %8.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", entry.name.c_str(), entry.distance, entry.requestedAt,
+				entry.decodeStartedAt, entry.decodeEndedAt, entry.firstUploadAt, entry.residentAt);
+		}
+	}
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LockFreeQueue.hpp"
+#include "Model3D.hpp"
+#include "SkyBox.hpp"
+#include "glm/glm.hpp"
+
+namespace gps
+{
+	// Asset shared between a handle and the loader; only the render thread touches the asset itself
+	template <typename T>
+	struct AssetState
+	{
+		AssetState() : ready(false) {}
+
+		T asset;
+		std::atomic<bool> ready;
+	};
+
+	// Future-like reference to an asset being loaded. Until it is ready it refers to an empty
+	// asset (a model without meshes, a skybox without a cube map), which draws nothing.
+	template <typename T>
+	class AssetHandle
+	{
+	public:
+		AssetHandle() {}
+		explicit AssetHandle(std::shared_ptr<AssetState<T> > state) : state(state) {}
+
+		bool IsValid() const { return state != nullptr; }
+		bool IsReady() const { return state && state->ready.load(std::memory_order_acquire); }
+
+		T& Get() const { return state->asset; }
+		T& operator*() const { return state->asset; }
+		T* operator->() const { return &state->asset; }
+
+		// Reference that does not keep the asset alive, for registries
+		std::weak_ptr<AssetState<T> > Weak() const { return state; }
+
+	private:
+		std::shared_ptr<AssetState<T> > state;
+	};
+
+	// One asset going through the loader: decoded on a worker, then uploaded in small steps on the render thread
+	class LoadJob
+	{
+	public:
+		LoadJob(const std::string& name)
+			: name(name), decodeTime(0.0), uploadTime(0.0), uploadFrames(0), lastFrame(0), position(0.0f), positioned(false),
+			distance(0.0f), requestedAt(0.0), decodeStartedAt(0.0), decodeEndedAt(0.0), firstUploadAt(-1.0)
+		{
+		}
+		virtual ~LoadJob() {}
+
+		// Worker thread - file reading and decoding, no GL calls
+		virtual void Decode() = 0;
+		// Render thread - uploads one texture, mesh or face, returns true when the asset is complete
+		virtual bool UploadStep() = 0;
+		// Render thread - hands the finished asset over to its handles
+		virtual void Publish() = 0;
+
+		std::string name;
+		double decodeTime;
+		double uploadTime;
+		int uploadFrames;
+		unsigned int lastFrame;
+
+		// Where the asset is drawn - jobs without a position go first, the others nearest to the viewer first
+		glm::vec3 position;
+		bool positioned;
+		// Distance to the viewer when the job was picked for decoding
+		float distance;
+		// Milliseconds since the loader started
+		double requestedAt;
+		double decodeStartedAt;
+		double decodeEndedAt;
+		double firstUploadAt;
+	};
+
+	// When one asset went through each stage, in milliseconds since the loader started
+	struct AssetTimelineEntry
+	{
+		std::string name;
+		float distance;
+		double requestedAt;
+		double decodeStartedAt;
+		double decodeEndedAt;
+		// First upload step - from here on a placeholder can be drawn for a model
+		double firstUploadAt;
+		double residentAt;
+	};
+
+	// Decodes models and skyboxes on worker threads and uploads them under a per-frame time budget
+	class AssetLoader
+	{
+	public:
+		AssetLoader();
+		~AssetLoader();
+
+		// Starts the workers - by default one per hardware thread, leaving one for rendering
+		void Start(unsigned int workerCount = 0);
+		// Joins the workers, dropping whatever was not uploaded yet
+		void Stop();
+
+		AssetHandle<Model3D> LoadModel(const std::string& fileName, const std::string& basePath);
+		// Same, for a model drawn around a world position - nearer models are decoded and uploaded first
+		AssetHandle<Model3D> LoadModel(const std::string& fileName, const std::string& basePath, const glm::vec3& position);
+		AssetHandle<SkyBox> LoadSkyBox(const std::vector<const GLchar*>& faces);
+
+		// Render thread, once per frame - the camera position used to order the remaining jobs
+		void SetViewerPosition(const glm::vec3& position);
+
+		// Render thread, once per frame - runs upload steps until the budget is spent (at least one step)
+		void ProcessUploads(double budgetMs);
+		// Render thread - blocks until every requested asset is uploaded
+		void Finish();
+
+		// Assets requested but not uploaded yet
+		int PendingCount() const { return pending.load(std::memory_order_acquire); }
+		int RequestedCount() const { return requested; }
+
+		// Every asset made resident so far, in the order they were
+		const std::vector<AssetTimelineEntry>& Timeline() const { return timeline; }
+		void PrintTimeline() const;
+
+	private:
+		AssetLoader(const AssetLoader&) = delete;
+		AssetLoader& operator=(const AssetLoader&) = delete;
+
+		void Enqueue(LoadJob* job);
+		void WorkerLoop();
+		double Now() const;
+		// Removes and returns the job to run next
+		static LoadJob* TakeNearest(std::deque<LoadJob*>& jobs, const glm::vec3& viewer);
+
+		std::vector<std::thread> workers;
+		std::mutex requestMutex;
+		std::condition_variable requestCondition;
+		std::deque<LoadJob*> requests;
+		std::atomic<bool> stopping;
+		//guarded by requestMutex
+		glm::vec3 viewerPosition;
+
+		//decoded jobs waiting for the render thread
+		LockFreeQueue<LoadJob*> decoded;
+		std::deque<LoadJob*> uploads;
+		LoadJob* current;
+
+		std::chrono::high_resolution_clock::time_point startTime;
+		std::vector<AssetTimelineEntry> timeline;
+
+		std::atomic<int> pending;
+		int requested;
+		unsigned int frame;
+	};
+}
@@ -0,0 +1,800 @@
+#include "Benchmarks.hpp"
+#include "Bvh.hpp"
+#include "ClusterGrid.hpp"
+#include "FileUtils.hpp"
+#include "Image.hpp"
+#include "CubeMapCache.hpp"
+#include "FrustumCulling.hpp"
+#include "ImageKernels.hpp"
+#include "SkyBox.hpp"
+#include "stb_image.h"
+#include "tiny_obj_loader.h"
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace gps
+{
+	typedef std::chrono::high_resolution_clock BenchmarkClock;
+
+	static const int BENCHMARK_RUNS = 3;
+
+	struct ObjParseResult
+	{
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+	};
+
+	static bool SameIndices(const std::vector<tinyobj::index_t>& a, const std::vector<tinyobj::index_t>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (a[i].vertex_index != b[i].vertex_index || a[i].normal_index != b[i].normal_index ||
+				a[i].texcoord_index != b[i].texcoord_index)
+				return false;
+		}
+		return true;
+	}
+
+	static bool SameResult(const ObjParseResult& a, const ObjParseResult& b)
+	{
+		if (a.attrib.vertices != b.attrib.vertices || a.attrib.normals != b.attrib.normals ||
+			a.attrib.texcoords != b.attrib.texcoords || a.shapes.size() != b.shapes.size() ||
+			a.materials.size() != b.materials.size())
+			return false;
+
+		for (size_t s = 0; s < a.shapes.size(); s++)
+		{
+			const tinyobj::mesh_t& meshA = a.shapes[s].mesh;
+			const tinyobj::mesh_t& meshB = b.shapes[s].mesh;
+			if (a.shapes[s].name != b.shapes[s].name || !SameIndices(meshA.indices, meshB.indices) ||
+				meshA.num_face_vertices != meshB.num_face_vertices || meshA.material_ids != meshB.material_ids)
+				return false;
+		}
+		return true;
+	}
+
+	//best of BENCHMARK_RUNS, in ms; threadCount 0 runs the serial parser
+	static double TimeObjParse(const std::string& fileName, const std::string& basePath, unsigned int threadCount, ObjParseResult& result)
+	{
+		double best = 0.0;
+		for (int run = 0; run < BENCHMARK_RUNS; run++)
+		{
+			result = ObjParseResult();
+			std::string err;
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			if (threadCount == 0)
+				tinyobj::LoadObj(&result.attrib, &result.shapes, &result.materials, &err, fileName.c_str(), basePath.c_str(), true);
+			else
+				tinyobj::LoadObjParallel(&result.attrib, &result.shapes, &result.materials, &err, fileName.c_str(), basePath.c_str(), true, threadCount);
+			double time = std::chrono::duration<double, std::milli>(BenchmarkClock::now() - start).count();
+			if (run == 0 || time < best)
+				best = time;
+		}
+		return best;
+	}
+
+	void BenchmarkObjParser(const std::string& directory)
+	{
+		std::vector<std::string> files;
+		ListFiles(directory, ".obj", files);
+		std::sort(files.begin(), files.end());
+
+		std::vector<unsigned int> threadCounts;
+		unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned int threads = 1; threads < hardwareThreads; threads *= 2)
+			threadCounts.push_back(threads);
+		threadCounts.push_back(hardwareThreads);
+
+		printf("%-40s %10s", "file", "serial");
+		for (size_t t = 0; t < threadCounts.size(); t++)
+			printf(" %8u thr", threadCounts[t]);
+		printf("\n");
+
+		double serialTotal = 0.0;
+		std::vector<double> parallelTotal(threadCounts.size(), 0.0);
+		bool allMatch = true;
+		for (size_t f = 0; f < files.size(); f++)
+		{
+			std::string basePath = files[f].substr(0, files[f].find_last_of('/') + 1);
+
+			ObjParseResult serial;
+			double serialTime = TimeObjParse(files[f], basePath, 0, serial);
+			serialTotal += serialTime;
+			printf("%-40s %7.2f ms", files[f].c_str(), serialTime);
+
+			for (size_t t = 0; t < threadCounts.size(); t++)
+			{
+				ObjParseResult parallel;
+				double parallelTime = TimeObjParse(files[f], basePath, threadCounts[t], parallel);
+				parallelTotal[t] += parallelTime;
+				bool match = SameResult(serial, parallel);
+				allMatch = allMatch && match;
+				printf(" %7.2f ms%s", parallelTime, match ? " " : "!");
+			}
+			printf("\n");
+		}
+
+		printf("%-40s %7.2f ms", "total", serialTotal);
+		for (size_t t = 0; t < threadCounts.size(); t++)
+			printf(" %7.2f ms ", parallelTotal[t]);
+		printf("\n%-40s %10s", "speedup over serial", "1.00x");
+		for (size_t t = 0; t < threadCounts.size(); t++)
+			printf(" %9.2fx ", parallelTotal[t] > 0.0 ? serialTotal / parallelTotal[t] : 0.0);
+		printf("\n%s\n", allMatch ? "parallel output matches the serial parser" : "MISMATCH: entries marked with ! differ from the serial parser");
+	}
+
+	//collects the number tokens of the v, vn and vt lines
+	static void CollectObjNumbers(const std::string& fileName, std::vector<std::string>& numbers)
+	{
+		MappedFile file;
+		if (!file.Open(fileName) || file.Size() == 0)
+			return;
+
+		const char* text = reinterpret_cast<const char*>(file.Data());
+		const char* end = text + file.Size();
+		const char* line = text;
+		while (line < end)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+			if (!lineEnd)
+				lineEnd = end;
+
+			const char* token = line;
+			while (token < lineEnd && (*token == ' ' || *token == '\t'))
+				token++;
+			bool vertexRecord = lineEnd - token > 2 && token[0] == 'v' &&
+				(token[1] == ' ' || token[1] == '\t' || ((token[1] == 'n' || token[1] == 't') && (token[2] == ' ' || token[2] == '\t')));
+			if (vertexRecord)
+			{
+				token += strcspn(token, " \t");
+				while (token < lineEnd)
+				{
+					while (token < lineEnd && (*token == ' ' || *token == '\t' || *token == '\r'))
+						token++;
+					const char* tokenEnd = token;
+					while (tokenEnd < lineEnd && *tokenEnd != ' ' && *tokenEnd != '\t' && *tokenEnd != '\r')
+						tokenEnd++;
+					if (tokenEnd > token)
+						numbers.push_back(std::string(token, tokenEnd));
+					token = tokenEnd;
+				}
+			}
+
+			line = lineEnd + 1;
+		}
+	}
+
+	static uint32_t FloatBits(float value)
+	{
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	//distance in representable floats, for same-sign values
+	static uint32_t UlpDistance(float a, float b)
+	{
+		uint32_t bitsA = FloatBits(a);
+		uint32_t bitsB = FloatBits(b);
+		return bitsA > bitsB ? bitsA - bitsB : bitsB - bitsA;
+	}
+
+	void BenchmarkFloatParser(const std::string& directory)
+	{
+		std::vector<std::string> files;
+		ListFiles(directory, ".obj", files);
+
+		std::vector<std::string> numbers;
+		size_t bytes = 0;
+		for (size_t f = 0; f < files.size(); f++)
+			CollectObjNumbers(files[f], numbers);
+		for (size_t n = 0; n < numbers.size(); n++)
+			bytes += numbers[n].size();
+
+		//bit-exactness: the exact parser must match strtof on every number
+		size_t exactMismatches = 0;
+		size_t legacyMismatches = 0;
+		size_t parserDifferences = 0;
+		uint32_t legacyMaxUlp = 0;
+		for (size_t n = 0; n < numbers.size(); n++)
+		{
+			const char* begin = numbers[n].c_str();
+			float reference = strtof(begin, NULL);
+			float exact = 0.0f;
+			float legacy = 0.0f;
+			bool exactParsed = tinyobj::ParseFloat(begin, &exact, false);
+			bool legacyParsed = tinyobj::ParseFloat(begin, &legacy, true);
+
+			if (exactParsed != legacyParsed || FloatBits(exact) != FloatBits(legacy))
+				parserDifferences++;
+			if (!exactParsed || FloatBits(exact) != FloatBits(reference))
+			{
+				if (exactMismatches++ < 10)
+					printf("exact parser mismatch: %s -> %.9g, strtof %.9g\n", begin, exact, reference);
+			}
+			if (!legacyParsed || FloatBits(legacy) != FloatBits(reference))
+			{
+				legacyMismatches++;
+				legacyMaxUlp = std::max(legacyMaxUlp, UlpDistance(legacy, reference));
+			}
+		}
+
+		printf("%zu numbers (%zu KB) from %zu .obj files under %s\n", numbers.size(), bytes / 1024, files.size(), directory.c_str());
+		printf("exact parser vs strtof    : %zu mismatches\n", exactMismatches);
+		printf("original parser vs strtof : %zu mismatches (max %u ulp)\n", legacyMismatches, legacyMaxUlp);
+		printf("exact vs original parser  : %zu differences\n", parserDifferences);
+		if (numbers.empty())
+			return;
+
+		//throughput, best of BENCHMARK_RUNS passes over all the numbers
+		const char* names[3] = { "original (tryParseDouble)", "exact (tryParseFloat)", "strtof" };
+		for (int parser = 0; parser < 3; parser++)
+		{
+			double best = 0.0;
+			float checksum = 0.0f;
+			for (int run = 0; run < BENCHMARK_RUNS; run++)
+			{
+				BenchmarkClock::time_point start = BenchmarkClock::now();
+				for (size_t n = 0; n < numbers.size(); n++)
+				{
+					const char* begin = numbers[n].c_str();
+					float value = 0.0f;
+					if (parser == 2)
+						value = strtof(begin, NULL);
+					else
+						tinyobj::ParseFloat(begin, &value, parser == 0);
+					checksum += value;
+				}
+				double time = std::chrono::duration<double, std::milli>(BenchmarkClock::now() - start).count();
+				if (run == 0 || time < best)
+					best = time;
+			}
+			printf("%-26s: %7.2f ms, %6.1f ns/number, %6.1f MB/s (checksum %g)\n", names[parser], best,
+				best * 1e6 / numbers.size(), bytes / (best * 1e-3) / (1024.0 * 1024.0), checksum);
+		}
+	}
+
+	enum ImageKernel
+	{
+		KERNEL_FLIP,
+		KERNEL_EXPAND,
+		KERNEL_PREMULTIPLY,
+		KERNEL_DOWNSAMPLE,
+		KERNEL_KAISER,
+		KERNEL_COUNT
+	};
+
+	struct KernelImage
+	{
+		int width;
+		int height;
+		std::vector<unsigned char> rgb;
+		std::vector<unsigned char> rgba;
+		// rgba with a varying alpha, including fully transparent texels, for the alpha-dependent kernels
+		std::vector<unsigned char> translucent;
+	};
+
+	static size_t KernelOutputSize(ImageKernel kernel, const KernelImage& image)
+	{
+		if (kernel == KERNEL_DOWNSAMPLE || kernel == KERNEL_KAISER)
+			return size_t(std::max(image.width / 2, 1)) * std::max(image.height / 2, 1) * 4;
+		return size_t(image.width) * image.height * 4;
+	}
+
+	//sizes the output of a kernel for every image and copies in the input of the in-place kernels, out of the timed part
+	static void PrepareKernelOutput(ImageKernel kernel, const std::vector<KernelImage>& images, std::vector<unsigned char>& output)
+	{
+		output.clear();
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			if (kernel == KERNEL_FLIP)
+				output.insert(output.end(), images[i].rgba.begin(), images[i].rgba.end());
+			else if (kernel == KERNEL_PREMULTIPLY)
+				output.insert(output.end(), images[i].translucent.begin(), images[i].translucent.end());
+			else
+				output.resize(output.size() + KernelOutputSize(kernel, images[i]));
+		}
+	}
+
+	//runs one kernel over every image, the outputs one after the other
+	static void RunImageKernel(ImageKernel kernel, const std::vector<KernelImage>& images, std::vector<unsigned char>& output)
+	{
+		size_t offset = 0;
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			const KernelImage& image = images[i];
+			size_t pixelCount = size_t(image.width) * image.height;
+			unsigned char* destination = &output[offset];
+			switch (kernel)
+			{
+			case KERNEL_FLIP:
+				FlipRows(destination, image.width, image.height, 4);
+				break;
+			case KERNEL_EXPAND:
+				ExpandRGBToRGBA(image.rgb.data(), destination, pixelCount);
+				break;
+			case KERNEL_PREMULTIPLY:
+				PremultiplyAlpha(destination, pixelCount);
+				break;
+			case KERNEL_DOWNSAMPLE:
+				DownsampleSRGB(image.translucent.data(), image.width, image.height, destination);
+				break;
+			default:
+				DownsampleKaiserSRGB(image.translucent.data(), image.width, image.height, destination);
+				break;
+			}
+			offset += KernelOutputSize(kernel, image);
+		}
+	}
+
+	void BenchmarkImageKernels(const std::string& directory)
+	{
+		std::vector<std::string> files;
+		ListFiles(directory, ".png", files);
+
+		//decoding: stb_image converting to RGBA against RGB plus the SIMD expansion done by gps::Image
+		double stbTime = 0.0, imageTime = 0.0;
+		std::vector<KernelImage> images;
+		size_t pixels = 0;
+		for (size_t f = 0; f < files.size(); f++)
+		{
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			int width, height, fileChannels;
+			unsigned char* decoded = stbi_load(files[f].c_str(), &width, &height, &fileChannels, 4);
+			stbTime += std::chrono::duration<double, std::milli>(BenchmarkClock::now() - start).count();
+			if (!decoded)
+			{
+				printf("could not load %s\n", files[f].c_str());
+				continue;
+			}
+			stbi_image_free(decoded);
+
+			start = BenchmarkClock::now();
+			Image image;
+			image.Load(files[f], 4);
+			imageTime += std::chrono::duration<double, std::milli>(BenchmarkClock::now() - start).count();
+
+			KernelImage kernelImage;
+			kernelImage.width = width;
+			kernelImage.height = height;
+			kernelImage.rgba.assign(image.Pixels(), image.Pixels() + size_t(width) * height * 4);
+			kernelImage.rgb.resize(size_t(width) * height * 3);
+			kernelImage.translucent = kernelImage.rgba;
+			for (size_t p = 0; p < size_t(width) * height; p++)
+			{
+				for (int c = 0; c < 3; c++)
+					kernelImage.rgb[p * 3 + c] = kernelImage.rgba[p * 4 + c];
+				//bands of alpha, every 16th texel fully transparent
+				kernelImage.translucent[p * 4 + 3] = p % 16 == 0 ? 0 : static_cast<unsigned char>((p / width + p) & 0xFF);
+			}
+			images.push_back(std::move(kernelImage));
+			pixels += size_t(width) * height;
+		}
+
+		printf("%zu images (%.1f Mpixels) under %s, best SIMD level %s\n", images.size(), pixels / 1e6, directory.c_str(),
+			SimdLevelName(DetectSimdLevel()));
+		if (images.empty())
+			return;
+		printf("decode, stb_image to RGBA      : %8.1f ms\n", stbTime);
+		printf("decode, RGB + SIMD expansion   : %8.1f ms\n", imageTime);
+
+		//kernels, best of BENCHMARK_RUNS at every level, checked against the scalar output
+		const char* names[KERNEL_COUNT] = { "flip rows", "RGB -> RGBA", "premultiply alpha", "sRGB box downsample", "sRGB Kaiser downsample" };
+		const SimdLevel bestLevel = DetectSimdLevel();
+		for (int kernel = 0; kernel < KERNEL_COUNT; kernel++)
+		{
+			std::vector<unsigned char> reference;
+			double scalarTime = 0.0;
+			//the Kaiser filter only has a scalar version
+			SimdLevel lastLevel = kernel == KERNEL_KAISER ? SIMD_SCALAR : bestLevel;
+			for (int level = SIMD_SCALAR; level <= lastLevel; level++)
+			{
+				SetSimdLevel(SimdLevel(level));
+				double best = 0.0;
+				std::vector<unsigned char> output;
+				for (int run = 0; run < BENCHMARK_RUNS; run++)
+				{
+					PrepareKernelOutput(ImageKernel(kernel), images, output);
+					BenchmarkClock::time_point start = BenchmarkClock::now();
+					RunImageKernel(ImageKernel(kernel), images, output);
+					double time = std::chrono::duration<double, std::milli>(BenchmarkClock::now() - start).count();
+					if (run == 0 || time < best)
+						best = time;
+				}
+				if (level == SIMD_SCALAR)
+				{
+					reference = output;
+					scalarTime = best;
+				}
+				printf("%-22s %-6s: %8.2f ms, %7.1f Mpixels/s, %5.2fx%s\n", names[kernel], SimdLevelName(SimdLevel(level)), best,
+					pixels / (best * 1e-3) / 1e6, scalarTime / best, output == reference ? "" : "  MISMATCH");
+			}
+		}
+		SetSimdLevel(bestLevel);
+	}
+
+	static double MillisecondsSince(BenchmarkClock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(BenchmarkClock::now() - start).count();
+	}
+
+	void BenchmarkSkyBoxLoading(const std::vector<std::vector<std::string> >& skyboxes)
+	{
+		unsigned int hardwareThreads = std::max(std::thread::hardware_concurrency(), 1u);
+		for (size_t s = 0; s < skyboxes.size(); s++)
+		{
+			const std::vector<std::string>& faces = skyboxes[s];
+			printf("--- %s ...\n", faces.empty() ? "(no faces)" : faces[0].c_str());
+
+			//what SkyBox used to do: one face after the other, tightly packed RGB, no mips
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			size_t decodedFaces = 0;
+			for (size_t i = 0; i < faces.size(); i++)
+			{
+				Image image;
+				if (image.Load(faces[i], 3))
+					decodedFaces++;
+			}
+			double serialTime = MillisecondsSince(start);
+
+			std::vector<Image> images;
+			start = BenchmarkClock::now();
+			SkyBox::DecodeFaces(faces, images, 1);
+			double oneThreadTime = MillisecondsSince(start);
+			start = BenchmarkClock::now();
+			bool complete = SkyBox::DecodeFaces(faces, images, hardwareThreads);
+			double parallelTime = MillisecondsSince(start);
+
+			//cold start writes the cache, the next one maps it
+			remove(CubeMapCache::PathFor(faces).c_str());
+			std::vector<const GLchar*> facePointers;
+			for (size_t i = 0; i < faces.size(); i++)
+				facePointers.push_back(faces[i].c_str());
+			start = BenchmarkClock::now();
+			{
+				SkyBoxData data;
+				SkyBox::Decode(facePointers, data);
+			}
+			double coldTime = MillisecondsSince(start);
+			start = BenchmarkClock::now();
+			bool cached;
+			{
+				SkyBoxData data;
+				SkyBox::Decode(facePointers, data);
+				cached = data.cache.IsOpen();
+			}
+			double warmTime = MillisecondsSince(start);
+
+			printf("%zu/%zu faces decoded%s\n", decodedFaces, faces.size(), complete ? "" : " - incomplete cube map, no cache");
+			printf("serial RGB decode (old)           : %8.1f ms\n", serialTime);
+			printf("RGBA + mips, 1 thread             : %8.1f ms\n", oneThreadTime);
+			printf("RGBA + mips, %2u thread(s)         : %8.1f ms\n", hardwareThreads, parallelTime);
+			printf("SkyBox::Decode, no cache          : %8.1f ms (decode + cache write)\n", coldTime);
+			printf("SkyBox::Decode, cache             : %8.1f ms%s\n", warmTime, cached ? "" : " (cache not used)");
+		}
+	}
+
+	void BenchmarkFrustumCulling(size_t count)
+	{
+		//spheres of 0.5 to 2.5 spread over a 1000 unit box around the camera, about a tenth of them in view
+		SphereSet spheres;
+		spheres.Reserve(count);
+		srand(1);
+		for (size_t i = 0; i < count; i++)
+		{
+			BoundingSphere sphere;
+			sphere.center = glm::vec3(rand() / float(RAND_MAX), rand() / float(RAND_MAX), rand() / float(RAND_MAX)) * 1000.0f - 500.0f;
+			sphere.radius = 0.5f + 2.0f * rand() / float(RAND_MAX);
+			spheres.Add(sphere);
+		}
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		Frustum frustum = Frustum::FromMatrix(projection * view);
+
+		printf("%zu spheres, best SIMD level %s\n", count, SimdLevelName(DetectSimdLevel()));
+		const SimdLevel bestLevel = DetectSimdLevel();
+		std::vector<uint32_t> reference;
+		double scalarTime = 0.0;
+		for (int level = SIMD_SCALAR; level <= bestLevel; level++)
+		{
+			SetSimdLevel(SimdLevel(level));
+			double best = 0.0;
+			std::vector<uint32_t> visible;
+			for (int run = 0; run < BENCHMARK_RUNS; run++)
+			{
+				BenchmarkClock::time_point start = BenchmarkClock::now();
+				spheres.Cull(frustum, visible);
+				double time = MillisecondsSince(start);
+				if (run == 0 || time < best)
+					best = time;
+			}
+			if (level == SIMD_SCALAR)
+			{
+				reference = visible;
+				scalarTime = best;
+			}
+			printf("frustum culling %-6s: %8.3f ms, %7.1f Mspheres/s, %5.2fx, %zu visible%s\n", SimdLevelName(SimdLevel(level)), best,
+				count / (best * 1e-3) / 1e6, scalarTime / best, visible.size(), visible == reference ? "" : "  MISMATCH");
+		}
+		SetSimdLevel(bestLevel);
+	}
+
+	static float RandomUnit()
+	{
+		return rand() / float(RAND_MAX);
+	}
+
+	static glm::vec3 RandomPoint(float extent)
+	{
+		return (glm::vec3(RandomUnit(), RandomUnit(), RandomUnit()) - 0.5f) * extent;
+	}
+
+	static bool SameIds(std::vector<uint32_t> a, std::vector<uint32_t> b)
+	{
+		std::sort(a.begin(), a.end());
+		std::sort(b.begin(), b.end());
+		return a == b;
+	}
+
+	void BenchmarkBvh()
+	{
+		const size_t counts[] = { 10000, 100000, 1000000 };
+		//queries timed over this many spheres and rays, checked against a scan for the first few
+		const int QUERIES = 1000;
+		const int CHECKED_QUERIES = 10;
+		for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+		{
+			const size_t count = counts[c];
+			//boxes of 0.5 to 3 units, spread so the density stays that of the tree patch whatever the count
+			const float extent = 10.0f * std::cbrt(float(count));
+			srand(1);
+			std::vector<BoundingBox> boxes(count);
+			std::vector<uint32_t> ids(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				glm::vec3 center = RandomPoint(extent);
+				glm::vec3 half = glm::vec3(0.25f) + glm::vec3(RandomUnit(), RandomUnit(), RandomUnit()) * 1.25f;
+				boxes[i] = BoundingBox(center - half, center + half);
+				ids[i] = uint32_t(i);
+			}
+			printf("--- %zu boxes in a %.0f unit cube\n", count, extent);
+
+			Bvh bvh;
+			std::vector<int> proxies;
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			bvh.Build(boxes, ids, proxies);
+			double buildTime = MillisecondsSince(start);
+			printf("build (median split)  : %8.2f ms, height %d, cost %.1f\n", buildTime, bvh.Height(), bvh.Cost());
+
+			Bvh inserted;
+			start = BenchmarkClock::now();
+			for (size_t i = 0; i < count; i++)
+				inserted.Insert(boxes[i], ids[i]);
+			double insertTime = MillisecondsSince(start);
+			printf("insert one by one     : %8.2f ms, height %d, cost %.1f\n", insertTime, inserted.Height(), inserted.Cost());
+
+			//camera in the middle of the boxes
+			glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 1000.0f);
+			glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+			Frustum frustum = Frustum::FromMatrix(projection * view);
+			std::vector<uint32_t> visible;
+			double frustumTime = 0.0;
+			for (int run = 0; run < BENCHMARK_RUNS; run++)
+			{
+				visible.clear();
+				start = BenchmarkClock::now();
+				bvh.QueryFrustum(frustum, visible);
+				double time = MillisecondsSince(start);
+				if (run == 0 || time < frustumTime)
+					frustumTime = time;
+			}
+			std::vector<uint32_t> scanned;
+			start = BenchmarkClock::now();
+			for (size_t i = 0; i < count; i++)
+			{
+				if (frustum.Intersects(boxes[i]))
+					scanned.push_back(ids[i]);
+			}
+			double scanTime = MillisecondsSince(start);
+			printf("frustum query         : %8.3f ms, %zu visible, scan of every box %.3f ms%s\n", frustumTime, visible.size(),
+				scanTime, SameIds(visible, scanned) ? "" : "  MISMATCH");
+
+			std::vector<BoundingSphere> spheres(QUERIES);
+			std::vector<Ray> rays(QUERIES);
+			for (int q = 0; q < QUERIES; q++)
+			{
+				spheres[q] = BoundingSphere(RandomPoint(extent), 5.0f);
+				rays[q] = Ray(RandomPoint(extent), glm::normalize(RandomPoint(2.0f) + glm::vec3(0.001f)));
+			}
+
+			size_t touched = 0;
+			std::vector<uint32_t> hits;
+			start = BenchmarkClock::now();
+			for (int q = 0; q < QUERIES; q++)
+			{
+				hits.clear();
+				bvh.QuerySphere(spheres[q], hits);
+				touched += hits.size();
+			}
+			double sphereTime = MillisecondsSince(start);
+			bool spheresMatch = true;
+			for (int q = 0; q < CHECKED_QUERIES; q++)
+			{
+				hits.clear();
+				bvh.QuerySphere(spheres[q], hits);
+				scanned.clear();
+				for (size_t i = 0; i < count; i++)
+				{
+					glm::vec3 offset = glm::clamp(spheres[q].center, boxes[i].min, boxes[i].max) - spheres[q].center;
+					if (glm::dot(offset, offset) <= spheres[q].radius * spheres[q].radius)
+						scanned.push_back(ids[i]);
+				}
+				spheresMatch = spheresMatch && SameIds(hits, scanned);
+			}
+			printf("sphere query          : %8.3f us each, %.1f boxes touched%s\n", sphereTime * 1000.0 / QUERIES,
+				double(touched) / QUERIES, spheresMatch ? "" : "  MISMATCH");
+
+			const float RAY_LENGTH = 100.0f;
+			int rayHits = 0;
+			start = BenchmarkClock::now();
+			for (int q = 0; q < QUERIES; q++)
+			{
+				uint32_t id;
+				float distance;
+				if (bvh.Raycast(rays[q], RAY_LENGTH, id, distance))
+					rayHits++;
+			}
+			double rayTime = MillisecondsSince(start);
+			bool raysMatch = true;
+			for (int q = 0; q < CHECKED_QUERIES; q++)
+			{
+				uint32_t id = 0;
+				float distance = RAY_LENGTH;
+				bool hit = bvh.Raycast(rays[q], RAY_LENGTH, id, distance);
+				float nearest = RAY_LENGTH;
+				bool scanHit = false;
+				for (size_t i = 0; i < count; i++)
+				{
+					//same slab test as the tree, in line
+					glm::vec3 inverse = 1.0f / rays[q].direction;
+					glm::vec3 t1 = (boxes[i].min - rays[q].origin) * inverse;
+					glm::vec3 t2 = (boxes[i].max - rays[q].origin) * inverse;
+					glm::vec3 tMin = glm::min(t1, t2);
+					glm::vec3 tMax = glm::max(t1, t2);
+					float enter = glm::max(glm::max(tMin.x, tMin.y), glm::max(tMin.z, 0.0f));
+					float exit = glm::min(glm::min(tMax.x, tMax.y), tMax.z);
+					if (enter <= exit && enter <= nearest)
+					{
+						nearest = enter;
+						scanHit = true;
+					}
+				}
+				raysMatch = raysMatch && hit == scanHit && (!hit || distance == nearest);
+			}
+			printf("ray query             : %8.3f us each, %d of %d hit within %.0f%s\n", rayTime * 1000.0 / QUERIES, rayHits,
+				QUERIES, RAY_LENGTH, raysMatch ? "" : "  MISMATCH");
+
+			//1% of the instances moving a little every frame, as Alduin and the blades do, then 1% jumping anywhere
+			const size_t moved = count / 100;
+			start = BenchmarkClock::now();
+			for (size_t i = 0; i < moved; i++)
+			{
+				glm::vec3 offset = RandomPoint(0.2f);
+				bvh.Move(proxies[i], BoundingBox(boxes[i].min + offset, boxes[i].max + offset));
+			}
+			double refitTime = MillisecondsSince(start);
+			float refitCost = bvh.Cost();
+			start = BenchmarkClock::now();
+			for (size_t i = moved; i < 2 * moved; i++)
+			{
+				glm::vec3 offset = RandomPoint(extent) - boxes[i].Center();
+				bvh.Move(proxies[i], BoundingBox(boxes[i].min + offset, boxes[i].max + offset));
+			}
+			double jumpTime = MillisecondsSince(start);
+			printf("move 1%% a little      : %8.3f ms, %.3f us each, cost %.1f\n", refitTime, refitTime * 1000.0 / moved, refitCost);
+			printf("move 1%% far           : %8.3f ms, %.3f us each, cost %.1f\n", jumpTime, jumpTime * 1000.0 / moved, bvh.Cost());
+			start = BenchmarkClock::now();
+			bvh.Rebuild();
+			printf("rebuild               : %8.2f ms, cost %.1f\n", MillisecondsSince(start), bvh.Cost());
+		}
+	}
+
+	void BenchmarkLightClusters()
+	{
+		const size_t counts[] = { 2, 10, 100, 1000, 10000 };
+		//the camera of the default window, looking into lights of the size --lights adds
+		const float fov = glm::radians(45.0f);
+		const float aspect = 1024.0f / 768.0f;
+		const float farPlane = 1000.0f;
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		const SimdLevel bestLevel = DetectSimdLevel();
+		const int cores = int(std::max(std::thread::hardware_concurrency(), 1u));
+		ClusterSettings settings;
+		printf("%dx%dx%d clusters, best SIMD level %s, %d cores\n", settings.tilesX, settings.tilesY, settings.slices,
+			SimdLevelName(bestLevel), cores);
+
+		for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+		{
+			const size_t count = counts[c];
+			srand(1);
+			std::vector<glm::vec4> lights(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				glm::vec3 position = glm::vec3(RandomUnit() * 200.0f - 100.0f, RandomUnit() * 20.0f - 10.0f, -RandomUnit() * 200.0f);
+				lights[i] = glm::vec4(position, 2.0f + 10.0f * RandomUnit());
+			}
+			printf("--- %zu lights\n", count);
+
+			settings.threads = 1;
+			ClusterGrid grid;
+			grid.Reset(settings);
+			SetSimdLevel(SIMD_SCALAR);
+			grid.Bin(lights, view, fov, aspect, farPlane);
+
+			//every light against every cluster box, with the distances taken out in the order of the grid
+			std::vector<glm::uvec2> referenceRanges(grid.ClusterCount());
+			std::vector<uint32_t> referenceIndices;
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			for (int cluster = 0; cluster < grid.ClusterCount(); cluster++)
+			{
+				BoundingBox box = grid.ClusterBox(cluster);
+				referenceRanges[cluster].x = uint32_t(referenceIndices.size());
+				for (size_t i = 0; i < count; i++)
+				{
+					glm::vec3 center(view * glm::vec4(glm::vec3(lights[i]), 1.0f));
+					float depth = -center.z;
+					float dz = std::max(std::max(-box.max.z - depth, depth + box.min.z), 0.0f);
+					float dy = std::max(std::max(box.min.y - center.y, center.y - box.max.y), 0.0f);
+					float dx = std::max(std::max(box.min.x - center.x, center.x - box.max.x), 0.0f);
+					float reach = lights[i].w * lights[i].w - dz * dz;
+					if (reach >= 0.0f && reach - dy * dy >= 0.0f && dx * dx <= reach - dy * dy)
+						referenceIndices.push_back(uint32_t(i));
+				}
+				referenceRanges[cluster].y = uint32_t(referenceIndices.size()) - referenceRanges[cluster].x;
+			}
+			double scanTime = MillisecondsSince(start);
+
+			double scalarTime = 0.0;
+			for (int level = SIMD_SCALAR; level <= bestLevel + 1; level++)
+			{
+				//every level on one thread, then the best one on every core
+				settings.threads = level <= bestLevel ? 1 : cores;
+				SimdLevel simdLevel = SimdLevel(std::min(level, int(bestLevel)));
+				SetSimdLevel(simdLevel);
+				grid.Reset(settings);
+				double best = 0.0;
+				for (int run = 0; run < BENCHMARK_RUNS; run++)
+				{
+					start = BenchmarkClock::now();
+					grid.Bin(lights, view, fov, aspect, farPlane);
+					double time = MillisecondsSince(start);
+					if (run == 0 || time < best)
+						best = time;
+				}
+				if (level == SIMD_SCALAR)
+					scalarTime = best;
+				bool same = grid.Ranges() == referenceRanges && grid.Indices() == referenceIndices;
+				printf("binning %-6s %2d thread(s): %8.3f ms, %6.3f us per light, %5.2fx%s\n", SimdLevelName(simdLevel),
+					grid.ThreadCount(), best, best * 1000.0 / count, scalarTime / best, same ? "" : "  MISMATCH");
+			}
+
+			size_t longest = 0;
+			for (size_t i = 0; i < referenceRanges.size(); i++)
+				longest = std::max(longest, size_t(referenceRanges[i].y));
+			printf("%.2f lights per cluster, %zu at most - every light against every cluster %.2f ms\n",
+				double(referenceIndices.size()) / grid.ClusterCount(), longest, scanTime);
+		}
+		SetSimdLevel(bestLevel);
+	}
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace gps
+{
+	// Times tinyobj::LoadObj against tinyobj::LoadObjParallel with 1..N threads on every .obj under the directory,
+	// checking that both produce the same data
+	void BenchmarkObjParser(const std::string& directory);
+
+	// Checks the exact float parser of tiny_obj_loader against strtof and the original parser on every number
+	// of the v/vn/vt records of the .obj files under the directory, and times the three
+	void BenchmarkFloatParser(const std::string& directory);
+
+	// Times the image kernels at every SIMD level the CPU supports on the .png files under the directory (the
+	// skybox faces), checking each level against the scalar code, and compares stb_image RGBA decoding
+	// with RGB decoding plus the SIMD expansion
+	void BenchmarkImageKernels(const std::string& directory);
+
+	// Times the skybox startup for each set of six faces: serial RGB decoding as it used to be, parallel RGBA
+	// decoding with mip chains, and SkyBox::Decode without and with the cube map cache
+	void BenchmarkSkyBoxLoading(const std::vector<std::vector<std::string> >& skyboxes);
+
+	// Times SphereSet::Cull at every SIMD level on count random spheres around a camera looking into them,
+	// checking each level against the scalar result
+	void BenchmarkFrustumCulling(size_t count);
+
+	// Times building, refitting and querying the scene Bvh over 10k, 100k and 1M random boxes, checking the
+	// queries against a scan of every box
+	void BenchmarkBvh();
+
+	// Times ClusterGrid::Bin on 2 to 10k point lights in front of the camera at every SIMD level, on one thread and on
+	// every core, checking the cluster lists against a test of every light against every cluster
+	void BenchmarkLightClusters();
+}
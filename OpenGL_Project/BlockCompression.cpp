@@ -0,0 +1,417 @@
+#include "BlockCompression.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace gps
+{
+	bool IsCompressedFormat(uint32_t format)
+	{
+		return format == COMPRESSED_BC1 || format == COMPRESSED_BC3 || format == COMPRESSED_BC4 || format == COMPRESSED_BC5;
+	}
+
+	size_t BlockSize(CompressedFormat format)
+	{
+		return (format == COMPRESSED_BC1 || format == COMPRESSED_BC4) ? 8 : 16;
+	}
+
+	size_t CompressedLevelSize(CompressedFormat format, int width, int height)
+	{
+		return size_t((width + 3) / 4) * size_t((height + 3) / 4) * BlockSize(format);
+	}
+
+	CompressedFormat ChooseCompressedFormat(const unsigned char* rgba, int width, int height)
+	{
+		bool gray = true;
+		for (size_t i = 0, count = size_t(width) * height; i < count; i++)
+		{
+			const unsigned char* pixel = rgba + i * 4;
+			if (pixel[3] != 255)
+				return COMPRESSED_BC3;
+			if (pixel[0] != pixel[1] || pixel[0] != pixel[2])
+				gray = false;
+		}
+		return gray ? COMPRESSED_BC4 : COMPRESSED_BC1;
+	}
+
+	//gathers a 4x4 block, repeating the last row/column past the edges
+	static void FetchBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, unsigned char block[64])
+	{
+		for (int y = 0; y < 4; y++)
+		{
+			int sourceY = blockY * 4 + y < height ? blockY * 4 + y : height - 1;
+			for (int x = 0; x < 4; x++)
+			{
+				int sourceX = blockX * 4 + x < width ? blockX * 4 + x : width - 1;
+				memcpy(block + (y * 4 + x) * 4, rgba + (size_t(sourceY) * width + sourceX) * 4, 4);
+			}
+		}
+	}
+
+	static uint16_t PackRGB565(const float color[3])
+	{
+		int r = int(color[0] * 31.0f / 255.0f + 0.5f);
+		int g = int(color[1] * 63.0f / 255.0f + 0.5f);
+		int b = int(color[2] * 31.0f / 255.0f + 0.5f);
+		r = r < 0 ? 0 : (r > 31 ? 31 : r);
+		g = g < 0 ? 0 : (g > 63 ? 63 : g);
+		b = b < 0 ? 0 : (b > 31 ? 31 : b);
+		return uint16_t((r << 11) | (g << 5) | b);
+	}
+
+	static void UnpackRGB565(uint16_t packed, int color[3])
+	{
+		int r = (packed >> 11) & 31;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	//four color palette of an opaque BC1 block (color0 > color1)
+	static void BC1Palette(uint16_t color0, uint16_t color1, int palette[4][3])
+	{
+		UnpackRGB565(color0, palette[0]);
+		UnpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	}
+
+	//picks the closest palette entry for each pixel, returns the squared error
+	static int BC1Indices(const unsigned char block[64], uint16_t color0, uint16_t color1, uint32_t& indices)
+	{
+		int palette[4][3];
+		BC1Palette(color0, color1, palette);
+
+		int error = 0;
+		indices = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			int bestDistance = 0x7FFFFFFF;
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = block[i * 4 + 0] - palette[p][0];
+				int dg = block[i * 4 + 1] - palette[p][1];
+				int db = block[i * 4 + 2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= uint32_t(best) << (2 * i);
+			error += bestDistance;
+		}
+		return error;
+	}
+
+	//orders the endpoints for the four color mode, returns false when they collapse to one color
+	static bool OrderEndpoints(uint16_t& color0, uint16_t& color1)
+	{
+		if (color0 < color1)
+		{
+			uint16_t temp = color0;
+			color0 = color1;
+			color1 = temp;
+		}
+		return color0 != color1;
+	}
+
+	static void EncodeBC1Block(const unsigned char block[64], unsigned char* output)
+	{
+		//principal axis of the colors, by power iteration on the covariance matrix
+		float mean[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+			for (int c = 0; c < 3; c++)
+				mean[c] += block[i * 4 + c];
+		for (int c = 0; c < 3; c++)
+			mean[c] /= 16.0f;
+
+		float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			float r = block[i * 4 + 0] - mean[0];
+			float g = block[i * 4 + 1] - mean[1];
+			float b = block[i * 4 + 2] - mean[2];
+			covariance[0] += r * r;
+			covariance[1] += r * g;
+			covariance[2] += r * b;
+			covariance[3] += g * g;
+			covariance[4] += g * b;
+			covariance[5] += b * b;
+		}
+
+		float axis[3] = { 0.9f, 1.0f, 0.7f };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float x = axis[0] * covariance[0] + axis[1] * covariance[1] + axis[2] * covariance[2];
+			float y = axis[0] * covariance[1] + axis[1] * covariance[3] + axis[2] * covariance[4];
+			float z = axis[0] * covariance[2] + axis[1] * covariance[4] + axis[2] * covariance[5];
+			float length = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+			if (length < 1e-6f)
+				break;
+			axis[0] = x / length;
+			axis[1] = y / length;
+			axis[2] = z / length;
+		}
+
+		//the extreme projections on the axis become the endpoints
+		float minimum = 1e30f, maximum = -1e30f;
+		for (int i = 0; i < 16; i++)
+		{
+			float projection = (block[i * 4 + 0] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1] + (block[i * 4 + 2] - mean[2]) * axis[2];
+			minimum = std::min(minimum, projection);
+			maximum = std::max(maximum, projection);
+		}
+		float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+		if (axisLength > 0.0f)
+		{
+			minimum /= axisLength;
+			maximum /= axisLength;
+		}
+		float start[3], end[3];
+		for (int c = 0; c < 3; c++)
+		{
+			start[c] = mean[c] + axis[c] * maximum;
+			end[c] = mean[c] + axis[c] * minimum;
+		}
+
+		uint16_t color0 = PackRGB565(start);
+		uint16_t color1 = PackRGB565(end);
+		uint32_t indices = 0;
+		int error = 0x7FFFFFFF;
+		if (OrderEndpoints(color0, color1))
+			error = BC1Indices(block, color0, color1, indices);
+
+		//least squares refit of the endpoints to the chosen indices
+		if (error > 0 && color0 != color1)
+		{
+			static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+			float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+			for (int i = 0; i < 16; i++)
+			{
+				float a = weights[(indices >> (2 * i)) & 3];
+				float b = 1.0f - a;
+				aa += a * a;
+				bb += b * b;
+				ab += a * b;
+				for (int c = 0; c < 3; c++)
+				{
+					ax[c] += a * block[i * 4 + c];
+					bx[c] += b * block[i * 4 + c];
+				}
+			}
+			float determinant = aa * bb - ab * ab;
+			if (fabsf(determinant) > 1e-6f)
+			{
+				float refit0[3], refit1[3];
+				for (int c = 0; c < 3; c++)
+				{
+					refit0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+					refit1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+				}
+				uint16_t refitColor0 = PackRGB565(refit0);
+				uint16_t refitColor1 = PackRGB565(refit1);
+				uint32_t refitIndices;
+				if (OrderEndpoints(refitColor0, refitColor1))
+				{
+					int refitError = BC1Indices(block, refitColor0, refitColor1, refitIndices);
+					if (refitError < error)
+					{
+						error = refitError;
+						color0 = refitColor0;
+						color1 = refitColor1;
+						indices = refitIndices;
+					}
+				}
+			}
+		}
+
+		if (color0 == color1)
+		{
+			//a single color - every pixel uses endpoint 0
+			color0 = PackRGB565(mean);
+			color1 = color0;
+			indices = 0;
+		}
+
+		output[0] = uint8_t(color0 & 0xFF);
+		output[1] = uint8_t(color0 >> 8);
+		output[2] = uint8_t(color1 & 0xFF);
+		output[3] = uint8_t(color1 >> 8);
+		for (int i = 0; i < 4; i++)
+			output[4 + i] = uint8_t(indices >> (8 * i));
+	}
+
+	//eight value palette of a BC4 block (value0 > value1)
+	static void BC4Palette(int value0, int value1, int palette[8])
+	{
+		palette[0] = value0;
+		palette[1] = value1;
+		for (int i = 1; i < 7; i++)
+			palette[i + 1] = ((7 - i) * value0 + i * value1) / 7;
+	}
+
+	static void EncodeBC4Block(const unsigned char block[64], int channel, unsigned char* output)
+	{
+		int minimum = 255, maximum = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			minimum = std::min(minimum, int(block[i * 4 + channel]));
+			maximum = std::max(maximum, int(block[i * 4 + channel]));
+		}
+
+		output[0] = uint8_t(maximum);
+		output[1] = uint8_t(minimum);
+		uint64_t indices = 0;
+		if (maximum != minimum)
+		{
+			int palette[8];
+			BC4Palette(maximum, minimum, palette);
+			for (int i = 0; i < 16; i++)
+			{
+				int value = block[i * 4 + channel];
+				int best = 0;
+				int bestDistance = 256;
+				for (int p = 0; p < 8; p++)
+				{
+					int distance = std::abs(value - palette[p]);
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= uint64_t(best) << (3 * i);
+			}
+		}
+		for (int i = 0; i < 6; i++)
+			output[2 + i] = uint8_t(indices >> (8 * i));
+	}
+
+	void CompressImage(const unsigned char* rgba, int width, int height, CompressedFormat format, unsigned char* blocks)
+	{
+		const int blocksX = (width + 3) / 4;
+		const int blocksY = (height + 3) / 4;
+		unsigned char block[64];
+
+		for (int blockY = 0; blockY < blocksY; blockY++)
+		{
+			for (int blockX = 0; blockX < blocksX; blockX++)
+			{
+				FetchBlock(rgba, width, height, blockX, blockY, block);
+				switch (format)
+				{
+				case COMPRESSED_BC1:
+					EncodeBC1Block(block, blocks);
+					break;
+				case COMPRESSED_BC3:
+					EncodeBC4Block(block, 3, blocks);
+					EncodeBC1Block(block, blocks + 8);
+					break;
+				case COMPRESSED_BC4:
+					EncodeBC4Block(block, 0, blocks);
+					break;
+				case COMPRESSED_BC5:
+					EncodeBC4Block(block, 0, blocks);
+					EncodeBC4Block(block, 1, blocks + 8);
+					break;
+				}
+				blocks += BlockSize(format);
+			}
+		}
+	}
+
+	static void DecodeBC1Block(const unsigned char* input, unsigned char block[64])
+	{
+		uint16_t color0 = uint16_t(input[0] | (input[1] << 8));
+		uint16_t color1 = uint16_t(input[2] | (input[3] << 8));
+		uint32_t indices = uint32_t(input[4]) | (uint32_t(input[5]) << 8) | (uint32_t(input[6]) << 16) | (uint32_t(input[7]) << 24);
+
+		int palette[4][3];
+		BC1Palette(color0, color1, palette);
+		if (color0 <= color1)
+		{
+			//three color mode, not produced by the encoder
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+
+		for (int i = 0; i < 16; i++)
+		{
+			int index = (indices >> (2 * i)) & 3;
+			for (int c = 0; c < 3; c++)
+				block[i * 4 + c] = uint8_t(palette[index][c]);
+			block[i * 4 + 3] = 255;
+		}
+	}
+
+	static void DecodeBC4Block(const unsigned char* input, int channel, unsigned char block[64])
+	{
+		int palette[8];
+		BC4Palette(input[0], input[1], palette);
+		if (input[0] <= input[1])
+		{
+			//six value mode, not produced by the encoder
+			for (int i = 1; i < 5; i++)
+				palette[i + 1] = ((5 - i) * input[0] + i * input[1]) / 5;
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t indices = 0;
+		for (int i = 0; i < 6; i++)
+			indices |= uint64_t(input[2 + i]) << (8 * i);
+		for (int i = 0; i < 16; i++)
+			block[i * 4 + channel] = uint8_t(palette[(indices >> (3 * i)) & 7]);
+	}
+
+	void DecompressImage(const unsigned char* blocks, int width, int height, CompressedFormat format, unsigned char* rgba)
+	{
+		const int blocksX = (width + 3) / 4;
+		const int blocksY = (height + 3) / 4;
+		unsigned char block[64];
+
+		for (int blockY = 0; blockY < blocksY; blockY++)
+		{
+			for (int blockX = 0; blockX < blocksX; blockX++)
+			{
+				switch (format)
+				{
+				case COMPRESSED_BC1:
+					DecodeBC1Block(blocks, block);
+					break;
+				case COMPRESSED_BC3:
+					DecodeBC1Block(blocks + 8, block);
+					DecodeBC4Block(blocks, 3, block);
+					break;
+				case COMPRESSED_BC4:
+				case COMPRESSED_BC5:
+					memset(block, 0, sizeof(block));
+					for (int i = 0; i < 16; i++)
+						block[i * 4 + 3] = 255;
+					DecodeBC4Block(blocks, 0, block);
+					if (format == COMPRESSED_BC5)
+						DecodeBC4Block(blocks + 8, 1, block);
+					break;
+				}
+				blocks += BlockSize(format);
+
+				for (int y = 0; y < 4 && blockY * 4 + y < height; y++)
+					for (int x = 0; x < 4 && blockX * 4 + x < width; x++)
+						memcpy(rgba + (size_t(blockY * 4 + y) * width + blockX * 4 + x) * 4, block + (y * 4 + x) * 4, 4);
+			}
+		}
+	}
+}
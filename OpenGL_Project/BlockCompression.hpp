@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace gps
+{
+	// Block-compressed texture formats. The values are the matching GL internal formats,
+	// so they can be stored in KTX headers and passed to glCompressedTexImage2D as they are.
+	enum CompressedFormat
+	{
+		COMPRESSED_BC1 = 0x83F0, // GL_COMPRESSED_RGB_S3TC_DXT1_EXT - opaque color, 8 bytes per block
+		COMPRESSED_BC3 = 0x83F3, // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT - color and alpha, 16 bytes per block
+		COMPRESSED_BC4 = 0x8DBB, // GL_COMPRESSED_RED_RGTC1 - one channel (masks, grayscale), 8 bytes per block
+		COMPRESSED_BC5 = 0x8DBD  // GL_COMPRESSED_RG_RGTC2 - two channels (normal maps), 16 bytes per block
+	};
+
+	bool IsCompressedFormat(uint32_t format);
+
+	// Bytes of one 4x4 block
+	size_t BlockSize(CompressedFormat format);
+
+	// Bytes of a whole level - partial blocks at the edges are padded
+	size_t CompressedLevelSize(CompressedFormat format, int width, int height);
+
+	// Picks BC3 if any pixel is translucent, BC4 if the image is gray, BC1 otherwise
+	CompressedFormat ChooseCompressedFormat(const unsigned char* rgba, int width, int height);
+
+	// Encodes an RGBA8 image (rows tightly packed) into blocks, row by row of blocks
+	void CompressImage(const unsigned char* rgba, int width, int height, CompressedFormat format, unsigned char* blocks);
+
+	// Decodes blocks back to RGBA8 - lets the encoder be checked without a GPU.
+	// Missing channels decode as the GL sampler returns them (0 for G/B, 255 for alpha).
+	void DecompressImage(const unsigned char* blocks, int width, int height, CompressedFormat format, unsigned char* rgba);
+}
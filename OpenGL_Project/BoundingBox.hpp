@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <cfloat>
+
+#include "glm/glm.hpp"
+
+namespace gps
+{
+	// Axis-aligned box, empty (min > max) until a point is added
+	struct BoundingBox
+	{
+		BoundingBox() : min(FLT_MAX), max(-FLT_MAX) {}
+		BoundingBox(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+		bool IsEmpty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+		glm::vec3 Center() const { return (min + max) * 0.5f; }
+		glm::vec3 Size() const { return max - min; }
+
+		void Add(const glm::vec3& point)
+		{
+			min = glm::min(min, point);
+			max = glm::max(max, point);
+		}
+
+		void Add(const BoundingBox& box)
+		{
+			min = glm::min(min, box.min);
+			max = glm::max(max, box.max);
+		}
+
+		bool Contains(const BoundingBox& box) const
+		{
+			return glm::all(glm::lessThanEqual(min, box.min)) && glm::all(glm::greaterThanEqual(max, box.max));
+		}
+
+		// Area of the six faces - the cost of a node in the bounding volume hierarchy
+		float SurfaceArea() const
+		{
+			glm::vec3 size = Size();
+			return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+		}
+
+		// Box around the transformed box - each axis of the result takes the extremes of the rotated axes
+		BoundingBox Transformed(const glm::mat4& matrix) const
+		{
+			if (IsEmpty())
+				return BoundingBox();
+
+			glm::vec3 center = glm::vec3(matrix * glm::vec4(Center(), 1.0f));
+			glm::vec3 extent = Size() * 0.5f;
+			glm::vec3 transformedExtent = glm::abs(glm::vec3(matrix[0])) * extent.x + glm::abs(glm::vec3(matrix[1])) * extent.y
+				+ glm::abs(glm::vec3(matrix[2])) * extent.z;
+			return BoundingBox(center - transformedExtent, center + transformedExtent);
+		}
+
+		glm::vec3 min;
+		glm::vec3 max;
+	};
+
+	// Sphere around a box or a set of points, empty (negative radius) until set
+	struct BoundingSphere
+	{
+		BoundingSphere() : center(0.0f), radius(-1.0f) {}
+		BoundingSphere(const glm::vec3& center, float radius) : center(center), radius(radius) {}
+
+		bool IsEmpty() const { return radius < 0.0f; }
+
+		// Sphere around the points, centered on their box - not the smallest one, but within a few percent for models
+		static BoundingSphere Around(const BoundingBox& box, const glm::vec3* points, size_t count, size_t stride = sizeof(glm::vec3))
+		{
+			if (box.IsEmpty())
+				return BoundingSphere();
+
+			glm::vec3 center = box.Center();
+			float radius2 = 0.0f;
+			const unsigned char* point = reinterpret_cast<const unsigned char*>(points);
+			for (size_t i = 0; i < count; i++, point += stride)
+			{
+				glm::vec3 offset = *reinterpret_cast<const glm::vec3*>(point) - center;
+				radius2 = std::max(radius2, glm::dot(offset, offset));
+			}
+			return BoundingSphere(center, glm::sqrt(radius2));
+		}
+
+		// Sphere still holding the transformed one - the radius grows with the largest scale of the matrix
+		BoundingSphere Transformed(const glm::mat4& matrix) const
+		{
+			float scale2 = std::max(glm::dot(glm::vec3(matrix[0]), glm::vec3(matrix[0])),
+				std::max(glm::dot(glm::vec3(matrix[1]), glm::vec3(matrix[1])), glm::dot(glm::vec3(matrix[2]), glm::vec3(matrix[2]))));
+			return BoundingSphere(glm::vec3(matrix * glm::vec4(center, 1.0f)), radius * glm::sqrt(scale2));
+		}
+
+		glm::vec3 center;
+		float radius;
+	};
+}
@@ -0,0 +1,432 @@
+#include "Bvh.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace gps
+{
+	static bool SameBox(const BoundingBox& a, const BoundingBox& b)
+	{
+		return glm::all(glm::equal(a.min, b.min)) && glm::all(glm::equal(a.max, b.max));
+	}
+
+	static BoundingBox Union(const BoundingBox& a, const BoundingBox& b)
+	{
+		BoundingBox box = a;
+		box.Add(b);
+		return box;
+	}
+
+	//distance along the ray to where it enters the box, negative when it misses
+	static float RayEnters(const BoundingBox& box, const glm::vec3& origin, const glm::vec3& inverseDirection)
+	{
+		glm::vec3 t1 = (box.min - origin) * inverseDirection;
+		glm::vec3 t2 = (box.max - origin) * inverseDirection;
+		glm::vec3 nearest = glm::min(t1, t2);
+		glm::vec3 farthest = glm::max(t1, t2);
+		float enter = glm::max(glm::max(nearest.x, nearest.y), glm::max(nearest.z, 0.0f));
+		float exit = glm::min(glm::min(farthest.x, farthest.y), farthest.z);
+		return enter <= exit ? enter : -1.0f;
+	}
+
+	Bvh::Bvh()
+		: root(NULL_NODE), freeList(NULL_NODE), freeCount(0), leafCount(0)
+	{
+	}
+
+	void Bvh::Clear()
+	{
+		nodes.clear();
+		root = NULL_NODE;
+		freeList = NULL_NODE;
+		freeCount = 0;
+		leafCount = 0;
+	}
+
+	int Bvh::AllocateNode()
+	{
+		int node;
+		if (freeList != NULL_NODE)
+		{
+			node = freeList;
+			freeList = nodes[node].parent;
+			freeCount--;
+		}
+		else
+		{
+			node = int(nodes.size());
+			nodes.push_back(Node());
+		}
+		nodes[node].box = BoundingBox();
+		nodes[node].parent = NULL_NODE;
+		nodes[node].left = NULL_NODE;
+		nodes[node].right = NULL_NODE;
+		nodes[node].id = 0;
+		return node;
+	}
+
+	void Bvh::FreeNode(int node)
+	{
+		nodes[node].parent = freeList;
+		nodes[node].left = NULL_NODE;
+		freeList = node;
+		freeCount++;
+	}
+
+	void Bvh::Build(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& ids, std::vector<int>& proxies)
+	{
+		Clear();
+		nodes.reserve(boxes.size() * 2);
+		proxies.resize(boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++)
+		{
+			int leaf = AllocateNode();
+			nodes[leaf].box = boxes[i];
+			nodes[leaf].id = ids[i];
+			proxies[i] = leaf;
+		}
+		leafCount = boxes.size();
+		if (!proxies.empty())
+		{
+			//BuildRange reorders the leaves, proxies keeps the order of the boxes
+			std::vector<int> leaves = proxies;
+			root = BuildRange(&leaves[0], leaves.size(), NULL_NODE);
+		}
+	}
+
+	void Bvh::Rebuild()
+	{
+		if (root == NULL_NODE)
+			return;
+
+		std::vector<int> leaves;
+		leaves.reserve(leafCount);
+		std::vector<int> stack(1, root);
+		while (!stack.empty())
+		{
+			int node = stack.back();
+			stack.pop_back();
+			if (nodes[node].IsLeaf())
+			{
+				leaves.push_back(node);
+				continue;
+			}
+			stack.push_back(nodes[node].left);
+			stack.push_back(nodes[node].right);
+			FreeNode(node);
+		}
+		root = BuildRange(&leaves[0], leaves.size(), NULL_NODE);
+	}
+
+	int Bvh::BuildRange(int* leaves, size_t count, int parent)
+	{
+		if (count == 1)
+		{
+			nodes[leaves[0]].parent = parent;
+			return leaves[0];
+		}
+
+		//split the longest axis of the centers at their median
+		BoundingBox centers;
+		for (size_t i = 0; i < count; i++)
+			centers.Add(nodes[leaves[i]].box.Center());
+		glm::vec3 size = centers.Size();
+		int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+		size_t half = count / 2;
+		const std::vector<Node>& all = nodes;
+		std::nth_element(leaves, leaves + half, leaves + count, [&all, axis](int a, int b)
+		{
+			return all[a].box.min[axis] + all[a].box.max[axis] < all[b].box.min[axis] + all[b].box.max[axis];
+		});
+
+		int node = AllocateNode();
+		nodes[node].parent = parent;
+		int left = BuildRange(leaves, half, node);
+		int right = BuildRange(leaves + half, count - half, node);
+		nodes[node].left = left;
+		nodes[node].right = right;
+		nodes[node].box = Union(nodes[left].box, nodes[right].box);
+		return node;
+	}
+
+	int Bvh::Insert(const BoundingBox& box, uint32_t id)
+	{
+		int leaf = AllocateNode();
+		nodes[leaf].box = box;
+		nodes[leaf].id = id;
+		InsertLeaf(leaf);
+		leafCount++;
+		return leaf;
+	}
+
+	void Bvh::Remove(int proxy)
+	{
+		RemoveLeaf(proxy);
+		FreeNode(proxy);
+		leafCount--;
+	}
+
+	bool Bvh::Move(int proxy, const BoundingBox& box)
+	{
+		if (SameBox(nodes[proxy].box, box))
+			return false;
+
+		int parent = nodes[proxy].parent;
+		if (parent != NULL_NODE && !nodes[parent].box.Contains(BoundingBox(box.Center(), box.Center())))
+		{
+			//gone past its neighbours, a refit would stretch every ancestor across the gap
+			RemoveLeaf(proxy);
+			nodes[proxy].box = box;
+			InsertLeaf(proxy);
+			return true;
+		}
+		nodes[proxy].box = box;
+		Refit(parent);
+		return true;
+	}
+
+	void Bvh::InsertLeaf(int leaf)
+	{
+		if (root == NULL_NODE)
+		{
+			root = leaf;
+			nodes[leaf].parent = NULL_NODE;
+			return;
+		}
+
+		//walk down to the sibling that costs the least surface area
+		const BoundingBox box = nodes[leaf].box;
+		int sibling = root;
+		while (!nodes[sibling].IsLeaf())
+		{
+			const Node& node = nodes[sibling];
+			float area = node.box.SurfaceArea();
+			float combinedArea = Union(node.box, box).SurfaceArea();
+			//a new parent here, or the growth of this node on the way to a deeper one
+			float cost = 2.0f * combinedArea;
+			float inheritance = 2.0f * (combinedArea - area);
+
+			float childCosts[2];
+			int children[2] = { node.left, node.right };
+			for (int c = 0; c < 2; c++)
+			{
+				const Node& child = nodes[children[c]];
+				float grown = Union(child.box, box).SurfaceArea();
+				childCosts[c] = (child.IsLeaf() ? grown : grown - child.box.SurfaceArea()) + inheritance;
+			}
+			if (cost < childCosts[0] && cost < childCosts[1])
+				break;
+			sibling = childCosts[0] < childCosts[1] ? children[0] : children[1];
+		}
+
+		int oldParent = nodes[sibling].parent;
+		int newParent = AllocateNode();
+		nodes[newParent].parent = oldParent;
+		nodes[newParent].box = Union(nodes[sibling].box, box);
+		nodes[newParent].left = sibling;
+		nodes[newParent].right = leaf;
+		nodes[sibling].parent = newParent;
+		nodes[leaf].parent = newParent;
+		if (oldParent == NULL_NODE)
+		{
+			root = newParent;
+			return;
+		}
+		if (nodes[oldParent].left == sibling)
+			nodes[oldParent].left = newParent;
+		else
+			nodes[oldParent].right = newParent;
+		Refit(oldParent);
+	}
+
+	void Bvh::RemoveLeaf(int leaf)
+	{
+		if (leaf == root)
+		{
+			root = NULL_NODE;
+			return;
+		}
+
+		//the sibling takes the place of the parent
+		int parent = nodes[leaf].parent;
+		int grandParent = nodes[parent].parent;
+		int sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+		nodes[sibling].parent = grandParent;
+		FreeNode(parent);
+		if (grandParent == NULL_NODE)
+		{
+			root = sibling;
+			return;
+		}
+		if (nodes[grandParent].left == parent)
+			nodes[grandParent].left = sibling;
+		else
+			nodes[grandParent].right = sibling;
+		Refit(grandParent);
+	}
+
+	void Bvh::Refit(int node)
+	{
+		while (node != NULL_NODE)
+		{
+			BoundingBox box = Union(nodes[nodes[node].left].box, nodes[nodes[node].right].box);
+			//the boxes above are the same unions as before
+			if (SameBox(box, nodes[node].box))
+				return;
+			nodes[node].box = box;
+			node = nodes[node].parent;
+		}
+	}
+
+	void Bvh::CollectLeaves(int node, std::vector<uint32_t>& ids, std::vector<int>& stack) const
+	{
+		size_t base = stack.size();
+		stack.push_back(node);
+		while (stack.size() > base)
+		{
+			const Node& current = nodes[stack.back()];
+			stack.pop_back();
+			if (current.IsLeaf())
+			{
+				ids.push_back(current.id);
+				continue;
+			}
+			stack.push_back(current.left);
+			stack.push_back(current.right);
+		}
+	}
+
+	void Bvh::QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& ids) const
+	{
+		if (root == NULL_NODE)
+			return;
+
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(root);
+		while (!stack.empty())
+		{
+			int node = stack.back();
+			stack.pop_back();
+			const Node& current = nodes[node];
+			if (!frustum.Intersects(current.box))
+				continue;
+			if (current.IsLeaf())
+			{
+				ids.push_back(current.id);
+			}
+			//no more plane tests below a node entirely in view
+			else if (frustum.Contains(current.box))
+			{
+				CollectLeaves(node, ids, stack);
+			}
+			else
+			{
+				stack.push_back(current.left);
+				stack.push_back(current.right);
+			}
+		}
+	}
+
+	void Bvh::QuerySphere(const BoundingSphere& sphere, std::vector<uint32_t>& ids) const
+	{
+		if (root == NULL_NODE)
+			return;
+
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(root);
+		const float radius2 = sphere.radius * sphere.radius;
+		while (!stack.empty())
+		{
+			const Node& current = nodes[stack.back()];
+			stack.pop_back();
+			glm::vec3 offset = glm::clamp(sphere.center, current.box.min, current.box.max) - sphere.center;
+			if (glm::dot(offset, offset) > radius2)
+				continue;
+			if (current.IsLeaf())
+			{
+				ids.push_back(current.id);
+				continue;
+			}
+			stack.push_back(current.left);
+			stack.push_back(current.right);
+		}
+	}
+
+	bool Bvh::Raycast(const Ray& ray, float maxDistance, uint32_t& id, float& distance) const
+	{
+		if (root == NULL_NODE)
+			return false;
+
+		const glm::vec3 inverseDirection = 1.0f / ray.direction;
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(root);
+		bool hit = false;
+		distance = maxDistance;
+		while (!stack.empty())
+		{
+			const Node& current = nodes[stack.back()];
+			stack.pop_back();
+			float enter = RayEnters(current.box, ray.origin, inverseDirection);
+			//missed, or farther than the nearest hit so far
+			if (enter < 0.0f || enter > distance)
+				continue;
+			if (current.IsLeaf())
+			{
+				id = current.id;
+				distance = enter;
+				hit = true;
+				continue;
+			}
+			//the nearer child on top, its hit prunes more of the other
+			float left = RayEnters(nodes[current.left].box, ray.origin, inverseDirection);
+			float right = RayEnters(nodes[current.right].box, ray.origin, inverseDirection);
+			bool leftFirst = left >= 0.0f && (right < 0.0f || left <= right);
+			stack.push_back(leftFirst ? current.right : current.left);
+			stack.push_back(leftFirst ? current.left : current.right);
+		}
+		return hit;
+	}
+
+	int Bvh::Height() const
+	{
+		if (root == NULL_NODE)
+			return 0;
+
+		int height = 0;
+		std::vector<std::pair<int, int> > stack(1, std::make_pair(root, 0));
+		while (!stack.empty())
+		{
+			std::pair<int, int> entry = stack.back();
+			stack.pop_back();
+			height = std::max(height, entry.second);
+			if (!nodes[entry.first].IsLeaf())
+			{
+				stack.push_back(std::make_pair(nodes[entry.first].left, entry.second + 1));
+				stack.push_back(std::make_pair(nodes[entry.first].right, entry.second + 1));
+			}
+		}
+		return height;
+	}
+
+	float Bvh::Cost() const
+	{
+		if (root == NULL_NODE || nodes[root].IsLeaf())
+			return 0.0f;
+
+		float area = 0.0f;
+		std::vector<int> stack(1, root);
+		while (!stack.empty())
+		{
+			const Node& current = nodes[stack.back()];
+			stack.pop_back();
+			if (current.IsLeaf())
+				continue;
+			area += current.box.SurfaceArea();
+			stack.push_back(current.left);
+			stack.push_back(current.right);
+		}
+		return area / nodes[root].box.SurfaceArea();
+	}
+}
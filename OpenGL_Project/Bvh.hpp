@@ -0,0 +1,98 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "BoundingBox.hpp"
+#include "FrustumCulling.hpp"
+
+namespace gps
+{
+	// Half-line for Bvh::Raycast, the direction normalized
+	struct Ray
+	{
+		Ray() : origin(0.0f), direction(0.0f, 0.0f, -1.0f) {}
+		Ray(const glm::vec3& origin, const glm::vec3& direction) : origin(origin), direction(direction) {}
+
+		glm::vec3 origin;
+		glm::vec3 direction;
+	};
+
+	// Dynamic bounding volume hierarchy over the world boxes of scene instances. Each leaf is one instance, found
+	// by the proxy Insert returns and reported by the id given with it. Internal nodes always have two children
+	// and the box around both.
+	//
+	// Build and Rebuild split the leaves top-down at the median of their centers, which gives the best tree.
+	// Insert walks down to the sibling that grows the least surface area, as in Box2D. Move refits: the leaf takes
+	// its new box and the ancestors grow or shrink with it, so a moving instance costs one walk up the tree. An
+	// instance whose center leaves the box of its parent is inserted again instead, so the tree stays tight for objects
+	// that travel far.
+	//
+	// The queries return ids in no particular order. Not thread safe.
+	class Bvh
+	{
+	public:
+		static const int NULL_NODE = -1;
+
+		Bvh();
+
+		void Clear();
+		// Replaces the tree with one built over the boxes, the i-th with ids[i] - proxies receives their proxies
+		void Build(const std::vector<BoundingBox>& boxes, const std::vector<uint32_t>& ids, std::vector<int>& proxies);
+		// Builds the tree again over the current leaves, which keep their proxies
+		void Rebuild();
+
+		// Returns the proxy of the new leaf
+		int Insert(const BoundingBox& box, uint32_t id);
+		void Remove(int proxy);
+		// Returns false when the box did not change
+		bool Move(int proxy, const BoundingBox& box);
+
+		const BoundingBox& Box(int proxy) const { return nodes[proxy].box; }
+		uint32_t Id(int proxy) const { return nodes[proxy].id; }
+
+		// Appends the ids of the leaves intersecting the frustum (camera or light) to ids
+		void QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& ids) const;
+		// Appends the ids of the leaves whose box the sphere touches
+		void QuerySphere(const BoundingSphere& sphere, std::vector<uint32_t>& ids) const;
+		// Nearest leaf box the ray enters within maxDistance - false when it hits none
+		bool Raycast(const Ray& ray, float maxDistance, uint32_t& id, float& distance) const;
+
+		size_t Size() const { return leafCount; }
+		size_t NodeCount() const { return nodes.size() - freeCount; }
+		// Longest path from the root to a leaf, 0 for an empty tree
+		int Height() const;
+		// Surface area of the internal nodes over the one of the root - lower is a better tree
+		float Cost() const;
+
+	private:
+		struct Node
+		{
+			BoundingBox box;
+			// Next free node while on the free list
+			int parent;
+			int left;
+			int right;
+			uint32_t id;
+
+			bool IsLeaf() const { return left == NULL_NODE; }
+		};
+
+		std::vector<Node> nodes;
+		int root;
+		int freeList;
+		size_t freeCount;
+		size_t leafCount;
+
+		int AllocateNode();
+		void FreeNode(int node);
+		void InsertLeaf(int leaf);
+		void RemoveLeaf(int leaf);
+		// Recomputes the boxes from node up to the root, stopping at the first one left unchanged
+		void Refit(int node);
+		int BuildRange(int* leaves, size_t count, int parent);
+		// Appends the ids of every leaf under node
+		void CollectLeaves(int node, std::vector<uint32_t>& ids, std::vector<int>& stack) const;
+	};
+}
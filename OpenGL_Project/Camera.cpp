@@ -27,6 +27,11 @@ namespace gps {
 		return glm::lookAt(cameraPosition, cameraPosition + cameraDirection , cameraUpDirection);
     }
     
+    glm::vec3 Camera::getCameraPosition()
+    {
+        return cameraPosition;
+    }
+    
     void Camera::move(MOVE_DIRECTION direction, float speed)
     {
         switch (direction) {
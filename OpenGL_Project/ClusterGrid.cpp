@@ -0,0 +1,381 @@
+#include "ClusterGrid.hpp"
+#include "ImageKernels.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <thread>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define GPS_X86 1
+#include <immintrin.h>
+#endif
+
+//MSVC compiles any intrinsic as is, GCC and Clang need the instruction set enabled per function
+#if defined(GPS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define GPS_TARGET_AVX __attribute__((target("avx")))
+#else
+#define GPS_TARGET_AVX
+#endif
+
+namespace gps
+{
+	//tiles per SIMD step at the widest level, the rows are padded to it
+	static const int TILE_BATCH = 8;
+
+	//one bit per tile of a row whose x range is within reach of x - reach is what the squared range leaves once
+	//the depth and height distances are taken out
+	typedef unsigned int (*RowTest)(const float* minX, const float* maxX, int count, float x, float reach);
+
+	static unsigned int RowTestScalar(const float* minX, const float* maxX, int count, float x, float reach)
+	{
+		unsigned int mask = 0;
+		for (int i = 0; i < count; i++)
+		{
+			float dx = std::max(std::max(minX[i] - x, x - maxX[i]), 0.0f);
+			if (dx * dx <= reach)
+				mask |= 1u << i;
+		}
+		return mask;
+	}
+
+#ifdef GPS_X86
+	static unsigned int RowTestSSE(const float* minX, const float* maxX, int count, float x, float reach)
+	{
+		const __m128 px = _mm_set1_ps(x);
+		const __m128 limit = _mm_set1_ps(reach);
+		const __m128 zero = _mm_setzero_ps();
+		unsigned int mask = 0;
+		for (int i = 0; i < count; i += 4)
+		{
+			__m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(minX + i), px), _mm_sub_ps(px, _mm_loadu_ps(maxX + i))), zero);
+			mask |= unsigned(_mm_movemask_ps(_mm_cmple_ps(_mm_mul_ps(dx, dx), limit))) << i;
+		}
+		return mask;
+	}
+
+	GPS_TARGET_AVX static unsigned int RowTestAVX(const float* minX, const float* maxX, int count, float x, float reach)
+	{
+		const __m256 px = _mm256_set1_ps(x);
+		const __m256 limit = _mm256_set1_ps(reach);
+		const __m256 zero = _mm256_setzero_ps();
+		unsigned int mask = 0;
+		for (int i = 0; i < count; i += 8)
+		{
+			__m256 dx = _mm256_max_ps(_mm256_max_ps(_mm256_sub_ps(_mm256_loadu_ps(minX + i), px),
+				_mm256_sub_ps(px, _mm256_loadu_ps(maxX + i))), zero);
+			mask |= unsigned(_mm256_movemask_ps(_mm256_cmp_ps(_mm256_mul_ps(dx, dx), limit, _CMP_LE_OQ))) << i;
+		}
+		return mask;
+	}
+#endif
+
+	static unsigned int LowestBit(unsigned int mask)
+	{
+		unsigned int bit = 0;
+		while (!(mask & (1u << bit)))
+			bit++;
+		return bit;
+	}
+
+	ClusterGrid::ClusterGrid()
+		: sliceScale(0.0f), paddedTilesX(0), boundsFov(-1.0f), boundsAspect(-1.0f), boundsFar(-1.0f), threadCount(1),
+		workRound(0), workLeft(0), stopping(false)
+	{
+		Reset(ClusterSettings());
+	}
+
+	ClusterGrid::~ClusterGrid()
+	{
+		StopWorkers();
+	}
+
+	void ClusterGrid::Reset(const ClusterSettings& settings)
+	{
+		//the next parallel Bin starts as many workers as the new settings ask for
+		StopWorkers();
+		this->settings = settings;
+		this->settings.tilesX = glm::clamp(settings.tilesX, 1, MAX_TILES_X);
+		this->settings.tilesY = glm::max(settings.tilesY, 1);
+		this->settings.slices = glm::max(settings.slices, 1);
+		this->settings.nearSplit = glm::max(settings.nearSplit, 0.01f);
+		this->settings.threads = glm::max(settings.threads, 0);
+		paddedTilesX = (this->settings.tilesX + TILE_BATCH - 1) / TILE_BATCH * TILE_BATCH;
+
+		//the bounds are computed again by the next Bin
+		boundsFov = -1.0f;
+		ranges.assign(ClusterCount(), glm::uvec2(0));
+		indices.clear();
+	}
+
+	int ClusterGrid::SliceOf(float depth) const
+	{
+		if (settings.slices == 1 || depth <= settings.nearSplit)
+			return 0;
+		return glm::min(1 + int(std::log(depth / settings.nearSplit) * sliceScale), settings.slices - 1);
+	}
+
+	BoundingBox ClusterGrid::ClusterBox(int cluster) const
+	{
+		int tileX = cluster % settings.tilesX;
+		int tileY = cluster / settings.tilesX % settings.tilesY;
+		int slice = cluster / (settings.tilesX * settings.tilesY);
+		return BoundingBox(glm::vec3(tileMinX[slice * paddedTilesX + tileX], tileMinY[slice * settings.tilesY + tileY], -sliceFar[slice]),
+			glm::vec3(tileMaxX[slice * paddedTilesX + tileX], tileMaxY[slice * settings.tilesY + tileY], -sliceNear[slice]));
+	}
+
+	void ClusterGrid::UpdateBounds(float fov, float aspect, float farPlane)
+	{
+		boundsFov = fov;
+		boundsAspect = aspect;
+		boundsFar = farPlane;
+
+		const int slices = settings.slices;
+		const float nearSplit = glm::min(settings.nearSplit, farPlane * 0.5f);
+		settings.nearSplit = nearSplit;
+		sliceScale = slices > 1 ? (slices - 1) / std::log(farPlane / nearSplit) : 0.0f;
+		sliceNear.resize(slices);
+		sliceFar.resize(slices);
+		for (int s = 0; s < slices; s++)
+		{
+			sliceNear[s] = s == 0 ? 0.0f : nearSplit * std::exp((s - 1) / sliceScale);
+			sliceFar[s] = s == slices - 1 ? farPlane : nearSplit * std::exp(s / sliceScale);
+		}
+
+		//a tile spans a fixed range of normalized device coordinates, wider in view space the deeper the slice
+		const float tanY = std::tan(fov * 0.5f);
+		const float tanX = tanY * aspect;
+		tileMinX.assign(size_t(slices) * paddedTilesX, FLT_MAX);
+		tileMaxX.assign(size_t(slices) * paddedTilesX, -FLT_MAX);
+		tileMinY.resize(size_t(slices) * settings.tilesY);
+		tileMaxY.resize(size_t(slices) * settings.tilesY);
+		for (int s = 0; s < slices; s++)
+		{
+			for (int x = 0; x < settings.tilesX; x++)
+			{
+				float left = -1.0f + 2.0f * x / settings.tilesX;
+				float right = -1.0f + 2.0f * (x + 1) / settings.tilesX;
+				tileMinX[s * paddedTilesX + x] = std::min(left * sliceNear[s], left * sliceFar[s]) * tanX;
+				tileMaxX[s * paddedTilesX + x] = std::max(right * sliceNear[s], right * sliceFar[s]) * tanX;
+			}
+			for (int y = 0; y < settings.tilesY; y++)
+			{
+				float bottom = -1.0f + 2.0f * y / settings.tilesY;
+				float top = -1.0f + 2.0f * (y + 1) / settings.tilesY;
+				tileMinY[s * settings.tilesY + y] = std::min(bottom * sliceNear[s], bottom * sliceFar[s]) * tanY;
+				tileMaxY[s * settings.tilesY + y] = std::max(top * sliceNear[s], top * sliceFar[s]) * tanY;
+			}
+		}
+	}
+
+	void ClusterGrid::Bin(const std::vector<glm::vec4>& lights, const glm::mat4& view, float fov, float aspect, float farPlane)
+	{
+		if (fov != boundsFov || aspect != boundsAspect || farPlane != boundsFar)
+			UpdateBounds(fov, aspect, farPlane);
+
+		const int slices = settings.slices;
+		const size_t count = lights.size();
+		lightX.resize(count);
+		lightY.resize(count);
+		lightDepth.resize(count);
+		lightRange.resize(count);
+		lightFirstSlice.resize(count);
+		lightLastSlice.resize(count);
+		//lights starting and ending in each slice, summed below into the lights of every slice
+		std::vector<long long> sliceLights(slices + 1, 0);
+		for (size_t i = 0; i < count; i++)
+		{
+			glm::vec3 center(view * glm::vec4(glm::vec3(lights[i]), 1.0f));
+			float range = lights[i].w;
+			lightX[i] = center.x;
+			lightY[i] = center.y;
+			lightDepth[i] = -center.z;
+			lightRange[i] = range;
+			if (range <= 0.0f || lightDepth[i] + range < 0.0f || lightDepth[i] - range > farPlane)
+			{
+				lightFirstSlice[i] = 1;
+				lightLastSlice[i] = 0;
+				continue;
+			}
+			//a slice more on each side - the slice bounds and the logarithm may round apart
+			lightFirstSlice[i] = glm::max(SliceOf(lightDepth[i] - range) - 1, 0);
+			lightLastSlice[i] = glm::min(SliceOf(lightDepth[i] + range) + 1, slices - 1);
+			sliceLights[lightFirstSlice[i]]++;
+			sliceLights[lightLastSlice[i] + 1]--;
+		}
+		long long total = 0;
+		for (int s = 0; s < slices; s++)
+		{
+			if (s > 0)
+				sliceLights[s] += sliceLights[s - 1];
+			total += sliceLights[s];
+		}
+
+		int threads = settings.threads > 0 ? settings.threads : int(std::max(std::thread::hardware_concurrency(), 1u));
+		threads = glm::min(threads, slices);
+		if (count < PARALLEL_LIGHTS)
+			threads = 1;
+
+		//contiguous slices per thread, about the same number of lights in each share
+		bins.resize(threads);
+		long long done = 0;
+		int slice = 0;
+		for (int t = 0; t < threads; t++)
+		{
+			bins[t].firstSlice = slice;
+			long long goal = total * (t + 1) / threads;
+			while (slice < slices && (t == threads - 1 || done < goal))
+				done += sliceLights[slice++];
+			bins[t].endSlice = slice;
+		}
+
+		if (threads > 1)
+		{
+			if (int(workers.size()) != threads - 1)
+			{
+				StopWorkers();
+				StartWorkers(threads - 1);
+			}
+			{
+				std::lock_guard<std::mutex> lock(workMutex);
+				workRound++;
+				workLeft = threads - 1;
+			}
+			workCondition.notify_all();
+			BinSlices(bins[0]);
+			std::unique_lock<std::mutex> lock(workMutex);
+			doneCondition.wait(lock, [this] { return workLeft == 0; });
+		}
+		else
+		{
+			BinSlices(bins[0]);
+		}
+		threadCount = threads;
+
+		const size_t sliceClusters = size_t(settings.tilesX) * settings.tilesY;
+		ranges.resize(ClusterCount());
+		indices.clear();
+		for (int t = 0; t < threads; t++)
+		{
+			const SliceBins& bin = bins[t];
+			uint32_t base = uint32_t(indices.size());
+			size_t first = bin.firstSlice * sliceClusters;
+			for (size_t c = 0; c < bin.counts.size(); c++)
+				ranges[first + c] = glm::uvec2(base + bin.starts[c], bin.counts[c]);
+			indices.insert(indices.end(), bin.indices.begin(), bin.indices.end());
+		}
+	}
+
+	void ClusterGrid::StartWorkers(int count)
+	{
+		stopping = false;
+		for (int w = 0; w < count; w++)
+			workers.push_back(std::thread(&ClusterGrid::WorkerLoop, this, w + 1, workRound));
+	}
+
+	void ClusterGrid::StopWorkers()
+	{
+		if (workers.empty())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(workMutex);
+			stopping = true;
+		}
+		workCondition.notify_all();
+		for (size_t w = 0; w < workers.size(); w++)
+			workers[w].join();
+		workers.clear();
+	}
+
+	void ClusterGrid::WorkerLoop(int bin, unsigned long round)
+	{
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(workMutex);
+				workCondition.wait(lock, [this, round] { return stopping || workRound != round; });
+				if (stopping)
+					return;
+				round = workRound;
+			}
+
+			BinSlices(bins[bin]);
+
+			std::lock_guard<std::mutex> lock(workMutex);
+			if (--workLeft == 0)
+				doneCondition.notify_one();
+		}
+	}
+
+	void ClusterGrid::BinSlices(SliceBins& bin) const
+	{
+		const int tilesX = settings.tilesX;
+		const int tilesY = settings.tilesY;
+		bin.counts.assign(size_t(bin.endSlice - bin.firstSlice) * tilesX * tilesY, 0);
+		bin.hitClusters.clear();
+		bin.hitLights.clear();
+
+		RowTest rowTest = RowTestScalar;
+		int rowWidth = tilesX;
+#ifdef GPS_X86
+		//the rows hold whole batches of 8, so neither path has a tail
+		const SimdLevel level = GetSimdLevel();
+		if (level == SIMD_AVX2)
+		{
+			rowTest = RowTestAVX;
+			rowWidth = paddedTilesX;
+		}
+		else if (level == SIMD_SSE2)
+		{
+			rowTest = RowTestSSE;
+			rowWidth = paddedTilesX;
+		}
+#endif
+
+		for (size_t light = 0; light < lightX.size(); light++)
+		{
+			int first = glm::max(lightFirstSlice[light], bin.firstSlice);
+			int last = glm::min(lightLastSlice[light], bin.endSlice - 1);
+			const float x = lightX[light];
+			const float y = lightY[light];
+			const float depth = lightDepth[light];
+			const float range2 = lightRange[light] * lightRange[light];
+			for (int s = first; s <= last; s++)
+			{
+				float dz = std::max(std::max(sliceNear[s] - depth, depth - sliceFar[s]), 0.0f);
+				float reachZ = range2 - dz * dz;
+				if (reachZ < 0.0f)
+					continue;
+				for (int ty = 0; ty < tilesY; ty++)
+				{
+					float dy = std::max(std::max(tileMinY[s * tilesY + ty] - y, y - tileMaxY[s * tilesY + ty]), 0.0f);
+					float reach = reachZ - dy * dy;
+					if (reach < 0.0f)
+						continue;
+					unsigned int mask = rowTest(&tileMinX[s * paddedTilesX], &tileMaxX[s * paddedTilesX], rowWidth, x, reach);
+					uint32_t row = uint32_t(((s - bin.firstSlice) * tilesY + ty) * tilesX);
+					for (; mask != 0; mask &= mask - 1)
+					{
+						uint32_t cluster = row + LowestBit(mask);
+						bin.counts[cluster]++;
+						bin.hitClusters.push_back(cluster);
+						bin.hitLights.push_back(uint32_t(light));
+					}
+				}
+			}
+		}
+
+		//counting sort of the hits by cluster - the lights stay in increasing order within a cluster
+		bin.starts.resize(bin.counts.size());
+		uint32_t start = 0;
+		for (size_t c = 0; c < bin.counts.size(); c++)
+		{
+			bin.starts[c] = start;
+			start += bin.counts[c];
+		}
+		bin.indices.resize(bin.hitLights.size());
+		for (size_t hit = 0; hit < bin.hitLights.size(); hit++)
+			bin.indices[bin.starts[bin.hitClusters[hit]]++] = bin.hitLights[hit];
+		for (size_t c = 0; c < bin.counts.size(); c++)
+			bin.starts[c] -= bin.counts[c];
+	}
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "BoundingBox.hpp"
+
+// CPU side of the clustered point lights - no GL calls, so the binning can be driven headless
+
+namespace gps
+{
+	// Shape of the cluster grid and the threads binning it - set from the command line before Init
+	struct ClusterSettings
+	{
+		ClusterSettings()
+			: tilesX(16), tilesY(9), slices(24), nearSplit(5.0f), threads(0)
+		{
+		}
+
+		// Screen tiles across and up, at most ClusterGrid::MAX_TILES_X across
+		int tilesX;
+		int tilesY;
+		// Depth slices: the first one from the camera to nearSplit, the others exponential from there to the far plane
+		int slices;
+		float nearSplit;
+		// 0 for one per core, 1 to bin on the calling thread only
+		int threads;
+	};
+
+	// The view frustum split in tiles of the screen and slices of the depth, and the lights reaching each of those
+	// clusters. A cluster is the view space box around its part of the frustum, a light the sphere of its range;
+	// a light goes to every cluster its sphere touches.
+	//
+	// The lights are binned slice by slice: the depth of a light picks its slices, each row of tiles of a slice is
+	// dropped unless the sphere reaches it in depth and height, and the tiles of a row are tested against the
+	// sphere all at once - SIMD at the level of the image kernels (see SetSimdLevel). The slices are shared among
+	// the threads, each one with its own lists, so they never write to the same place; the lists of a cluster
+	// hold the light indices in increasing order whatever the thread count. The worker threads are started by the
+	// first Bin that needs them and wait for the next one in between, so no thread is created per frame; Reset
+	// and the destructor join them.
+	class ClusterGrid
+	{
+	public:
+		// The tiles of a row are tested into a 32-bit mask
+		static const int MAX_TILES_X = 32;
+		// Fewer lights than this are binned on the calling thread, starting threads would cost more
+		static const size_t PARALLEL_LIGHTS = 256;
+
+		ClusterGrid();
+		~ClusterGrid();
+
+		void Reset(const ClusterSettings& settings);
+
+		// Bins the lights, world position in xyz and range in w, into the clusters of the camera
+		void Bin(const std::vector<glm::vec4>& lights, const glm::mat4& view, float fov, float aspect, float farPlane);
+
+		// Offset of the first light of every cluster in Indices and the number of lights - x first, then y, then
+		// the slice
+		const std::vector<glm::uvec2>& Ranges() const { return ranges; }
+		const std::vector<uint32_t>& Indices() const { return indices; }
+
+		int TilesX() const { return settings.tilesX; }
+		int TilesY() const { return settings.tilesY; }
+		int Slices() const { return settings.slices; }
+		int ClusterCount() const { return settings.tilesX * settings.tilesY * settings.slices; }
+		// Slices past the first per unit of log(depth / nearSplit)
+		float SliceScale() const { return sliceScale; }
+		float NearSplit() const { return settings.nearSplit; }
+		// Slice of a view depth, as the shaders find it
+		int SliceOf(float depth) const;
+		// View space box of a cluster, valid after Bin
+		BoundingBox ClusterBox(int cluster) const;
+		// Threads the last Bin ran on
+		int ThreadCount() const { return threadCount; }
+
+	private:
+		ClusterGrid(const ClusterGrid&) = delete;
+		ClusterGrid& operator=(const ClusterGrid&) = delete;
+
+		// Lists of the slices given to one thread, merged into ranges and indices once every thread is done
+		struct SliceBins
+		{
+			int firstSlice;
+			int endSlice;
+			//lights per cluster, then where they start in indices
+			std::vector<uint32_t> counts;
+			std::vector<uint32_t> starts;
+			//cluster and light of every hit, in the order found
+			std::vector<uint32_t> hitClusters;
+			std::vector<uint32_t> hitLights;
+			std::vector<uint32_t> indices;
+		};
+
+		ClusterSettings settings;
+		float sliceScale;
+		//tiles of a row padded to the widest SIMD step
+		int paddedTilesX;
+		//projection the bounds were computed for
+		float boundsFov;
+		float boundsAspect;
+		float boundsFar;
+		//depth range of every slice, then the view space x range of every tile of a slice and its y range per row
+		std::vector<float> sliceNear;
+		std::vector<float> sliceFar;
+		std::vector<float> tileMinX;
+		std::vector<float> tileMaxX;
+		std::vector<float> tileMinY;
+		std::vector<float> tileMaxY;
+		//lights in view space, depth positive, and the slices they may reach
+		std::vector<float> lightX;
+		std::vector<float> lightY;
+		std::vector<float> lightDepth;
+		std::vector<float> lightRange;
+		std::vector<int> lightFirstSlice;
+		std::vector<int> lightLastSlice;
+		std::vector<SliceBins> bins;
+		std::vector<glm::uvec2> ranges;
+		std::vector<uint32_t> indices;
+		int threadCount;
+
+		//worker w bins bins[w + 1] once per round, the calling thread bins bins[0]
+		std::vector<std::thread> workers;
+		std::mutex workMutex;
+		std::condition_variable workCondition;
+		std::condition_variable doneCondition;
+		//guarded by workMutex
+		unsigned long workRound;
+		int workLeft;
+		bool stopping;
+
+		void UpdateBounds(float fov, float aspect, float farPlane);
+		void BinSlices(SliceBins& bin) const;
+		void StartWorkers(int count);
+		void StopWorkers();
+		void WorkerLoop(int bin, unsigned long round);
+	};
+}
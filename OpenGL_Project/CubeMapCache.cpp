@@ -0,0 +1,204 @@
+#include "CubeMapCache.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace gps
+{
+	static const char CUBEMAP_CACHE_MAGIC[8] = { 'G', 'P', 'S', 'C', 'U', 'B', 'E', '\0' };
+
+	struct CubeMapCacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t size;
+		uint32_t levelCount;
+		uint32_t faceCount;
+		uint32_t stringsSize;
+		uint32_t dataOffset;
+	};
+
+	struct DependencyRecord
+	{
+		uint64_t size;
+		int64_t mtime;
+		uint64_t hash;
+		uint32_t pathOffset;
+		uint32_t pathLength;
+	};
+
+	static size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	static size_t LevelSize(int size, size_t level)
+	{
+		size_t width = std::max(size >> level, 1);
+		return width * width * 4;
+	}
+
+	std::string CubeMapCache::PathFor(const std::vector<std::string>& faces)
+	{
+		return faces.empty() ? std::string() : faces[0] + ".gpscube";
+	}
+
+	bool CubeMapCache::Open(const std::vector<std::string>& faces)
+	{
+		Close();
+
+		if (faces.size() != CUBEMAP_FACES || !file.Open(PathFor(faces)) || file.Size() < sizeof(CubeMapCacheHeader))
+		{
+			Close();
+			return false;
+		}
+
+		const unsigned char* data = file.Data();
+		const size_t fileSize = file.Size();
+
+		CubeMapCacheHeader header;
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.magic, CUBEMAP_CACHE_MAGIC, sizeof(CUBEMAP_CACHE_MAGIC)) != 0 ||
+			header.version != CUBEMAP_CACHE_VERSION || header.faceCount != CUBEMAP_FACES ||
+			header.size == 0 || header.levelCount == 0 || header.levelCount > 32)
+		{
+			Close();
+			return false;
+		}
+
+		const size_t dependenciesOffset = sizeof(CubeMapCacheHeader);
+		const size_t stringsOffset = dependenciesOffset + CUBEMAP_FACES * sizeof(DependencyRecord);
+		if (stringsOffset + header.stringsSize > header.dataOffset || header.dataOffset > fileSize)
+		{
+			Close();
+			return false;
+		}
+		const char* strings = reinterpret_cast<const char*>(data + stringsOffset);
+
+		//the cache is only valid while every face is unchanged, and for the faces in the same order
+		for (size_t i = 0; i < CUBEMAP_FACES; ++i)
+		{
+			DependencyRecord record;
+			memcpy(&record, data + dependenciesOffset + i * sizeof(DependencyRecord), sizeof(record));
+			if (uint64_t(record.pathOffset) + record.pathLength > header.stringsSize ||
+				std::string(strings + record.pathOffset, record.pathLength) != faces[i])
+			{
+				Close();
+				return false;
+			}
+
+			FileStamp stamp;
+			stamp.size = record.size;
+			stamp.mtime = record.mtime;
+			stamp.hash = record.hash;
+			if (!IsFileStampCurrent(faces[i], stamp))
+			{
+				Close();
+				return false;
+			}
+		}
+
+		size = static_cast<int>(header.size);
+		levelCount = header.levelCount;
+		size_t offset = header.dataOffset;
+		for (size_t level = 0; level < levelCount; ++level)
+		{
+			levelOffsets.push_back(offset);
+			offset += LevelSize(size, level) * CUBEMAP_FACES;
+		}
+		if (offset > fileSize)
+		{
+			Close();
+			return false;
+		}
+
+		return true;
+	}
+
+	void CubeMapCache::Close()
+	{
+		file.Close();
+		size = 0;
+		levelCount = 0;
+		levelOffsets.clear();
+	}
+
+	const unsigned char* CubeMapCache::Face(size_t level, size_t face) const
+	{
+		return file.Data() + levelOffsets[level] + face * LevelSize(size, level);
+	}
+
+	void CubeMapCache::Prefetch() const
+	{
+		volatile unsigned char sink = 0;
+		for (size_t offset = 0; offset < file.Size(); offset += 4096)
+			sink ^= file.Data()[offset];
+	}
+
+	bool CubeMapCache::Write(const std::vector<std::string>& faces, const std::vector<Image>& images)
+	{
+		if (faces.size() != CUBEMAP_FACES || images.size() != CUBEMAP_FACES)
+			return false;
+
+		//square faces of one size, each with the full mip chain
+		const int size = images[0].Width();
+		for (size_t i = 0; i < CUBEMAP_FACES; ++i)
+		{
+			if (!images[i].IsLoaded() || images[i].Channels() != 4 || images[i].Width() != size || images[i].Height() != size ||
+				images[i].LevelCount() != images[0].LevelCount())
+				return false;
+		}
+
+		std::string strings;
+		std::vector<DependencyRecord> dependencyRecords;
+		for (size_t i = 0; i < CUBEMAP_FACES; ++i)
+		{
+			FileStamp stamp;
+			if (!GetFileStamp(faces[i], stamp, true))
+				return false;
+
+			DependencyRecord record;
+			record.size = stamp.size;
+			record.mtime = stamp.mtime;
+			record.hash = stamp.hash;
+			record.pathOffset = static_cast<uint32_t>(strings.size());
+			record.pathLength = static_cast<uint32_t>(faces[i].size());
+			strings += faces[i];
+			dependencyRecords.push_back(record);
+		}
+
+		CubeMapCacheHeader header;
+		memcpy(header.magic, CUBEMAP_CACHE_MAGIC, sizeof(CUBEMAP_CACHE_MAGIC));
+		header.version = CUBEMAP_CACHE_VERSION;
+		header.size = static_cast<uint32_t>(size);
+		header.levelCount = static_cast<uint32_t>(images[0].LevelCount());
+		header.faceCount = static_cast<uint32_t>(CUBEMAP_FACES);
+		header.stringsSize = static_cast<uint32_t>(strings.size());
+
+		//pixels go after the tables, 16-byte aligned so they can be uploaded straight from the mapping
+		size_t tablesSize = sizeof(CubeMapCacheHeader) + dependencyRecords.size() * sizeof(DependencyRecord) + strings.size();
+		header.dataOffset = static_cast<uint32_t>(AlignUp(tablesSize, 16));
+
+		std::vector<unsigned char> tables(header.dataOffset, 0);
+		size_t cursor = 0;
+		memcpy(&tables[cursor], &header, sizeof(header));
+		cursor += sizeof(header);
+		memcpy(&tables[cursor], &dependencyRecords[0], dependencyRecords.size() * sizeof(DependencyRecord));
+		cursor += dependencyRecords.size() * sizeof(DependencyRecord);
+		memcpy(&tables[cursor], strings.data(), strings.size());
+
+		//the faces are written from the images, they are far too large to copy into one buffer
+		std::vector<FileChunk> chunks;
+		FileChunk chunk = { &tables[0], tables.size() };
+		chunks.push_back(chunk);
+		for (size_t level = 0; level < header.levelCount; ++level)
+		{
+			for (size_t face = 0; face < CUBEMAP_FACES; ++face)
+			{
+				FileChunk pixels = { images[face].LevelPixels(level), LevelSize(size, level) };
+				chunks.push_back(pixels);
+			}
+		}
+
+		return WriteFileAtomic(PathFor(faces), chunks);
+	}
+}
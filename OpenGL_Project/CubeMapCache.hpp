@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "FileUtils.hpp"
+#include "Image.hpp"
+
+namespace gps
+{
+	// Bump whenever the layout or the content produced by SkyBox::Decode changes
+	const uint32_t CUBEMAP_CACHE_VERSION = 1;
+
+	const size_t CUBEMAP_FACES = 6;
+
+	// Binary "<first face>.gpscube" cache holding the six decoded RGBA8 faces of a skybox and their mip
+	// chains, level by level from the largest. It is invalidated when any of the face images change.
+	class CubeMapCache
+	{
+	public:
+		CubeMapCache() : size(0), levelCount(0) {}
+
+		static std::string PathFor(const std::vector<std::string>& faces);
+
+		// Maps the cache of a set of faces and checks it is still current
+		bool Open(const std::vector<std::string>& faces);
+		void Close();
+
+		bool IsOpen() const { return file.IsOpen(); }
+		// Width and height of the largest level
+		int Size() const { return size; }
+		size_t LevelCount() const { return levelCount; }
+		const unsigned char* Face(size_t level, size_t face) const;
+		size_t DataSize() const { return file.Size(); }
+
+		// Reads one byte per page, so later reads of the mapping do not stall on the disk
+		void Prefetch() const;
+
+		// Serializes six square RGBA images with their mip chains, stamping the face files
+		static bool Write(const std::vector<std::string>& faces, const std::vector<Image>& images);
+
+	private:
+		MappedFile file;
+		int size;
+		size_t levelCount;
+		std::vector<size_t> levelOffsets;
+	};
+}
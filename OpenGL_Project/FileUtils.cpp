@@ -0,0 +1,242 @@
+#include "FileUtils.hpp"
+#include <cstdio>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace gps
+{
+	uint64_t HashBytes(const void* data, size_t size, uint64_t seed)
+	{
+		const unsigned char* bytes = static_cast<const unsigned char*>(data);
+		uint64_t hash = seed;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	static bool StatFile(const std::string& path, uint64_t& size, int64_t& mtime)
+	{
+#ifdef _WIN32
+		struct _stat64 info;
+		if (_stat64(path.c_str(), &info) != 0)
+			return false;
+#else
+		struct stat info;
+		if (stat(path.c_str(), &info) != 0)
+			return false;
+#endif
+		size = static_cast<uint64_t>(info.st_size);
+		mtime = static_cast<int64_t>(info.st_mtime);
+		return true;
+	}
+
+	bool GetFileStamp(const std::string& path, FileStamp& stamp, bool withHash)
+	{
+		if (!StatFile(path, stamp.size, stamp.mtime))
+			return false;
+
+		stamp.hash = 0;
+		if (withHash)
+		{
+			MappedFile file;
+			if (!file.Open(path))
+				return false;
+			stamp.hash = HashBytes(file.Data(), file.Size());
+		}
+		return true;
+	}
+
+	bool IsFileStampCurrent(const std::string& path, const FileStamp& stamp)
+	{
+		FileStamp current;
+		if (!StatFile(path, current.size, current.mtime))
+			return false;
+		if (current.size != stamp.size)
+			return false;
+		if (current.mtime == stamp.mtime)
+			return true;
+
+		//touched but maybe not modified (e.g. a fresh checkout) - compare contents
+		return GetFileStamp(path, current, true) && current.hash == stamp.hash;
+	}
+
+	MappedFile::MappedFile()
+		: data(nullptr), size(0), opened(false)
+#ifdef _WIN32
+		, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+#else
+		, fileDescriptor(-1)
+#endif
+	{
+	}
+
+	MappedFile::~MappedFile()
+	{
+		Close();
+	}
+
+	bool MappedFile::Open(const std::string& path)
+	{
+		Close();
+#ifdef _WIN32
+		fileHandle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (fileHandle == INVALID_HANDLE_VALUE)
+			return false;
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(fileHandle, &fileSize))
+		{
+			Close();
+			return false;
+		}
+		size = static_cast<size_t>(fileSize.QuadPart);
+		opened = true;
+		if (size == 0)
+			return true;
+
+		mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mappingHandle)
+		{
+			Close();
+			return false;
+		}
+		data = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+		fileDescriptor = open(path.c_str(), O_RDONLY);
+		if (fileDescriptor < 0)
+			return false;
+
+		struct stat info;
+		if (fstat(fileDescriptor, &info) != 0)
+		{
+			Close();
+			return false;
+		}
+		size = static_cast<size_t>(info.st_size);
+		opened = true;
+		if (size == 0)
+			return true;
+
+		void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+		data = mapping == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(mapping);
+#endif
+		if (!data)
+		{
+			Close();
+			return false;
+		}
+		return true;
+	}
+
+	void MappedFile::Close()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mappingHandle)
+			CloseHandle(mappingHandle);
+		if (fileHandle != INVALID_HANDLE_VALUE)
+			CloseHandle(fileHandle);
+		mappingHandle = nullptr;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if (data)
+			munmap(const_cast<unsigned char*>(data), size);
+		if (fileDescriptor >= 0)
+			close(fileDescriptor);
+		fileDescriptor = -1;
+#endif
+		data = nullptr;
+		size = 0;
+		opened = false;
+	}
+
+	static bool EndsWith(const std::string& text, const std::string& suffix)
+	{
+		return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+	}
+
+	void ListFiles(const std::string& directory, const std::string& extension, std::vector<std::string>& files)
+	{
+		std::string prefix = directory.empty() || EndsWith(directory, "/") ? directory : directory + "/";
+#ifdef _WIN32
+		WIN32_FIND_DATAA entry;
+		HANDLE search = FindFirstFileA((prefix + "*").c_str(), &entry);
+		if (search == INVALID_HANDLE_VALUE)
+			return;
+		do
+		{
+			std::string name = entry.cFileName;
+			if (name == "." || name == "..")
+				continue;
+			if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+				ListFiles(prefix + name, extension, files);
+			else if (EndsWith(name, extension))
+				files.push_back(prefix + name);
+		} while (FindNextFileA(search, &entry));
+		FindClose(search);
+#else
+		DIR* dir = opendir(prefix.c_str());
+		if (!dir)
+			return;
+		while (dirent* entry = readdir(dir))
+		{
+			std::string name = entry->d_name;
+			if (name == "." || name == "..")
+				continue;
+			struct stat info;
+			if (stat((prefix + name).c_str(), &info) != 0)
+				continue;
+			if (S_ISDIR(info.st_mode))
+				ListFiles(prefix + name, extension, files);
+			else if (EndsWith(name, extension))
+				files.push_back(prefix + name);
+		}
+		closedir(dir);
+#endif
+	}
+
+	bool WriteFileAtomic(const std::string& path, const void* data, size_t size)
+	{
+		std::vector<FileChunk> chunks(1);
+		chunks[0].data = data;
+		chunks[0].size = size;
+		return WriteFileAtomic(path, chunks);
+	}
+
+	bool WriteFileAtomic(const std::string& path, const std::vector<FileChunk>& chunks)
+	{
+		std::string temporaryPath = path + ".tmp";
+		FILE* file = fopen(temporaryPath.c_str(), "wb");
+		if (!file)
+			return false;
+
+		bool written = true;
+		for (size_t i = 0; i < chunks.size() && written; i++)
+			written = chunks[i].size == 0 || fwrite(chunks[i].data, 1, chunks[i].size, file) == chunks[i].size;
+		written = fclose(file) == 0 && written;
+		if (!written)
+		{
+			remove(temporaryPath.c_str());
+			return false;
+		}
+
+		//rename does not replace an existing file on Windows
+		remove(path.c_str());
+		return rename(temporaryPath.c_str(), path.c_str()) == 0;
+	}
+}
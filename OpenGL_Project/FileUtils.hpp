@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps
+{
+	// Identifies the exact content of a file on disk
+	struct FileStamp
+	{
+		uint64_t size;
+		int64_t mtime;
+		uint64_t hash;
+	};
+
+	// 64-bit FNV-1a hash, chainable through the seed
+	uint64_t HashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
+
+	// Reads size and modification time, and the content hash if requested
+	bool GetFileStamp(const std::string& path, FileStamp& stamp, bool withHash);
+
+	// A file is current if its size matches and either the mtime or the content hash matches
+	bool IsFileStampCurrent(const std::string& path, const FileStamp& stamp);
+
+	// Read-only memory mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+
+		bool Open(const std::string& path);
+		void Close();
+
+		const unsigned char* Data() const { return data; }
+		size_t Size() const { return size; }
+		bool IsOpen() const { return opened; }
+
+	private:
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const unsigned char* data;
+		size_t size;
+		bool opened;
+#ifdef _WIN32
+		void* fileHandle;
+		void* mappingHandle;
+#else
+		int fileDescriptor;
+#endif
+	};
+
+	// Recursively collects the files under a directory whose name ends with the extension (e.g. ".obj")
+	void ListFiles(const std::string& directory, const std::string& extension, std::vector<std::string>& files);
+
+	// Writes the buffer to a temporary file and moves it over the target, so readers never see partial files
+	bool WriteFileAtomic(const std::string& path, const void* data, size_t size);
+
+	// Piece of a file written with WriteFileAtomic
+	struct FileChunk
+	{
+		const void* data;
+		size_t size;
+	};
+
+	// Same as above for a file assembled from several buffers, without copying them together first
+	bool WriteFileAtomic(const std::string& path, const std::vector<FileChunk>& chunks);
+}
@@ -0,0 +1,62 @@
+#include "FrameUniforms.hpp"
+#include <cstdio>
+
+namespace gps
+{
+	FrameUniformBuffer::FrameUniformBuffer()
+		: buffer(0), data(), uploads(0)
+	{
+	}
+
+	void FrameUniformBuffer::Init()
+	{
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		//the binding is never changed, the programs are pointed at it once
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, buffer);
+	}
+
+	void FrameUniformBuffer::Destroy()
+	{
+		if (buffer != 0)
+		{
+			glDeleteBuffers(1, &buffer);
+			buffer = 0;
+		}
+	}
+
+	bool FrameUniformBuffer::Attach(const gps::Shader& shader)
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(shader.shaderProgram, "FrameUniforms");
+		if (blockIndex == GL_INVALID_INDEX)
+			return false;
+
+		//a block edited in one place only shows up here instead of as garbage on screen.
+		//drivers may or may not round the size of the last member up to 16 bytes
+		GLint blockSize = 0;
+		glGetActiveUniformBlockiv(shader.shaderProgram, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &blockSize);
+		if (((blockSize + 15) & ~15) != GLint(sizeof(FrameUniforms)))
+		{
+			fprintf(stderr, "FrameUniforms block of program %u is %d bytes, expected %d\n",
+				shader.shaderProgram, blockSize, int(sizeof(FrameUniforms)));
+		}
+
+		glUniformBlockBinding(shader.shaderProgram, blockIndex, FRAME_UNIFORMS_BINDING);
+		return true;
+	}
+
+	void FrameUniformBuffer::Upload()
+	{
+		if (buffer == 0)
+			return;
+
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		uploads++;
+	}
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+
+#include "Shader.hpp"
+
+namespace gps
+{
+	// The structs below mirror the std140 "FrameUniforms" block declared in the shaders.
+	// std140 aligns a vec3 to 16 bytes, so every vec3 is followed by a float - a scalar member or padding.
+	// Any change here has to be made to the block in every shader under shaders/ as well.
+
+	struct DirLight
+	{
+		glm::vec3 direction;
+		float pad0;
+		glm::vec3 color;
+		float pad1;
+
+		glm::vec3 ambient;
+		float pad2;
+		glm::vec3 diffuse;
+		float pad3;
+		glm::vec3 specular;
+		float pad4;
+	};
+
+	// Not part of the block - the point lights reach the shaders as ClusterLight texels (see LightClusters)
+	struct PointLight
+	{
+		glm::vec3 position;
+		float constant;
+		glm::vec3 color;
+		float linear;
+
+		glm::vec3 ambient;
+		float quadratic;
+		glm::vec3 diffuse;
+		float pad0;
+		glm::vec3 specular;
+		float pad1;
+	};
+
+	// Point lights with a shadow, the first ones of the clustered lights (see LightClusters)
+	const int POINT_LIGHT_COUNT = 2;
+	// Cascades of the directional light shadow (see ShadowCascades)
+	const int MAX_SHADOW_CASCADES = 4;
+	// Point light shadows drawn again in one frame at most (see PointShadows)
+	const int MAX_POINT_SHADOW_UPDATES = 4;
+
+	struct FrameUniforms
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		//light space of each shadow cascade, nearest first
+		glm::mat4 cascadeMatrices[MAX_SHADOW_CASCADES];
+		//inverse transpose of the view - the shaders use its upper 3x3, a std140 mat3 would be padded to 3 vec4 anyway
+		glm::mat4 lightDirMatrix;
+		//view distance where each cascade ends
+		glm::vec4 cascadeSplits;
+
+		DirLight dirLight;
+		//clusters per pixel across and up, slices per unit of log(depth / near split), then the near split
+		glm::vec4 clusterParams;
+		//tiles across and up, depth slices and the number of point lights
+		glm::ivec4 clusterGrid;
+
+		glm::vec3 fogColor;
+		float fogDensity;
+		//a GLSL bool is 4 bytes in std140
+		GLuint fogEnabled;
+		GLint cascadeCount;
+		float pad[2];
+	};
+
+	static_assert(sizeof(DirLight) == 80, "DirLight does not match the std140 layout");
+	static_assert(sizeof(FrameUniforms) == 608, "FrameUniforms does not match the std140 layout");
+
+	// Uniform buffer holding FrameUniforms, bound once to FRAME_UNIFORMS_BINDING and shared by every program.
+	// The CPU copy is filled during the frame and sent with a single Upload.
+	class FrameUniformBuffer
+	{
+	public:
+		static const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+		FrameUniformBuffer();
+
+		// Creates the buffer and binds it to FRAME_UNIFORMS_BINDING
+		void Init();
+		void Destroy();
+
+		// Points the "FrameUniforms" block of a program at the shared binding, false if the program does not declare it.
+		// Warns when the block size reported by the driver differs from sizeof(FrameUniforms).
+		static bool Attach(const gps::Shader& shader);
+
+		FrameUniforms& Data() { return data; }
+		const FrameUniforms& Data() const { return data; }
+
+		// Sends the whole block - the previous storage is orphaned so a frame still in flight is not waited for
+		void Upload();
+
+		unsigned long UploadCount() const { return uploads; }
+
+	private:
+		GLuint buffer;
+		FrameUniforms data;
+		unsigned long uploads;
+	};
+}
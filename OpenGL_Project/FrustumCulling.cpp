@@ -0,0 +1,230 @@
+#include "FrustumCulling.hpp"
+#include "ImageKernels.hpp"
+#include <cfloat>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define GPS_X86 1
+#include <immintrin.h>
+#endif
+
+//MSVC compiles any intrinsic as is, GCC and Clang need the instruction set enabled per function
+#if defined(GPS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define GPS_TARGET_AVX __attribute__((target("avx")))
+#else
+#define GPS_TARGET_AVX
+#endif
+
+namespace gps
+{
+	//spheres per SIMD step at the widest level, the arrays are padded to it
+	static const size_t SPHERE_BATCH = 8;
+
+	Frustum Frustum::FromMatrix(const glm::mat4& viewProjection)
+	{
+		//rows of the matrix - glm stores columns
+		glm::vec4 rows[4];
+		for (int i = 0; i < 4; i++)
+			rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+
+		Frustum frustum;
+		frustum.planes[0] = rows[3] + rows[0];
+		frustum.planes[1] = rows[3] - rows[0];
+		frustum.planes[2] = rows[3] + rows[1];
+		frustum.planes[3] = rows[3] - rows[1];
+		frustum.planes[4] = rows[3] + rows[2];
+		frustum.planes[5] = rows[3] - rows[2];
+		for (int i = 0; i < 6; i++)
+			frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+		return frustum;
+	}
+
+	bool Frustum::Intersects(const BoundingSphere& sphere) const
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			if (glm::dot(glm::vec3(planes[i]), sphere.center) + planes[i].w + sphere.radius < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	bool Frustum::Intersects(const BoundingBox& box) const
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal(planes[i]);
+			glm::vec3 farthest(normal.x >= 0.0f ? box.max.x : box.min.x, normal.y >= 0.0f ? box.max.y : box.min.y,
+				normal.z >= 0.0f ? box.max.z : box.min.z);
+			if (glm::dot(normal, farthest) + planes[i].w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	bool Frustum::Contains(const BoundingBox& box) const
+	{
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal(planes[i]);
+			glm::vec3 nearest(normal.x >= 0.0f ? box.min.x : box.max.x, normal.y >= 0.0f ? box.min.y : box.max.y,
+				normal.z >= 0.0f ? box.min.z : box.max.z);
+			if (glm::dot(normal, nearest) + planes[i].w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	SphereSet::SphereSet()
+		: count(0)
+	{
+	}
+
+	void SphereSet::Clear()
+	{
+		x.clear();
+		y.clear();
+		z.clear();
+		radius.clear();
+		count = 0;
+	}
+
+	void SphereSet::Reserve(size_t count)
+	{
+		size_t padded = (count + SPHERE_BATCH - 1) / SPHERE_BATCH * SPHERE_BATCH;
+		x.reserve(padded);
+		y.reserve(padded);
+		z.reserve(padded);
+		radius.reserve(padded);
+	}
+
+	size_t SphereSet::Add(const BoundingSphere& sphere)
+	{
+		if (count == x.size())
+		{
+			//a new batch of padding, -FLT_MAX puts it outside of every plane
+			x.resize(count + SPHERE_BATCH, 0.0f);
+			y.resize(count + SPHERE_BATCH, 0.0f);
+			z.resize(count + SPHERE_BATCH, 0.0f);
+			radius.resize(count + SPHERE_BATCH, -FLT_MAX);
+		}
+		Set(count, sphere);
+		return count++;
+	}
+
+	void SphereSet::Set(size_t index, const BoundingSphere& sphere)
+	{
+		x[index] = sphere.center.x;
+		y[index] = sphere.center.y;
+		z[index] = sphere.center.z;
+		//an empty sphere is never visible
+		radius[index] = sphere.IsEmpty() ? -FLT_MAX : sphere.radius;
+	}
+
+	static void CullScalar(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+		size_t begin, size_t count, std::vector<uint32_t>& visible)
+	{
+		for (size_t i = begin; i < count; i++)
+		{
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				inside = plane.x * x[i] + plane.y * y[i] + plane.z * z[i] + plane.w + radius[i] >= 0.0f;
+			}
+			if (inside)
+				visible.push_back(uint32_t(i));
+		}
+	}
+
+#ifdef GPS_X86
+	static void PushVisible(unsigned int mask, size_t first, size_t count, std::vector<uint32_t>& visible)
+	{
+		//the padding is never visible, so no bit goes past count
+		for (; mask != 0; mask &= mask - 1)
+		{
+			unsigned int bit = 0;
+			while (!(mask & (1u << bit)))
+				bit++;
+			if (first + bit < count)
+				visible.push_back(uint32_t(first + bit));
+		}
+	}
+
+	static void CullSSE(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+		size_t count, std::vector<uint32_t>& visible)
+	{
+		__m128 planes[6][4];
+		for (int p = 0; p < 6; p++)
+		{
+			for (int c = 0; c < 4; c++)
+				planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+		}
+
+		const __m128 zero = _mm_setzero_ps();
+		for (size_t i = 0; i < count; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(x + i);
+			__m128 cy = _mm_loadu_ps(y + i);
+			__m128 cz = _mm_loadu_ps(z + i);
+			__m128 r = _mm_loadu_ps(radius + i);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], cx), _mm_mul_ps(planes[p][1], cy)),
+					_mm_add_ps(_mm_mul_ps(planes[p][2], cz), _mm_add_ps(planes[p][3], r)));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, zero));
+			}
+			PushVisible(unsigned(_mm_movemask_ps(inside)), i, count, visible);
+		}
+	}
+
+	GPS_TARGET_AVX static void CullAVX(const Frustum& frustum, const float* x, const float* y, const float* z, const float* radius,
+		size_t count, std::vector<uint32_t>& visible)
+	{
+		__m256 planes[6][4];
+		for (int p = 0; p < 6; p++)
+		{
+			for (int c = 0; c < 4; c++)
+				planes[p][c] = _mm256_set1_ps(frustum.planes[p][c]);
+		}
+
+		const __m256 zero = _mm256_setzero_ps();
+		for (size_t i = 0; i < count; i += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(x + i);
+			__m256 cy = _mm256_loadu_ps(y + i);
+			__m256 cz = _mm256_loadu_ps(z + i);
+			__m256 r = _mm256_loadu_ps(radius + i);
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[0][0], cx), _mm256_mul_ps(planes[0][1], cy)),
+				_mm256_add_ps(_mm256_mul_ps(planes[0][2], cz), _mm256_add_ps(planes[0][3], r)));
+			__m256 inside = _mm256_cmp_ps(distance, zero, _CMP_GE_OQ);
+			for (int p = 1; p < 6; p++)
+			{
+				distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planes[p][0], cx), _mm256_mul_ps(planes[p][1], cy)),
+					_mm256_add_ps(_mm256_mul_ps(planes[p][2], cz), _mm256_add_ps(planes[p][3], r)));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+			}
+			PushVisible(unsigned(_mm256_movemask_ps(inside)), i, count, visible);
+		}
+	}
+#endif
+
+	size_t SphereSet::Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const
+	{
+		visible.clear();
+		if (count == 0)
+			return 0;
+
+#ifdef GPS_X86
+		const SimdLevel level = GetSimdLevel();
+		//the arrays hold whole batches of 8, so neither path has a tail
+		if (level == SIMD_AVX2)
+			CullAVX(frustum, &x[0], &y[0], &z[0], &radius[0], count, visible);
+		else if (level == SIMD_SSE2)
+			CullSSE(frustum, &x[0], &y[0], &z[0], &radius[0], count, visible);
+		else
+#endif
+			CullScalar(frustum, &x[0], &y[0], &z[0], &radius[0], 0, count, visible);
+		return visible.size();
+	}
+}
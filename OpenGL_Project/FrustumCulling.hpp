@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "glm/glm.hpp"
+
+#include "BoundingBox.hpp"
+
+namespace gps
+{
+	// Six planes facing inwards (left, right, bottom, top, near, far), normalized so the plane equation
+	// gives the distance
+	struct Frustum
+	{
+		glm::vec4 planes[6];
+
+		// Planes of the clip volume of a view-projection matrix - a camera, or the orthographic light
+		// of the shadow map
+		static Frustum FromMatrix(const glm::mat4& viewProjection);
+
+		// False only when the sphere is entirely outside one plane - spheres near a corner may pass
+		bool Intersects(const BoundingSphere& sphere) const;
+		// Same for a box, tested at its corner farthest along each plane normal
+		bool Intersects(const BoundingBox& box) const;
+		// True when the whole box is inside - everything under a contained node of a hierarchy is visible
+		bool Contains(const BoundingBox& box) const;
+	};
+
+	// Spheres tested against a frustum and spheres found visible, summed over a frame
+	struct CullStats
+	{
+		CullStats() : tested(0), visible(0) {}
+
+		unsigned long tested;
+		unsigned long visible;
+
+		void Add(const CullStats& other)
+		{
+			tested += other.tested;
+			visible += other.visible;
+		}
+	};
+
+	// World space spheres kept as separate x, y, z and radius arrays, so 4 (SSE) or 8 (AVX) of them are
+	// tested against a plane at once. The SIMD level is the one of the image kernels (see SetSimdLevel).
+	class SphereSet
+	{
+	public:
+		SphereSet();
+
+		void Clear();
+		void Reserve(size_t count);
+		// Returns the index of the sphere
+		size_t Add(const BoundingSphere& sphere);
+		void Set(size_t index, const BoundingSphere& sphere);
+		size_t Size() const { return count; }
+
+		// Replaces visible with the indices of the spheres intersecting the frustum, in order,
+		// and returns their number
+		size_t Cull(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+
+	private:
+		// Padded to a multiple of 8 with spheres no frustum can contain
+		std::vector<float> x;
+		std::vector<float> y;
+		std::vector<float> z;
+		std::vector<float> radius;
+		size_t count;
+	};
+}
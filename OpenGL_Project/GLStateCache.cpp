@@ -0,0 +1,242 @@
+#include "GLStateCache.hpp"
+
+namespace gps
+{
+	//GLEW entry points are pointers loaded by glewInit, so they are read at call time
+	static void GLAPIENTRY DriverUseProgram(GLuint program) { glUseProgram(program); }
+	static void GLAPIENTRY DriverBindVertexArray(GLuint vao) { glBindVertexArray(vao); }
+	static void GLAPIENTRY DriverActiveTexture(GLenum unit) { glActiveTexture(unit); }
+	static void GLAPIENTRY DriverBindTexture(GLenum target, GLuint texture) { glBindTexture(target, texture); }
+	static void GLAPIENTRY DriverBindFramebuffer(GLenum target, GLuint framebuffer) { glBindFramebuffer(target, framebuffer); }
+	static void GLAPIENTRY DriverEnable(GLenum capability) { glEnable(capability); }
+	static void GLAPIENTRY DriverDisable(GLenum capability) { glDisable(capability); }
+	static void GLAPIENTRY DriverCullFace(GLenum mode) { glCullFace(mode); }
+	static void GLAPIENTRY DriverDepthFunc(GLenum func) { glDepthFunc(func); }
+	static void GLAPIENTRY DriverDepthMask(GLboolean flag) { glDepthMask(flag); }
+	static void GLAPIENTRY DriverViewport(GLint x, GLint y, GLsizei width, GLsizei height) { glViewport(x, y, width, height); }
+	static void GLAPIENTRY DriverDeleteTextures(GLsizei n, const GLuint* textures) { glDeleteTextures(n, textures); }
+	static void GLAPIENTRY DriverDeleteVertexArrays(GLsizei n, const GLuint* arrays) { glDeleteVertexArrays(n, arrays); }
+
+	GLFunctions GLFunctions::Driver()
+	{
+		GLFunctions functions;
+		functions.useProgram = DriverUseProgram;
+		functions.bindVertexArray = DriverBindVertexArray;
+		functions.activeTexture = DriverActiveTexture;
+		functions.bindTexture = DriverBindTexture;
+		functions.bindFramebuffer = DriverBindFramebuffer;
+		functions.enable = DriverEnable;
+		functions.disable = DriverDisable;
+		functions.cullFace = DriverCullFace;
+		functions.depthFunc = DriverDepthFunc;
+		functions.depthMask = DriverDepthMask;
+		functions.viewport = DriverViewport;
+		functions.deleteTextures = DriverDeleteTextures;
+		functions.deleteVertexArrays = DriverDeleteVertexArrays;
+		return functions;
+	}
+
+	GLStateCache& GLStateCache::Instance()
+	{
+		static GLStateCache instance(GLFunctions::Driver());
+		return instance;
+	}
+
+	GLStateCache::GLStateCache(const GLFunctions& functions)
+		: gl(functions), issued(0), skipped(0)
+	{
+		Invalidate();
+	}
+
+	bool GLStateCache::Changes(GLuint& shadow, GLuint value)
+	{
+		if (shadow == value)
+		{
+			skipped++;
+			return false;
+		}
+		shadow = value;
+		issued++;
+		return true;
+	}
+
+	void GLStateCache::UseProgram(GLuint program)
+	{
+		if (Changes(this->program, program))
+			gl.useProgram(program);
+	}
+
+	void GLStateCache::BindVertexArray(GLuint vao)
+	{
+		if (Changes(this->vao, vao))
+			gl.bindVertexArray(vao);
+	}
+
+	void GLStateCache::ActiveTexture(GLenum unit)
+	{
+		if (Changes(activeUnit, unit - GL_TEXTURE0))
+			gl.activeTexture(unit);
+	}
+
+	void GLStateCache::BindTexture(GLenum target, GLuint texture)
+	{
+		int index = TargetIndex(target);
+		//targets and units outside the shadow copy are passed through
+		if (index < 0 || activeUnit >= GLuint(MAX_TEXTURE_UNITS))
+		{
+			issued++;
+			gl.bindTexture(target, texture);
+			return;
+		}
+		if (Changes(textures[activeUnit][index], texture))
+			gl.bindTexture(target, texture);
+	}
+
+	void GLStateCache::BindTextureUnit(GLuint unit, GLenum target, GLuint texture)
+	{
+		int index = TargetIndex(target);
+		if (index >= 0 && unit < GLuint(MAX_TEXTURE_UNITS) && textures[unit][index] == texture)
+		{
+			skipped++;
+			return;
+		}
+		ActiveTexture(GL_TEXTURE0 + unit);
+		BindTexture(target, texture);
+	}
+
+	void GLStateCache::BindFramebuffer(GLenum target, GLuint framebuffer)
+	{
+		if (target == GL_FRAMEBUFFER)
+		{
+			if (drawFramebuffer == framebuffer && readFramebuffer == framebuffer)
+			{
+				skipped++;
+				return;
+			}
+			drawFramebuffer = framebuffer;
+			readFramebuffer = framebuffer;
+			issued++;
+			gl.bindFramebuffer(target, framebuffer);
+		}
+		else if (Changes(target == GL_READ_FRAMEBUFFER ? readFramebuffer : drawFramebuffer, framebuffer))
+		{
+			gl.bindFramebuffer(target, framebuffer);
+		}
+	}
+
+	void GLStateCache::SetCapability(GLenum capability, bool enabled)
+	{
+		int index = CapabilityIndex(capability);
+		if (index >= 0 && !Changes(capabilities[index], enabled ? 1 : 0))
+			return;
+		if (index < 0)
+			issued++;
+
+		if (enabled)
+			gl.enable(capability);
+		else
+			gl.disable(capability);
+	}
+
+	void GLStateCache::CullFace(GLenum mode)
+	{
+		if (Changes(cullMode, mode))
+			gl.cullFace(mode);
+	}
+
+	void GLStateCache::DepthFunc(GLenum func)
+	{
+		if (Changes(depthFunc, func))
+			gl.depthFunc(func);
+	}
+
+	void GLStateCache::DepthMask(bool enabled)
+	{
+		if (Changes(depthMask, enabled ? 1 : 0))
+			gl.depthMask(enabled ? GL_TRUE : GL_FALSE);
+	}
+
+	void GLStateCache::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		if (viewportKnown && viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+		{
+			skipped++;
+			return;
+		}
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+		viewportKnown = true;
+		issued++;
+		gl.viewport(x, y, width, height);
+	}
+
+	void GLStateCache::DeleteTexture(GLuint texture)
+	{
+		for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		{
+			for (int target = 0; target < TARGET_COUNT; target++)
+			{
+				if (textures[unit][target] == texture)
+					textures[unit][target] = 0;
+			}
+		}
+		gl.deleteTextures(1, &texture);
+	}
+
+	void GLStateCache::DeleteVertexArray(GLuint vao)
+	{
+		if (this->vao == vao)
+			this->vao = 0;
+		gl.deleteVertexArrays(1, &vao);
+	}
+
+	void GLStateCache::Invalidate()
+	{
+		program = UNKNOWN;
+		vao = UNKNOWN;
+		activeUnit = UNKNOWN;
+		for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		{
+			for (int target = 0; target < TARGET_COUNT; target++)
+				textures[unit][target] = UNKNOWN;
+		}
+		drawFramebuffer = UNKNOWN;
+		readFramebuffer = UNKNOWN;
+		for (int cap = 0; cap < CAP_COUNT; cap++)
+			capabilities[cap] = UNKNOWN;
+		cullMode = UNKNOWN;
+		depthFunc = UNKNOWN;
+		depthMask = UNKNOWN;
+		viewportKnown = false;
+	}
+
+	void GLStateCache::ResetCounts()
+	{
+		issued = 0;
+		skipped = 0;
+	}
+
+	int GLStateCache::TargetIndex(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_TEXTURE_2D: return TARGET_2D;
+		case GL_TEXTURE_CUBE_MAP: return TARGET_CUBE_MAP;
+		case GL_TEXTURE_2D_ARRAY: return TARGET_2D_ARRAY;
+		default: return -1;
+		}
+	}
+
+	int GLStateCache::CapabilityIndex(GLenum capability)
+	{
+		switch (capability)
+		{
+		case GL_DEPTH_TEST: return CAP_DEPTH_TEST;
+		case GL_CULL_FACE: return CAP_CULL_FACE;
+		case GL_BLEND: return CAP_BLEND;
+		default: return -1;
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "GLEW/glew.h"
+
+namespace gps
+{
+	// GL entry points used by GLStateCache. The driver table forwards to GLEW, a test fills in its own
+	// functions to record the calls without a context.
+	struct GLFunctions
+	{
+		void (GLAPIENTRY* useProgram)(GLuint program);
+		void (GLAPIENTRY* bindVertexArray)(GLuint vao);
+		void (GLAPIENTRY* activeTexture)(GLenum unit);
+		void (GLAPIENTRY* bindTexture)(GLenum target, GLuint texture);
+		void (GLAPIENTRY* bindFramebuffer)(GLenum target, GLuint framebuffer);
+		void (GLAPIENTRY* enable)(GLenum capability);
+		void (GLAPIENTRY* disable)(GLenum capability);
+		void (GLAPIENTRY* cullFace)(GLenum mode);
+		void (GLAPIENTRY* depthFunc)(GLenum func);
+		void (GLAPIENTRY* depthMask)(GLboolean flag);
+		void (GLAPIENTRY* viewport)(GLint x, GLint y, GLsizei width, GLsizei height);
+		void (GLAPIENTRY* deleteTextures)(GLsizei n, const GLuint* textures);
+		void (GLAPIENTRY* deleteVertexArrays)(GLsizei n, const GLuint* arrays);
+
+		// Forwards to the GLEW entry points of the current context
+		static GLFunctions Driver();
+	};
+
+	// Shadows the bound program, VAO, textures, framebuffers, depth/cull state and viewport, and drops the calls
+	// that would set a value already in place. Every state change made through GL directly has to go through
+	// here instead, or be followed by Invalidate, or the shadow copy no longer matches the context.
+	// Render thread only.
+	class GLStateCache
+	{
+	public:
+		static const int MAX_TEXTURE_UNITS = 16;
+
+		// Cache of the current context, using the driver entry points
+		static GLStateCache& Instance();
+
+		explicit GLStateCache(const GLFunctions& functions);
+
+		void UseProgram(GLuint program);
+		void BindVertexArray(GLuint vao);
+		// Selects the unit for the texture calls made through GL directly (uploads, parameters)
+		void ActiveTexture(GLenum unit);
+		// Binds to the active unit
+		void BindTexture(GLenum target, GLuint texture);
+		// Binds to a unit, switching the active unit only when the binding changes
+		void BindTextureUnit(GLuint unit, GLenum target, GLuint texture);
+		// GL_FRAMEBUFFER sets both the draw and the read binding
+		void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+		void Enable(GLenum capability) { SetCapability(capability, true); }
+		void Disable(GLenum capability) { SetCapability(capability, false); }
+		void SetCapability(GLenum capability, bool enabled);
+		void CullFace(GLenum mode);
+		void DepthFunc(GLenum func);
+		void DepthMask(bool enabled);
+		void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+		// Deleted names are unbound by GL and may be handed out again, so their bindings are forgotten too
+		void DeleteTexture(GLuint texture);
+		void DeleteVertexArray(GLuint vao);
+
+		// Forgets everything - the next call of each kind is issued
+		void Invalidate();
+
+		unsigned long IssuedCount() const { return issued; }
+		unsigned long SkippedCount() const { return skipped; }
+		void ResetCounts();
+
+	private:
+		enum TextureTarget
+		{
+			TARGET_2D,
+			TARGET_CUBE_MAP,
+			TARGET_2D_ARRAY,
+			TARGET_COUNT
+		};
+
+		enum Capability
+		{
+			CAP_DEPTH_TEST,
+			CAP_CULL_FACE,
+			CAP_BLEND,
+			CAP_COUNT
+		};
+
+		// Bindings and values not known yet (at start or after Invalidate) hold UNKNOWN
+		static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+		GLFunctions gl;
+
+		GLuint program;
+		GLuint vao;
+		GLuint activeUnit;
+		GLuint textures[MAX_TEXTURE_UNITS][TARGET_COUNT];
+		GLuint drawFramebuffer;
+		GLuint readFramebuffer;
+		GLuint capabilities[CAP_COUNT];
+		GLuint cullMode;
+		GLuint depthFunc;
+		GLuint depthMask;
+		GLint viewport[4];
+		bool viewportKnown;
+
+		unsigned long issued;
+		unsigned long skipped;
+
+		static int TargetIndex(GLenum target);
+		static int CapabilityIndex(GLenum capability);
+		// Counts the call and tells whether it has to be issued
+		bool Changes(GLuint& shadow, GLuint value);
+	};
+}
@@ -0,0 +1,164 @@
+#include "GeometryArena.hpp"
+#include "GLStateCache.hpp"
+#include <iostream>
+
+namespace gps
+{
+	//draws the draw data buffer starts with, it grows by doubling
+	static const size_t INITIAL_DRAW_DATA = 1024;
+
+	GeometryArena& GeometryArena::Instance()
+	{
+		static GeometryArena instance;
+		return instance;
+	}
+
+	GeometryArena::GeometryArena()
+		: drawDataBuffer(0), drawDataCapacity(0), meshCount(0), enabled(true)
+	{
+	}
+
+	void GeometryArena::Allocate(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, ArenaRange& range)
+	{
+		Block* block = NULL;
+		for (size_t i = 0; i < blocks.size() && block == NULL; i++)
+		{
+			if (blocks[i].vertexCapacity - blocks[i].vertexCount >= vertexCount && blocks[i].indexCapacity - blocks[i].indexCount >= indexCount)
+				block = &blocks[i];
+		}
+		if (block == NULL)
+			block = &OpenBlock(glm::max(vertexCount, BLOCK_VERTICES), glm::max(indexCount, BLOCK_INDICES));
+
+		range.vao = block->vao;
+		range.vertexBuffer = block->vertexBuffer;
+		range.indexBuffer = block->indexBuffer;
+		range.depthVao = block->depthVao;
+		range.positionBuffer = block->positionBuffer;
+		range.baseVertex = GLint(block->vertexCount);
+		range.firstIndex = block->indexCount;
+
+		//the indices stay relative to the mesh, the draws add baseVertex
+		glBindBuffer(GL_ARRAY_BUFFER, block->vertexBuffer);
+		glBufferSubData(GL_ARRAY_BUFFER, GLintptr(block->vertexCount) * sizeof(Vertex), GLsizeiptr(vertexCount) * sizeof(Vertex), vertices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, block->indexBuffer);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(block->indexCount) * sizeof(GLuint), GLsizeiptr(indexCount) * sizeof(GLuint), indices);
+		if (block->positionBuffer != block->vertexBuffer)
+		{
+			std::vector<glm::vec3> positions(vertexCount);
+			for (GLuint v = 0; v < vertexCount; v++)
+				positions[v] = vertices[v].Position;
+			glBindBuffer(GL_ARRAY_BUFFER, block->positionBuffer);
+			glBufferSubData(GL_ARRAY_BUFFER, GLintptr(block->vertexCount) * sizeof(glm::vec3), GLsizeiptr(vertexCount) * sizeof(glm::vec3),
+				positions.empty() ? NULL : &positions[0]);
+		}
+
+		block->vertexCount += vertexCount;
+		block->indexCount += indexCount;
+		meshCount++;
+	}
+
+	GeometryArena::Block& GeometryArena::OpenBlock(GLuint vertexCapacity, GLuint indexCapacity)
+	{
+		if (drawDataBuffer == 0)
+		{
+			glGenBuffers(1, &drawDataBuffer);
+			glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+			//never left without storage, the instance attributes of the VAOs read it even in plain draws
+			glBufferData(GL_ARRAY_BUFFER, INITIAL_DRAW_DATA * sizeof(DrawData), NULL, GL_STREAM_DRAW);
+			drawDataCapacity = INITIAL_DRAW_DATA;
+		}
+
+		Block block;
+		block.vertexCapacity = vertexCapacity;
+		block.indexCapacity = indexCapacity;
+		block.vertexCount = 0;
+		block.indexCount = 0;
+		glGenVertexArrays(1, &block.vao);
+		glGenBuffers(1, &block.vertexBuffer);
+		glGenBuffers(1, &block.indexBuffer);
+
+		GLStateCache::Instance().BindVertexArray(block.vao);
+		glBindBuffer(GL_ARRAY_BUFFER, block.vertexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexCapacity) * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.indexBuffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, GLsizeiptr(indexCapacity) * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+
+		//same layout as Mesh::setupMesh
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+
+		//and the per-draw model matrix of Mesh::CreateInstancedVertexArray, followed by the material layers
+		glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(3 + column);
+			glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(DrawData), (GLvoid*)(offsetof(DrawData, model) + sizeof(glm::vec4) * column));
+			glVertexAttribDivisor(3 + column, 1);
+		}
+		glEnableVertexAttribArray(Mesh::MATERIAL_LAYERS_ATTRIBUTE);
+		glVertexAttribPointer(Mesh::MATERIAL_LAYERS_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(DrawData), (GLvoid*)offsetof(DrawData, materialLayers));
+		glVertexAttribDivisor(Mesh::MATERIAL_LAYERS_ATTRIBUTE, 1);
+
+		block.depthVao = block.vao;
+		block.positionBuffer = block.vertexBuffer;
+		if (Mesh::DepthStreamEnabled())
+		{
+			glGenVertexArrays(1, &block.depthVao);
+			glGenBuffers(1, &block.positionBuffer);
+			GLStateCache::Instance().BindVertexArray(block.depthVao);
+			glBindBuffer(GL_ARRAY_BUFFER, block.positionBuffer);
+			glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(vertexCapacity) * sizeof(glm::vec3), NULL, GL_STATIC_DRAW);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.indexBuffer);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+
+			//the depth programs read only the model matrix of the draw data
+			glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+			for (GLuint column = 0; column < 4; column++)
+			{
+				glEnableVertexAttribArray(3 + column);
+				glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(DrawData), (GLvoid*)(offsetof(DrawData, model) + sizeof(glm::vec4) * column));
+				glVertexAttribDivisor(3 + column, 1);
+			}
+		}
+
+		GLStateCache::Instance().BindVertexArray(0);
+		blocks.push_back(block);
+		return blocks.back();
+	}
+
+	void GeometryArena::UploadDrawData(const std::vector<DrawData>& drawData)
+	{
+		if (drawData.empty() || drawDataBuffer == 0)
+			return;
+
+		glBindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+		//the VAOs refer to the buffer name, so new storage needs no attribute setup
+		while (drawDataCapacity < drawData.size())
+			drawDataCapacity *= 2;
+		//orphaned every frame - the driver hands out fresh storage instead of waiting for last frame's draws
+		glBufferData(GL_ARRAY_BUFFER, drawDataCapacity * sizeof(DrawData), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, drawData.size() * sizeof(DrawData), &drawData[0]);
+	}
+
+	void GeometryArena::PrintReport() const
+	{
+		size_t vertices = 0;
+		size_t indices = 0;
+		size_t capacity = 0;
+		size_t vertexBytes = sizeof(Vertex) + (Mesh::DepthStreamEnabled() ? sizeof(glm::vec3) : 0);
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			vertices += blocks[i].vertexCount;
+			indices += blocks[i].indexCount;
+			capacity += blocks[i].vertexCapacity * vertexBytes + blocks[i].indexCapacity * sizeof(GLuint);
+		}
+		std::cout << "geometry arena: " << meshCount << " meshes in " << blocks.size() << " blocks, " << vertices << " vertices, "
+			<< indices << " indices, " << (vertices * vertexBytes + indices * sizeof(GLuint)) / 1024 << " KB used of "
+			<< capacity / 1024 << " KB" << (Mesh::DepthStreamEnabled() ? " (with the depth position stream)" : "") << std::endl;
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+
+#include "Mesh.hpp"
+
+namespace gps
+{
+	// Place of a mesh in the arena: the VAOs of its block and the offsets of its vertices and indices
+	struct ArenaRange
+	{
+		GLuint vao;
+		GLuint vertexBuffer;
+		GLuint indexBuffer;
+		// Position stream of the depth passes, the same as vao and vertexBuffer when it is off
+		GLuint depthVao;
+		GLuint positionBuffer;
+		GLint baseVertex;
+		GLuint firstIndex;
+	};
+
+	// Per-draw data of the multi-draws, read as instance attributes: the model matrix at locations 3-6 and the
+	// material layers at Mesh::MATERIAL_LAYERS_ATTRIBUTE
+	struct DrawData
+	{
+		glm::mat4 model;
+		glm::vec4 materialLayers;
+	};
+
+	// Layout of the commands read by glMultiDrawElementsIndirect
+	struct DrawElementsIndirectCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// Static geometry of every mesh packed into a few large vertex and index buffers. Each block is one
+	// vertex buffer, one index buffer and one VAO, so the meshes of a block are drawn without any VAO change and
+	// can be merged into one multi-draw. Meshes are never freed, so the space is never reclaimed either.
+	//
+	// Every block VAO also reads a DrawData per instance from the draw data buffer: an indirect command with
+	// one instance and baseInstance i draws its mesh with the i-th model matrix and material layers.
+	//
+	// With the depth stream on (Mesh::EnableDepthStream), a block also keeps the positions alone in a buffer
+	// parallel to its vertices, with a second VAO over them and the same indices, so the depth passes fetch 12
+	// bytes a vertex and draw with the same baseVertex and firstIndex.
+	// Render thread only.
+	class GeometryArena
+	{
+	public:
+		// 32 MB of vertices and 12 MB of indices - larger meshes get a block of their own size
+		static const GLuint BLOCK_VERTICES = 1 << 20;
+		static const GLuint BLOCK_INDICES = 3 << 20;
+
+		static GeometryArena& Instance();
+
+		// Meshes created while the arena is disabled keep buffers of their own
+		void SetEnabled(bool enabled) { this->enabled = enabled; }
+		bool IsEnabled() const { return enabled; }
+
+		// Copies the geometry into the first block with room for it, opening a new block if none has
+		void Allocate(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, ArenaRange& range);
+
+		// Replaces the per-draw data read by the block VAOs
+		void UploadDrawData(const std::vector<DrawData>& drawData);
+
+		size_t BlockCount() const { return blocks.size(); }
+		size_t MeshCount() const { return meshCount; }
+		void PrintReport() const;
+
+	private:
+		GeometryArena();
+		GeometryArena(const GeometryArena&) = delete;
+		GeometryArena& operator=(const GeometryArena&) = delete;
+
+		struct Block
+		{
+			GLuint vao;
+			GLuint vertexBuffer;
+			GLuint indexBuffer;
+			GLuint depthVao;
+			GLuint positionBuffer;
+			GLuint vertexCapacity;
+			GLuint indexCapacity;
+			GLuint vertexCount;
+			GLuint indexCount;
+		};
+
+		std::vector<Block> blocks;
+		GLuint drawDataBuffer;
+		size_t drawDataCapacity;
+		size_t meshCount;
+		bool enabled;
+
+		Block& OpenBlock(GLuint vertexCapacity, GLuint indexCapacity);
+	};
+}
@@ -0,0 +1,141 @@
+#include "Image.hpp"
+#include "ImageKernels.hpp"
+#include "stb_image.h"
+
+#include <algorithm>
+
+namespace gps
+{
+	Image::Image()
+		: width(0), height(0), channels(0), pixels(nullptr)
+	{
+	}
+
+	Image::~Image()
+	{
+		Free();
+	}
+
+	Image::Image(Image&& other)
+		: width(other.width), height(other.height), channels(other.channels), pixels(other.pixels),
+		converted(std::move(other.converted)), mips(std::move(other.mips))
+	{
+		other.pixels = nullptr;
+		other.width = other.height = other.channels = 0;
+	}
+
+	Image& Image::operator=(Image&& other)
+	{
+		if (this != &other)
+		{
+			Free();
+			width = other.width;
+			height = other.height;
+			channels = other.channels;
+			pixels = other.pixels;
+			converted = std::move(other.converted);
+			mips = std::move(other.mips);
+			other.pixels = nullptr;
+			other.width = other.height = other.channels = 0;
+		}
+		return *this;
+	}
+
+	//takes over the output of stb_image, widening RGB to RGBA when asked to
+	bool Image::Decode(unsigned char* decoded, int fileChannels, int channels)
+	{
+		if (!decoded)
+		{
+			width = height = 0;
+			return false;
+		}
+		if (fileChannels == 3 && channels == 4)
+		{
+			size_t pixelCount = size_t(width) * height;
+			converted.resize(pixelCount * 4);
+			ExpandRGBToRGBA(decoded, converted.data(), pixelCount);
+			stbi_image_free(decoded);
+			pixels = converted.data();
+		}
+		else
+		{
+			pixels = decoded;
+		}
+		this->channels = channels;
+		return true;
+	}
+
+	bool Image::Load(const std::string& path, int channels)
+	{
+		Free();
+		int fileChannels;
+		if (!stbi_info(path.c_str(), &width, &height, &fileChannels))
+			fileChannels = 0;
+		int decodeChannels = fileChannels == 3 && channels == 4 ? 3 : channels;
+		return Decode(stbi_load(path.c_str(), &width, &height, &fileChannels, decodeChannels), fileChannels, channels);
+	}
+
+	bool Image::LoadFromMemory(const unsigned char* data, size_t size, int channels)
+	{
+		Free();
+		int fileChannels;
+		if (!stbi_info_from_memory(data, static_cast<int>(size), &width, &height, &fileChannels))
+			fileChannels = 0;
+		int decodeChannels = fileChannels == 3 && channels == 4 ? 3 : channels;
+		return Decode(stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &fileChannels, decodeChannels), fileChannels, channels);
+	}
+
+	void Image::Free()
+	{
+		if (pixels && converted.empty())
+			stbi_image_free(pixels);
+		std::vector<unsigned char>().swap(converted);
+		std::vector<std::vector<unsigned char> >().swap(mips);
+		pixels = nullptr;
+		width = height = channels = 0;
+	}
+
+	void Image::FlipVertically()
+	{
+		FlipRows(pixels, width, height, channels);
+	}
+
+	void Image::GenerateMipChain()
+	{
+		if (!pixels || channels != 4)
+			return;
+
+		mips.clear();
+		int levelWidth = width;
+		int levelHeight = height;
+		const unsigned char* source = pixels;
+		while (levelWidth > 1 || levelHeight > 1)
+		{
+			int nextWidth = std::max(levelWidth / 2, 1);
+			int nextHeight = std::max(levelHeight / 2, 1);
+			mips.push_back(std::vector<unsigned char>(size_t(nextWidth) * nextHeight * 4));
+			DownsampleSRGB(source, levelWidth, levelHeight, mips.back().data());
+			source = mips.back().data();
+			levelWidth = nextWidth;
+			levelHeight = nextHeight;
+		}
+	}
+
+	int Image::LevelWidth(size_t level) const
+	{
+		return std::max(width >> level, 1);
+	}
+
+	int Image::LevelHeight(size_t level) const
+	{
+		return std::max(height >> level, 1);
+	}
+
+	size_t Image::TotalSize() const
+	{
+		size_t size = 0;
+		for (size_t level = 0; level < LevelCount(); level++)
+			size += size_t(LevelWidth(level)) * LevelHeight(level) * channels;
+		return size;
+	}
+}
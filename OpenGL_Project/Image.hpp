@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace gps
+{
+	// Decoded 8-bit image in CPU memory, freed with the object
+	class Image
+	{
+	public:
+		Image();
+		~Image();
+
+		Image(Image&& other);
+		Image& operator=(Image&& other);
+
+		// Decodes an image file, converting it to the requested number of channels (1-4).
+		// RGB files asked for as RGBA are widened with the SIMD kernel instead of stb_image's converter.
+		bool Load(const std::string& path, int channels);
+		// Decodes an image file already in memory
+		bool LoadFromMemory(const unsigned char* data, size_t size, int channels);
+		void Free();
+
+		// Makes the first row the bottom one, as glTexImage2D expects
+		void FlipVertically();
+
+		// Builds the mip levels below the image (RGBA only), see DownsampleSRGB
+		void GenerateMipChain();
+
+		// Level 0 is the image itself, there is a single level until GenerateMipChain is called
+		size_t LevelCount() const { return pixels ? mips.size() + 1 : 0; }
+		int LevelWidth(size_t level) const;
+		int LevelHeight(size_t level) const;
+		const unsigned char* LevelPixels(size_t level) const { return level == 0 ? pixels : mips[level - 1].data(); }
+		// Bytes taken by all the levels
+		size_t TotalSize() const;
+
+		int Width() const { return width; }
+		int Height() const { return height; }
+		int Channels() const { return channels; }
+		const unsigned char* Pixels() const { return pixels; }
+		bool IsLoaded() const { return pixels != nullptr; }
+
+	private:
+		Image(const Image&) = delete;
+		Image& operator=(const Image&) = delete;
+
+		bool Decode(unsigned char* decoded, int fileChannels, int channels);
+
+		int width;
+		int height;
+		int channels;
+		unsigned char* pixels;
+		// Holds the pixels when they were converted after decoding, otherwise stb_image owns them
+		std::vector<unsigned char> converted;
+		std::vector<std::vector<unsigned char> > mips;
+	};
+}
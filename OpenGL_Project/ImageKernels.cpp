@@ -0,0 +1,566 @@
+#include "ImageKernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define GPS_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//MSVC compiles any intrinsic as is, GCC and Clang need the instruction set enabled per function
+#if defined(GPS_X86) && (defined(__GNUC__) || defined(__clang__))
+#define GPS_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define GPS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GPS_TARGET_SSSE3
+#define GPS_TARGET_AVX2
+#endif
+
+namespace gps
+{
+	static bool HasSSSE3()
+	{
+#if !defined(GPS_X86)
+		return false;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 9)) != 0;
+#else
+		return __builtin_cpu_supports("ssse3") != 0;
+#endif
+	}
+
+	SimdLevel DetectSimdLevel()
+	{
+#if !defined(GPS_X86)
+		return SIMD_SCALAR;
+#elif defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+		if (osSavesYmm && maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				return SIMD_AVX2;
+		}
+		//SSE2 is part of x64 and of every CPU the /arch:SSE2 default targets
+		return SIMD_SSE2;
+#else
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			return SIMD_AVX2;
+		if (__builtin_cpu_supports("sse2"))
+			return SIMD_SSE2;
+		return SIMD_SCALAR;
+#endif
+	}
+
+	static SimdLevel& CurrentLevel()
+	{
+		static SimdLevel level = DetectSimdLevel();
+		return level;
+	}
+
+	SimdLevel GetSimdLevel()
+	{
+		return CurrentLevel();
+	}
+
+	void SetSimdLevel(SimdLevel level)
+	{
+		CurrentLevel() = std::min(level, DetectSimdLevel());
+	}
+
+	const char* SimdLevelName(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SIMD_AVX2: return "AVX2";
+		case SIMD_SSE2: return "SSE2";
+		default: return "scalar";
+		}
+	}
+
+	// sRGB <-> linear conversion tables, linear values are 16-bit fixed point
+	struct SRGBTables
+	{
+		int32_t toLinear[256];
+		int32_t toSRGB[4096]; // indexed by the top 12 bits of the linear value
+		float toLinearFloat[256];
+
+		SRGBTables()
+		{
+			for (int i = 0; i < 256; i++)
+			{
+				double value = i / 255.0;
+				double linear = value <= 0.04045 ? value / 12.92 : pow((value + 0.055) / 1.055, 2.4);
+				toLinear[i] = int32_t(linear * 65535.0 + 0.5);
+				toLinearFloat[i] = float(linear);
+			}
+			for (int i = 0; i < 4096; i++)
+			{
+				//middle of the bucket
+				double linear = (i + 0.5) / 4096.0;
+				double value = linear <= 0.0031308 ? linear * 12.92 : 1.055 * pow(linear, 1.0 / 2.4) - 0.055;
+				toSRGB[i] = int32_t(std::min(255.0, value * 255.0 + 0.5));
+			}
+		}
+	};
+
+	static const SRGBTables& Tables()
+	{
+		static const SRGBTables tables;
+		return tables;
+	}
+
+	//--- row flip
+
+	static void SwapBytesScalar(unsigned char* a, unsigned char* b, size_t size, size_t start)
+	{
+		size_t i = start;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t x, y;
+			memcpy(&x, a + i, 8);
+			memcpy(&y, b + i, 8);
+			memcpy(a + i, &y, 8);
+			memcpy(b + i, &x, 8);
+		}
+		for (; i < size; i++)
+			std::swap(a[i], b[i]);
+	}
+
+#ifdef GPS_X86
+	static void SwapBytesSSE2(unsigned char* a, unsigned char* b, size_t size)
+	{
+		size_t i = 0;
+		for (; i + 16 <= size; i += 16)
+		{
+			__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+			__m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(a + i), y);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(b + i), x);
+		}
+		SwapBytesScalar(a, b, size, i);
+	}
+
+	GPS_TARGET_AVX2 static void SwapBytesAVX2(unsigned char* a, unsigned char* b, size_t size)
+	{
+		size_t i = 0;
+		for (; i + 32 <= size; i += 32)
+		{
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+			__m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(a + i), y);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(b + i), x);
+		}
+		SwapBytesScalar(a, b, size, i);
+	}
+#endif
+
+	void FlipRows(unsigned char* pixels, int width, int height, int channels)
+	{
+		const size_t rowSize = size_t(width) * channels;
+		const SimdLevel level = GetSimdLevel();
+		for (int row = 0; row < height / 2; row++)
+		{
+			unsigned char* top = pixels + row * rowSize;
+			unsigned char* bottom = pixels + (height - row - 1) * rowSize;
+#ifdef GPS_X86
+			if (level == SIMD_AVX2)
+				SwapBytesAVX2(top, bottom, rowSize);
+			else if (level == SIMD_SSE2)
+				SwapBytesSSE2(top, bottom, rowSize);
+			else
+#endif
+				SwapBytesScalar(top, bottom, rowSize, 0);
+		}
+	}
+
+	//--- RGB -> RGBA
+
+	static void ExpandRGBToRGBAScalar(const unsigned char* rgb, unsigned char* rgba, size_t start, size_t pixelCount)
+	{
+		for (size_t i = start; i < pixelCount; i++)
+		{
+			rgba[i * 4 + 0] = rgb[i * 3 + 0];
+			rgba[i * 4 + 1] = rgb[i * 3 + 1];
+			rgba[i * 4 + 2] = rgb[i * 3 + 2];
+			rgba[i * 4 + 3] = 255;
+		}
+	}
+
+#ifdef GPS_X86
+	GPS_TARGET_SSSE3 static void ExpandRGBToRGBASSSE3(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount)
+	{
+		const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m128i alpha = _mm_set1_epi32(int(0xFF000000));
+		size_t i = 0;
+		//4 pixels per step, reading 16 of the 12 bytes they take
+		for (; i + 6 <= pixelCount; i += 4)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), _mm_or_si128(_mm_shuffle_epi8(pixels, shuffle), alpha));
+		}
+		ExpandRGBToRGBAScalar(rgb, rgba, i, pixelCount);
+	}
+
+	GPS_TARGET_AVX2 static void ExpandRGBToRGBAAVX2(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount)
+	{
+		const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+		const __m256i alpha = _mm256_set1_epi32(int(0xFF000000));
+		size_t i = 0;
+		//8 pixels per step, 4 in each 128-bit lane since the shuffle does not cross lanes
+		for (; i + 10 <= pixelCount; i += 8)
+		{
+			__m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3));
+			__m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + i * 3 + 12));
+			__m256i pixels = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(pixels, shuffle), alpha));
+		}
+		ExpandRGBToRGBAScalar(rgb, rgba, i, pixelCount);
+	}
+#endif
+
+	void ExpandRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount)
+	{
+#ifdef GPS_X86
+		static const bool ssse3 = HasSSSE3();
+		const SimdLevel level = GetSimdLevel();
+		if (level == SIMD_AVX2)
+			return ExpandRGBToRGBAAVX2(rgb, rgba, pixelCount);
+		if (level == SIMD_SSE2 && ssse3)
+			return ExpandRGBToRGBASSSE3(rgb, rgba, pixelCount);
+#endif
+		ExpandRGBToRGBAScalar(rgb, rgba, 0, pixelCount);
+	}
+
+	//--- alpha premultiplication
+
+	static void PremultiplyAlphaScalar(unsigned char* rgba, size_t start, size_t pixelCount)
+	{
+		for (size_t i = start; i < pixelCount; i++)
+		{
+			unsigned char* pixel = rgba + i * 4;
+			int alpha = pixel[3];
+			for (int c = 0; c < 3; c++)
+				pixel[c] = static_cast<unsigned char>((pixel[c] * alpha + 127) / 255);
+		}
+	}
+
+#ifdef GPS_X86
+	//(t + (t >> 8)) >> 8 with t = c * a + 128 is the rounded c * a / 255
+	static inline __m128i MultiplyByAlphaSSE2(__m128i color)
+	{
+		const __m128i bias = _mm_set1_epi16(128);
+		__m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(color, 0xFF), 0xFF);
+		__m128i product = _mm_add_epi16(_mm_mullo_epi16(color, alpha), bias);
+		return _mm_srli_epi16(_mm_add_epi16(product, _mm_srli_epi16(product, 8)), 8);
+	}
+
+	static void PremultiplyAlphaSSE2(unsigned char* rgba, size_t pixelCount)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000));
+		size_t i = 0;
+		for (; i + 4 <= pixelCount; i += 4)
+		{
+			__m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+			__m128i low = MultiplyByAlphaSSE2(_mm_unpacklo_epi8(pixels, zero));
+			__m128i high = MultiplyByAlphaSSE2(_mm_unpackhi_epi8(pixels, zero));
+			__m128i result = _mm_packus_epi16(low, high);
+			result = _mm_or_si128(_mm_and_si128(pixels, alphaMask), _mm_andnot_si128(alphaMask, result));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + i * 4), result);
+		}
+		PremultiplyAlphaScalar(rgba, i, pixelCount);
+	}
+
+	GPS_TARGET_AVX2 static inline __m256i MultiplyByAlphaAVX2(__m256i color)
+	{
+		const __m256i bias = _mm256_set1_epi16(128);
+		__m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(color, 0xFF), 0xFF);
+		__m256i product = _mm256_add_epi16(_mm256_mullo_epi16(color, alpha), bias);
+		return _mm256_srli_epi16(_mm256_add_epi16(product, _mm256_srli_epi16(product, 8)), 8);
+	}
+
+	GPS_TARGET_AVX2 static void PremultiplyAlphaAVX2(unsigned char* rgba, size_t pixelCount)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i alphaMask = _mm256_set1_epi32(int(0xFF000000));
+		size_t i = 0;
+		for (; i + 8 <= pixelCount; i += 8)
+		{
+			__m256i pixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rgba + i * 4));
+			//unpack and pack both work within 128-bit lanes, so the pixel order is kept
+			__m256i low = MultiplyByAlphaAVX2(_mm256_unpacklo_epi8(pixels, zero));
+			__m256i high = MultiplyByAlphaAVX2(_mm256_unpackhi_epi8(pixels, zero));
+			__m256i result = _mm256_packus_epi16(low, high);
+			result = _mm256_or_si256(_mm256_and_si256(pixels, alphaMask), _mm256_andnot_si256(alphaMask, result));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + i * 4), result);
+		}
+		PremultiplyAlphaScalar(rgba, i, pixelCount);
+	}
+#endif
+
+	void PremultiplyAlpha(unsigned char* rgba, size_t pixelCount)
+	{
+#ifdef GPS_X86
+		const SimdLevel level = GetSimdLevel();
+		if (level == SIMD_AVX2)
+			return PremultiplyAlphaAVX2(rgba, pixelCount);
+		if (level == SIMD_SSE2)
+			return PremultiplyAlphaSSE2(rgba, pixelCount);
+#endif
+		PremultiplyAlphaScalar(rgba, 0, pixelCount);
+	}
+
+	//--- sRGB box downsample
+
+	//one destination pixel from its 2x2 footprint, in the exact arithmetic of the AVX2 path
+	static inline void BoxPixel(const unsigned char* p0, const unsigned char* p1, const unsigned char* p2, const unsigned char* p3,
+		const SRGBTables& tables, unsigned char* destination)
+	{
+		int weight = p0[3] + p1[3] + p2[3] + p3[3];
+		for (int c = 0; c < 3; c++)
+		{
+			int32_t l0 = tables.toLinear[p0[c]], l1 = tables.toLinear[p1[c]], l2 = tables.toLinear[p2[c]], l3 = tables.toLinear[p3[c]];
+			int32_t sum;
+			float divisor;
+			if (weight > 0)
+			{
+				sum = l0 * p0[3] + l1 * p1[3] + l2 * p2[3] + l3 * p3[3];
+				divisor = float(weight);
+			}
+			else
+			{
+				//fully transparent - plain average, so the color stays sensible for filtering
+				sum = l0 + l1 + l2 + l3;
+				divisor = 4.0f;
+			}
+			int32_t linear = int32_t(float(sum) / divisor);
+			destination[c] = static_cast<unsigned char>(tables.toSRGB[linear >> 4]);
+		}
+		destination[3] = static_cast<unsigned char>((weight + 2) >> 2);
+	}
+
+	static void DownsampleRowScalar(const unsigned char* row0, const unsigned char* row1, int width, int destinationWidth,
+		int start, unsigned char* destination)
+	{
+		const SRGBTables& tables = Tables();
+		for (int x = start; x < destinationWidth; x++)
+		{
+			int x0 = std::min(x * 2, width - 1);
+			int x1 = std::min(x * 2 + 1, width - 1);
+			BoxPixel(row0 + x0 * 4, row0 + x1 * 4, row1 + x0 * 4, row1 + x1 * 4, tables, destination + x * 4);
+		}
+	}
+
+#ifdef GPS_X86
+	GPS_TARGET_AVX2 static void DownsampleRowAVX2(const unsigned char* row0, const unsigned char* row1, int width, int destinationWidth,
+		unsigned char* destination)
+	{
+		const SRGBTables& tables = Tables();
+		const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+		const __m256i byteMask = _mm256_set1_epi32(0xFF);
+		const __m256i four = _mm256_set1_epi32(4);
+		const __m256i two = _mm256_set1_epi32(2);
+
+		int x = 0;
+		//8 destination pixels per step, from 16 source pixels of each row
+		for (; (x + 8) * 2 <= width; x += 8)
+		{
+			__m256i pixels[4];
+			const unsigned char* rows[2] = { row0, row1 };
+			for (int r = 0; r < 2; r++)
+			{
+				__m256i first = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + x * 8));
+				__m256i second = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[r] + x * 8 + 32));
+				first = _mm256_permutevar8x32_epi32(first, deinterleave);
+				second = _mm256_permutevar8x32_epi32(second, deinterleave);
+				pixels[r * 2 + 0] = _mm256_permute2x128_si256(first, second, 0x20);
+				pixels[r * 2 + 1] = _mm256_permute2x128_si256(first, second, 0x31);
+			}
+
+			__m256i alpha[4];
+			__m256i weight = _mm256_setzero_si256();
+			for (int p = 0; p < 4; p++)
+			{
+				alpha[p] = _mm256_srli_epi32(pixels[p], 24);
+				weight = _mm256_add_epi32(weight, alpha[p]);
+			}
+			__m256i transparent = _mm256_cmpeq_epi32(weight, _mm256_setzero_si256());
+			__m256 divisor = _mm256_cvtepi32_ps(_mm256_blendv_epi8(weight, four, transparent));
+
+			__m256i result = _mm256_slli_epi32(_mm256_srli_epi32(_mm256_add_epi32(weight, two), 2), 24);
+			for (int c = 0; c < 3; c++)
+			{
+				__m256i weighted = _mm256_setzero_si256();
+				__m256i plain = _mm256_setzero_si256();
+				for (int p = 0; p < 4; p++)
+				{
+					__m256i value = _mm256_and_si256(_mm256_srli_epi32(pixels[p], 8 * c), byteMask);
+					__m256i linear = _mm256_i32gather_epi32(tables.toLinear, value, 4);
+					weighted = _mm256_add_epi32(weighted, _mm256_mullo_epi32(linear, alpha[p]));
+					plain = _mm256_add_epi32(plain, linear);
+				}
+				__m256i sum = _mm256_blendv_epi8(weighted, plain, transparent);
+				__m256i linear = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(sum), divisor));
+				__m256i value = _mm256_i32gather_epi32(tables.toSRGB, _mm256_srli_epi32(linear, 4), 4);
+				result = _mm256_or_si256(result, _mm256_slli_epi32(value, 8 * c));
+			}
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + x * 4), result);
+		}
+		DownsampleRowScalar(row0, row1, width, destinationWidth, x, destination);
+	}
+#endif
+
+	void DownsampleSRGB(const unsigned char* source, int width, int height, unsigned char* destination)
+	{
+		const int destinationWidth = width > 1 ? width / 2 : 1;
+		const int destinationHeight = height > 1 ? height / 2 : 1;
+		const size_t rowSize = size_t(width) * 4;
+		const SimdLevel level = GetSimdLevel();
+
+		for (int y = 0; y < destinationHeight; y++)
+		{
+			const unsigned char* row0 = source + std::min(y * 2, height - 1) * rowSize;
+			const unsigned char* row1 = source + std::min(y * 2 + 1, height - 1) * rowSize;
+			unsigned char* row = destination + size_t(y) * destinationWidth * 4;
+#ifdef GPS_X86
+			//SSE2 has no gather - the table lookups dominate, so it shares the scalar path
+			if (level == SIMD_AVX2)
+				DownsampleRowAVX2(row0, row1, width, destinationWidth, row);
+			else
+#endif
+				DownsampleRowScalar(row0, row1, width, destinationWidth, 0, row);
+		}
+	}
+
+	//--- sRGB Kaiser downsample
+
+	static double BesselI0(double x)
+	{
+		double sum = 1.0, term = 1.0;
+		for (int k = 1; k < 32; k++)
+		{
+			term *= (x / (2.0 * k)) * (x / (2.0 * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	//6 taps at -2.5 .. 2.5 source pixels around the destination pixel center
+	static const int KAISER_TAPS = 6;
+
+	static void KaiserWeights(float weights[KAISER_TAPS])
+	{
+		const double beta = 4.0;
+		const double radius = 3.0;
+		const double pi = 3.14159265358979323846;
+		double total = 0.0;
+		double values[KAISER_TAPS];
+		for (int k = 0; k < KAISER_TAPS; k++)
+		{
+			double distance = k - 2.5;
+			double argument = pi * distance / 2.0;
+			double sinc = sin(argument) / argument;
+			double ratio = distance / radius;
+			double window = BesselI0(beta * sqrt(1.0 - ratio * ratio)) / BesselI0(beta);
+			values[k] = sinc * window;
+			total += values[k];
+		}
+		for (int k = 0; k < KAISER_TAPS; k++)
+			weights[k] = float(values[k] / total);
+	}
+
+	//channels per sample: color premultiplied by weight, weight, alpha
+	static const int KAISER_CHANNELS = 5;
+
+	static void KaiserPass(const std::vector<float>& source, int count, int stride, int lines, int lineStride,
+		const float weights[KAISER_TAPS], std::vector<float>& destination, int destinationStride, int destinationLineStride)
+	{
+		const int destinationCount = count / 2;
+		for (int line = 0; line < lines; line++)
+		{
+			for (int i = 0; i < destinationCount; i++)
+			{
+				float sum[KAISER_CHANNELS] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+				for (int k = 0; k < KAISER_TAPS; k++)
+				{
+					int position = std::min(std::max(i * 2 - 2 + k, 0), count - 1);
+					const float* sample = &source[size_t(line) * lineStride + size_t(position) * stride];
+					for (int c = 0; c < KAISER_CHANNELS; c++)
+						sum[c] += weights[k] * sample[c];
+				}
+				float* output = &destination[size_t(line) * destinationLineStride + size_t(i) * destinationStride];
+				for (int c = 0; c < KAISER_CHANNELS; c++)
+					output[c] = sum[c];
+			}
+		}
+	}
+
+	void DownsampleKaiserSRGB(const unsigned char* source, int width, int height, unsigned char* destination)
+	{
+		const SRGBTables& tables = Tables();
+		float weights[KAISER_TAPS];
+		KaiserWeights(weights);
+
+		//transparent texels keep a tiny weight, so fully transparent areas still get an average color
+		const float minimumWeight = 1.0f / 1024.0f;
+		std::vector<float> samples(size_t(width) * height * KAISER_CHANNELS);
+		for (size_t i = 0, count = size_t(width) * height; i < count; i++)
+		{
+			const unsigned char* pixel = source + i * 4;
+			float alpha = pixel[3] / 255.0f;
+			float weight = alpha + minimumWeight;
+			float* sample = &samples[i * KAISER_CHANNELS];
+			for (int c = 0; c < 3; c++)
+				sample[c] = tables.toLinearFloat[pixel[c]] * weight;
+			sample[3] = weight;
+			sample[4] = alpha;
+		}
+
+		int currentWidth = width;
+		if (width > 1)
+		{
+			std::vector<float> horizontal(size_t(width / 2) * height * KAISER_CHANNELS);
+			KaiserPass(samples, width, KAISER_CHANNELS, height, width * KAISER_CHANNELS, weights,
+				horizontal, KAISER_CHANNELS, (width / 2) * KAISER_CHANNELS);
+			samples.swap(horizontal);
+			currentWidth = width / 2;
+		}
+		if (height > 1)
+		{
+			std::vector<float> vertical(size_t(currentWidth) * (height / 2) * KAISER_CHANNELS);
+			KaiserPass(samples, height, currentWidth * KAISER_CHANNELS, currentWidth, KAISER_CHANNELS, weights,
+				vertical, currentWidth * KAISER_CHANNELS, KAISER_CHANNELS);
+			samples.swap(vertical);
+		}
+
+		const int destinationHeight = height > 1 ? height / 2 : 1;
+		for (size_t i = 0, count = size_t(currentWidth) * destinationHeight; i < count; i++)
+		{
+			const float* sample = &samples[i * KAISER_CHANNELS];
+			unsigned char* pixel = destination + i * 4;
+			for (int c = 0; c < 3; c++)
+			{
+				float linear = sample[3] > 0.0f ? sample[c] / sample[3] : 0.0f;
+				linear = std::min(std::max(linear, 0.0f), 1.0f);
+				pixel[c] = static_cast<unsigned char>(tables.toSRGB[int(linear * 65535.0f + 0.5f) >> 4]);
+			}
+			float alpha = std::min(std::max(sample[4], 0.0f), 1.0f);
+			pixel[3] = static_cast<unsigned char>(alpha * 255.0f + 0.5f);
+		}
+	}
+}
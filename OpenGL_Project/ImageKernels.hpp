@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+
+namespace gps
+{
+	// Instruction sets the image kernels can use, from slowest to fastest
+	enum SimdLevel
+	{
+		SIMD_SCALAR,
+		SIMD_SSE2, // byte shuffles (RGB -> RGBA) also need SSSE3
+		SIMD_AVX2
+	};
+
+	// Best level the CPU and OS support
+	SimdLevel DetectSimdLevel();
+
+	// Level used by the kernels - the detected one unless lowered, e.g. to compare paths in benchmarks
+	SimdLevel GetSimdLevel();
+	void SetSimdLevel(SimdLevel level);
+
+	const char* SimdLevelName(SimdLevel level);
+
+	// Swaps the rows top to bottom, so the first row of the file becomes the bottom one OpenGL expects
+	void FlipRows(unsigned char* pixels, int width, int height, int channels);
+
+	// Widens tightly packed RGB8 pixels to RGBA8 with opaque alpha
+	void ExpandRGBToRGBA(const unsigned char* rgb, unsigned char* rgba, size_t pixelCount);
+
+	// Multiplies the color of RGBA8 pixels by their alpha, rounded like (c * a + 127) / 255
+	void PremultiplyAlpha(unsigned char* rgba, size_t pixelCount);
+
+	// Halves an RGBA8 image with a 2x2 box filter. Color is averaged in linear space and weighted
+	// by alpha, so translucent texels do not bleed into their neighbours; alpha is averaged as is.
+	// The result is max(1, width / 2) x max(1, height / 2).
+	void DownsampleSRGB(const unsigned char* source, int width, int height, unsigned char* destination);
+
+	// Same as DownsampleSRGB with a 6-tap Kaiser-windowed sinc filter instead of the box - sharper,
+	// meant for offline baking (scalar only)
+	void DownsampleKaiserSRGB(const unsigned char* source, int width, int height, unsigned char* destination);
+}
@@ -0,0 +1,213 @@
+#include "KtxFile.hpp"
+#include <cstring>
+
+namespace gps
+{
+	static const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+	static const uint32_t KTX_ENDIANNESS = 0x04030201;
+	static const char SOURCE_STAMP_KEY[] = "gps.sourceStamp";
+	static const char ORIENTATION_KEY[] = "KTXorientation";
+	static const char ORIENTATION_VALUE[] = "S=r,T=u";
+
+	struct KtxHeader
+	{
+		unsigned char identifier[12];
+		uint32_t endianness;
+		uint32_t glType;
+		uint32_t glTypeSize;
+		uint32_t glFormat;
+		uint32_t glInternalFormat;
+		uint32_t glBaseInternalFormat;
+		uint32_t pixelWidth;
+		uint32_t pixelHeight;
+		uint32_t pixelDepth;
+		uint32_t numberOfArrayElements;
+		uint32_t numberOfFaces;
+		uint32_t numberOfMipmapLevels;
+		uint32_t bytesOfKeyValueData;
+	};
+
+	//GL_RGB, GL_RGBA, GL_RED, GL_RG
+	static uint32_t BaseInternalFormat(CompressedFormat format)
+	{
+		switch (format)
+		{
+		case COMPRESSED_BC1: return 0x1907;
+		case COMPRESSED_BC3: return 0x1908;
+		case COMPRESSED_BC4: return 0x1903;
+		default: return 0x8227;
+		}
+	}
+
+	static size_t Pad4(size_t value)
+	{
+		return (value + 3) & ~size_t(3);
+	}
+
+	static void AppendKeyValue(std::vector<unsigned char>& output, const char* key, const void* value, size_t valueSize)
+	{
+		uint32_t size = static_cast<uint32_t>(strlen(key) + 1 + valueSize);
+		const unsigned char* sizeBytes = reinterpret_cast<const unsigned char*>(&size);
+		output.insert(output.end(), sizeBytes, sizeBytes + sizeof(size));
+		output.insert(output.end(), key, key + strlen(key) + 1);
+		const unsigned char* valueBytes = static_cast<const unsigned char*>(value);
+		output.insert(output.end(), valueBytes, valueBytes + valueSize);
+		output.resize(Pad4(output.size()), 0);
+	}
+
+	KtxFile::KtxFile()
+		: format(COMPRESSED_BC1), hasSourceStamp(false)
+	{
+	}
+
+	std::string KtxFile::PathFor(const std::string& imageFileName)
+	{
+		return imageFileName + ".ktx";
+	}
+
+	bool KtxFile::Open(const std::string& path)
+	{
+		Close();
+
+		if (!file.Open(path) || file.Size() < sizeof(KtxHeader))
+		{
+			Close();
+			return false;
+		}
+
+		const unsigned char* data = file.Data();
+		const size_t size = file.Size();
+
+		KtxHeader header;
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 || header.endianness != KTX_ENDIANNESS ||
+			!IsCompressedFormat(header.glInternalFormat) || header.glType != 0 || header.pixelDepth != 0 ||
+			header.numberOfArrayElements != 0 || header.numberOfFaces != 1 || header.pixelWidth == 0 || header.pixelHeight == 0)
+		{
+			Close();
+			return false;
+		}
+		format = static_cast<CompressedFormat>(header.glInternalFormat);
+
+		size_t offset = sizeof(KtxHeader);
+		const size_t keyValueEnd = offset + header.bytesOfKeyValueData;
+		if (keyValueEnd > size)
+		{
+			Close();
+			return false;
+		}
+		while (offset + sizeof(uint32_t) <= keyValueEnd)
+		{
+			uint32_t pairSize;
+			memcpy(&pairSize, data + offset, sizeof(pairSize));
+			offset += sizeof(pairSize);
+			if (pairSize > keyValueEnd - offset)
+				break;
+
+			const char* key = reinterpret_cast<const char*>(data + offset);
+			size_t keySize = strlen(SOURCE_STAMP_KEY) + 1;
+			if (pairSize == keySize + sizeof(FileStamp) && memcmp(key, SOURCE_STAMP_KEY, keySize) == 0)
+			{
+				memcpy(&sourceStamp, data + offset + keySize, sizeof(FileStamp));
+				hasSourceStamp = true;
+			}
+			offset += Pad4(pairSize);
+		}
+		offset = keyValueEnd;
+
+		int width = static_cast<int>(header.pixelWidth);
+		int height = static_cast<int>(header.pixelHeight);
+		uint32_t levelCount = header.numberOfMipmapLevels ? header.numberOfMipmapLevels : 1;
+		for (uint32_t i = 0; i < levelCount; i++)
+		{
+			uint32_t imageSize;
+			if (offset + sizeof(imageSize) > size)
+			{
+				Close();
+				return false;
+			}
+			memcpy(&imageSize, data + offset, sizeof(imageSize));
+			offset += sizeof(imageSize);
+			if (imageSize != CompressedLevelSize(format, width, height) || imageSize > size - offset)
+			{
+				Close();
+				return false;
+			}
+
+			CompressedLevel level;
+			level.width = width;
+			level.height = height;
+			level.data = data + offset;
+			level.size = imageSize;
+			levels.push_back(level);
+
+			offset += Pad4(imageSize);
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+
+		return true;
+	}
+
+	void KtxFile::Close()
+	{
+		file.Close();
+		levels.clear();
+		hasSourceStamp = false;
+	}
+
+	size_t KtxFile::DataSize() const
+	{
+		size_t total = 0;
+		for (size_t i = 0; i < levels.size(); i++)
+			total += levels[i].size;
+		return total;
+	}
+
+	bool KtxFile::GetSourceStamp(FileStamp& stamp) const
+	{
+		if (!hasSourceStamp)
+			return false;
+		stamp = sourceStamp;
+		return true;
+	}
+
+	bool KtxFile::Write(const std::string& path, CompressedFormat format, const std::vector<CompressedLevel>& levels, const FileStamp& sourceStamp)
+	{
+		if (levels.empty())
+			return false;
+
+		std::vector<unsigned char> keyValueData;
+		AppendKeyValue(keyValueData, ORIENTATION_KEY, ORIENTATION_VALUE, sizeof(ORIENTATION_VALUE));
+		AppendKeyValue(keyValueData, SOURCE_STAMP_KEY, &sourceStamp, sizeof(sourceStamp));
+
+		KtxHeader header;
+		memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+		header.endianness = KTX_ENDIANNESS;
+		header.glType = 0;
+		header.glTypeSize = 1;
+		header.glFormat = 0;
+		header.glInternalFormat = format;
+		header.glBaseInternalFormat = BaseInternalFormat(format);
+		header.pixelWidth = levels[0].width;
+		header.pixelHeight = levels[0].height;
+		header.pixelDepth = 0;
+		header.numberOfArrayElements = 0;
+		header.numberOfFaces = 1;
+		header.numberOfMipmapLevels = static_cast<uint32_t>(levels.size());
+		header.bytesOfKeyValueData = static_cast<uint32_t>(keyValueData.size());
+
+		std::vector<unsigned char> output(reinterpret_cast<const unsigned char*>(&header), reinterpret_cast<const unsigned char*>(&header) + sizeof(header));
+		output.insert(output.end(), keyValueData.begin(), keyValueData.end());
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			uint32_t imageSize = static_cast<uint32_t>(levels[i].size);
+			const unsigned char* sizeBytes = reinterpret_cast<const unsigned char*>(&imageSize);
+			output.insert(output.end(), sizeBytes, sizeBytes + sizeof(imageSize));
+			output.insert(output.end(), levels[i].data, levels[i].data + levels[i].size);
+			output.resize(Pad4(output.size()), 0);
+		}
+
+		return WriteFileAtomic(path, output.data(), output.size());
+	}
+}
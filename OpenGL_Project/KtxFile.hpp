@@ -0,0 +1,53 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "BlockCompression.hpp"
+#include "FileUtils.hpp"
+
+namespace gps
+{
+	// One mip level of a compressed texture
+	struct CompressedLevel
+	{
+		int width;
+		int height;
+		const unsigned char* data;
+		size_t size;
+	};
+
+	// KTX 1.1 file holding a block-compressed 2D texture with its mip chain, stored bottom row
+	// first as OpenGL expects. Baked textures live next to their source as "<image>.ktx" and
+	// carry the stamp of the source image, so stale ones are ignored.
+	class KtxFile
+	{
+	public:
+		KtxFile();
+
+		static std::string PathFor(const std::string& imageFileName);
+
+		// Maps a .ktx file, checking the header and that every level is inside the file
+		bool Open(const std::string& path);
+		void Close();
+		bool IsOpen() const { return file.IsOpen(); }
+
+		CompressedFormat Format() const { return format; }
+		size_t LevelCount() const { return levels.size(); }
+		const CompressedLevel& Level(size_t i) const { return levels[i]; }
+		// Bytes of all the levels
+		size_t DataSize() const;
+
+		// Stamp of the image the texture was baked from, false if the file does not have one
+		bool GetSourceStamp(FileStamp& stamp) const;
+
+		// Writes the levels, largest first, tagging the file with the stamp of its source image
+		static bool Write(const std::string& path, CompressedFormat format, const std::vector<CompressedLevel>& levels, const FileStamp& sourceStamp);
+
+	private:
+		MappedFile file;
+		CompressedFormat format;
+		std::vector<CompressedLevel> levels;
+		bool hasSourceStamp;
+		FileStamp sourceStamp;
+	};
+}
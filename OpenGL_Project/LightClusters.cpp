@@ -0,0 +1,106 @@
+#include "LightClusters.hpp"
+#include "GLStateCache.hpp"
+
+namespace gps
+{
+	LightClusters::LightClusters()
+		: lightCount(0), lightBuffer(0), lightTexture(0), rangeBuffer(0), rangeTexture(0), indexBuffer(0), indexTexture(0)
+	{
+	}
+
+	static void CreateBufferTexture(GLenum format, GLuint& buffer, GLuint& texture)
+	{
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		//the texture follows the buffer through every later glBufferData, it is attached once
+		glGenTextures(1, &texture);
+		GLStateCache::Instance().BindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+		GLStateCache::Instance().BindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+
+	void LightClusters::Init(const ClusterSettings& settings)
+	{
+		grid.Reset(settings);
+		CreateBufferTexture(GL_RGBA32F, lightBuffer, lightTexture);
+		CreateBufferTexture(GL_RG32UI, rangeBuffer, rangeTexture);
+		CreateBufferTexture(GL_R32UI, indexBuffer, indexTexture);
+	}
+
+	void LightClusters::Destroy()
+	{
+		GLuint textures[] = { lightTexture, rangeTexture, indexTexture };
+		for (int i = 0; i < 3; i++)
+		{
+			if (textures[i] != 0)
+				GLStateCache::Instance().DeleteTexture(textures[i]);
+		}
+		GLuint buffers[] = { lightBuffer, rangeBuffer, indexBuffer };
+		glDeleteBuffers(3, buffers);
+		lightTexture = rangeTexture = indexTexture = 0;
+		lightBuffer = rangeBuffer = indexBuffer = 0;
+	}
+
+	void LightClusters::Upload(GLuint buffer, const void* data, size_t size)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+		//orphaned, as the uniform buffers - last frame may still be shading from the old lists
+		glBufferData(GL_TEXTURE_BUFFER, glm::max(size, size_t(16)), NULL, GL_STREAM_DRAW);
+		if (size > 0)
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+	}
+
+	void LightClusters::Update(const std::vector<ClusterLight>& lights, const glm::mat4& view, float fov, float aspect, float farPlane)
+	{
+		spheres.resize(lights.size());
+		for (size_t i = 0; i < lights.size(); i++)
+			spheres[i] = lights[i].positionRange;
+		grid.Bin(spheres, view, fov, aspect, farPlane);
+		lightCount = lights.size();
+
+		if (lightBuffer == 0)
+			return;
+		const std::vector<glm::uvec2>& ranges = grid.Ranges();
+		const std::vector<uint32_t>& indices = grid.Indices();
+		Upload(lightBuffer, lights.empty() ? NULL : &lights[0], lights.size() * sizeof(ClusterLight));
+		Upload(rangeBuffer, &ranges[0], ranges.size() * sizeof(glm::uvec2));
+		Upload(indexBuffer, indices.empty() ? NULL : &indices[0], indices.size() * sizeof(uint32_t));
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	}
+
+	glm::vec4 LightClusters::Params(int width, int height) const
+	{
+		return glm::vec4(float(grid.TilesX()) / glm::max(width, 1), float(grid.TilesY()) / glm::max(height, 1),
+			grid.SliceScale(), grid.NearSplit());
+	}
+
+	glm::ivec4 LightClusters::GridSize() const
+	{
+		return glm::ivec4(grid.TilesX(), grid.TilesY(), grid.Slices(), int(lightCount));
+	}
+
+	void LightClusters::Bind(GLuint firstUnit) const
+	{
+		GLStateCache& glState = GLStateCache::Instance();
+		glState.BindTextureUnit(firstUnit, GL_TEXTURE_BUFFER, lightTexture);
+		glState.BindTextureUnit(firstUnit + 1, GL_TEXTURE_BUFFER, rangeTexture);
+		glState.BindTextureUnit(firstUnit + 2, GL_TEXTURE_BUFFER, indexTexture);
+	}
+
+	size_t LightClusters::MaxClusterLights() const
+	{
+		size_t longest = 0;
+		const std::vector<glm::uvec2>& ranges = grid.Ranges();
+		for (size_t c = 0; c < ranges.size(); c++)
+			longest = glm::max(longest, size_t(ranges[c].y));
+		return longest;
+	}
+
+	size_t LightClusters::MemoryBytes() const
+	{
+		return lightCount * sizeof(ClusterLight) + grid.Ranges().size() * sizeof(glm::uvec2) + grid.Indices().size() * sizeof(uint32_t);
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <vector>
+
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+
+#include "ClusterGrid.hpp"
+
+namespace gps
+{
+	// One point light as the object shaders read it - five RGBA32F texels of the light buffer
+	struct ClusterLight
+	{
+		//world position, then the distance where the light ends
+		glm::vec4 positionRange;
+		//color, then the constant attenuation
+		glm::vec4 colorConstant;
+		//ambient, then the linear attenuation
+		glm::vec4 ambientLinear;
+		//diffuse, then the quadratic attenuation
+		glm::vec4 diffuseQuadratic;
+		//specular, then the light of its shadow in PointShadows, -1 without one
+		glm::vec4 specularShadow;
+	};
+
+	static_assert(sizeof(ClusterLight) == 80, "ClusterLight does not match the five texels of the light buffer");
+
+	// Clustered forward lighting: every frame the point lights are binned into the clusters of a ClusterGrid, and
+	// the lights, the offset and count of every cluster and the light indices of the clusters are sent as three
+	// buffer textures. A fragment finds its cluster from its window position and view depth and shades with the
+	// lights of that cluster only. The context is GL 4.0, so the lists are texel buffers rather than storage buffers.
+	class LightClusters
+	{
+	public:
+		static const int LIGHT_TEXELS = 5;
+
+		LightClusters();
+
+		// Creates the buffers and their buffer textures
+		void Init(const ClusterSettings& settings);
+		void Destroy();
+
+		// Bins the lights for the camera and sends them with the lists of the clusters - once per frame
+		void Update(const std::vector<ClusterLight>& lights, const glm::mat4& view, float fov, float aspect, float farPlane);
+
+		// Clusters per pixel across and up, then the slice scale and near split - clusterParams of the frame uniforms
+		glm::vec4 Params(int width, int height) const;
+		// Tiles across and up, slices and the light count - clusterGrid of the frame uniforms
+		glm::ivec4 GridSize() const;
+
+		// The light, range and index buffer textures on three units from firstUnit
+		void Bind(GLuint firstUnit) const;
+
+		const ClusterGrid& Grid() const { return grid; }
+		size_t LightCount() const { return lightCount; }
+		// Longest list of any cluster in the last Update
+		size_t MaxClusterLights() const;
+		size_t MemoryBytes() const;
+
+	private:
+		LightClusters(const LightClusters&) = delete;
+		LightClusters& operator=(const LightClusters&) = delete;
+
+		ClusterGrid grid;
+		std::vector<glm::vec4> spheres;
+		size_t lightCount;
+		GLuint lightBuffer;
+		GLuint lightTexture;
+		GLuint rangeBuffer;
+		GLuint rangeTexture;
+		GLuint indexBuffer;
+		GLuint indexTexture;
+
+		// Sends size bytes to a buffer, orphaning the old storage - never empty, a texture buffer needs a store
+		static void Upload(GLuint buffer, const void* data, size_t size);
+	};
+}
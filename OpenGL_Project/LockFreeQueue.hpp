@@ -0,0 +1,101 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace gps
+{
+	// Bounded multi-producer multi-consumer queue (Vyukov). Each cell carries a sequence number
+	// telling producers and consumers whose turn it is, so no locks are taken on either side.
+	template <typename T>
+	class LockFreeQueue
+	{
+	public:
+		// Capacity is rounded up to a power of two
+		explicit LockFreeQueue(size_t capacity = 64)
+		{
+			size_t size = 2;
+			while (size < capacity)
+				size *= 2;
+			mask = size - 1;
+			cells.reset(new Cell[size]);
+			for (size_t i = 0; i < size; i++)
+				cells[i].sequence.store(i, std::memory_order_relaxed);
+			enqueuePosition.store(0, std::memory_order_relaxed);
+			dequeuePosition.store(0, std::memory_order_relaxed);
+		}
+
+		// Returns false when the queue is full
+		bool Push(const T& value)
+		{
+			size_t position = enqueuePosition.load(std::memory_order_relaxed);
+			Cell* cell;
+			for (;;)
+			{
+				cell = &cells[position & mask];
+				size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+				if (difference == 0)
+				{
+					if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+					return false;
+				else
+					position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+			cell->data = value;
+			cell->sequence.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Returns false when the queue is empty
+		bool Pop(T& value)
+		{
+			size_t position = dequeuePosition.load(std::memory_order_relaxed);
+			Cell* cell;
+			for (;;)
+			{
+				cell = &cells[position & mask];
+				size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+				if (difference == 0)
+				{
+					if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+					return false;
+				else
+					position = dequeuePosition.load(std::memory_order_relaxed);
+			}
+			value = cell->data;
+			cell->sequence.store(position + mask + 1, std::memory_order_release);
+			return true;
+		}
+
+	private:
+		LockFreeQueue(const LockFreeQueue&) = delete;
+		LockFreeQueue& operator=(const LockFreeQueue&) = delete;
+
+		struct Cell
+		{
+			std::atomic<size_t> sequence;
+			T data;
+		};
+
+		//producers and consumers work on separate cache lines
+		static const size_t CACHE_LINE_SIZE = 64;
+
+		char padding0[CACHE_LINE_SIZE];
+		std::unique_ptr<Cell[]> cells;
+		size_t mask;
+		char padding1[CACHE_LINE_SIZE];
+		std::atomic<size_t> enqueuePosition;
+		char padding2[CACHE_LINE_SIZE];
+		std::atomic<size_t> dequeuePosition;
+		char padding3[CACHE_LINE_SIZE];
+	};
+}
@@ -7,57 +7,202 @@
 //
 
 #include "Mesh.hpp"
+#include "GeometryArena.hpp"
+#include "GLStateCache.hpp"
 namespace gps {
 
+	bool Mesh::depthStreamEnabled = true;
+
 	/* Mesh Constructor */
 	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
 		this->textures = textures;
+		this->vertexCount = vertices.size();
+		this->indexCount = indices.size();
+		this->ComputeMaterialKey();
+		this->ComputeBounds(vertices.empty() ? NULL : &vertices[0], vertices.size());
+
+		this->setupMesh(vertices.empty() ? NULL : &vertices[0], vertices.size(), indices.empty() ? NULL : &indices[0]);
+	}
+
+	Mesh::Mesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, std::vector<Texture> textures)
+	{
+		this->textures = textures;
+		this->vertexCount = vertexCount;
+		this->indexCount = indexCount;
+		this->ComputeMaterialKey();
+		this->ComputeBounds(vertices, vertexCount);
 
-		this->setupMesh();
+		this->setupMesh(vertices, vertexCount, indices);
 	}
 
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(const gps::Shader& shader)
 	{
 		shader.useShaderProgram();
 
 		//set textures
+		BindTextures(shader);
+		GLint layersLocation = TextureLocations(shader).materialLayers;
+		if (layersLocation >= 0)
+			glUniform4fv(layersLocation, 1, &materialLayers[0]);
+
+		//the VAO and textures stay bound, the next mesh rebinds only what differs
+		GLStateCache::Instance().BindVertexArray(this->VAO);
+		glDrawElementsBaseVertex(GL_TRIANGLES, this->indexCount, GL_UNSIGNED_INT, IndexOffset(), this->baseVertex);
+	}
+
+	GLuint Mesh::BindTextures(const gps::Shader& shader) const
+	{
+		const std::vector<GLint>& locations = TextureLocations(shader).locations;
 		for (GLuint i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			glUniform1i(locations[i], i);
+			GLStateCache::Instance().BindTextureUnit(i, GL_TEXTURE_2D_ARRAY, this->textures[i].id);
+		}
+		return GLuint(textures.size());
+	}
+
+	void Mesh::ComputeMaterialKey()
+	{
+		//the layers differ from mesh to mesh, the arrays bound do not
+		materialLayers = glm::vec4(0.0f);
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			if (textures[i].type == "material.ambient")
+				materialLayers.x = float(textures[i].layer);
+			else if (textures[i].type == "material.diffuse")
+				materialLayers.y = float(textures[i].layer);
+			else if (textures[i].type == "material.specular")
+				materialLayers.z = float(textures[i].layer);
+		}
+
+		//FNV-1a over the GL ids of the texture arrays, in unit order
+		materialKey = 0;
+		if (textures.empty())
+			return;
+
+		materialKey = 14695981039346656037ull;
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			materialKey ^= textures[i].id;
+			materialKey *= 1099511628211ull;
+		}
+	}
+
+	void Mesh::ComputeBounds(const Vertex* vertices, GLuint vertexCount)
+	{
+		bounds = BoundingBox();
+		for (GLuint v = 0; v < vertexCount; v++)
+			bounds.Add(vertices[v].Position);
+		sphere = BoundingSphere::Around(bounds, vertexCount > 0 ? &vertices[0].Position : NULL, vertexCount, sizeof(Vertex));
+	}
+
+	const Mesh::ProgramTextureLocations& Mesh::TextureLocations(const gps::Shader& shader) const
+	{
+		//a mesh is drawn with a couple of programs at most
+		for (size_t p = 0; p < textureLocations.size(); p++)
+		{
+			if (textureLocations[p].program == shader.shaderProgram)
+				return textureLocations[p];
+		}
+
+		ProgramTextureLocations entry;
+		entry.program = shader.shaderProgram;
+		for (size_t i = 0; i < textures.size(); i++)
+			entry.locations.push_back(shader.GetUniformLocation(textures[i].type));
+		entry.materialLayers = shader.GetUniformLocation("materialLayers");
+		textureLocations.push_back(entry);
+		return textureLocations.back();
+	}
+
+	GLuint Mesh::CreateInstancedVertexArray(GLuint instanceBuffer) const
+	{
+		GLuint instancedVAO;
+		glGenVertexArrays(1, &instancedVAO);
+		GLStateCache::Instance().BindVertexArray(instancedVAO);
+
+		//same layout as setupMesh, over the same buffers
+		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+
+		//a mat4 attribute takes four locations, one column each, advancing once per instance
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(3 + column);
+			glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(sizeof(glm::vec4) * column));
+			glVertexAttribDivisor(3 + column, 1);
 		}
 
-		glBindVertexArray(this->VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+		GLStateCache::Instance().BindVertexArray(0);
+		return instancedVAO;
+	}
+
+	GLuint Mesh::CreateInstancedDepthVertexArray(GLuint instanceBuffer) const
+	{
+		if (!depthStreamEnabled)
+			return CreateInstancedVertexArray(instanceBuffer);
+
+		GLuint instancedVAO;
+		glGenVertexArrays(1, &instancedVAO);
+		GLStateCache::Instance().BindVertexArray(instancedVAO);
+
+		glBindBuffer(GL_ARRAY_BUFFER, this->positionVBO);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
 
-        for(GLuint i = 0; i < this->textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(3 + column);
+			glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(sizeof(glm::vec4) * column));
+			glVertexAttribDivisor(3 + column, 1);
+		}
 
-    }
+		GLStateCache::Instance().BindVertexArray(0);
+		return instancedVAO;
+	}
 
 	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh(){
+	void Mesh::setupMesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices){
+		if (GeometryArena::Instance().IsEnabled())
+		{
+			ArenaRange range;
+			GeometryArena::Instance().Allocate(vertices, vertexCount, indices, this->indexCount, range);
+			this->VAO = range.vao;
+			this->VBO = range.vertexBuffer;
+			this->EBO = range.indexBuffer;
+			this->depthVAO = range.depthVao;
+			this->positionVBO = range.positionBuffer;
+			this->baseVertex = range.baseVertex;
+			this->firstIndex = range.firstIndex;
+			this->inArena = true;
+			return;
+		}
+
+		this->baseVertex = 0;
+		this->firstIndex = 0;
+		this->inArena = false;
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->VAO);
 		glGenBuffers(1, &this->VBO);
 		glGenBuffers(1, &this->EBO);
 
-		glBindVertexArray(this->VAO);
+		GLStateCache::Instance().BindVertexArray(this->VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indexCount * sizeof(GLuint), indices, GL_STATIC_DRAW);
 
 		// Set the vertex attribute pointers
 		// Vertex Positions
@@ -70,7 +215,26 @@ namespace gps {
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
 
-		glBindVertexArray(0);
+		this->depthVAO = this->VAO;
+		this->positionVBO = this->VBO;
+		if (depthStreamEnabled)
+		{
+			std::vector<glm::vec3> positions(vertexCount);
+			for (GLuint v = 0; v < vertexCount; v++)
+				positions[v] = vertices[v].Position;
+
+			glGenVertexArrays(1, &this->depthVAO);
+			glGenBuffers(1, &this->positionVBO);
+			GLStateCache::Instance().BindVertexArray(this->depthVAO);
+			glBindBuffer(GL_ARRAY_BUFFER, this->positionVBO);
+			glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(glm::vec3), positions.empty() ? NULL : &positions[0], GL_STATIC_DRAW);
+			//the indices are shared with the full VAO
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+		}
+
+		GLStateCache::Instance().BindVertexArray(0);
 	}
 
 }
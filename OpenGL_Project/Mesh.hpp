@@ -10,11 +10,13 @@
 #define Mesh_hpp
 
 #include <stdio.h>
+#include <stdint.h>
 #include "glm/glm.hpp"
 #include "GLEW/glew.h"
 #include <string>
 #include <vector>
 #include "Shader.hpp"
+#include "BoundingBox.hpp"
 
 namespace gps {
 
@@ -27,7 +29,10 @@ struct Vertex
 
 struct Texture
 {
+    //GL_TEXTURE_2D_ARRAY holding the texture
     GLuint id;
+    //layer of the texture in the array
+    GLuint layer;
     //ambientTexture, diffuseTexture, specularTexture
     std::string type;
     std::string path;
@@ -43,20 +48,87 @@ struct Material
 class Mesh
 {
 public:
-    std::vector<Vertex> vertices;
-    std::vector<GLuint> indices;
+    // Attribute location of the per-instance material layers, see MaterialLayers
+    static const GLuint MATERIAL_LAYERS_ATTRIBUTE = 7;
+
     std::vector<Texture> textures;
 
 	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
-	void Draw(gps::Shader shader);
+	// Uploads the geometry straight from memory the mesh does not own (e.g. a mapped cache file)
+	Mesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, std::vector<Texture> textures);
+
+	void Draw(const gps::Shader& shader);
+
+	// Binds the texture arrays to units 0..n-1 and points the program's samplers at them, returns the number of textures bound
+	GLuint BindTextures(const gps::Shader& shader) const;
+	GLuint VertexArray() const { return VAO; }
+	// VAO of the depth passes: only the positions, tightly packed (12 bytes a vertex instead of 32), over the same
+	// indices. The full VAO when the depth stream is off.
+	GLuint DepthVertexArray() const { return depthVAO; }
+	// New VAO over the mesh buffers with a per-instance model matrix at locations 3-6, read from instanceBuffer
+	GLuint CreateInstancedVertexArray(GLuint instanceBuffer) const;
+	// Same over the position stream, for the instanced depth program
+	GLuint CreateInstancedDepthVertexArray(GLuint instanceBuffer) const;
+	GLuint VertexCount() const { return vertexCount; }
+	GLuint IndexCount() const { return indexCount; }
+	// Offsets of the mesh in its buffers - both 0 unless it lives in the geometry arena
+	GLint BaseVertex() const { return baseVertex; }
+	GLuint FirstIndex() const { return firstIndex; }
+	// Byte offset of the first index, as passed to the draw calls
+	const GLvoid* IndexOffset() const { return (const GLvoid*)(size_t(firstIndex) * sizeof(GLuint)); }
+	bool InArena() const { return inArena; }
+	// Size of the vertex and index buffers, the position stream included
+	size_t GeometryBytes() const
+	{
+		return vertexCount * (sizeof(Vertex) + (depthStreamEnabled ? sizeof(glm::vec3) : 0)) + indexCount * sizeof(GLuint);
+	}
+	// Same for meshes using the same texture arrays, 0 for a mesh without textures
+	uint64_t MaterialKey() const { return materialKey; }
+	// Layers of the ambient, diffuse and specular textures in their arrays - read by the shaders from the
+	// "materialLayers" uniform, or from the attribute at MATERIAL_LAYERS_ATTRIBUTE when drawn as an instance
+	const glm::vec4& MaterialLayers() const { return materialLayers; }
+	// Model space bounds of the vertices
+	const BoundingBox& Bounds() const { return bounds; }
+	const BoundingSphere& Sphere() const { return sphere; }
+
+	// Off, the depth passes read the full vertices - set before any mesh is created (for comparisons)
+	static void EnableDepthStream(bool enabled) { depthStreamEnabled = enabled; }
+	static bool DepthStreamEnabled() { return depthStreamEnabled; }
 
 private:
+    static bool depthStreamEnabled;
+
     /*  Render data  */
     GLuint VAO, VBO, EBO;
+    // VAO and VBO of the position-only stream - the same as VAO and VBO when the stream is off
+    GLuint depthVAO, positionVBO;
+    GLuint vertexCount;
+    GLuint indexCount;
+    GLint baseVertex;
+    GLuint firstIndex;
+    bool inArena;
+    uint64_t materialKey;
+    glm::vec4 materialLayers;
+    BoundingBox bounds;
+    BoundingSphere sphere;
+
+	// Sampler locations of the textures and the "materialLayers" location in one program, resolved the first time
+	// the mesh is drawn with it
+	struct ProgramTextureLocations
+	{
+		GLuint program;
+		std::vector<GLint> locations;
+		GLint materialLayers;
+	};
+	mutable std::vector<ProgramTextureLocations> textureLocations;
+
+	const ProgramTextureLocations& TextureLocations(const gps::Shader& shader) const;
+	void ComputeMaterialKey();
+	void ComputeBounds(const Vertex* vertices, GLuint vertexCount);
 
-	// Initializes all the buffer objects/arrays
-	void setupMesh();
+	// Initializes all the buffer objects/arrays, or places the geometry in the arena when it is enabled
+	void setupMesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices);
 
 };
 
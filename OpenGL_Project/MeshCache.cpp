@@ -0,0 +1,288 @@
+#include "MeshCache.hpp"
+#include <cstring>
+
+namespace gps
+{
+	static const char MESH_CACHE_MAGIC[8] = { 'G', 'P', 'S', 'M', 'E', 'S', 'H', '\0' };
+
+	struct MeshCacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t dependencyCount;
+		uint32_t shapeCount;
+		uint32_t textureCount;
+		uint32_t stringsSize;
+	};
+
+	struct DependencyRecord
+	{
+		uint64_t size;
+		int64_t mtime;
+		uint64_t hash;
+		uint32_t pathOffset;
+		uint32_t pathLength;
+	};
+
+	struct ShapeRecord
+	{
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint32_t vertexCount;
+		uint32_t indexCount;
+		uint32_t firstTexture;
+		uint32_t textureCount;
+	};
+
+	struct TextureRecord
+	{
+		uint32_t pathOffset;
+		uint32_t pathLength;
+		uint32_t typeOffset;
+		uint32_t typeLength;
+	};
+
+	static size_t AlignUp(size_t value, size_t alignment)
+	{
+		return (value + alignment - 1) & ~(alignment - 1);
+	}
+
+	// Collects the .mtl libraries an .obj file refers to, resolved like tinyobj::MaterialFileReader does
+	static void FindMaterialLibraries(const std::string& objFileName, const std::string& basePath, std::vector<std::string>& libraries)
+	{
+		MappedFile obj;
+		if (!obj.Open(objFileName) || obj.Size() == 0)
+			return;
+
+		const char* text = reinterpret_cast<const char*>(obj.Data());
+		const char* end = text + obj.Size();
+		const char* line = text;
+		while (line < end)
+		{
+			const char* lineEnd = static_cast<const char*>(memchr(line, '\n', end - line));
+			if (!lineEnd)
+				lineEnd = end;
+
+			const char* token = line;
+			while (token < lineEnd && (*token == ' ' || *token == '\t'))
+				token++;
+			if (lineEnd - token > 7 && strncmp(token, "mtllib", 6) == 0 && (token[6] == ' ' || token[6] == '\t'))
+			{
+				token += 7;
+				while (token < lineEnd && (*token == ' ' || *token == '\t'))
+					token++;
+				const char* nameEnd = token;
+				while (nameEnd < lineEnd && *nameEnd != ' ' && *nameEnd != '\t' && *nameEnd != '\r')
+					nameEnd++;
+				if (nameEnd > token)
+					libraries.push_back(basePath + std::string(token, nameEnd));
+			}
+
+			line = lineEnd + 1;
+		}
+	}
+
+	std::string MeshCache::PathFor(const std::string& objFileName)
+	{
+		return objFileName + ".gpsmesh";
+	}
+
+	bool MeshCache::Open(const std::string& objFileName)
+	{
+		Close();
+
+		if (!file.Open(PathFor(objFileName)) || file.Size() < sizeof(MeshCacheHeader))
+		{
+			Close();
+			return false;
+		}
+
+		const unsigned char* data = file.Data();
+		const size_t size = file.Size();
+
+		MeshCacheHeader header;
+		memcpy(&header, data, sizeof(header));
+		if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+			header.version != MESH_CACHE_VERSION || header.vertexSize != sizeof(Vertex))
+		{
+			Close();
+			return false;
+		}
+
+		const size_t dependenciesOffset = sizeof(MeshCacheHeader);
+		const size_t shapesOffset = dependenciesOffset + header.dependencyCount * sizeof(DependencyRecord);
+		const size_t texturesOffset = shapesOffset + header.shapeCount * sizeof(ShapeRecord);
+		const size_t stringsOffset = texturesOffset + header.textureCount * sizeof(TextureRecord);
+		if (stringsOffset + header.stringsSize > size)
+		{
+			Close();
+			return false;
+		}
+		const char* strings = reinterpret_cast<const char*>(data + stringsOffset);
+
+		//the cache is only valid while every source file is unchanged
+		for (uint32_t i = 0; i < header.dependencyCount; ++i)
+		{
+			DependencyRecord record;
+			memcpy(&record, data + dependenciesOffset + i * sizeof(DependencyRecord), sizeof(record));
+			if (uint64_t(record.pathOffset) + record.pathLength > header.stringsSize)
+			{
+				Close();
+				return false;
+			}
+
+			FileStamp stamp;
+			stamp.size = record.size;
+			stamp.mtime = record.mtime;
+			stamp.hash = record.hash;
+			if (!IsFileStampCurrent(std::string(strings + record.pathOffset, record.pathLength), stamp))
+			{
+				Close();
+				return false;
+			}
+		}
+
+		for (uint32_t i = 0; i < header.shapeCount; ++i)
+		{
+			ShapeRecord record;
+			memcpy(&record, data + shapesOffset + i * sizeof(ShapeRecord), sizeof(record));
+			if (record.vertexOffset + uint64_t(record.vertexCount) * sizeof(Vertex) > size ||
+				record.indexOffset + uint64_t(record.indexCount) * sizeof(GLuint) > size ||
+				uint64_t(record.firstTexture) + record.textureCount > header.textureCount)
+			{
+				Close();
+				return false;
+			}
+
+			CachedShape shape;
+			shape.vertices = reinterpret_cast<const Vertex*>(data + record.vertexOffset);
+			shape.vertexCount = record.vertexCount;
+			shape.indices = reinterpret_cast<const GLuint*>(data + record.indexOffset);
+			shape.indexCount = record.indexCount;
+
+			for (uint32_t t = 0; t < record.textureCount; ++t)
+			{
+				TextureRecord texture;
+				memcpy(&texture, data + texturesOffset + (record.firstTexture + t) * sizeof(TextureRecord), sizeof(texture));
+				if (uint64_t(texture.pathOffset) + texture.pathLength > header.stringsSize ||
+					uint64_t(texture.typeOffset) + texture.typeLength > header.stringsSize)
+				{
+					Close();
+					return false;
+				}
+
+				TextureRef ref;
+				ref.path = std::string(strings + texture.pathOffset, texture.pathLength);
+				ref.type = std::string(strings + texture.typeOffset, texture.typeLength);
+				shape.textures.push_back(ref);
+			}
+
+			shapes.push_back(shape);
+		}
+
+		return true;
+	}
+
+	void MeshCache::Close()
+	{
+		shapes.clear();
+		file.Close();
+	}
+
+	bool MeshCache::Write(const std::string& objFileName, const std::string& basePath, const std::vector<ShapeData>& shapeData)
+	{
+		std::vector<std::string> dependencies;
+		dependencies.push_back(objFileName);
+		FindMaterialLibraries(objFileName, basePath, dependencies);
+
+		std::string strings;
+		std::vector<DependencyRecord> dependencyRecords;
+		for (size_t i = 0; i < dependencies.size(); ++i)
+		{
+			FileStamp stamp;
+			if (!GetFileStamp(dependencies[i], stamp, true))
+				continue; //a missing .mtl is not fatal for tinyobj either
+
+			DependencyRecord record;
+			record.size = stamp.size;
+			record.mtime = stamp.mtime;
+			record.hash = stamp.hash;
+			record.pathOffset = static_cast<uint32_t>(strings.size());
+			record.pathLength = static_cast<uint32_t>(dependencies[i].size());
+			strings += dependencies[i];
+			dependencyRecords.push_back(record);
+		}
+
+		std::vector<TextureRecord> textureRecords;
+		std::vector<ShapeRecord> shapeRecords(shapeData.size());
+		for (size_t s = 0; s < shapeData.size(); ++s)
+		{
+			shapeRecords[s].firstTexture = static_cast<uint32_t>(textureRecords.size());
+			shapeRecords[s].textureCount = static_cast<uint32_t>(shapeData[s].textures.size());
+			for (size_t t = 0; t < shapeData[s].textures.size(); ++t)
+			{
+				const TextureRef& ref = shapeData[s].textures[t];
+				TextureRecord record;
+				record.pathOffset = static_cast<uint32_t>(strings.size());
+				record.pathLength = static_cast<uint32_t>(ref.path.size());
+				strings += ref.path;
+				record.typeOffset = static_cast<uint32_t>(strings.size());
+				record.typeLength = static_cast<uint32_t>(ref.type.size());
+				strings += ref.type;
+				textureRecords.push_back(record);
+			}
+		}
+
+		MeshCacheHeader header;
+		memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+		header.version = MESH_CACHE_VERSION;
+		header.vertexSize = sizeof(Vertex);
+		header.dependencyCount = static_cast<uint32_t>(dependencyRecords.size());
+		header.shapeCount = static_cast<uint32_t>(shapeRecords.size());
+		header.textureCount = static_cast<uint32_t>(textureRecords.size());
+		header.stringsSize = static_cast<uint32_t>(strings.size());
+
+		//geometry goes after the tables, 16-byte aligned so it can be used straight from the mapping
+		size_t offset = sizeof(MeshCacheHeader) + dependencyRecords.size() * sizeof(DependencyRecord) +
+			shapeRecords.size() * sizeof(ShapeRecord) + textureRecords.size() * sizeof(TextureRecord) + strings.size();
+		for (size_t s = 0; s < shapeData.size(); ++s)
+		{
+			offset = AlignUp(offset, 16);
+			shapeRecords[s].vertexOffset = offset;
+			shapeRecords[s].vertexCount = static_cast<uint32_t>(shapeData[s].vertices.size());
+			offset += shapeData[s].vertices.size() * sizeof(Vertex);
+
+			offset = AlignUp(offset, 16);
+			shapeRecords[s].indexOffset = offset;
+			shapeRecords[s].indexCount = static_cast<uint32_t>(shapeData[s].indices.size());
+			offset += shapeData[s].indices.size() * sizeof(GLuint);
+		}
+
+		std::vector<unsigned char> buffer(offset, 0);
+		size_t cursor = 0;
+		memcpy(&buffer[cursor], &header, sizeof(header));
+		cursor += sizeof(header);
+		if (!dependencyRecords.empty())
+			memcpy(&buffer[cursor], &dependencyRecords[0], dependencyRecords.size() * sizeof(DependencyRecord));
+		cursor += dependencyRecords.size() * sizeof(DependencyRecord);
+		if (!shapeRecords.empty())
+			memcpy(&buffer[cursor], &shapeRecords[0], shapeRecords.size() * sizeof(ShapeRecord));
+		cursor += shapeRecords.size() * sizeof(ShapeRecord);
+		if (!textureRecords.empty())
+			memcpy(&buffer[cursor], &textureRecords[0], textureRecords.size() * sizeof(TextureRecord));
+		cursor += textureRecords.size() * sizeof(TextureRecord);
+		if (!strings.empty())
+			memcpy(&buffer[cursor], strings.data(), strings.size());
+
+		for (size_t s = 0; s < shapeData.size(); ++s)
+		{
+			if (!shapeData[s].vertices.empty())
+				memcpy(&buffer[shapeRecords[s].vertexOffset], &shapeData[s].vertices[0], shapeData[s].vertices.size() * sizeof(Vertex));
+			if (!shapeData[s].indices.empty())
+				memcpy(&buffer[shapeRecords[s].indexOffset], &shapeData[s].indices[0], shapeData[s].indices.size() * sizeof(GLuint));
+		}
+
+		return WriteFileAtomic(PathFor(objFileName), buffer.empty() ? nullptr : &buffer[0], buffer.size());
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "FileUtils.hpp"
+#include "Mesh.hpp"
+
+namespace gps
+{
+	// Bump whenever the layout or the content produced by Model3D::ReadOBJ changes
+	const uint32_t MESH_CACHE_VERSION = 2;
+
+	// Texture referenced by a cached shape - loaded through Model3D::LoadTexture
+	struct TextureRef
+	{
+		std::string path;
+		std::string type;
+	};
+
+	// Final per-shape geometry, as handed to gps::Mesh
+	struct ShapeData
+	{
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+		std::vector<TextureRef> textures;
+	};
+
+	// View of a shape inside a mapped cache file
+	struct CachedShape
+	{
+		const Vertex* vertices;
+		GLuint vertexCount;
+		const GLuint* indices;
+		GLuint indexCount;
+		std::vector<TextureRef> textures;
+	};
+
+	// Binary "<file>.obj.gpsmesh" cache holding the output of Model3D::ReadOBJ.
+	// It is invalidated when the .obj or any of its .mtl libraries change.
+	class MeshCache
+	{
+	public:
+		static std::string PathFor(const std::string& objFileName);
+
+		// Maps the cache of an .obj file and checks it is still current
+		bool Open(const std::string& objFileName);
+		void Close();
+
+		size_t ShapeCount() const { return shapes.size(); }
+		const CachedShape& Shape(size_t i) const { return shapes[i]; }
+
+		// Serializes the shapes of an .obj file, stamping the .obj and its .mtl libraries
+		static bool Write(const std::string& objFileName, const std::string& basePath, const std::vector<ShapeData>& shapeData);
+
+	private:
+		MappedFile file;
+		std::vector<CachedShape> shapes;
+	};
+}
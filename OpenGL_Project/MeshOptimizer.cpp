@@ -0,0 +1,280 @@
+#include "MeshOptimizer.hpp"
+#include <cmath>
+#include <cstring>
+
+namespace gps
+{
+	static const GLuint INVALID_INDEX = 0xFFFFFFFFu;
+
+	// Forsyth's scoring model is tuned for an LRU cache of 32 entries
+	static const int VERTEX_CACHE_SIZE = 32;
+
+	static uint32_t FloatBits(float value)
+	{
+		//+0 and -0 must weld together
+		if (value == 0.0f)
+			value = 0.0f;
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	static void VertexKey(const Vertex& vertex, uint32_t key[8])
+	{
+		key[0] = FloatBits(vertex.Position.x);
+		key[1] = FloatBits(vertex.Position.y);
+		key[2] = FloatBits(vertex.Position.z);
+		key[3] = FloatBits(vertex.Normal.x);
+		key[4] = FloatBits(vertex.Normal.y);
+		key[5] = FloatBits(vertex.Normal.z);
+		key[6] = FloatBits(vertex.TexCoords.x);
+		key[7] = FloatBits(vertex.TexCoords.y);
+	}
+
+	static uint32_t HashKey(const uint32_t key[8])
+	{
+		uint32_t hash = 2166136261u;
+		for (int i = 0; i < 8; ++i)
+		{
+			hash ^= key[i];
+			hash *= 16777619u;
+			hash ^= hash >> 15;
+		}
+		return hash;
+	}
+
+	void WeldVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		//open addressing table, at most half full
+		size_t tableSize = 16;
+		while (tableSize < vertices.size() * 2)
+			tableSize *= 2;
+		std::vector<GLuint> table(tableSize, INVALID_INDEX);
+		std::vector<uint32_t> keys;
+		keys.reserve(vertices.size() * 8);
+
+		std::vector<Vertex> welded;
+		welded.reserve(vertices.size());
+		std::vector<GLuint> remap(vertices.size());
+
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			uint32_t key[8];
+			VertexKey(vertices[i], key);
+
+			size_t slot = HashKey(key) & (tableSize - 1);
+			while (table[slot] != INVALID_INDEX && memcmp(&keys[table[slot] * 8], key, sizeof(key)) != 0)
+				slot = (slot + 1) & (tableSize - 1);
+
+			if (table[slot] == INVALID_INDEX)
+			{
+				table[slot] = static_cast<GLuint>(welded.size());
+				welded.push_back(vertices[i]);
+				keys.insert(keys.end(), key, key + 8);
+			}
+			remap[i] = table[slot];
+		}
+
+		for (size_t i = 0; i < indices.size(); ++i)
+			indices[i] = remap[indices[i]];
+
+		vertices.swap(welded);
+	}
+
+	static float VertexScore(int cachePosition, unsigned int activeTriangles)
+	{
+		if (activeTriangles == 0)
+			return -1.0f;
+
+		float score = 0.0f;
+		if (cachePosition >= 0)
+		{
+			//the three vertices of the last triangle get a fixed score so it is not reused straight away
+			if (cachePosition < 3)
+				score = 0.75f;
+			else
+				score = powf(1.0f - float(cachePosition - 3) / float(VERTEX_CACHE_SIZE - 3), 1.5f);
+		}
+
+		//boost vertices with few triangles left, to finish them off
+		score += 2.0f / sqrtf(float(activeTriangles));
+		return score;
+	}
+
+	void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return;
+
+		//vertex -> triangles adjacency
+		std::vector<unsigned int> activeTriangles(vertexCount, 0);
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+			activeTriangles[indices[i]]++;
+
+		std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+		for (size_t v = 0; v < vertexCount; ++v)
+			adjacencyOffset[v + 1] = adjacencyOffset[v] + activeTriangles[v];
+
+		std::vector<unsigned int> adjacency(triangleCount * 3);
+		std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t t = 0; t < triangleCount; ++t)
+			for (int k = 0; k < 3; ++k)
+				adjacency[fill[indices[t * 3 + k]]++] = static_cast<unsigned int>(t);
+
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t v = 0; v < vertexCount; ++v)
+			vertexScore[v] = VertexScore(-1, activeTriangles[v]);
+
+		std::vector<float> triangleScore(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		for (size_t t = 0; t < triangleCount; ++t)
+			triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+
+		std::vector<GLuint> cache;
+		std::vector<GLuint> nextCache;
+		cache.reserve(VERTEX_CACHE_SIZE + 3);
+		nextCache.reserve(VERTEX_CACHE_SIZE + 3);
+
+		std::vector<GLuint> result;
+		result.reserve(triangleCount * 3);
+
+		size_t bestTriangle = 0;
+		size_t scanCursor = 0;
+		for (size_t t = 1; t < triangleCount; ++t)
+			if (triangleScore[t] > triangleScore[bestTriangle])
+				bestTriangle = t;
+
+		for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+		{
+			if (bestTriangle == triangleCount)
+			{
+				//nothing useful in the cache - continue with the next unused triangle
+				while (emitted[scanCursor])
+					scanCursor++;
+				bestTriangle = scanCursor;
+			}
+
+			const GLuint* triangle = &indices[bestTriangle * 3];
+			result.insert(result.end(), triangle, triangle + 3);
+			emitted[bestTriangle] = true;
+
+			//the emitted vertices move to the front of the LRU cache
+			nextCache.clear();
+			for (int k = 0; k < 3; ++k)
+			{
+				GLuint v = triangle[k];
+				nextCache.push_back(v);
+
+				unsigned int* begin = &adjacency[adjacencyOffset[v]];
+				unsigned int* end = begin + activeTriangles[v];
+				for (unsigned int* it = begin; it != end; ++it)
+				{
+					if (*it == bestTriangle)
+					{
+						*it = *(end - 1);
+						activeTriangles[v]--;
+						break;
+					}
+				}
+			}
+			for (size_t c = 0; c < cache.size(); ++c)
+			{
+				GLuint v = cache[c];
+				if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+					nextCache.push_back(v);
+			}
+			for (size_t c = VERTEX_CACHE_SIZE; c < nextCache.size(); ++c)
+			{
+				//evicted vertices lose their cache bonus
+				GLuint v = nextCache[c];
+				float score = VertexScore(-1, activeTriangles[v]);
+				float delta = score - vertexScore[v];
+				vertexScore[v] = score;
+
+				const unsigned int* adjacent = &adjacency[adjacencyOffset[v]];
+				for (unsigned int a = 0; a < activeTriangles[v]; ++a)
+					triangleScore[adjacent[a]] += delta;
+			}
+			if (nextCache.size() > size_t(VERTEX_CACHE_SIZE))
+				nextCache.resize(VERTEX_CACHE_SIZE);
+			cache.swap(nextCache);
+
+			//rescore what is in the cache and pick the best triangle touching it
+			for (size_t c = 0; c < cache.size(); ++c)
+			{
+				GLuint v = cache[c];
+				float score = VertexScore(static_cast<int>(c), activeTriangles[v]);
+				float delta = score - vertexScore[v];
+				vertexScore[v] = score;
+
+				const unsigned int* adjacent = &adjacency[adjacencyOffset[v]];
+				for (unsigned int a = 0; a < activeTriangles[v]; ++a)
+					triangleScore[adjacent[a]] += delta;
+			}
+
+			bestTriangle = triangleCount;
+			float bestScore = -1.0f;
+			for (size_t c = 0; c < cache.size(); ++c)
+			{
+				GLuint v = cache[c];
+				const unsigned int* adjacent = &adjacency[adjacencyOffset[v]];
+				for (unsigned int a = 0; a < activeTriangles[v]; ++a)
+				{
+					if (triangleScore[adjacent[a]] > bestScore)
+					{
+						bestScore = triangleScore[adjacent[a]];
+						bestTriangle = adjacent[a];
+					}
+				}
+			}
+		}
+
+		indices.swap(result);
+	}
+
+	void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+	{
+		std::vector<GLuint> remap(vertices.size(), INVALID_INDEX);
+		std::vector<Vertex> ordered;
+		ordered.reserve(vertices.size());
+
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			GLuint& index = indices[i];
+			if (remap[index] == INVALID_INDEX)
+			{
+				remap[index] = static_cast<GLuint>(ordered.size());
+				ordered.push_back(vertices[index]);
+			}
+			index = remap[index];
+		}
+
+		//unreferenced vertices are dropped
+		vertices.swap(ordered);
+	}
+
+	float ComputeACMR(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize)
+	{
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0)
+			return 0.0f;
+
+		//FIFO cache: a vertex is resident while fewer than cacheSize misses happened since it was loaded
+		std::vector<size_t> loadedAt(vertexCount, 0);
+		std::vector<bool> loaded(vertexCount, false);
+		size_t misses = 0;
+		for (size_t i = 0; i < triangleCount * 3; ++i)
+		{
+			GLuint v = indices[i];
+			if (!loaded[v] || misses - loadedAt[v] >= cacheSize)
+			{
+				loaded[v] = true;
+				loadedAt[v] = misses;
+				misses++;
+			}
+		}
+
+		return float(misses) / float(triangleCount);
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+
+#include "Mesh.hpp"
+
+namespace gps
+{
+	// Merges vertices with identical position, normal and texture coordinates and rewrites the indices
+	void WeldVertices(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+	// Reorders triangles for the post-transform vertex cache (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+	void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+	// Reorders vertices in the order they are first referenced, so fetches walk the buffer linearly
+	void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+	// Average cache miss ratio - transformed vertices per triangle for a FIFO cache of the given size
+	float ComputeACMR(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+}
@@ -7,6 +7,12 @@
 //
 
 #include "Model3D.hpp"
+#include "MeshOptimizer.hpp"
+#include "TextureRegistry.hpp"
+#include "GLStateCache.hpp"
+#include "FileUtils.hpp"
+#include <algorithm>
+#include <chrono>
 
 
 namespace gps {
@@ -26,23 +32,454 @@ namespace gps {
 		ReadOBJ(fileName, basePath);
 	}
 
+	Model3D::Model3D(const Model3D& other)
+		: meshes(other.meshes), loadedTextures(other.loadedTextures), textureIndex(other.textureIndex), bounds(other.bounds), sphere(other.sphere)
+	{
+		for (size_t i = 0; i < loadedTextures.size(); i++)
+			gps::TextureRegistry::Instance().Retain(loadedTextures[i].id);
+	}
+
+	Model3D::Model3D(Model3D&& other)
+	{
+		Swap(other);
+	}
+
+	Model3D& Model3D::operator=(Model3D other)
+	{
+		Swap(other);
+		return *this;
+	}
+
+	Model3D::~Model3D()
+	{
+		for (size_t i = 0; i < loadedTextures.size(); i++)
+			gps::TextureRegistry::Instance().Release(loadedTextures[i].id);
+	}
+
+	void Model3D::Swap(Model3D& other)
+	{
+		meshes.swap(other.meshes);
+		loadedTextures.swap(other.loadedTextures);
+		textureIndex.swap(other.textureIndex);
+		std::swap(bounds, other.bounds);
+		std::swap(sphere, other.sphere);
+	}
+
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	void Model3D::Draw(const gps::Shader& shaderProgram)
 	{
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	size_t Model3D::GeometryBytes() const
+	{
+		size_t bytes = 0;
+		for (size_t i = 0; i < meshes.size(); i++)
+			bytes += meshes[i].GeometryBytes();
+		return bytes;
+	}
+
+	void Model3D::Enqueue(gps::RenderQueue& queue, gps::RenderPass pass, int program, const glm::mat4& modelMatrix) const
+	{
+		glm::vec3 center = bounds.IsEmpty() ? glm::vec3(0.0f) : bounds.Center();
+		for (size_t i = 0; i < meshes.size(); i++)
+			queue.Add(pass, program, meshes[i], modelMatrix, center);
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
 
+		ModelData data;
+		Decode(fileName, basePath, data);
+
+		typedef std::chrono::high_resolution_clock clock;
+		clock::time_point uploadStart = clock::now();
+		while (!UploadStep(data))
+			;
+		double uploadTime = std::chrono::duration<double, std::milli>(clock::now() - uploadStart).count();
+		std::cout << fileName << ": uploaded in " << uploadTime << " ms" << std::endl;
+	}
+
+	// Hashes an image file and, unless its content is already resident, maps its baked version or
+	// decodes it, flips it for OpenGL and builds its mip chain - safe to call from any thread
+	static void DecodeTexture(const std::string& path, gps::Image& image, std::unique_ptr<gps::KtxFile>& compressed, uint64_t& hash) {
+		if (!gps::TextureRegistry::Instance().Prepare(path, 4, hash, image, compressed)) {
+			fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+			hash = 0;
+			return;
+		}
+		if (!image.IsLoaded()) {
+			return;
+		}
+		// NPOT check
+		if ((image.Width() & (image.Width() - 1)) != 0 || (image.Height() & (image.Height() - 1)) != 0) {
+			fprintf(
+				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", path.c_str()
+			);
+		}
+		image.FlipVertically();
+		//built here rather than with glGenerateMipmap, so it stays off the GL thread
+		image.GenerateMipChain();
+	}
+
+	//a texture alone at its size may give up this many top mip levels to join an array of a smaller size
+	static const size_t ARRAY_RESIZE_LEVELS = 1;
+
+	static bool HasPixels(const ModelData& data, size_t t) {
+		return data.compressed[t] || data.images[t].IsLoaded();
+	}
+
+	static GLenum TextureFormat(const ModelData& data, size_t t) {
+		return data.compressed[t] ? GLenum(data.compressed[t]->Format()) : GL_RGBA8;
+	}
+
+	static size_t TextureLevelCount(const ModelData& data, size_t t) {
+		return data.compressed[t] ? data.compressed[t]->LevelCount() : data.images[t].LevelCount();
+	}
+
+	// Size of a mip level of a decoded or baked texture, false if it has no such level
+	static bool TextureLevelSize(const ModelData& data, size_t t, size_t level, int& width, int& height) {
+		if (level >= TextureLevelCount(data, t)) {
+			return false;
+		}
+		if (data.compressed[t]) {
+			width = data.compressed[t]->Level(level).width;
+			height = data.compressed[t]->Level(level).height;
+		}
+		else {
+			width = data.images[t].LevelWidth(level);
+			height = data.images[t].LevelHeight(level);
+		}
+		return true;
+	}
+
+	// Storage for every level and layer of the bound array
+	static void AllocateArrayLevels(const ModelData& data, const TextureArrayPlan& plan) {
+		size_t t = plan.members[0];
+		GLsizei layers = static_cast<GLsizei>(plan.members.size());
+		for (size_t level = 0; level < plan.levelCount; level++) {
+			int width, height;
+			TextureLevelSize(data, t, plan.skippedLevels[0] + level, width, height);
+			if (data.compressed[t]) {
+				//every member has the same format and size, so the same level size too
+				size_t layerSize = data.compressed[t]->Level(plan.skippedLevels[0] + level).size;
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), plan.format, width, height, layers, 0,
+					static_cast<GLsizei>(layerSize * layers), NULL);
+			}
+			else {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			}
+		}
+	}
+
+	// Copies the levels of a texture from skippedLevels on into one layer of the bound array, returns the bytes uploaded
+	static size_t UploadArrayLayerLevels(const ModelData& data, size_t t, size_t skippedLevels, size_t levelCount, GLint layer) {
+		size_t bytes = 0;
+		for (size_t level = 0; level < levelCount; level++) {
+			int width, height;
+			TextureLevelSize(data, t, skippedLevels + level, width, height);
+			if (data.compressed[t]) {
+				const gps::CompressedLevel& source = data.compressed[t]->Level(skippedLevels + level);
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, layer, width, height, 1,
+					GLenum(data.compressed[t]->Format()), static_cast<GLsizei>(source.size), source.data);
+				bytes += source.size;
+			}
+			else {
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, static_cast<GLint>(level), 0, 0, layer, width, height, 1,
+					GL_RGBA, GL_UNSIGNED_BYTE, data.images[t].LevelPixels(skippedLevels + level));
+				bytes += size_t(width) * height * 4;
+			}
+		}
+		return bytes;
+	}
+
+	// Sampling state of the bound array
+	static void SetArrayParameters(size_t levelCount, GLenum format) {
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levelCount) - 1);
+
+		//gray textures are stored in one channel
+		if (format == gps::COMPRESSED_BC4) {
+			GLint swizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+			glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+		}
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	// Groups the decoded textures into texture arrays
+	void Model3D::PlanTextureArrays(ModelData& data) {
+		data.arrays.clear();
+		std::vector<bool> placed(data.textures.size(), false);
+
+		//same format and size first
+		for (size_t t = 0; t < data.textures.size(); t++) {
+			if (placed[t]) {
+				continue;
+			}
+			placed[t] = true;
+
+			TextureArrayPlan plan;
+			plan.members.push_back(t);
+			plan.skippedLevels.push_back(0);
+			plan.format = 0;
+			plan.width = 0;
+			plan.height = 0;
+			plan.levelCount = 0;
+			data.arrays.push_back(plan);
+
+			//unreadable, or already resident under its own content - stays alone
+			if (!HasPixels(data, t)) {
+				continue;
+			}
+
+			TextureArrayPlan& array = data.arrays.back();
+			array.format = TextureFormat(data, t);
+			TextureLevelSize(data, t, 0, array.width, array.height);
+			array.levelCount = TextureLevelCount(data, t);
+			for (size_t u = t + 1; u < data.textures.size(); u++) {
+				int width, height;
+				if (placed[u] || !HasPixels(data, u) || TextureFormat(data, u) != array.format ||
+					!TextureLevelSize(data, u, 0, width, height) || width != array.width || height != array.height) {
+					continue;
+				}
+				placed[u] = true;
+				array.members.push_back(u);
+				array.skippedLevels.push_back(0);
+				array.levelCount = std::min(array.levelCount, TextureLevelCount(data, u));
+			}
+		}
+
+		//then a lone texture moves into an array matching one of its smaller levels
+		for (size_t a = 0; a < data.arrays.size(); a++) {
+			if (data.arrays[a].members.size() != 1 || data.arrays[a].levelCount == 0) {
+				continue;
+			}
+			size_t t = data.arrays[a].members[0];
+			bool moved = false;
+			for (size_t skip = 1; skip <= ARRAY_RESIZE_LEVELS && !moved; skip++) {
+				int width, height;
+				if (!TextureLevelSize(data, t, skip, width, height)) {
+					break;
+				}
+				for (size_t b = 0; b < data.arrays.size() && !moved; b++) {
+					TextureArrayPlan& target = data.arrays[b];
+					if (b == a || target.levelCount == 0 || target.format != data.arrays[a].format ||
+						target.width != width || target.height != height) {
+						continue;
+					}
+					target.members.push_back(t);
+					target.skippedLevels.push_back(skip);
+					target.levelCount = std::min(target.levelCount, TextureLevelCount(data, t) - skip);
+					moved = true;
+				}
+			}
+			if (moved) {
+				data.arrays.erase(data.arrays.begin() + a);
+				a--;
+			}
+		}
+
+		//a lone texture is keyed by its content, like a plain texture, so other models can share it
+		for (size_t a = 0; a < data.arrays.size(); a++) {
+			TextureArrayPlan& plan = data.arrays[a];
+			if (plan.members.size() == 1 && plan.skippedLevels[0] == 0) {
+				plan.key = data.hashes[plan.members[0]];
+				continue;
+			}
+			plan.key = HashBytes(&plan.format, sizeof(plan.format));
+			for (size_t i = 0; i < plan.members.size(); i++) {
+				uint64_t member[2] = { data.hashes[plan.members[i]], plan.skippedLevels[i] };
+				plan.key = HashBytes(member, sizeof(member), plan.key);
+			}
+		}
+	}
+
+	// Parses the .obj file (or maps its cache) and decodes the textures - touches no GL state
+	void Model3D::Decode(std::string fileName, std::string basePath, ModelData& data) {
+
+		typedef std::chrono::high_resolution_clock clock;
+		clock::time_point loadStart = clock::now();
+		const char* source;
+
+		data.fileName = fileName;
+
+		//warm start - geometry is mapped from the binary cache and uploaded as is
+		if (data.cache.Open(fileName)) {
+			for (size_t s = 0; s < data.cache.ShapeCount(); s++)
+				data.shapes.push_back(data.cache.Shape(s));
+			source = "warm load (mesh cache)";
+		}
+		else {
+			ParseOBJ(fileName, basePath, data.shapeData);
+			for (size_t s = 0; s < data.shapeData.size(); s++) {
+				const gps::ShapeData& shape = data.shapeData[s];
+				gps::CachedShape view;
+				view.vertices = shape.vertices.data();
+				view.vertexCount = static_cast<GLuint>(shape.vertices.size());
+				view.indices = shape.indices.data();
+				view.indexCount = static_cast<GLuint>(shape.indices.size());
+				view.textures = shape.textures;
+				data.shapes.push_back(view);
+			}
+			source = "cold load (parsed OBJ)";
+		}
+		for (size_t s = 0; s < data.shapes.size(); s++) {
+			const gps::CachedShape& shape = data.shapes[s];
+			for (GLuint v = 0; v < shape.vertexCount; v++)
+				data.bounds.Add(shape.vertices[v].Position);
+		}
+		//the sphere is centered on the box of the whole model, so it takes a second pass
+		for (size_t s = 0; s < data.shapes.size(); s++) {
+			const gps::CachedShape& shape = data.shapes[s];
+			if (shape.vertexCount == 0) {
+				continue;
+			}
+			gps::BoundingSphere shapeSphere = gps::BoundingSphere::Around(data.bounds, &shape.vertices[0].Position, shape.vertexCount, sizeof(gps::Vertex));
+			data.sphere.center = shapeSphere.center;
+			data.sphere.radius = std::max(data.sphere.radius, shapeSphere.radius);
+		}
+		clock::time_point texturesStart = clock::now();
+
+		//each texture is decoded once, even when several shapes share it
+		for (size_t s = 0; s < data.shapes.size(); s++) {
+			const std::vector<gps::TextureRef>& references = data.shapes[s].textures;
+			for (size_t i = 0; i < references.size(); i++) {
+				bool known = false;
+				for (size_t t = 0; t < data.textures.size() && !known; t++)
+					known = data.textures[t].path == references[i].path;
+				if (!known)
+					data.textures.push_back(references[i]);
+			}
+		}
+		data.hashes.resize(data.textures.size());
+		data.images.resize(data.textures.size());
+		data.compressed.resize(data.textures.size());
+		for (size_t t = 0; t < data.textures.size(); t++)
+			DecodeTexture(data.textures[t].path, data.images[t], data.compressed[t], data.hashes[t]);
+		PlanTextureArrays(data);
+
+		clock::time_point texturesEnd = clock::now();
+		double geometryTime = std::chrono::duration<double, std::milli>(texturesStart - loadStart).count();
+		double textureTime = std::chrono::duration<double, std::milli>(texturesEnd - texturesStart).count();
+		std::cout << fileName << ": " << source << " " << geometryTime << " ms geometry, " << textureTime << " ms texture decode" << std::endl;
+	}
+
+	// Uploads one texture array layer or one mesh of the decoded data, returns true once everything is uploaded
+	bool Model3D::UploadStep(ModelData& data) {
+
+		bounds = data.bounds;
+		sphere = data.sphere;
+
+		if (data.nextArray < data.arrays.size()) {
+			UploadArrayLayer(data);
+
+			if (data.nextArray == data.arrays.size()) {
+				size_t resized = 0;
+				for (size_t a = 0; a < data.arrays.size(); a++) {
+					for (size_t i = 0; i < data.arrays[a].skippedLevels.size(); i++)
+						resized += data.arrays[a].skippedLevels[i] > 0 ? 1 : 0;
+				}
+				std::cout << data.fileName << ": " << data.textures.size() << " textures in " << data.arrays.size() << " texture arrays ("
+					<< float(data.textures.size()) / data.arrays.size() << " layers per array, " << resized << " resized)" << std::endl;
+			}
+		}
+		else if (data.nextShape < data.shapes.size()) {
+			const gps::CachedShape& shape = data.shapes[data.nextShape];
+			meshes.push_back(gps::Mesh(shape.vertices, shape.vertexCount, shape.indices, shape.indexCount, LoadTextures(shape.textures)));
+			data.nextShape++;
+		}
+
+		return data.nextArray == data.arrays.size() && data.nextShape == data.shapes.size();
+	}
+
+	// Uploads the next layer of the array being built, registering the array after its last layer
+	void Model3D::UploadArrayLayer(ModelData& data) {
+		const gps::TextureArrayPlan& plan = data.arrays[data.nextArray];
+		gps::TextureRegistry& registry = gps::TextureRegistry::Instance();
+
+		if (data.nextLayer == 0) {
+			if (plan.members.size() == 1 && plan.skippedLevels[0] == 0) {
+				//a lone texture goes through the registry by content, as a plain texture would
+				size_t t = plan.members[0];
+				data.currentArray = AcquireTexture(data.textures[t].path, data.hashes[t], data.images[t], data.compressed[t]);
+				data.nextLayer = 1;
+			}
+			else {
+				data.currentArray = registry.Acquire(plan.key);
+				if (data.currentArray != 0) {
+					data.nextLayer = plan.members.size();
+				}
+				else {
+					glGenTextures(1, &data.currentArray);
+					GLStateCache::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, data.currentArray);
+					AllocateArrayLevels(data, plan);
+				}
+			}
+		}
+
+		if (data.nextLayer < plan.members.size()) {
+			GLStateCache::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, data.currentArray);
+			UploadArrayLayerLevels(data, plan.members[data.nextLayer], plan.skippedLevels[data.nextLayer], plan.levelCount,
+				static_cast<GLint>(data.nextLayer));
+			data.nextLayer++;
+
+			if (data.nextLayer == plan.members.size()) {
+				SetArrayParameters(plan.levelCount, plan.format);
+				GLStateCache::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+				size_t bytes = 0;
+				for (size_t level = 0; level < plan.levelCount; level++) {
+					int width, height;
+					TextureLevelSize(data, plan.members[0], plan.skippedLevels[0] + level, width, height);
+					bytes += data.compressed[plan.members[0]] ? data.compressed[plan.members[0]]->Level(plan.skippedLevels[0] + level).size
+						: size_t(width) * height * 4;
+				}
+				registry.Insert(plan.key, data.currentArray, bytes * plan.members.size(), data.textures[plan.members[0]].path,
+					static_cast<int>(plan.members.size()));
+			}
+			else {
+				return;
+			}
+		}
+
+		for (size_t i = 0; i < plan.members.size(); i++) {
+			size_t t = plan.members[i];
+			gps::Texture currentTexture;
+			currentTexture.id = data.currentArray;
+			currentTexture.layer = static_cast<GLuint>(i);
+			currentTexture.type = data.textures[t].type;
+			currentTexture.path = data.textures[t].path;
+			textureIndex[currentTexture.path] = loadedTextures.size();
+			loadedTextures.push_back(currentTexture);
+			//one reference per layer, each released by the destructor
+			if (i > 0 && data.currentArray != 0) {
+				registry.Retain(data.currentArray);
+			}
+
+			//pixels are in video memory now
+			data.images[t].Free();
+			data.compressed[t].reset();
+		}
+
+		data.nextArray++;
+		data.nextLayer = 0;
+		data.currentArray = 0;
+	}
+
+	// Builds the final per-shape geometry from the .obj file and writes the mesh cache
+	void Model3D::ParseOBJ(std::string fileName, std::string basePath, std::vector<gps::ShapeData>& shapeData) {
+
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret = tinyobj::LoadObjParallel(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
@@ -55,11 +492,15 @@ namespace gps {
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		shapeData.resize(shapes.size());
+		size_t totalCornerCount = 0;
+		size_t weldedVertexCount = 0;
+
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			std::vector<gps::Vertex>& vertices = shapeData[s].vertices;
+			std::vector<GLuint>& indices = shapeData[s].indices;
+			std::vector<gps::TextureRef>& textures = shapeData[s].textures;
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
@@ -104,6 +545,19 @@ namespace gps {
 				index_offset += fv;
 			}
 
+			// Weld the per-corner vertices into an indexed mesh and reorder it for the post-transform cache
+			size_t cornerCount = vertices.size();
+			gps::WeldVertices(vertices, indices);
+			float weldedACMR = gps::ComputeACMR(indices, vertices.size());
+			gps::OptimizeVertexCache(indices, vertices.size());
+			gps::OptimizeVertexFetch(vertices, indices);
+			float optimizedACMR = gps::ComputeACMR(indices, vertices.size());
+
+			std::cout << "  shape " << s << ": " << cornerCount << " -> " << vertices.size() << " vertices, ACMR "
+				<< (cornerCount ? 3.0f : 0.0f) << " -> " << weldedACMR << " (welded) -> " << optimizedACMR << " (optimized)" << std::endl;
+			weldedVertexCount += vertices.size();
+			totalCornerCount += cornerCount;
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			int a = shapes[s].mesh.material_ids.size();
@@ -119,8 +573,9 @@ namespace gps {
 					std::string ambientTexturePath = materials[materialId].ambient_texname;
 					if (!ambientTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "material.ambient");
+						gps::TextureRef currentTexture;
+						currentTexture.path = basePath + ambientTexturePath;
+						currentTexture.type = "material.ambient";
 						textures.push_back(currentTexture);
 					}
 
@@ -128,8 +583,9 @@ namespace gps {
 					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
 					if (!diffuseTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "material.diffuse");
+						gps::TextureRef currentTexture;
+						currentTexture.path = basePath + diffuseTexturePath;
+						currentTexture.type = "material.diffuse";
 						textures.push_back(currentTexture);
 					}
 
@@ -137,93 +593,144 @@ namespace gps {
 					std::string specularTexturePath = materials[materialId].specular_texname;
 					if (!specularTexturePath.empty())
 					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "material.specular");
+						gps::TextureRef currentTexture;
+						currentTexture.path = basePath + specularTexturePath;
+						currentTexture.type = "material.specular";
 						textures.push_back(currentTexture);
 					}
 				}
 			}
+		}
+
+		std::cout << "# of vertices  : " << totalCornerCount << " -> " << weldedVertexCount << " ("
+			<< totalCornerCount * sizeof(gps::Vertex) / 1024 << " KB -> " << weldedVertexCount * sizeof(gps::Vertex) / 1024 << " KB VBO)" << std::endl;
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+		if (!gps::MeshCache::Write(fileName, basePath, shapeData)) {
+			std::cerr << "WARNING: could not write mesh cache " << gps::MeshCache::PathFor(fileName) << std::endl;
 		}
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
-				if (loadedTextures[i].path == path)
-				{
-					//already loaded texture
-					return loadedTextures[i];
-				}
+			std::unordered_map<std::string, size_t>::const_iterator loaded = textureIndex.find(path);
+			if (loaded != textureIndex.end()) {
+				//already loaded texture
+				return loadedTextures[loaded->second];
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			gps::Image image;
+			std::unique_ptr<gps::KtxFile> compressed;
+			uint64_t hash;
+			DecodeTexture(path, image, compressed, hash);
+			currentTexture.id = AcquireTexture(path, hash, image, compressed);
+			currentTexture.layer = 0;
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
+			textureIndex[path] = loadedTextures.size();
 			loadedTextures.push_back(currentTexture);
 
 			return currentTexture;
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
+	// Retrieves all the textures referenced by a shape
+	std::vector<gps::Texture> Model3D::LoadTextures(const std::vector<gps::TextureRef>& references) {
+
+		std::vector<gps::Texture> textures;
+		for (size_t i = 0; i < references.size(); i++) {
+			textures.push_back(LoadTexture(references[i].path, references[i].type));
+			//a file used by several slots is loaded once, under the type of its first use
+			textures.back().type = references[i].type;
 		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
+
+		return textures;
+	}
+
+	// Gets the texture from the registry, uploading it if this content is not resident yet
+	GLuint Model3D::AcquireTexture(const std::string& path, uint64_t hash, gps::Image& image, std::unique_ptr<gps::KtxFile>& compressed) {
+		//the file could not be read
+		if (hash == 0) {
+			return 0;
 		}
 
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
+		gps::TextureRegistry& registry = gps::TextureRegistry::Instance();
+		GLuint textureID = registry.Acquire(hash);
+		if (textureID != 0) {
+			return textureID;
+		}
 
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
+		//resident when it was decoded, but released since
+		if (!image.IsLoaded() && !compressed) {
+			DecodeTexture(path, image, compressed, hash);
+		}
+
+		size_t bytes;
+		if (compressed) {
+			textureID = UploadTexture(*compressed);
+			bytes = compressed->DataSize();
+		}
+		else {
+			textureID = UploadTexture(image);
+			bytes = image.TotalSize();
+		}
+		if (textureID != 0) {
+			registry.Insert(hash, textureID, bytes, path);
+		}
+		return textureID;
+	}
+
+	// Loads decoded pixel data and its mip chain into the video memory, as a texture array of one layer
+	GLuint Model3D::UploadTexture(const gps::Image& image) {
+		if (!image.IsLoaded()) {
+			return 0;
 		}
 
 		GLuint textureID;
 		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_RGBA, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLStateCache::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+		for (size_t level = 0; level < image.LevelCount(); level++) {
+			glTexImage3D(
+				GL_TEXTURE_2D_ARRAY,
+				static_cast<GLint>(level),
+				GL_RGBA8, //GL_SRGB,//GL_RGBA,
+				image.LevelWidth(level),
+				image.LevelHeight(level),
+				1,
+				0,
+				GL_RGBA,
+				GL_UNSIGNED_BYTE,
+				image.LevelPixels(level)
+			);
+		}
+		SetArrayParameters(image.LevelCount(), GL_RGBA8);
+		GLStateCache::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+		return textureID;
+	}
+
+	// Loads a baked block-compressed texture and its mip chain into the video memory, as a texture array of one layer
+	GLuint Model3D::UploadTexture(const gps::KtxFile& compressed) {
+		GLuint textureID;
+		glGenTextures(1, &textureID);
+		GLStateCache::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+		for (size_t level = 0; level < compressed.LevelCount(); level++) {
+			const gps::CompressedLevel& data = compressed.Level(level);
+			glCompressedTexImage3D(
+				GL_TEXTURE_2D_ARRAY,
+				static_cast<GLint>(level),
+				compressed.Format(),
+				data.width,
+				data.height,
+				1,
+				0,
+				static_cast<GLsizei>(data.size),
+				data.data
+			);
+		}
+		SetArrayParameters(compressed.LevelCount(), compressed.Format());
+		GLStateCache::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, 0);
 
 		return textureID;
 	}
@@ -10,16 +10,72 @@
 #define Model3D_hpp
 
 #include <iostream>
+#include <memory>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include "BoundingBox.hpp"
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "RenderQueue.hpp"
+#include "Image.hpp"
+#include "KtxFile.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
 namespace gps {
 
+	// Textures of a model uploaded as the layers of one GL_TEXTURE_2D_ARRAY - same format and, once the
+	// skipped levels are dropped, same size
+	struct TextureArrayPlan
+	{
+		// Positions in ModelData::textures, one per layer
+		std::vector<size_t> members;
+		// Top mip levels of each member left out to reach the array size
+		std::vector<size_t> skippedLevels;
+		// GL_RGBA8, or the format of the baked textures
+		GLenum format;
+		int width;
+		int height;
+		size_t levelCount;
+		// Registry key - the content hash of a lone texture, a hash of the members otherwise
+		uint64_t key;
+	};
+
+	// CPU side of a model, produced by Model3D::Decode and consumed by Model3D::UploadStep
+	struct ModelData
+	{
+		ModelData() : nextArray(0), nextLayer(0), currentArray(0), nextShape(0) {}
+
+		std::string fileName;
+		// Geometry either mapped from the mesh cache or freshly parsed
+		MeshCache cache;
+		std::vector<ShapeData> shapeData;
+		std::vector<CachedShape> shapes;
+		// Unique texture references, in first use order, their content hashes (0 if unreadable)
+		// and either decoded pixels or a mapped baked texture - both left empty when the content
+		// is already in the texture registry
+		std::vector<TextureRef> textures;
+		std::vector<uint64_t> hashes;
+		std::vector<Image> images;
+		std::vector<std::unique_ptr<KtxFile> > compressed;
+		// Grouping of the textures, planned once they are decoded
+		std::vector<TextureArrayPlan> arrays;
+		size_t nextArray;
+		size_t nextLayer;
+		GLuint currentArray;
+		size_t nextShape;
+		// Model space bounds of all the shapes
+		BoundingBox bounds;
+		BoundingSphere sphere;
+
+	private:
+		ModelData(const ModelData&) = delete;
+		ModelData& operator=(const ModelData&) = delete;
+	};
+
     class Model3D
     {
 
@@ -30,22 +86,74 @@ namespace gps {
 
 		Model3D(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// Copies share the textures, holding their own references in the texture registry
+		Model3D(const Model3D& other);
+		Model3D(Model3D&& other);
+		Model3D& operator=(Model3D other);
+		~Model3D();
+
+		void Draw(const gps::Shader& shaderProgram);
+
+		const std::vector<gps::Mesh>& Meshes() const { return meshes; }
+		// Video memory taken by the vertex and index buffers of the uploaded meshes
+		size_t GeometryBytes() const;
+
+		// Queues each mesh instead of drawing it - the depth of the model bounds center orders them
+		void Enqueue(gps::RenderQueue& queue, gps::RenderPass pass, int program, const glm::mat4& modelMatrix) const;
+
+		// Parses the .obj file (or maps its cache) and decodes the textures - touches no GL state
+		static void Decode(std::string fileName, std::string basePath, ModelData& data);
+
+		// Uploads one texture array layer or one mesh of the decoded data, returns true once everything is uploaded
+		bool UploadStep(ModelData& data);
+
+		// Model space bounds, known as soon as the model is decoded - before any mesh is uploaded
+		const gps::BoundingBox& Bounds() const { return bounds; }
+		const gps::BoundingSphere& Sphere() const { return sphere; }
+		void SetBounds(const gps::BoundingBox& bounds, const gps::BoundingSphere& sphere)
+		{
+			this->bounds = bounds;
+			this->sphere = sphere;
+		}
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// Position of each texture in loadedTextures, by path
+		std::unordered_map<std::string, size_t> textureIndex;
+		gps::BoundingBox bounds;
+		gps::BoundingSphere sphere;
+
+		void Swap(Model3D& other);
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
 
+		// Builds the final per-shape geometry from the .obj file and writes the mesh cache
+		static void ParseOBJ(std::string fileName, std::string basePath, std::vector<gps::ShapeData>& shapeData);
+
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Retrieves all the textures referenced by a shape
+		std::vector<gps::Texture> LoadTextures(const std::vector<gps::TextureRef>& references);
+
+		// Gets the texture from the registry, uploading it if this content is not resident yet
+		GLuint AcquireTexture(const std::string& path, uint64_t hash, gps::Image& image, std::unique_ptr<gps::KtxFile>& compressed);
+
+		// Groups the decoded textures into texture arrays
+		static void PlanTextureArrays(ModelData& data);
+
+		// Uploads the next layer of the array being built, registering the array after its last layer
+		void UploadArrayLayer(ModelData& data);
+
+		// Loads decoded pixel data into the video memory, as a texture array of one layer
+		GLuint UploadTexture(const gps::Image& image);
+
+		// Loads a baked block-compressed texture and its mip chain into the video memory, as a texture array of one layer
+		GLuint UploadTexture(const gps::KtxFile& compressed);
     };
 }
 
@@ -0,0 +1,80 @@
+#include "ModelRegistry.hpp"
+#include <algorithm>
+#include <iostream>
+
+namespace gps
+{
+	ModelRegistry::ModelRegistry(AssetLoader& loader)
+		: loader(loader), loads(0), shared(0)
+	{
+	}
+
+	std::string ModelRegistry::Key(const std::string& fileName)
+	{
+		//"objects\tree\tree.obj" and "objects/tree/tree.obj" are the same file
+		std::string key = fileName;
+		std::replace(key.begin(), key.end(), '\\', '/');
+		return key;
+	}
+
+	bool ModelRegistry::Find(const std::string& key, AssetHandle<Model3D>& handle)
+	{
+		std::unordered_map<std::string, Entry>::iterator it = models.find(key);
+		if (it == models.end())
+			return false;
+
+		handle = it->second.model;
+		it->second.shares++;
+		shared++;
+		return true;
+	}
+
+	AssetHandle<Model3D> ModelRegistry::Acquire(const std::string& fileName, const std::string& basePath)
+	{
+		std::string key = Key(fileName);
+		AssetHandle<Model3D> handle;
+		if (Find(key, handle))
+			return handle;
+
+		handle = loader.LoadModel(fileName, basePath);
+		Entry entry = { handle, 0 };
+		models[key] = entry;
+		loads++;
+		return handle;
+	}
+
+	AssetHandle<Model3D> ModelRegistry::Acquire(const std::string& fileName, const std::string& basePath, const glm::vec3& position)
+	{
+		std::string key = Key(fileName);
+		AssetHandle<Model3D> handle;
+		if (Find(key, handle))
+			return handle;
+
+		handle = loader.LoadModel(fileName, basePath, position);
+		Entry entry = { handle, 0 };
+		models[key] = entry;
+		loads++;
+		return handle;
+	}
+
+	void ModelRegistry::PrintReport() const
+	{
+		size_t savedBytes = 0;
+		for (std::unordered_map<std::string, Entry>::const_iterator it = models.begin(); it != models.end(); ++it)
+		{
+			const AssetHandle<Model3D>& model = it->second.model;
+			//an asset still loading has no meshes yet, so it counts for nothing
+			if (!model.IsReady())
+				continue;
+
+			size_t bytes = model->GeometryBytes();
+			savedBytes += bytes * it->second.shares;
+			//the registry and the lock hold two of the references
+			std::cout << "model registry:   " << it->first << " - " << model.Weak().lock().use_count() - 2 << " handles, "
+				<< it->second.shares << " shared, " << bytes / 1024 << " KB" << std::endl;
+		}
+
+		std::cout << "model registry: " << models.size() << " models, " << loads << " loads, " << shared << " shared references, "
+			<< savedBytes / 1024 << " KB of video memory saved" << std::endl;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+
+#include "AssetLoader.hpp"
+#include "Model3D.hpp"
+#include "glm/glm.hpp"
+
+namespace gps
+{
+	// Models by .obj path, loaded once through the asset loader and shared by every object drawing them.
+	// The registry holds a handle to every model it loaded, so they stay resident for the life of the process even
+	// once no object draws them: the geometry arena never takes ranges back and meshes do not delete their
+	// buffers, so a model dropped and loaded again would upload its geometry a second time. Render thread only.
+	// Shared models are meant to be read only: drawing code takes the meshes and bounds and never changes them.
+	class ModelRegistry
+	{
+	public:
+		explicit ModelRegistry(AssetLoader& loader);
+
+		AssetHandle<Model3D> Acquire(const std::string& fileName, const std::string& basePath);
+		// The position orders the loading, as for AssetLoader::LoadModel. For a model already requested,
+		// the position of the first request is kept.
+		AssetHandle<Model3D> Acquire(const std::string& fileName, const std::string& basePath, const glm::vec3& position);
+
+		// Loads started, and requests served with a model already loaded or loading
+		int LoadCount() const { return loads; }
+		int SharedCount() const { return shared; }
+
+		// Per model: handles alive, times shared and the geometry those shares did not upload again
+		void PrintReport() const;
+
+	private:
+		ModelRegistry(const ModelRegistry&) = delete;
+		ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+		struct Entry
+		{
+			AssetHandle<Model3D> model;
+			int shares;
+		};
+
+		AssetLoader& loader;
+		std::unordered_map<std::string, Entry> models;
+		int loads;
+		int shared;
+
+		static std::string Key(const std::string& fileName);
+		// Returns true with the model of this path, if it was requested before
+		bool Find(const std::string& key, AssetHandle<Model3D>& handle);
+	};
+}
@@ -0,0 +1,49 @@
+#include "Placeholder.hpp"
+#include "GLStateCache.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+
+namespace gps
+{
+	BoundsPlaceholder::BoundsPlaceholder()
+		: vao(0), vbo(0), modelProgram(0)
+	{
+	}
+
+	void BoundsPlaceholder::Init()
+	{
+		//the 12 edges of the unit cube
+		const GLfloat edges[] = {
+			0, 0, 0, 1, 0, 0,  1, 0, 0, 1, 1, 0,  1, 1, 0, 0, 1, 0,  0, 1, 0, 0, 0, 0,
+			0, 0, 1, 1, 0, 1,  1, 0, 1, 1, 1, 1,  1, 1, 1, 0, 1, 1,  0, 1, 1, 0, 0, 1,
+			0, 0, 0, 0, 0, 1,  1, 0, 0, 1, 0, 1,  1, 1, 0, 1, 1, 1,  0, 1, 0, 0, 1, 1
+		};
+
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+		GLStateCache::Instance().BindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(edges), edges, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+		GLStateCache::Instance().BindVertexArray(0);
+	}
+
+	void BoundsPlaceholder::Draw(const gps::Shader& shader, const gps::Model3D& model, bool resident, const glm::mat4& modelMatrix)
+	{
+		if (resident || vao == 0 || model.Bounds().IsEmpty())
+			return;
+
+		if (modelProgram != shader.shaderProgram)
+		{
+			modelUniform = shader.GetUniform<glm::mat4>("model");
+			modelProgram = shader.shaderProgram;
+		}
+
+		glm::mat4 boxMatrix = glm::translate(modelMatrix, model.Bounds().min);
+		boxMatrix = glm::scale(boxMatrix, model.Bounds().Size());
+		modelUniform.Set(boxMatrix);
+
+		GLStateCache::Instance().BindVertexArray(vao);
+		glDrawArrays(GL_LINES, 0, 24);
+	}
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "Model3D.hpp"
+#include "Shader.hpp"
+#include "glm/glm.hpp"
+
+namespace gps
+{
+	// Wireframe box drawn in place of a model that is still loading, fitted to the model bounds.
+	// Meant for the flat color light shader (position at location 0, "model" uniform) - the caller sets its
+	// "color" once for all the boxes.
+	class BoundsPlaceholder
+	{
+	public:
+		BoundsPlaceholder();
+
+		// Creates the box geometry - needs a GL context
+		void Init();
+
+		// Draws nothing once the model is resident, or while its bounds are not known yet
+		void Draw(const gps::Shader& shader, const gps::Model3D& model, bool resident, const glm::mat4& modelMatrix);
+
+	private:
+		GLuint vao;
+		GLuint vbo;
+		// "model" of the program last drawn with, resolved again only when the program changes
+		GLuint modelProgram;
+		Uniform<glm::mat4> modelUniform;
+	};
+}
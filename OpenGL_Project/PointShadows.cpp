@@ -0,0 +1,147 @@
+#include "PointShadows.hpp"
+#include "GLStateCache.hpp"
+#include "ShadowCascades.hpp"
+#include <cstdio>
+#include <cstring>
+
+namespace gps
+{
+	PointShadows::PointShadows()
+		: uniforms(), atlasSize(0), texture(0), framebuffer(0), uniformBuffer(0), faceBuffer(0), faceStride(0)
+	{
+	}
+
+	void PointShadows::Init(const PointShadowSettings& settings)
+	{
+		this->settings = settings;
+		this->settings.budget = glm::clamp(settings.budget, 0, MAX_POINT_SHADOW_UPDATES);
+		//the tiles split in quarters all the way down
+		while ((this->settings.atlasSize & (this->settings.atlasSize - 1)) != 0)
+			this->settings.atlasSize &= this->settings.atlasSize - 1;
+		//a texture is still bound to the sampler when off, the shaders just never read it
+		atlasSize = settings.enabled ? this->settings.atlasSize : 1;
+		scheduler.Reset(settings.enabled ? POINT_LIGHT_COUNT : 0, atlasSize, settings.maxFace, settings.minFace, this->settings.budget);
+
+		glGenTextures(1, &texture);
+		GLStateCache::Instance().BindTexture(GL_TEXTURE_2D, texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, atlasSize, atlasSize, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		//a bilinear blend of 4 compared texels, kept inside the face by the shader
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		glGenFramebuffers(1, &framebuffer);
+		GLStateCache::Instance().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			fprintf(stderr, "ERROR: point shadow atlas framebuffer incomplete\n");
+		GLStateCache::Instance().BindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		alignment = glm::max(alignment, 1);
+		faceStride = (GLsizeiptr(sizeof(glm::mat4)) + alignment - 1) / alignment * alignment;
+		glGenBuffers(1, &faceBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, faceBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, faceStride * POINT_LIGHT_COUNT * PointShadowScheduler::FACE_COUNT, NULL, GL_DYNAMIC_DRAW);
+
+		glGenBuffers(1, &uniformBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(PointShadowUniforms), &uniforms, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		//read by every object program, never rebound
+		glBindBufferBase(GL_UNIFORM_BUFFER, POINT_SHADOW_BINDING, uniformBuffer);
+	}
+
+	void PointShadows::Destroy()
+	{
+		if (texture != 0)
+			GLStateCache::Instance().DeleteTexture(texture);
+		if (framebuffer != 0)
+			glDeleteFramebuffers(1, &framebuffer);
+		if (faceBuffer != 0)
+			glDeleteBuffers(1, &faceBuffer);
+		if (uniformBuffer != 0)
+			glDeleteBuffers(1, &uniformBuffer);
+		texture = 0;
+		framebuffer = 0;
+		faceBuffer = 0;
+		uniformBuffer = 0;
+	}
+
+	bool PointShadows::Attach(const gps::Shader& shader)
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(shader.shaderProgram, "PointShadows");
+		if (blockIndex == GL_INVALID_INDEX)
+			return false;
+		glUniformBlockBinding(shader.shaderProgram, blockIndex, POINT_SHADOW_BINDING);
+		return true;
+	}
+
+	const std::vector<int>& PointShadows::Update(const std::vector<PointShadowRequest>& requests)
+	{
+		scheduled.clear();
+		if (!settings.enabled || uniformBuffer == 0)
+			return scheduled;
+
+		scheduled = scheduler.Schedule(requests);
+
+		//a light keeps the matrices and tiles its faces were drawn with until it is drawn again
+		for (size_t i = 0; i < scheduled.size(); i++)
+		{
+			int light = scheduled[i];
+			for (int face = 0; face < PointShadowScheduler::FACE_COUNT; face++)
+			{
+				int index = light * PointShadowScheduler::FACE_COUNT + face;
+				const AtlasRect& rect = scheduler.Face(light, face);
+				uniforms.faceMatrices[index] = PointShadowFaceMatrix(requests[light].position, requests[light].range, face);
+				uniforms.faceRects[index] = glm::vec4(float(rect.x) / atlasSize, float(rect.y) / atlasSize,
+					float(rect.size) / atlasSize, 1.0f / rect.size);
+			}
+		}
+		for (int light = 0; light < POINT_LIGHT_COUNT; light++)
+			uniforms.shadowEnabled[light] = light < int(requests.size()) && scheduler.HasShadow(light) ? 1 : 0;
+
+		std::vector<unsigned char> faceData(size_t(faceStride) * POINT_LIGHT_COUNT * PointShadowScheduler::FACE_COUNT, 0);
+		for (int index = 0; index < POINT_LIGHT_COUNT * PointShadowScheduler::FACE_COUNT; index++)
+			memcpy(&faceData[size_t(faceStride) * index], &uniforms.faceMatrices[index], sizeof(glm::mat4));
+
+		//orphaned, as the cascade buffer - last frame's faces may still be drawing from it
+		glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(PointShadowUniforms), NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(PointShadowUniforms), &uniforms);
+		if (!scheduled.empty())
+		{
+			glBindBuffer(GL_UNIFORM_BUFFER, faceBuffer);
+			glBufferData(GL_UNIFORM_BUFFER, faceData.size(), NULL, GL_DYNAMIC_DRAW);
+			glBufferSubData(GL_UNIFORM_BUFFER, 0, faceData.size(), &faceData[0]);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		return scheduled;
+	}
+
+	void PointShadows::BeginFace(int light, int face)
+	{
+		GLStateCache& glState = GLStateCache::Instance();
+		const AtlasRect& rect = scheduler.Face(light, face);
+		glState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		glState.Viewport(rect.x, rect.y, rect.size, rect.size);
+		//the clear and the draws stay inside the tile, the other faces keep their shadows
+		glState.Enable(GL_SCISSOR_TEST);
+		glScissor(rect.x, rect.y, rect.size, rect.size);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		int index = light * PointShadowScheduler::FACE_COUNT + face;
+		glBindBufferRange(GL_UNIFORM_BUFFER, ShadowCascades::CASCADE_UNIFORMS_BINDING, faceBuffer, faceStride * index, sizeof(glm::mat4));
+	}
+
+	void PointShadows::EndFaces()
+	{
+		GLStateCache::Instance().Disable(GL_SCISSOR_TEST);
+	}
+}
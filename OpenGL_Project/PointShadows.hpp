@@ -0,0 +1,98 @@
+#pragma once
+#include <vector>
+
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+
+#include "FrameUniforms.hpp"
+#include "Shader.hpp"
+#include "ShadowAtlas.hpp"
+
+namespace gps
+{
+	// Atlas size, face sizes and update budget of the point light shadows - set from the command line before Init
+	struct PointShadowSettings
+	{
+		PointShadowSettings()
+			: enabled(true), atlasSize(2048), maxFace(512), minFace(64), budget(1), maxRange(50.0f)
+		{
+		}
+
+		bool enabled;
+		// Width and height of the depth atlas every face is a tile of
+		GLsizei atlasSize;
+		// Face size of a light covering the screen, halved as its contribution halves down to minFace
+		int maxFace;
+		int minFace;
+		// Lights drawn again per frame, at most MAX_POINT_SHADOW_UPDATES
+		int budget;
+		// Far plane of the faces - the attenuation usually ends the light well before
+		float maxRange;
+	};
+
+	// Mirrors the std140 "PointShadows" block of shaders/shaderMulti.frag
+	struct PointShadowUniforms
+	{
+		//light * 6 + face, faces in the order of PointShadowFaceMatrix
+		glm::mat4 faceMatrices[POINT_LIGHT_COUNT * PointShadowScheduler::FACE_COUNT];
+		//x and y of the face in the atlas and its size, in texture coordinates, then 1 / its size in texels
+		glm::vec4 faceRects[POINT_LIGHT_COUNT * PointShadowScheduler::FACE_COUNT];
+		//0 for a light without a shadow - one component per light
+		glm::ivec4 shadowEnabled;
+	};
+
+	static_assert(POINT_LIGHT_COUNT <= 4, "PointShadowUniforms keeps one int per light in an ivec4");
+	static_assert(sizeof(PointShadowUniforms) == 976, "PointShadowUniforms does not match the std140 layout");
+
+	// Shadows of the point lights: the six cube faces of each light are tiles of one 2D depth atlas, sized and
+	// redrawn by a PointShadowScheduler. The faces are drawn with the depth programs of the cascades - their
+	// "ShadowCascade" block is pointed at the matrix of the face - and looked up by the object shaders through
+	// the "PointShadows" block, which gives the matrix and tile of every face.
+	class PointShadows
+	{
+	public:
+		static const GLuint POINT_SHADOW_BINDING = 2;
+
+		PointShadows();
+
+		// Creates the depth atlas, its framebuffer and the buffers of the face matrices
+		void Init(const PointShadowSettings& settings);
+		void Destroy();
+
+		// Points the "PointShadows" block of a program at its binding, false if it does not declare it
+		static bool Attach(const gps::Shader& shader);
+
+		// Schedules the lights and sends the faces of those with a shadow - once per frame, returns the lights
+		// to draw this frame, the i-th drawn from render pass PASS_POINT_SHADOW + i
+		const std::vector<int>& Update(const std::vector<PointShadowRequest>& requests);
+		const std::vector<int>& Scheduled() const { return scheduled; }
+
+		// Makes a face of a light the depth target - its tile as viewport and scissor, cleared - with its matrix
+		// as the light space of the depth programs
+		void BeginFace(int light, int face);
+		// Turns the scissor test back off
+		void EndFaces();
+
+		GLuint Texture() const { return texture; }
+		const PointShadowSettings& Settings() const { return settings; }
+		const PointShadowScheduler& Scheduler() const { return scheduler; }
+		PointShadowScheduler& Scheduler() { return scheduler; }
+		size_t MemoryBytes() const { return size_t(atlasSize) * atlasSize * 4; }
+
+	private:
+		PointShadows(const PointShadows&) = delete;
+		PointShadows& operator=(const PointShadows&) = delete;
+
+		PointShadowSettings settings;
+		PointShadowScheduler scheduler;
+		std::vector<int> scheduled;
+		PointShadowUniforms uniforms;
+		GLsizei atlasSize;
+		GLuint texture;
+		GLuint framebuffer;
+		GLuint uniformBuffer;
+		// The face matrices again, one per GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT slot, for the depth programs
+		GLuint faceBuffer;
+		GLsizeiptr faceStride;
+	};
+}
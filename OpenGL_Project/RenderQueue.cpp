@@ -0,0 +1,334 @@
+#include "RenderQueue.hpp"
+#include "GLStateCache.hpp"
+#include <algorithm>
+#include <cstring>
+#include <gtc/matrix_inverse.hpp>
+
+namespace gps
+{
+	static const int PROGRAM_BITS = 8;
+	static const int MATERIAL_BITS = 16;
+	static const int VAO_BITS = 12;
+	static const int DEPTH_BITS = 24;
+
+	void RenderStats::Add(const RenderStats& other)
+	{
+		draws += other.draws;
+		multiDraws += other.multiDraws;
+		instances += other.instances;
+		programSwitches += other.programSwitches;
+		materialBinds += other.materialBinds;
+		textureBinds += other.textureBinds;
+		vaoBinds += other.vaoBinds;
+		vertexBytes += other.vertexBytes;
+	}
+
+	static uint64_t VertexBytes(RenderPass pass, const gps::Mesh& mesh, GLsizei instances)
+	{
+		size_t stride = IsShadowPass(pass) && Mesh::DepthStreamEnabled() ? sizeof(glm::vec3) : sizeof(Vertex);
+		return uint64_t(mesh.VertexCount()) * stride * instances;
+	}
+
+	static bool SameTextures(const gps::Mesh& a, const gps::Mesh& b)
+	{
+		if (a.MaterialKey() != b.MaterialKey() || a.textures.size() != b.textures.size())
+			return false;
+		for (size_t i = 0; i < a.textures.size(); i++)
+		{
+			if (a.textures[i].id != b.textures[i].id)
+				return false;
+		}
+		return true;
+	}
+
+	RenderQueue::RenderQueue()
+		: commandBuffer(0), commandCapacity(0), multiDraw(false), view(1.0f)
+	{
+		for (int pass = 0; pass < PASS_COUNT; pass++)
+			sortModes[pass] = SORT_BY_STATE;
+	}
+
+	int RenderQueue::RegisterProgram(const gps::Shader& shader)
+	{
+		for (size_t i = 0; i < programs.size(); i++)
+		{
+			if (programs[i].shader->shaderProgram == shader.shaderProgram)
+				return int(i);
+		}
+
+		ProgramEntry entry;
+		entry.shader = &shader;
+		entry.modelUniform = shader.GetUniform<glm::mat4>("model");
+		entry.normalMatrixUniform = shader.GetUniform<glm::mat3>("normalMatrix");
+		entry.materialLayersUniform = shader.GetUniform<glm::vec4>("materialLayers");
+		entry.batchProgram = -1;
+		programs.push_back(entry);
+		return int(programs.size() - 1);
+	}
+
+	void RenderQueue::SetBatchProgram(int program, const gps::Shader& batchShader)
+	{
+		int batchProgram = RegisterProgram(batchShader);
+		programs[program].batchProgram = batchProgram;
+	}
+
+	void RenderQueue::Begin(const glm::mat4& view)
+	{
+		this->view = view;
+		items.clear();
+		order.clear();
+		batches.clear();
+		commands.clear();
+		drawData.clear();
+		frameStats = RenderStats();
+	}
+
+	void RenderQueue::Add(RenderPass pass, int program, const gps::Mesh& mesh, const glm::mat4& modelMatrix, const glm::vec3& center)
+	{
+		RenderItem item;
+		item.mesh = &mesh;
+		item.program = program;
+		item.vao = IsShadowPass(pass) ? mesh.DepthVertexArray() : mesh.VertexArray();
+		item.instanceCount = 0;
+		item.modelMatrix = modelMatrix;
+		Push(pass, item, glm::vec3(modelMatrix * glm::vec4(center, 1.0f)));
+	}
+
+	void RenderQueue::AddInstanced(RenderPass pass, int program, const gps::Mesh& mesh, GLuint vao, GLsizei instanceCount, const glm::vec3& center)
+	{
+		if (instanceCount <= 0)
+			return;
+
+		RenderItem item;
+		item.mesh = &mesh;
+		item.program = program;
+		item.vao = vao;
+		item.instanceCount = instanceCount;
+		item.modelMatrix = glm::mat4(1.0f);
+		Push(pass, item, center);
+	}
+
+	void RenderQueue::Push(RenderPass pass, const RenderItem& item, const glm::vec3& worldCenter)
+	{
+		//the camera looks down -z
+		float viewDepth = -(view * glm::vec4(worldCenter, 1.0f)).z;
+		uint32_t material = IsShadowPass(pass) ? 0 : MaterialId(item.mesh->MaterialKey());
+		uint64_t key = MakeKey(pass, item.program, material, VaoId(item.vao), DepthBits(viewDepth));
+
+		order.push_back(std::make_pair(key, uint32_t(items.size())));
+		items.push_back(item);
+	}
+
+	void RenderQueue::Sort()
+	{
+		//the index breaks ties, so equal keys keep their insertion order
+		std::sort(order.begin(), order.end());
+
+		if (multiDraw)
+			BuildBatches();
+	}
+
+	bool RenderQueue::Batchable(const RenderItem& item) const
+	{
+		//meshes outside the arena have no transform attributes in their VAO
+		return item.instanceCount == 0 && item.mesh->InArena() && programs[item.program].batchProgram >= 0;
+	}
+
+	bool RenderQueue::SameBatch(RenderPass pass, const RenderItem& first, const RenderItem& item) const
+	{
+		return Batchable(item) && item.program == first.program && item.vao == first.vao &&
+			(IsShadowPass(pass) || SameTextures(*first.mesh, *item.mesh));
+	}
+
+	void RenderQueue::BuildBatches()
+	{
+		Batch none = { 0, 0 };
+		batches.assign(order.size(), none);
+
+		size_t i = 0;
+		while (i < order.size())
+		{
+			const RenderItem& first = items[order[i].second];
+			RenderPass pass = RenderPass(order[i].first >> 60);
+			size_t end = i + 1;
+			if (Batchable(first))
+			{
+				while (end < order.size() && RenderPass(order[end].first >> 60) == pass && SameBatch(pass, first, items[order[end].second]))
+					end++;
+			}
+
+			//a single item is cheaper as a plain draw with its own program
+			if (end - i < 2)
+			{
+				i = end;
+				continue;
+			}
+
+			batches[i].count = uint32_t(end - i);
+			batches[i].firstCommand = uint32_t(commands.size());
+			for (size_t j = i; j < end; j++)
+			{
+				const RenderItem& item = items[order[j].second];
+				DrawElementsIndirectCommand command;
+				command.count = item.mesh->IndexCount();
+				command.instanceCount = 1;
+				command.firstIndex = item.mesh->FirstIndex();
+				command.baseVertex = item.mesh->BaseVertex();
+				//the instance attributes start at this draw
+				command.baseInstance = GLuint(drawData.size());
+				commands.push_back(command);
+				DrawData draw;
+				draw.model = item.modelMatrix;
+				draw.materialLayers = item.mesh->MaterialLayers();
+				drawData.push_back(draw);
+			}
+			i = end;
+		}
+
+		if (commands.empty())
+			return;
+
+		GeometryArena::Instance().UploadDrawData(drawData);
+
+		if (commandBuffer == 0)
+			glGenBuffers(1, &commandBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		commandCapacity = std::max(commandCapacity, commands.size());
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commandCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0]);
+	}
+
+	void RenderQueue::Submit(RenderPass pass)
+	{
+		//the pass is the top field, so its items are one contiguous range
+		uint64_t passBegin = uint64_t(pass) << 60;
+		std::vector<std::pair<uint64_t, uint32_t> >::const_iterator it =
+			std::lower_bound(order.begin(), order.end(), std::make_pair(passBegin, uint32_t(0)));
+
+		int currentProgram = -1;
+		GLuint currentVao = 0;
+		const gps::Mesh* currentMaterial = NULL;
+		glm::mat3 normalMatrix;
+
+		while (it != order.end() && (it->first >> 60) == uint64_t(pass))
+		{
+			const RenderItem& item = items[it->second];
+			const Batch* batch = batches.empty() ? NULL : &batches[it - order.begin()];
+			bool batched = batch != NULL && batch->count > 0;
+			int itemProgram = batched ? programs[item.program].batchProgram : item.program;
+			const ProgramEntry& program = programs[itemProgram];
+
+			if (itemProgram != currentProgram)
+			{
+				program.shader->useShaderProgram();
+				currentProgram = itemProgram;
+				//the sampler uniforms belong to the program
+				currentMaterial = NULL;
+				frameStats.programSwitches++;
+			}
+
+			if (!IsShadowPass(pass) && (currentMaterial == NULL || !SameTextures(*currentMaterial, *item.mesh)))
+			{
+				frameStats.textureBinds += item.mesh->BindTextures(*program.shader);
+				currentMaterial = item.mesh;
+				frameStats.materialBinds++;
+			}
+
+			if (item.vao != currentVao)
+			{
+				currentVao = item.vao;
+				GLStateCache::Instance().BindVertexArray(currentVao);
+				frameStats.vaoBinds++;
+			}
+
+			frameStats.draws++;
+			if (batched)
+			{
+				//the texture arrays of the first item are those of the whole batch, the layers come with the draw data
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+				glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+					(const GLvoid*)(size_t(batch->firstCommand) * sizeof(DrawElementsIndirectCommand)), batch->count, 0);
+				frameStats.multiDraws++;
+				frameStats.instances += batch->count;
+				for (uint32_t j = 0; j < batch->count; j++)
+					frameStats.vertexBytes += VertexBytes(pass, *items[(it + j)->second].mesh, 1);
+				it += batch->count;
+				continue;
+			}
+
+			++it;
+			if (item.instanceCount > 0)
+			{
+				//the transforms and normal matrices come from the instance attributes, the layers are the same for
+				//every instance - the value of the disabled attribute array
+				if (!IsShadowPass(pass))
+					glVertexAttrib4fv(Mesh::MATERIAL_LAYERS_ATTRIBUTE, &item.mesh->MaterialLayers()[0]);
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.mesh->IndexCount(), GL_UNSIGNED_INT, item.mesh->IndexOffset(),
+					item.instanceCount, item.mesh->BaseVertex());
+				frameStats.instances += item.instanceCount;
+				frameStats.vertexBytes += VertexBytes(pass, *item.mesh, item.instanceCount);
+				continue;
+			}
+
+			program.modelUniform.Set(item.modelMatrix);
+			if (program.materialLayersUniform.IsActive())
+				program.materialLayersUniform.Set(item.mesh->MaterialLayers());
+			if (program.normalMatrixUniform.IsActive())
+			{
+				normalMatrix = glm::mat3(glm::inverseTranspose(view * item.modelMatrix));
+				program.normalMatrixUniform.Set(normalMatrix);
+			}
+
+			glDrawElementsBaseVertex(GL_TRIANGLES, item.mesh->IndexCount(), GL_UNSIGNED_INT, item.mesh->IndexOffset(), item.mesh->BaseVertex());
+			frameStats.instances++;
+			frameStats.vertexBytes += VertexBytes(pass, *item.mesh, 1);
+		}
+	}
+
+	uint32_t RenderQueue::MaterialId(uint64_t materialKey)
+	{
+		if (materialKey == 0)
+			return 0;
+
+		std::unordered_map<uint64_t, uint32_t>::const_iterator it = materialIds.find(materialKey);
+		if (it != materialIds.end())
+			return it->second;
+
+		//0 is kept for meshes without textures
+		uint32_t id = (uint32_t(materialIds.size()) + 1) & ((1u << MATERIAL_BITS) - 1);
+		materialIds[materialKey] = id;
+		return id;
+	}
+
+	uint32_t RenderQueue::VaoId(GLuint vao)
+	{
+		std::unordered_map<GLuint, uint32_t>::const_iterator it = vaoIds.find(vao);
+		if (it != vaoIds.end())
+			return it->second;
+
+		uint32_t id = uint32_t(vaoIds.size()) & ((1u << VAO_BITS) - 1);
+		vaoIds[vao] = id;
+		return id;
+	}
+
+	uint32_t RenderQueue::DepthBits(float viewDepth)
+	{
+		//the bits of a positive float grow with its value, the top 24 of them keep the order
+		if (!(viewDepth > 0.0f))
+			return 0;
+		uint32_t bits;
+		memcpy(&bits, &viewDepth, sizeof(bits));
+		return bits >> (32 - DEPTH_BITS - 1);
+	}
+
+	uint64_t RenderQueue::MakeKey(RenderPass pass, int program, uint32_t material, uint32_t vao, uint32_t depth) const
+	{
+		uint64_t key = uint64_t(pass) << 60;
+		uint64_t state = (uint64_t(program & ((1 << PROGRAM_BITS) - 1)) << (MATERIAL_BITS + VAO_BITS))
+			| (uint64_t(material) << VAO_BITS) | uint64_t(vao);
+
+		if (sortModes[pass] == SORT_FRONT_TO_BACK)
+			return key | (uint64_t(depth) << (PROGRAM_BITS + MATERIAL_BITS + VAO_BITS)) | state;
+		return key | (state << DEPTH_BITS) | uint64_t(depth);
+	}
+}
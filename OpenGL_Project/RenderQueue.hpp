@@ -0,0 +1,176 @@
+#pragma once
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+
+#include "FrameUniforms.hpp"
+#include "GeometryArena.hpp"
+#include "Mesh.hpp"
+#include "Shader.hpp"
+
+namespace gps
+{
+	// Passes in submission order - the pass is the top field of the sort key. Each shadow cascade is a pass of
+	// its own, PASS_SHADOW + cascade, with its static casters in PASS_SHADOW_STATIC + cascade when they are cached.
+	// A point light shadow drawn in the frame is PASS_POINT_SHADOW + slot, submitted once per cube face.
+	enum RenderPass
+	{
+		PASS_SHADOW_STATIC = 0,
+		PASS_SHADOW = PASS_SHADOW_STATIC + MAX_SHADOW_CASCADES,
+		PASS_POINT_SHADOW = PASS_SHADOW + MAX_SHADOW_CASCADES,
+		PASS_OPAQUE = PASS_POINT_SHADOW + MAX_POINT_SHADOW_UPDATES,
+		PASS_COUNT
+	};
+
+	static_assert(PASS_COUNT <= 16, "the pass field of the sort key is 4 bits");
+
+	inline bool IsShadowPass(RenderPass pass) { return pass < PASS_OPAQUE; }
+
+	enum RenderSortMode
+	{
+		// Program, then material, then VAO, then depth - fewest state changes
+		SORT_BY_STATE,
+		// Depth right after the pass, so the depth test rejects hidden fragments early
+		SORT_FRONT_TO_BACK
+	};
+
+	// Draw calls and state changes issued by RenderQueue::Submit
+	struct RenderStats
+	{
+		RenderStats() : draws(0), multiDraws(0), instances(0), programSwitches(0), materialBinds(0), textureBinds(0), vaoBinds(0),
+			vertexBytes(0) {}
+
+		unsigned long draws;
+		// Draws that were one glMultiDrawElementsIndirect over several meshes
+		unsigned long multiDraws;
+		// Meshes drawn - more than draws when some of them are instanced
+		unsigned long instances;
+		unsigned long programSwitches;
+		unsigned long materialBinds;
+		unsigned long textureBinds;
+		unsigned long vaoBinds;
+		// Vertex data the draws read, every vertex of a mesh once per instance - post-transform cache hits aside
+		uint64_t vertexBytes;
+
+		void Add(const RenderStats& other);
+	};
+
+	// Collects the meshes to draw in a frame, sorts them by a 64-bit key and submits them one pass at a time,
+	// skipping the program, texture and VAO binds that would not change anything.
+	//
+	// Key layout, most significant bits first:
+	//   SORT_BY_STATE       pass:4 program:8 material:16 vao:12 depth:24
+	//   SORT_FRONT_TO_BACK  pass:4 depth:24 program:8 material:16 vao:12
+	// Program, material and VAO fields hold dense ids handed out by the queue. The key only orders the
+	// items - Submit compares the actual GL names, so ids that wrap around cost binds but never correctness.
+	//
+	// With multi-draw on, runs of consecutive items that share the program, the texture arrays and an arena block
+	// are drawn by one glMultiDrawElementsIndirect. Their model matrices and material layers go to the arena draw
+	// data buffer, each command picking its own through baseInstance, so they are drawn with the batch program of
+	// their program - one that reads them from the instance attributes, like the instanced shaders. Otherwise
+	// every item is its own glDrawElementsBaseVertex.
+	class RenderQueue
+	{
+	public:
+		RenderQueue();
+
+		// Programs must be registered before their items are added - resolves the "model", "normalMatrix" and
+		// "materialLayers" uniforms.
+		// Returns the program index used by Add.
+		int RegisterProgram(const gps::Shader& shader);
+
+		// Program drawing the multi-draw batches of a registered program
+		void SetBatchProgram(int program, const gps::Shader& batchShader);
+		// Needs GL 4.3 or ARB_multi_draw_indirect with ARB_base_instance - off by default
+		void SetMultiDraw(bool enabled) { multiDraw = enabled; }
+		bool MultiDraw() const { return multiDraw; }
+
+		void SetSortMode(RenderPass pass, RenderSortMode mode) { sortModes[pass] = mode; }
+		RenderSortMode SortMode(RenderPass pass) const { return sortModes[pass]; }
+
+		// Starts a frame - the view orders the items by depth and gives the normal matrices
+		void Begin(const glm::mat4& view);
+
+		// Queues a mesh. The depth is taken at center, in model space (usually the center of the model bounds).
+		// Items of the shadow passes bind no textures and draw through the position stream of the mesh.
+		void Add(RenderPass pass, int program, const gps::Mesh& mesh, const glm::mat4& modelMatrix, const glm::vec3& center);
+
+		// Queues one instanced draw of a mesh through a VAO carrying the per-instance transforms
+		// (see Mesh::CreateInstancedVertexArray, CreateInstancedDepthVertexArray for the shadow passes). The program takes the model matrix from the instance attributes,
+		// the depth is taken at center, in world space.
+		void AddInstanced(RenderPass pass, int program, const gps::Mesh& mesh, GLuint vao, GLsizei instanceCount, const glm::vec3& center);
+
+		// Orders every queued item and uploads the commands and transforms of the multi-draws - done once,
+		// after all the passes have been filled
+		void Sort();
+
+		// Draws the items of one pass, in key order. The caller sets the pass state (framebuffer, viewport, culling).
+		void Submit(RenderPass pass);
+
+		size_t ItemCount() const { return items.size(); }
+		// Key of the i-th item in submission order, valid after Sort
+		uint64_t SortedKey(size_t i) const { return order[i].first; }
+
+		// Counts for the passes submitted since Begin
+		const RenderStats& FrameStats() const { return frameStats; }
+
+	private:
+		struct ProgramEntry
+		{
+			const gps::Shader* shader;
+			Uniform<glm::mat4> modelUniform;
+			Uniform<glm::mat3> normalMatrixUniform;
+			Uniform<glm::vec4> materialLayersUniform;
+			// -1 when the items of this program are never merged
+			int batchProgram;
+		};
+
+		struct RenderItem
+		{
+			const gps::Mesh* mesh;
+			int program;
+			GLuint vao;
+			// 0 for a plain draw with modelMatrix
+			GLsizei instanceCount;
+			glm::mat4 modelMatrix;
+		};
+
+		// Items merged into one multi-draw, kept at the position of the first item in order
+		struct Batch
+		{
+			uint32_t count;
+			uint32_t firstCommand;
+		};
+
+		void Push(RenderPass pass, const RenderItem& item, const glm::vec3& worldCenter);
+		bool Batchable(const RenderItem& item) const;
+		bool SameBatch(RenderPass pass, const RenderItem& first, const RenderItem& item) const;
+		void BuildBatches();
+
+		std::vector<ProgramEntry> programs;
+		std::vector<RenderItem> items;
+		// (key, item index), sorted
+		std::vector<std::pair<uint64_t, uint32_t> > order;
+		std::unordered_map<uint64_t, uint32_t> materialIds;
+		std::unordered_map<GLuint, uint32_t> vaoIds;
+		// Parallel to order, count 0 where no batch starts
+		std::vector<Batch> batches;
+		std::vector<DrawElementsIndirectCommand> commands;
+		std::vector<DrawData> drawData;
+		GLuint commandBuffer;
+		size_t commandCapacity;
+		bool multiDraw;
+		RenderSortMode sortModes[PASS_COUNT];
+		glm::mat4 view;
+		RenderStats frameStats;
+
+		uint32_t MaterialId(uint64_t materialKey);
+		uint32_t VaoId(GLuint vao);
+		static uint32_t DepthBits(float viewDepth);
+		uint64_t MakeKey(RenderPass pass, int program, uint32_t material, uint32_t vao, uint32_t depth) const;
+	};
+}
@@ -0,0 +1,313 @@
+#include "SelfTests.hpp"
+#include "GLStateCache.hpp"
+#include "ShadowAtlas.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace gps
+{
+	// Prints a step of a test and counts the failed ones
+	class TestReport
+	{
+	public:
+		explicit TestReport(const char* name) : name(name), steps(0), failures(0) {}
+
+		void Check(const char* step, bool passed)
+		{
+			steps++;
+			if (!passed)
+				failures++;
+			printf("%-60s %s\n", step, passed ? "ok" : "FAILED");
+		}
+
+		bool Finish() const
+		{
+			printf("%s: %d/%d steps passed\n", name, steps - failures, steps);
+			return failures == 0;
+		}
+
+	private:
+		const char* name;
+		int steps;
+		int failures;
+	};
+
+	//calls that reached the mock GL table since the last step, space separated
+	static std::string mockCalls;
+
+	static void RecordCall(const char* function, unsigned a, unsigned b = 0)
+	{
+		char call[64];
+		snprintf(call, sizeof(call), "%s%s(%u,%u)", mockCalls.empty() ? "" : " ", function, a, b);
+		mockCalls += call;
+	}
+
+	static void GLAPIENTRY MockUseProgram(GLuint program) { RecordCall("useProgram", program); }
+	static void GLAPIENTRY MockBindVertexArray(GLuint vao) { RecordCall("bindVertexArray", vao); }
+	static void GLAPIENTRY MockActiveTexture(GLenum unit) { RecordCall("activeTexture", unit - GL_TEXTURE0); }
+	static void GLAPIENTRY MockBindTexture(GLenum target, GLuint texture) { RecordCall("bindTexture", target, texture); }
+	static void GLAPIENTRY MockBindFramebuffer(GLenum target, GLuint framebuffer) { RecordCall("bindFramebuffer", target, framebuffer); }
+	static void GLAPIENTRY MockEnable(GLenum capability) { RecordCall("enable", capability); }
+	static void GLAPIENTRY MockDisable(GLenum capability) { RecordCall("disable", capability); }
+	static void GLAPIENTRY MockCullFace(GLenum mode) { RecordCall("cullFace", mode); }
+	static void GLAPIENTRY MockDepthFunc(GLenum func) { RecordCall("depthFunc", func); }
+	static void GLAPIENTRY MockDepthMask(GLboolean flag) { RecordCall("depthMask", flag); }
+	static void GLAPIENTRY MockViewport(GLint x, GLint y, GLsizei width, GLsizei height) { RecordCall("viewport", width, height); }
+	static void GLAPIENTRY MockDeleteTextures(GLsizei n, const GLuint* textures) { RecordCall("deleteTextures", n, textures[0]); }
+	static void GLAPIENTRY MockDeleteVertexArrays(GLsizei n, const GLuint* arrays) { RecordCall("deleteVertexArrays", n, arrays[0]); }
+
+	static GLFunctions MockFunctions()
+	{
+		GLFunctions functions;
+		functions.useProgram = MockUseProgram;
+		functions.bindVertexArray = MockBindVertexArray;
+		functions.activeTexture = MockActiveTexture;
+		functions.bindTexture = MockBindTexture;
+		functions.bindFramebuffer = MockBindFramebuffer;
+		functions.enable = MockEnable;
+		functions.disable = MockDisable;
+		functions.cullFace = MockCullFace;
+		functions.depthFunc = MockDepthFunc;
+		functions.depthMask = MockDepthMask;
+		functions.viewport = MockViewport;
+		functions.deleteTextures = MockDeleteTextures;
+		functions.deleteVertexArrays = MockDeleteVertexArrays;
+		return functions;
+	}
+
+	// True when the calls made since the last step are the expected ones, printing both otherwise
+	static bool TakeCalls(const char* expected)
+	{
+		bool same = mockCalls == expected;
+		if (!same)
+			printf("  expected: %s\n  issued  : %s\n", expected, mockCalls.c_str());
+		mockCalls.clear();
+		return same;
+	}
+
+	// Sets every kind of state the cache shadows, the same values on every call
+	static void SetEveryState(GLStateCache& cache)
+	{
+		cache.UseProgram(3);
+		cache.BindVertexArray(4);
+		cache.BindTextureUnit(1, GL_TEXTURE_2D, 5);
+		cache.BindFramebuffer(GL_FRAMEBUFFER, 6);
+		cache.Enable(GL_DEPTH_TEST);
+		cache.Disable(GL_BLEND);
+		cache.CullFace(GL_BACK);
+		cache.DepthFunc(GL_LESS);
+		cache.DepthMask(true);
+		cache.Viewport(0, 0, 640, 480);
+	}
+
+	bool TestGLStateCache()
+	{
+		TestReport report("GLStateCache");
+		GLStateCache cache(MockFunctions());
+		mockCalls.clear();
+
+		//nothing is known at first, so every call goes through once
+		SetEveryState(cache);
+		report.Check("first calls are issued", TakeCalls("useProgram(3,0) bindVertexArray(4,0) activeTexture(1,0) "
+			"bindTexture(3553,5) bindFramebuffer(36160,6) enable(2929,0) disable(3042,0) cullFace(1029,0) "
+			"depthFunc(513,0) depthMask(1,0) viewport(640,480)"));
+		SetEveryState(cache);
+		report.Check("the same calls again are dropped", TakeCalls(""));
+		report.Check("counts: 11 issued, 10 skipped", cache.IssuedCount() == 11 && cache.SkippedCount() == 10);
+
+		cache.Enable(GL_BLEND);
+		cache.Enable(GL_BLEND);
+		cache.Disable(GL_DEPTH_TEST);
+		cache.Disable(GL_DEPTH_TEST);
+		cache.Enable(GL_DEPTH_TEST);
+		report.Check("enable/disable issued only when the state flips", TakeCalls("enable(3042,0) disable(2929,0) enable(2929,0)"));
+		cache.Enable(GL_SCISSOR_TEST);
+		cache.Enable(GL_SCISSOR_TEST);
+		report.Check("capabilities not shadowed are passed through", TakeCalls("enable(3089,0) enable(3089,0)"));
+
+		cache.BindTextureUnit(1, GL_TEXTURE_2D_ARRAY, 7);
+		cache.BindTextureUnit(1, GL_TEXTURE_2D, 5);
+		report.Check("another target of the active unit skips activeTexture", TakeCalls("bindTexture(35866,7)"));
+		cache.BindTextureUnit(2, GL_TEXTURE_2D, 5);
+		cache.BindTextureUnit(1, GL_TEXTURE_2D_ARRAY, 7);
+		cache.ActiveTexture(GL_TEXTURE2);
+		report.Check("units switch only for a binding that changes", TakeCalls("activeTexture(2,0) bindTexture(3553,5)"));
+
+		cache.BindFramebuffer(GL_READ_FRAMEBUFFER, 6);
+		cache.BindFramebuffer(GL_DRAW_FRAMEBUFFER, 8);
+		cache.BindFramebuffer(GL_DRAW_FRAMEBUFFER, 8);
+		cache.BindFramebuffer(GL_FRAMEBUFFER, 6);
+		report.Check("draw and read framebuffers are tracked apart", TakeCalls("bindFramebuffer(36009,8) bindFramebuffer(36160,6)"));
+
+		cache.Viewport(0, 0, 640, 480);
+		cache.Viewport(0, 0, 2048, 2048);
+		cache.DepthMask(false);
+		cache.DepthMask(false);
+		report.Check("viewport and depth mask issued only when they change", TakeCalls("viewport(2048,2048) depthMask(0,0)"));
+
+		//a deleted name may be handed out again, its old bindings must not hide the new object
+		cache.DeleteTexture(5);
+		cache.DeleteVertexArray(4);
+		cache.BindTextureUnit(1, GL_TEXTURE_2D, 5);
+		cache.BindVertexArray(4);
+		report.Check("bindings of deleted names are forgotten", TakeCalls("deleteTextures(1,5) deleteVertexArrays(1,4) "
+			"activeTexture(1,0) bindTexture(3553,5) bindVertexArray(4,0)"));
+
+		//the context was lost and made again, or a library changed it behind the cache
+		SetEveryState(cache);
+		mockCalls.clear();
+		cache.Invalidate();
+		SetEveryState(cache);
+		report.Check("everything is issued again after Invalidate", TakeCalls("useProgram(3,0) bindVertexArray(4,0) "
+			"activeTexture(1,0) bindTexture(3553,5) bindFramebuffer(36160,6) enable(2929,0) disable(3042,0) "
+			"cullFace(1029,0) depthFunc(513,0) depthMask(1,0) viewport(640,480)"));
+		SetEveryState(cache);
+		report.Check("and dropped again once known", TakeCalls(""));
+
+		cache.ResetCounts();
+		report.Check("ResetCounts clears the counts", cache.IssuedCount() == 0 && cache.SkippedCount() == 0);
+		return report.Finish();
+	}
+
+	// True when the tiles lie inside the atlas and none of them overlap
+	static bool TilesDisjoint(const std::vector<AtlasRect>& tiles, int atlasSize)
+	{
+		for (size_t i = 0; i < tiles.size(); i++)
+		{
+			const AtlasRect& a = tiles[i];
+			if (a.x < 0 || a.y < 0 || a.x + a.size > atlasSize || a.y + a.size > atlasSize)
+				return false;
+			for (size_t j = i + 1; j < tiles.size(); j++)
+			{
+				const AtlasRect& b = tiles[j];
+				if (a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	static PointShadowRequest MakeRequest(float x, float contribution)
+	{
+		PointShadowRequest request;
+		request.position = glm::vec3(x, 1.0f, 0.0f);
+		request.range = 10.0f;
+		request.contribution = contribution;
+		return request;
+	}
+
+	static bool SameLights(const std::vector<int>& scheduled, int first, int second = -1)
+	{
+		std::vector<int> expected;
+		if (first >= 0)
+			expected.push_back(first);
+		if (second >= 0)
+			expected.push_back(second);
+		return scheduled == expected;
+	}
+
+	bool TestShadowAtlas()
+	{
+		TestReport report("ShadowAtlas");
+		const long long fullArea = 1024LL * 1024;
+
+		AtlasAllocator allocator;
+		allocator.Reset(1024, 64);
+		AtlasRect rect;
+		report.Check("a 300 texel request gets a 512 tile", allocator.Allocate(300, rect) && rect.size == 512);
+		report.Check("a 10 texel request gets a tile of minTile", allocator.Allocate(10, rect) && rect.size == 64);
+		report.Check("requests of 0 or larger than the atlas are refused", !allocator.Allocate(0, rect) && !allocator.Allocate(2048, rect));
+		report.Check("free area counts the held tiles out", allocator.FreeArea() == fullArea - 512 * 512 - 64 * 64);
+
+		//the root splits into quarters, one of them is taken and the other three wait
+		allocator.Reset(1024, 64);
+		AtlasRect first;
+		AtlasRect second;
+		allocator.Allocate(512, first);
+		allocator.Allocate(512, second);
+		allocator.Free(first);
+		report.Check("quarters do not merge while one of them is held", !allocator.Allocate(1024, rect));
+		allocator.Free(second);
+		report.Check("four free quarters merge back into their parent", allocator.Allocate(1024, rect) && rect.size == 1024);
+		allocator.Free(rect);
+
+		//mixed sizes until the atlas is full, then everything back
+		std::vector<AtlasRect> tiles;
+		const int sizes[] = { 64, 256, 128, 64, 512 };
+		for (int i = 0; allocator.Allocate(sizes[i % 5], rect) || (sizes[i % 5] > 64 && allocator.Allocate(64, rect)); i++)
+			tiles.push_back(rect);
+		report.Check("tiles fill the atlas without overlapping", allocator.FreeArea() == 0 && TilesDisjoint(tiles, 1024));
+		for (size_t i = 0; i < tiles.size(); i += 2)
+			allocator.Free(tiles[i]);
+		for (size_t i = 1; i < tiles.size(); i += 2)
+			allocator.Free(tiles[i]);
+		report.Check("freed in any order, the tiles merge back into the atlas", allocator.FreeArea() == fullArea &&
+			allocator.Allocate(1024, rect));
+
+		//six 512 faces do not fit in 1024, so both lights step down to 256 and stay there
+		PointShadowScheduler scheduler;
+		scheduler.Reset(2, 1024, 512, 64, 4);
+		std::vector<PointShadowRequest> requests;
+		requests.push_back(MakeRequest(0.0f, 1.0f));
+		requests.push_back(MakeRequest(5.0f, 1.0f));
+		report.Check("new lights are drawn on the first frame", SameLights(scheduler.Schedule(requests), 0, 1));
+		report.Check("lights that do not fit step down to 256 faces", scheduler.FaceSize(0) == 256 && scheduler.FaceSize(1) == 256);
+		bool idle = true;
+		for (int frame = 0; frame < 10; frame++)
+			idle = idle && scheduler.Schedule(requests).empty();
+		report.Check("fitted down, they are not drawn again", idle && scheduler.UpdateCount() == 2);
+
+		requests[1].castersMoved = true;
+		report.Check("moved casters redraw only their light", SameLights(scheduler.Schedule(requests), 1) && scheduler.FaceSize(1) == 256);
+		requests[1].castersMoved = false;
+
+		//a light asking for smaller faces is fitted again at once, into smaller tiles
+		requests[0].contribution = 0.2f;
+		report.Check("a light refitted to 128 faces is drawn", SameLights(scheduler.Schedule(requests), 0) && scheduler.FaceSize(0) == 128);
+		report.Check("freed tiles let the other light try 512 faces again, in vain", scheduler.Schedule(requests).empty() &&
+			scheduler.FaceSize(1) == 256);
+		report.Check("and then it stays settled", scheduler.Schedule(requests).empty());
+
+		//16 tiles of 512: two lights take 12 of them, the third fits at 256 until the first one shrinks
+		scheduler.Reset(3, 2048, 512, 64, 4);
+		requests.push_back(MakeRequest(10.0f, 1.0f));
+		requests[0].contribution = 1.0f;
+		scheduler.Schedule(requests);
+		report.Check("the third light fits at 256 faces", scheduler.FaceSize(0) == 512 && scheduler.FaceSize(1) == 512 &&
+			scheduler.FaceSize(2) == 256);
+		requests[0].contribution = 0.2f;
+		scheduler.Schedule(requests);
+		report.Check("once space is freed it grows to 512 and is drawn", SameLights(scheduler.Schedule(requests), 2) &&
+			scheduler.FaceSize(2) == 512 && scheduler.HasShadow(2));
+		std::vector<AtlasRect> faces;
+		for (int light = 0; light < 3; light++)
+		{
+			for (int face = 0; face < PointShadowScheduler::FACE_COUNT; face++)
+				faces.push_back(scheduler.Face(light, face));
+		}
+		report.Check("the faces of the lights do not overlap", TilesDisjoint(faces, 2048));
+
+		//not even six 64 faces fit in a 128 atlas
+		scheduler.Reset(1, 128, 512, 64, 4);
+		requests.resize(1);
+		scheduler.Schedule(requests);
+		scheduler.ResetCounts();
+		idle = true;
+		for (int frame = 0; frame < 10; frame++)
+			idle = idle && scheduler.Schedule(requests).empty();
+		report.Check("a refused light casts no shadow and is not tried again", idle && !scheduler.HasShadow(0) &&
+			scheduler.FaceSize(0) == 0 && scheduler.UpdateCount() == 0);
+
+		//one light a frame, the others wait their turn
+		scheduler.Reset(3, 2048, 256, 64, 1);
+		requests.assign(3, MakeRequest(0.0f, 1.0f));
+		int drawn = 0;
+		for (int frame = 0; frame < 3; frame++)
+			drawn += int(scheduler.Schedule(requests).size());
+		report.Check("the budget spreads new lights over frames", drawn == 3 && scheduler.DeferredCount() == 3 &&
+			scheduler.HasShadow(0) && scheduler.HasShadow(1) && scheduler.HasShadow(2));
+		return report.Finish();
+	}
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+namespace gps
+{
+	// Headless checks of the CPU side of the renderer, run from the command line without a window. Each one prints
+	// its steps and returns false when any of them fails.
+
+	// Drives a GLStateCache over a mock GL table: redundant binds and enable/disable calls must be dropped, the
+	// bindings of deleted names forgotten, and every call issued again after Invalidate, as after a context reset
+	bool TestGLStateCache();
+
+	// Drives the AtlasAllocator through splits, merges and a full atlas, then the PointShadowScheduler through
+	// static, moving, shrinking and refused lights: each light must be drawn only when it or its faces change
+	bool TestShadowAtlas();
+}
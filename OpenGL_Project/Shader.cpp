@@ -7,10 +7,20 @@
 //
 
 #include "Shader.hpp"
-#include <gtc/type_ptr.inl>
+#include "GLStateCache.hpp"
 #include "glm.hpp"
+#include <algorithm>
+#include <vector>
 
 namespace gps {
+    static bool uniformCacheEnabled = true;
+    static unsigned long driverLookups = 0;
+
+    Shader::Shader()
+        : shaderProgram(0), uniforms(std::make_shared<UniformTable>())
+    {
+    }
+
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -90,40 +100,159 @@ namespace gps {
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+
+        ReflectUniforms();
+    }
+
+    void Shader::ReflectUniforms()
+    {
+        //a new table, copies of the shader made before linking keep theirs
+        uniforms = std::make_shared<UniformTable>();
+
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> buffer(std::max(maxLength, 1) + 1);
+
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            UniformInfo info;
+            glGetActiveUniform(shaderProgram, GLuint(i), GLsizei(buffer.size()), &length, &info.size, &info.type, &buffer[0]);
+            std::string name(&buffer[0], length);
+            info.location = glGetUniformLocation(shaderProgram, name.c_str());
+            //members of uniform blocks have no location
+            if (info.location < 0)
+                continue;
+
+            //arrays of basic types are reported once, as "name[0]"
+            size_t bracket = name.size() > 3 ? name.size() - 3 : std::string::npos;
+            if (bracket != std::string::npos && name.compare(bracket, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, bracket);
+                (*uniforms)[base] = info;
+                for (GLint element = 0; element < info.size; element++)
+                {
+                    std::string elementName = base + "[" + std::to_string(element) + "]";
+                    UniformInfo elementInfo = { glGetUniformLocation(shaderProgram, elementName.c_str()), info.type, 1 };
+                    (*uniforms)[elementName] = elementInfo;
+                }
+            }
+            else
+            {
+                (*uniforms)[name] = info;
+            }
+        }
+    }
+
+    GLint Shader::GetUniformLocation(const std::string& name) const
+    {
+        UniformTable::const_iterator it = uniforms->find(name);
+        return it == uniforms->end() ? -1 : it->second.location;
+    }
+
+    //every sampler type the shaders declare, or may - float, integer and unsigned, shadow, array and buffer
+    static bool IsSamplerType(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_SAMPLER_1D:
+        case GL_SAMPLER_2D:
+        case GL_SAMPLER_3D:
+        case GL_SAMPLER_CUBE:
+        case GL_SAMPLER_1D_SHADOW:
+        case GL_SAMPLER_2D_SHADOW:
+        case GL_SAMPLER_CUBE_SHADOW:
+        case GL_SAMPLER_1D_ARRAY:
+        case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_1D_ARRAY_SHADOW:
+        case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_CUBE_MAP_ARRAY:
+        case GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW:
+        case GL_SAMPLER_2D_MULTISAMPLE:
+        case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+        case GL_SAMPLER_2D_RECT:
+        case GL_SAMPLER_2D_RECT_SHADOW:
+        case GL_SAMPLER_BUFFER:
+        case GL_INT_SAMPLER_2D:
+        case GL_INT_SAMPLER_2D_ARRAY:
+        case GL_INT_SAMPLER_BUFFER:
+        case GL_UNSIGNED_INT_SAMPLER_2D:
+        case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+        case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool Shader::CheckUniformType(const std::string& name, const UniformInfo& info, GLenum expected)
+    {
+        if (info.type == expected)
+            return true;
+        //samplers are set with glUniform1i
+        if (expected == GL_INT && IsSamplerType(info.type))
+            return true;
+        std::cout << "WARNING: uniform " << name << " is not of the requested type" << std::endl;
+        return false;
+    }
+
+    GLint Shader::SetterLocation(const std::string& name) const
+    {
+        if (uniformCacheEnabled)
+            return GetUniformLocation(name);
+        driverLookups++;
+        return glGetUniformLocation(shaderProgram, name.c_str());
+    }
+
+    void Shader::EnableUniformCache(bool enabled)
+    {
+        uniformCacheEnabled = enabled;
+    }
+
+    unsigned long Shader::DriverLookupCount()
+    {
+        return driverLookups;
+    }
+
+    void Shader::ResetLookupCounts()
+    {
+        driverLookups = 0;
     }
 
-    void Shader::useShaderProgram()
+    void Shader::useShaderProgram() const
     {
-        glUseProgram(this->shaderProgram);
+        GLStateCache::Instance().UseProgram(this->shaderProgram);
     }
 
-	void Shader::setBool(const std::string& name, bool value)
+	void Shader::setBool(const std::string& name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), int(value));
+		glUniform1i(SetterLocation(name), int(value));
 	}
 
-	void Shader::setInt(const std::string& name, int value)
+	void Shader::setInt(const std::string& name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(shaderProgram, name.c_str()), value);
+		glUniform1i(SetterLocation(name), value);
 	}
 
-	void Shader::setFloat(const std::string& name, float value)
+	void Shader::setFloat(const std::string& name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(shaderProgram, name.c_str()), value);
+		glUniform1f(SetterLocation(name), value);
 	}
 
-	void Shader::setVec3(const std::string& name, glm::vec3 value)
+	void Shader::setVec3(const std::string& name, glm::vec3 value) const
 	{
-		glUniform3fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, glm::value_ptr(value));
+		glUniform3fv(SetterLocation(name), 1, glm::value_ptr(value));
 	}
 
-	void Shader::setMat3(const std::string& name, glm::mat3 value)
+	void Shader::setMat3(const std::string& name, glm::mat3 value) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+		glUniformMatrix3fv(SetterLocation(name), 1, GL_FALSE, glm::value_ptr(value));
 	}
 
-	void Shader::setMat4(const std::string& name, glm::mat4 value)
+	void Shader::setMat4(const std::string& name, glm::mat4 value) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(shaderProgram, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+		glUniformMatrix4fv(SetterLocation(name), 1, GL_FALSE, glm::value_ptr(value));
 	}
 }
@@ -15,32 +15,113 @@
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <memory>
+#include <unordered_map>
 #include <detail/type_vec3.hpp>
 #include <mat3x2.hpp>
+#include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
 
 namespace gps {
 
+// Location and type of an active uniform, as reflected when the program is linked
+struct UniformInfo
+{
+    GLint location;
+    GLenum type;
+    GLint size;
+};
+
+typedef std::unordered_map<std::string, UniformInfo> UniformTable;
+
+// GL type a uniform must have to be set from T - samplers are also set through int
+template <typename T> struct UniformType;
+template <> struct UniformType<bool> { static const GLenum value = GL_BOOL; };
+template <> struct UniformType<int> { static const GLenum value = GL_INT; };
+template <> struct UniformType<float> { static const GLenum value = GL_FLOAT; };
+template <> struct UniformType<glm::vec3> { static const GLenum value = GL_FLOAT_VEC3; };
+template <> struct UniformType<glm::vec4> { static const GLenum value = GL_FLOAT_VEC4; };
+template <> struct UniformType<glm::mat3> { static const GLenum value = GL_FLOAT_MAT3; };
+template <> struct UniformType<glm::mat4> { static const GLenum value = GL_FLOAT_MAT4; };
+
+// Uniform resolved once, then set without any lookup. An inactive uniform keeps location -1, which GL ignores.
+// Sets the uniform of the program in use, like glUniform* does.
+template <typename T>
+class Uniform
+{
+public:
+    Uniform() : location(-1) {}
+    explicit Uniform(GLint location) : location(location) {}
+
+    void Set(const T& value) const;
+    GLint Location() const { return location; }
+    bool IsActive() const { return location >= 0; }
+
+private:
+    GLint location;
+};
+
+template <> inline void Uniform<bool>::Set(const bool& value) const { glUniform1i(location, int(value)); }
+template <> inline void Uniform<int>::Set(const int& value) const { glUniform1i(location, value); }
+template <> inline void Uniform<float>::Set(const float& value) const { glUniform1f(location, value); }
+template <> inline void Uniform<glm::vec3>::Set(const glm::vec3& value) const { glUniform3fv(location, 1, glm::value_ptr(value)); }
+template <> inline void Uniform<glm::vec4>::Set(const glm::vec4& value) const { glUniform4fv(location, 1, glm::value_ptr(value)); }
+template <> inline void Uniform<glm::mat3>::Set(const glm::mat3& value) const { glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+template <> inline void Uniform<glm::mat4>::Set(const glm::mat4& value) const { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+
 class Shader
 {
 public:
+    Shader();
+
     GLuint shaderProgram;
+    // Compiles and links the program, then reflects its active uniforms
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
-    void useShaderProgram();
+    void useShaderProgram() const;
+
+    // Location of an active uniform from the reflected table, -1 if the program has no such uniform.
+    // Array elements are listed both as "name" (the first one) and "name[i]".
+    GLint GetUniformLocation(const std::string& name) const;
+    // Typed handle to keep for per-draw updates - warns when the GLSL type does not match T
+    template <typename T>
+    Uniform<T> GetUniform(const std::string& name) const;
+    const UniformTable& Uniforms() const { return *uniforms; }
+
+    // With the cache off the set* functions ask the driver every time, as they used to (for comparisons)
+    static void EnableUniformCache(bool enabled);
+    // glGetUniformLocation calls made by the set* functions since the last reset
+    static unsigned long DriverLookupCount();
+    static void ResetLookupCounts();
 
 	//utility uniform functions
-	void setBool(const std::string &name, bool value);
-	void setInt(const std::string &name, int value);
-	void setFloat(const std::string &name, float value);
-	void setVec3(const std::string &name, glm::vec3 value);
-	void setMat3(const std::string &name, glm::mat3 value);
-	void setMat4(const std::string &name, glm::mat4 value);
+	void setBool(const std::string &name, bool value) const;
+	void setInt(const std::string &name, int value) const;
+	void setFloat(const std::string &name, float value) const;
+	void setVec3(const std::string &name, glm::vec3 value) const;
+	void setMat3(const std::string &name, glm::mat3 value) const;
+	void setMat4(const std::string &name, glm::mat4 value) const;
 
 private:
+    // Shared by the copies - shaders are passed around by value
+    std::shared_ptr<UniformTable> uniforms;
+
+    GLint SetterLocation(const std::string& name) const;
+    void ReflectUniforms();
+    static bool CheckUniformType(const std::string& name, const UniformInfo& info, GLenum expected);
     std::string readShaderFile(std::string fileName);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
 };
 
+template <typename T>
+Uniform<T> Shader::GetUniform(const std::string& name) const
+{
+    UniformTable::const_iterator it = uniforms->find(name);
+    if (it == uniforms->end() || !CheckUniformType(name, it->second, UniformType<T>::value))
+        return Uniform<T>();
+    return Uniform<T>(it->second.location);
+}
+
 }
 
 #endif /* Shader_hpp */
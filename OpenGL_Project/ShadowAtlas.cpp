@@ -0,0 +1,306 @@
+#include "ShadowAtlas.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <algorithm>
+
+namespace gps
+{
+	AtlasAllocator::AtlasAllocator()
+		: atlasSize(0), minTile(0)
+	{
+	}
+
+	void AtlasAllocator::Reset(int atlasSize, int minTile)
+	{
+		this->atlasSize = atlasSize;
+		this->minTile = glm::max(glm::min(minTile, atlasSize), 1);
+		freeTiles.assign(LevelOf(this->minTile) + 1, std::vector<AtlasRect>());
+		if (atlasSize > 0)
+			freeTiles[0].push_back(AtlasRect(0, 0, atlasSize));
+	}
+
+	int AtlasAllocator::LevelOf(int size) const
+	{
+		//halved while the half still holds size
+		int level = 0;
+		for (int tile = atlasSize; tile / 2 >= glm::max(size, minTile); tile /= 2)
+			level++;
+		return level;
+	}
+
+	bool AtlasAllocator::Allocate(int size, AtlasRect& rect)
+	{
+		if (size <= 0 || size > atlasSize || freeTiles.empty())
+			return false;
+		return Take(LevelOf(size), rect);
+	}
+
+	bool AtlasAllocator::Take(int level, AtlasRect& rect)
+	{
+		if (!freeTiles[level].empty())
+		{
+			rect = freeTiles[level].back();
+			freeTiles[level].pop_back();
+			return true;
+		}
+		if (level == 0)
+			return false;
+
+		AtlasRect parent;
+		if (!Take(level - 1, parent))
+			return false;
+		//the first quarter is handed out, the other three wait for the next tiles of this size
+		int half = parent.size / 2;
+		freeTiles[level].push_back(AtlasRect(parent.x + half, parent.y + half, half));
+		freeTiles[level].push_back(AtlasRect(parent.x, parent.y + half, half));
+		freeTiles[level].push_back(AtlasRect(parent.x + half, parent.y, half));
+		rect = AtlasRect(parent.x, parent.y, half);
+		return true;
+	}
+
+	void AtlasAllocator::Free(const AtlasRect& rect)
+	{
+		AtlasRect tile = rect;
+		int level = LevelOf(tile.size);
+		while (level > 0)
+		{
+			//the quarters of the same parent, all free, merge back into it
+			int parentSize = tile.size * 2;
+			int parentX = tile.x / parentSize * parentSize;
+			int parentY = tile.y / parentSize * parentSize;
+			std::vector<AtlasRect>& tiles = freeTiles[level];
+			size_t siblings[3];
+			int found = 0;
+			for (size_t i = 0; i < tiles.size() && found < 3; i++)
+			{
+				if (tiles[i].x / parentSize * parentSize == parentX && tiles[i].y / parentSize * parentSize == parentY)
+					siblings[found++] = i;
+			}
+			if (found < 3)
+				break;
+
+			//highest index first, so the others stay valid
+			std::sort(siblings, siblings + 3);
+			for (int i = 2; i >= 0; i--)
+			{
+				tiles[siblings[i]] = tiles.back();
+				tiles.pop_back();
+			}
+			tile = AtlasRect(parentX, parentY, parentSize);
+			level--;
+		}
+		freeTiles[level].push_back(tile);
+	}
+
+	long long AtlasAllocator::FreeArea() const
+	{
+		long long area = 0;
+		for (size_t level = 0; level < freeTiles.size(); level++)
+		{
+			for (size_t i = 0; i < freeTiles[level].size(); i++)
+				area += (long long)freeTiles[level][i].size * freeTiles[level][i].size;
+		}
+		return area;
+	}
+
+	PointShadowScheduler::PointShadowScheduler()
+		: maxFace(0), minFace(0), budget(0), updates(0), deferred(0), releases(0)
+	{
+	}
+
+	void PointShadowScheduler::Reset(int lightCount, int atlasSize, int maxFace, int minFace, int budget)
+	{
+		this->minFace = glm::max(minFace, 1);
+		this->maxFace = glm::max(glm::min(maxFace, atlasSize), this->minFace);
+		this->budget = budget;
+		allocator.Reset(atlasSize, this->minFace);
+
+		LightState light;
+		light.faceSize = 0;
+		light.valid = false;
+		light.stale = true;
+		light.position = glm::vec3(0.0f);
+		light.range = 0.0f;
+		light.waiting = 0;
+		light.requestedSize = 0;
+		light.fittedReleases = 0;
+		lights.assign(lightCount, light);
+		scheduled.clear();
+		updates = 0;
+		deferred = 0;
+		releases = 0;
+	}
+
+	int PointShadowScheduler::DesiredFaceSize(float contribution) const
+	{
+		if (!(contribution > 0.0f))
+			return 0;
+		int size = maxFace;
+		while (contribution < 0.5f && size / 2 >= minFace)
+		{
+			contribution *= 2.0f;
+			size /= 2;
+		}
+		return size;
+	}
+
+	const std::vector<int>& PointShadowScheduler::Schedule(const std::vector<PointShadowRequest>& requests)
+	{
+		scheduled.clear();
+		candidates.clear();
+		for (size_t i = 0; i < lights.size() && i < requests.size(); i++)
+		{
+			LightState& light = lights[i];
+			const PointShadowRequest& request = requests[i];
+			if (request.castersMoved || request.position != light.position || request.range != light.range)
+				light.stale = true;
+			light.position = request.position;
+			light.range = request.range;
+
+			//off screen, it can wait until it is seen again
+			int desired = DesiredFaceSize(request.contribution);
+			if (desired == 0)
+				continue;
+			//fitted as well as the atlas allowed, and no tile freed since - trying again would give the same faces
+			bool settled = desired == light.requestedSize && (light.faceSize == desired || light.fittedReleases == releases);
+			if (settled && (!light.stale || !light.valid))
+				continue;
+
+			Candidate candidate;
+			candidate.light = int(i);
+			candidate.hasShadow = light.valid;
+			candidate.priority = request.contribution * float(1 + light.waiting);
+			candidates.push_back(candidate);
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+		{
+			if (a.hasShadow != b.hasShadow)
+				return !a.hasShadow;
+			if (a.priority != b.priority)
+				return a.priority > b.priority;
+			return a.light < b.light;
+		});
+
+		for (size_t c = 0; c < candidates.size(); c++)
+		{
+			LightState& light = lights[candidates[c].light];
+			if (int(scheduled.size()) >= budget)
+			{
+				light.waiting++;
+				deferred++;
+				continue;
+			}
+
+			int desired = DesiredFaceSize(requests[candidates[c].light].contribution);
+			if (!light.valid || desired != light.requestedSize)
+			{
+				Release(light);
+				bool fitted = Acquire(light, desired) || (EvictOffscreen(requests) && Acquire(light, desired));
+				light.requestedSize = desired;
+				light.fittedReleases = releases;
+				if (!fitted)
+					continue;
+			}
+			else if (light.faceSize < desired && light.fittedReleases != releases)
+			{
+				//fitted down earlier and tiles were freed since - only drawn again for larger faces or moved casters
+				bool grown = Grow(light, desired);
+				light.fittedReleases = releases;
+				if (!grown && !light.stale)
+					continue;
+			}
+			light.valid = true;
+			light.stale = false;
+			light.waiting = 0;
+			scheduled.push_back(candidates[c].light);
+			updates++;
+		}
+		return scheduled;
+	}
+
+	void PointShadowScheduler::Release(LightState& light)
+	{
+		if (light.faceSize == 0)
+			return;
+		for (int face = 0; face < FACE_COUNT; face++)
+			allocator.Free(light.faces[face]);
+		light.faceSize = 0;
+		light.valid = false;
+		releases++;
+	}
+
+	bool PointShadowScheduler::AllocateFaces(int size, AtlasRect* faces)
+	{
+		int face = 0;
+		while (face < FACE_COUNT && allocator.Allocate(size, faces[face]))
+			face++;
+		if (face == FACE_COUNT)
+			return true;
+		while (face > 0)
+			allocator.Free(faces[--face]);
+		return false;
+	}
+
+	bool PointShadowScheduler::Acquire(LightState& light, int size)
+	{
+		for (; size >= minFace; size /= 2)
+		{
+			if (AllocateFaces(size, light.faces))
+			{
+				//the tiles may be larger than asked for, when size is not a power of two
+				light.faceSize = light.faces[0].size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool PointShadowScheduler::Grow(LightState& light, int size)
+	{
+		AtlasRect faces[FACE_COUNT];
+		for (; size > light.faceSize; size /= 2)
+		{
+			if (AllocateFaces(size, faces))
+			{
+				//the old faces only go once the new ones are held, so the light never ends up with less
+				bool valid = light.valid;
+				Release(light);
+				for (int face = 0; face < FACE_COUNT; face++)
+					light.faces[face] = faces[face];
+				light.faceSize = faces[0].size;
+				light.valid = valid;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool PointShadowScheduler::EvictOffscreen(const std::vector<PointShadowRequest>& requests)
+	{
+		bool evicted = false;
+		for (size_t i = 0; i < lights.size() && i < requests.size(); i++)
+		{
+			if (lights[i].faceSize > 0 && DesiredFaceSize(requests[i].contribution) == 0)
+			{
+				Release(lights[i]);
+				evicted = true;
+			}
+		}
+		return evicted;
+	}
+
+	glm::mat4 PointShadowFaceMatrix(const glm::vec3& position, float range, int face)
+	{
+		//the directions and up vectors of GL_TEXTURE_CUBE_MAP_POSITIVE_X onwards
+		static const glm::vec3 directions[PointShadowScheduler::FACE_COUNT] = {
+			glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f),
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f) };
+		static const glm::vec3 ups[PointShadowScheduler::FACE_COUNT] = {
+			glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+			glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f) };
+
+		float nearPlane = glm::min(0.1f, range * 0.5f);
+		glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, range);
+		return projection * glm::lookAt(position, position + directions[face], ups[face]);
+	}
+}
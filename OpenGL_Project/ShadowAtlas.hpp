@@ -0,0 +1,154 @@
+#pragma once
+#include <vector>
+
+#include "glm/glm.hpp"
+
+// CPU side of the point light shadows - no GL calls, so the allocation and the scheduling can be driven headless
+
+namespace gps
+{
+	// Square tile of the atlas, in texels
+	struct AtlasRect
+	{
+		AtlasRect() : x(0), y(0), size(0) {}
+		AtlasRect(int x, int y, int size) : x(x), y(y), size(size) {}
+
+		int x;
+		int y;
+		int size;
+	};
+
+	// Quadtree buddy allocator over a square atlas: tiles are powers of two, a free tile too large is split in
+	// four and the four quarters of a tile merge back into it once they are all freed. Tiles never move, so a tile
+	// keeps its content for as long as it is held.
+	class AtlasAllocator
+	{
+	public:
+		AtlasAllocator();
+
+		// Both powers of two - minTile is the smallest tile handed out
+		void Reset(int atlasSize, int minTile);
+
+		// Hands out the smallest tile holding size, at least minTile - false when no tile of that size is left
+		bool Allocate(int size, AtlasRect& rect);
+		void Free(const AtlasRect& rect);
+
+		int AtlasSize() const { return atlasSize; }
+		int MinTile() const { return minTile; }
+		// Texels not held by any tile
+		long long FreeArea() const;
+
+	private:
+		int atlasSize;
+		int minTile;
+		// Free tiles per level, level 0 the whole atlas
+		std::vector<std::vector<AtlasRect> > freeTiles;
+
+		// Level of the smallest tile holding size, clamped to the levels from the whole atlas down to minTile
+		int LevelOf(int size) const;
+		bool Take(int level, AtlasRect& rect);
+	};
+
+	// What the scheduler knows of a point light in a frame
+	struct PointShadowRequest
+	{
+		PointShadowRequest() : position(0.0f), range(0.0f), contribution(0.0f), castersMoved(false) {}
+
+		glm::vec3 position;
+		// Far plane of the faces - nothing farther casts or receives
+		float range;
+		// Share of the screen the light reaches, weighted by its brightness - 0 when it is off screen
+		float contribution;
+		// A caster inside the range moved, or was added or removed, since the last frame
+		bool castersMoved;
+	};
+
+	// Decides each frame which point light shadows are drawn again and at what resolution. A light is stale
+	// when it has no tile yet, its casters or itself moved, or its contribution asks for another face size; at most
+	// budget stale lights are drawn in a frame, the others keep their old faces. The most important go first: the
+	// ones without any shadow, then by contribution grown with the frames they have been waiting, so none starves.
+	//
+	// Face sizes follow the contribution, from maxFace for a light covering the screen down to minFace, halved for
+	// every halving of the contribution. The six faces of a light are tiles of the same size. Lights off screen are
+	// never drawn but keep their faces until a light on screen needs the space. A light that does not fit steps
+	// down until it does, and keeps the smaller faces until tiles are freed and larger ones fit; one that does not
+	// fit at minFace casts no shadow until space is freed. Neither is tried again before that.
+	class PointShadowScheduler
+	{
+	public:
+		static const int FACE_COUNT = 6;
+
+		PointShadowScheduler();
+
+		void Reset(int lightCount, int atlasSize, int maxFace, int minFace, int budget);
+
+		// Returns the lights to draw this frame, most important first, and holds their new tiles
+		const std::vector<int>& Schedule(const std::vector<PointShadowRequest>& requests);
+
+		// 0 when the light has no shadow
+		int FaceSize(int light) const { return lights[light].faceSize; }
+		const AtlasRect& Face(int light, int face) const { return lights[light].faces[face]; }
+		// True once the faces hold the shadow of the light, drawn in an earlier frame or scheduled in this one
+		bool HasShadow(int light) const { return lights[light].valid; }
+		// Face size the contribution asks for - at least minFace on screen, 0 off screen
+		int DesiredFaceSize(float contribution) const;
+
+		const AtlasAllocator& Allocator() const { return allocator; }
+		int Budget() const { return budget; }
+		// Lights drawn and lights left stale since ResetCounts
+		unsigned long UpdateCount() const { return updates; }
+		unsigned long DeferredCount() const { return deferred; }
+		void ResetCounts() { updates = 0; deferred = 0; }
+
+	private:
+		struct LightState
+		{
+			AtlasRect faces[FACE_COUNT];
+			int faceSize;
+			// The faces hold a shadow of the light, maybe an old one
+			bool valid;
+			bool stale;
+			glm::vec3 position;
+			float range;
+			// Frames it has been stale and on screen without being drawn
+			int waiting;
+			// Face size asked for when the faces were last fitted - larger than faceSize when they did not fit - and
+			// the releases count then
+			int requestedSize;
+			unsigned long fittedReleases;
+		};
+
+		struct Candidate
+		{
+			int light;
+			bool hasShadow;
+			float priority;
+		};
+
+		AtlasAllocator allocator;
+		std::vector<LightState> lights;
+		int maxFace;
+		int minFace;
+		int budget;
+		std::vector<int> scheduled;
+		std::vector<Candidate> candidates;
+		unsigned long updates;
+		unsigned long deferred;
+		// Lights whose tiles were freed - a light fitted down or refused tries again once it changes
+		unsigned long releases;
+
+		void Release(LightState& light);
+		// All six faces of a size or none
+		bool AllocateFaces(int size, AtlasRect* faces);
+		// Faces of the requested size, or smaller - false when not even minFace fits
+		bool Acquire(LightState& light, int size);
+		// Moves a light to faces larger than its own and up to size, if any fit - it keeps its faces otherwise
+		bool Grow(LightState& light, int size);
+		// Frees the faces of the lights off screen, true when there were any
+		bool EvictOffscreen(const std::vector<PointShadowRequest>& requests);
+	};
+
+	// View-projection of a cube face seen from a point light: 90 degrees, +x -x +y -y +z -z, with the
+	// orientation of the cube map faces
+	glm::mat4 PointShadowFaceMatrix(const glm::vec3& position, float range, int face);
+}
@@ -0,0 +1,287 @@
+#include "ShadowCascades.hpp"
+#include "GLStateCache.hpp"
+#include "glm/gtc/matrix_transform.hpp"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace gps
+{
+	ShadowCascades::ShadowCascades()
+		: texture(0), framebuffer(0), staticTexture(0), staticFramebuffer(0), staticSize(0), staticMargin(0), staticDraws(0),
+		cascadeBuffer(0), cascadeStride(0), lightView(1.0f), splits(0.0f)
+	{
+		for (int i = 0; i < MAX_SHADOW_CASCADES; i++)
+		{
+			matrices[i] = glm::mat4(1.0f);
+			cells[i] = glm::ivec3(0);
+			radii[i] = 0.0f;
+			staticMatrices[i] = glm::mat4(1.0f);
+			staticCells[i] = glm::ivec3(0);
+			staticRadii[i] = 0.0f;
+			staticValid[i] = false;
+		}
+	}
+
+	void ShadowCascades::Init(const ShadowSettings& settings)
+	{
+		this->settings = settings;
+		this->settings.cascades = glm::clamp(settings.cascades, 1, MAX_SHADOW_CASCADES);
+
+		if (settings.depthBits != 16 && settings.depthBits != 32)
+			this->settings.depthBits = 24;
+
+		texture = CreateDepthArray(this->settings.resolution);
+		framebuffer = CreateFramebuffer(texture);
+		if (this->settings.cacheStatic)
+		{
+			//as wide a margin as the texture size limit leaves
+			GLint maxSize = 16384;
+			glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+			staticMargin = glm::max(int(this->settings.resolution * glm::max(settings.staticMargin, 0.0f)), 0);
+			staticMargin = glm::min(staticMargin, glm::max((maxSize - this->settings.resolution) / 2, 0));
+			staticSize = this->settings.resolution + 2 * staticMargin;
+			staticTexture = CreateDepthArray(staticSize);
+			staticFramebuffer = CreateFramebuffer(staticTexture);
+		}
+
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		alignment = glm::max(alignment, 1);
+		cascadeStride = (GLsizeiptr(sizeof(glm::mat4)) + alignment - 1) / alignment * alignment;
+		glGenBuffers(1, &cascadeBuffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, cascadeBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, cascadeStride * MAX_SHADOW_CASCADES * 2, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	GLuint ShadowCascades::CreateDepthArray(GLsizei size) const
+	{
+		GLenum format = GL_DEPTH_COMPONENT24;
+		GLenum type = GL_UNSIGNED_INT;
+		if (settings.depthBits == 16)
+		{
+			format = GL_DEPTH_COMPONENT16;
+			type = GL_UNSIGNED_SHORT;
+		}
+		else if (settings.depthBits == 32)
+		{
+			format = GL_DEPTH_COMPONENT32F;
+			type = GL_FLOAT;
+		}
+
+		GLuint depthArray;
+		glGenTextures(1, &depthArray);
+		GLStateCache::Instance().BindTexture(GL_TEXTURE_2D_ARRAY, depthArray);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, size, size, settings.cascades,
+			0, GL_DEPTH_COMPONENT, type, NULL);
+		//each lookup compares 4 texels and blends the results - bilinear percentage closer filtering for free
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		//outside of a cascade is lit
+		const GLfloat border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+		return depthArray;
+	}
+
+	GLuint ShadowCascades::CreateFramebuffer(GLuint depthArray) const
+	{
+		GLuint target;
+		glGenFramebuffers(1, &target);
+		GLStateCache::Instance().BindFramebuffer(GL_FRAMEBUFFER, target);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthArray, 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			fprintf(stderr, "ERROR: shadow cascade framebuffer incomplete\n");
+		GLStateCache::Instance().BindFramebuffer(GL_FRAMEBUFFER, 0);
+		return target;
+	}
+
+	void ShadowCascades::Destroy()
+	{
+		if (texture != 0)
+			GLStateCache::Instance().DeleteTexture(texture);
+		if (framebuffer != 0)
+			glDeleteFramebuffers(1, &framebuffer);
+		if (staticTexture != 0)
+			GLStateCache::Instance().DeleteTexture(staticTexture);
+		if (staticFramebuffer != 0)
+			glDeleteFramebuffers(1, &staticFramebuffer);
+		if (cascadeBuffer != 0)
+			glDeleteBuffers(1, &cascadeBuffer);
+		texture = 0;
+		framebuffer = 0;
+		staticTexture = 0;
+		staticFramebuffer = 0;
+		cascadeBuffer = 0;
+	}
+
+	bool ShadowCascades::Attach(const gps::Shader& shader)
+	{
+		GLuint blockIndex = glGetUniformBlockIndex(shader.shaderProgram, "ShadowCascade");
+		if (blockIndex == GL_INVALID_INDEX)
+			return false;
+		glUniformBlockBinding(shader.shaderProgram, blockIndex, CASCADE_UNIFORMS_BINDING);
+		return true;
+	}
+
+	void ShadowCascades::Update(const glm::mat4& view, float fov, float aspect, float nearPlane, const glm::vec3& lightDirection)
+	{
+		const int count = settings.cascades;
+		const float farPlane = settings.shadowDistance;
+
+		//practical split scheme - a blend of even and logarithmic distances
+		float distances[MAX_SHADOW_CASCADES + 1];
+		distances[0] = nearPlane;
+		for (int i = 1; i <= count; i++)
+		{
+			float part = float(i) / count;
+			float logarithmic = nearPlane * glm::pow(farPlane / nearPlane, part);
+			float even = nearPlane + (farPlane - nearPlane) * part;
+			distances[i] = settings.splitLambda * logarithmic + (1.0f - settings.splitLambda) * even;
+		}
+		for (int i = 0; i < MAX_SHADOW_CASCADES; i++)
+			splits[i] = distances[glm::min(i + 1, count)];
+
+		//the light view only turns with the light, so the texel grid stays put while the camera moves
+		glm::vec3 direction = glm::normalize(lightDirection);
+		glm::vec3 up = glm::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::mat4 turned = glm::lookAt(direction, glm::vec3(0.0f), up);
+		if (turned != lightView)
+		{
+			lightView = turned;
+			InvalidateStatic();
+		}
+
+		glm::mat4 inverseView = glm::inverse(view);
+		float tanY = glm::tan(fov * 0.5f);
+		float tanX = tanY * aspect;
+		for (int c = 0; c < count; c++)
+		{
+			//corners of the part of the view frustum, in world space
+			glm::vec3 corners[8];
+			for (int i = 0; i < 8; i++)
+			{
+				float distance = distances[c + (i >> 2)];
+				glm::vec3 corner((i & 1 ? 1.0f : -1.0f) * tanX * distance, (i & 2 ? 1.0f : -1.0f) * tanY * distance, -distance);
+				corners[i] = glm::vec3(inverseView * glm::vec4(corner, 1.0f));
+			}
+			glm::vec3 center(0.0f);
+			for (int i = 0; i < 8; i++)
+				center += corners[i] / 8.0f;
+			float radius = 0.0f;
+			for (int i = 0; i < 8; i++)
+				radius = glm::max(radius, glm::length(corners[i] - center));
+			//rounded up, so float noise does not change the size from frame to frame
+			radius = glm::ceil(radius * 16.0f) / 16.0f;
+
+			//whole texels across, whole depth steps along - the step is the radius
+			glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+			float texel = 2.0f * radius / settings.resolution;
+			cells[c] = glm::ivec3(int(glm::floor(lightCenter.x / texel)), int(glm::floor(lightCenter.y / texel)),
+				int(glm::floor(lightCenter.z / radius)));
+			radii[c] = radius;
+			matrices[c] = CellMatrix(cells[c], radius, radius);
+			staticMatrices[c] = CellMatrix(cells[c], radius, radius + staticMargin * texel);
+		}
+
+		std::vector<unsigned char> data(size_t(cascadeStride) * MAX_SHADOW_CASCADES * 2, 0);
+		for (int c = 0; c < count; c++)
+		{
+			memcpy(&data[size_t(cascadeStride) * c], &matrices[c], sizeof(glm::mat4));
+			memcpy(&data[size_t(cascadeStride) * (MAX_SHADOW_CASCADES + c)], &staticMatrices[c], sizeof(glm::mat4));
+		}
+		//orphaned, last frame's cascades may still be drawing from it
+		glBindBuffer(GL_UNIFORM_BUFFER, cascadeBuffer);
+		glBufferData(GL_UNIFORM_BUFFER, data.size(), NULL, GL_DYNAMIC_DRAW);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, data.size(), &data[0]);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	glm::mat4 ShadowCascades::CellMatrix(const glm::ivec3& cell, float radius, float extent) const
+	{
+		float texel = 2.0f * radius / settings.resolution;
+		float x = cell.x * texel;
+		float y = cell.y * texel;
+		//the view looks down -z - the depth range reaches back to the casters between the light and the part, and
+		//covers the whole step the center may be in
+		float nearZ = (cell.z + 1) * radius;
+		float farZ = cell.z * radius;
+		glm::mat4 lightProjection = glm::ortho(x - extent, x + extent, y - extent, y + extent,
+			-nearZ - radius - settings.casterDistance, -farZ + radius);
+		return lightProjection * lightView;
+	}
+
+	void ShadowCascades::BeginCascade(int cascade)
+	{
+		GLStateCache& glState = GLStateCache::Instance();
+		if (settings.cacheStatic)
+		{
+			//a copy on the GPU - no caster is drawn for it. The cascade moved by whole texels since its static layer
+			//was drawn, so it is the square of the layer that many texels from the middle.
+			glm::ivec2 offset = glm::ivec2(staticMargin) + glm::ivec2(cells[cascade]) - glm::ivec2(staticCells[cascade]);
+			glState.BindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebuffer);
+			glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, cascade);
+			glState.BindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+			glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+			glBlitFramebuffer(offset.x, offset.y, offset.x + settings.resolution, offset.y + settings.resolution,
+				0, 0, settings.resolution, settings.resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+			glState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		}
+		else
+		{
+			glState.BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, cascade);
+		}
+		glState.Viewport(0, 0, settings.resolution, settings.resolution);
+		if (!settings.cacheStatic)
+			glClear(GL_DEPTH_BUFFER_BIT);
+		glBindBufferRange(GL_UNIFORM_BUFFER, CASCADE_UNIFORMS_BINDING, cascadeBuffer, cascadeStride * cascade, sizeof(glm::mat4));
+	}
+
+	bool ShadowCascades::StaticDirty(int cascade) const
+	{
+		if (!settings.cacheStatic)
+			return false;
+		glm::ivec3 moved = glm::abs(cells[cascade] - staticCells[cascade]);
+		return !staticValid[cascade] || staticRadii[cascade] != radii[cascade] || moved.z != 0 || moved.x > staticMargin ||
+			moved.y > staticMargin;
+	}
+
+	void ShadowCascades::BeginStaticCascade(int cascade)
+	{
+		GLStateCache& glState = GLStateCache::Instance();
+		glState.BindFramebuffer(GL_FRAMEBUFFER, staticFramebuffer);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTexture, 0, cascade);
+		glState.Viewport(0, 0, staticSize, staticSize);
+		glClear(GL_DEPTH_BUFFER_BIT);
+		glBindBufferRange(GL_UNIFORM_BUFFER, CASCADE_UNIFORMS_BINDING, cascadeBuffer, cascadeStride * (MAX_SHADOW_CASCADES + cascade),
+			sizeof(glm::mat4));
+
+		staticCells[cascade] = cells[cascade];
+		staticRadii[cascade] = radii[cascade];
+		staticValid[cascade] = true;
+		staticDraws++;
+	}
+
+	void ShadowCascades::InvalidateStatic()
+	{
+		for (int i = 0; i < MAX_SHADOW_CASCADES; i++)
+			staticValid[i] = false;
+	}
+
+	size_t ShadowCascades::MemoryBytes() const
+	{
+		//24-bit depth is stored in 32 bits
+		size_t texelBytes = settings.depthBits == 16 ? 2 : 4;
+		size_t layerTexels = size_t(settings.resolution) * settings.resolution;
+		if (settings.cacheStatic)
+			layerTexels += size_t(staticSize) * staticSize;
+		return layerTexels * settings.cascades * texelBytes;
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+
+#include "FrameUniforms.hpp"
+#include "Shader.hpp"
+
+namespace gps
+{
+	// Size, depth format and reach of the shadow cascades - set from the command line before Init
+	struct ShadowSettings
+	{
+		ShadowSettings()
+			: resolution(2048), cascades(3), depthBits(24), shadowDistance(120.0f), splitLambda(0.75f), casterDistance(100.0f),
+			cacheStatic(true), staticMargin(0.125f)
+		{
+		}
+
+		// Width and height of every cascade
+		GLsizei resolution;
+		// 1 to MAX_SHADOW_CASCADES
+		int cascades;
+		// 16, 24 or 32 (float)
+		int depthBits;
+		// View distance where the last cascade ends - nothing farther has shadows
+		float shadowDistance;
+		// 0 splits the distance evenly, 1 logarithmically
+		float splitLambda;
+		// How far towards the light, past the part of the view a cascade covers, its casters can be
+		float casterDistance;
+		// Keep the static casters of each cascade in a layer of their own, drawn again only when it changes
+		bool cacheStatic;
+		// Border the static layers have on every side, as a share of the resolution - how far a cascade can move
+		// before its static layer is drawn again
+		float staticMargin;
+	};
+
+	// Cascaded shadow maps of the directional light: the camera frustum up to the shadow distance is split in
+	// parts, each with an orthographic light projection around it and one layer of a depth texture array.
+	// The projections are fitted to the bounding sphere of their part, so their size never changes as the camera
+	// turns, and their origin is snapped to whole texels, so the shadow edges do not swim as it moves. Their depth
+	// range is snapped too, to steps of the radius, so it only changes when the camera has moved that far along
+	// the light.
+	//
+	// The depth texture compares in hardware (sampler2DArrayShadow). The depth shaders read the light space of
+	// the cascade being drawn from the "ShadowCascade" block, bound to one slot of the cascade buffer at a time.
+	//
+	// With cacheStatic, the casters that never move are drawn into a second texture array, and a cascade starts
+	// each frame as a copy of its static layer with only the moving casters drawn over it. A static layer covers
+	// its cascade plus a margin of staticMargin on every side, with the same texels and depth range, so the copy
+	// is the part under the cascade wherever it moved within the margin. A static layer is drawn again when its
+	// cascade leaves the margin or its depth range changes, when the light turns, or after InvalidateStatic.
+	class ShadowCascades
+	{
+	public:
+		static const GLuint CASCADE_UNIFORMS_BINDING = 1;
+
+		ShadowCascades();
+
+		// Creates the depth texture array, its framebuffer and the buffer of the cascade matrices
+		void Init(const ShadowSettings& settings);
+		void Destroy();
+
+		// Points the "ShadowCascade" block of a depth program at the cascade binding, false if it does not declare it
+		static bool Attach(const gps::Shader& shader);
+
+		// Splits the camera frustum and fits a light projection around each part - call once per frame, before
+		// the cascades are drawn. lightDirection points towards the light.
+		void Update(const glm::mat4& view, float fov, float aspect, float nearPlane, const glm::vec3& lightDirection);
+
+		// Makes a cascade the depth target, with its viewport, and the light space of the depth programs. The cascade
+		// starts as a copy of its static layer when caching, cleared otherwise.
+		void BeginCascade(int cascade);
+
+		// True when the static layer of a cascade has to be drawn this frame - valid after Update
+		bool StaticDirty(int cascade) const;
+		// Same as BeginCascade for the static layer, which is cleared and counted as up to date
+		void BeginStaticCascade(int cascade);
+		// Static casters were added, moved or removed - every static layer is drawn again
+		void InvalidateStatic();
+		bool Caching() const { return settings.cacheStatic; }
+		// Static layers drawn since ResetCounts
+		unsigned long StaticDrawCount() const { return staticDraws; }
+		void ResetCounts() { staticDraws = 0; }
+
+		int Count() const { return settings.cascades; }
+		const glm::mat4& Matrix(int cascade) const { return matrices[cascade]; }
+		// Light space of the static layer of a cascade if it were drawn this frame - the cascade and its margin
+		const glm::mat4& StaticMatrix(int cascade) const { return staticMatrices[cascade]; }
+		// View distance where each cascade ends, the unused ones at the last distance
+		const glm::vec4& Splits() const { return splits; }
+		GLuint Texture() const { return texture; }
+		const ShadowSettings& Settings() const { return settings; }
+		size_t MemoryBytes() const;
+
+	private:
+		ShadowCascades(const ShadowCascades&) = delete;
+		ShadowCascades& operator=(const ShadowCascades&) = delete;
+
+		ShadowSettings settings;
+		GLuint texture;
+		GLuint framebuffer;
+		// Static casters only, 0 without caching - layers of staticSize, the resolution and a margin on each side
+		GLuint staticTexture;
+		GLuint staticFramebuffer;
+		GLsizei staticSize;
+		int staticMargin;
+		glm::mat4 staticMatrices[MAX_SHADOW_CASCADES];
+		//cell and radius of each cascade when its static layer was drawn
+		glm::ivec3 staticCells[MAX_SHADOW_CASCADES];
+		float staticRadii[MAX_SHADOW_CASCADES];
+		bool staticValid[MAX_SHADOW_CASCADES];
+		unsigned long staticDraws;
+		GLuint cascadeBuffer;
+		// Distance between the matrices in the buffer, a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT - the
+		// cascades first, then the static layers
+		GLsizeiptr cascadeStride;
+		glm::mat4 lightView;
+		glm::mat4 matrices[MAX_SHADOW_CASCADES];
+		//origin of each cascade in whole texels across the light and whole depth steps along it, and its radius
+		glm::ivec3 cells[MAX_SHADOW_CASCADES];
+		float radii[MAX_SHADOW_CASCADES];
+		glm::vec4 splits;
+
+		GLuint CreateDepthArray(GLsizei size) const;
+		// Light space of a cascade cell, extent the half width of what it covers
+		glm::mat4 CellMatrix(const glm::ivec3& cell, float radius, float extent) const;
+		GLuint CreateFramebuffer(GLuint depthArray) const;
+	};
+}
@@ -7,72 +7,195 @@
 //
 
 #include "SkyBox.hpp"
+#include "GLStateCache.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 namespace gps {
     
     SkyBox::SkyBox()
+        : skyboxVAO(0), skyboxVBO(0), cubemapTexture(0)
     {
         
     }
     
     void SkyBox::Load(std::vector<const GLchar*> cubeMapFaces)
     {
-        cubemapTexture = LoadSkyBoxTextures(cubeMapFaces);
-        InitSkyBox();
+        SkyBoxData data;
+        Decode(cubeMapFaces, data);
+        while (!UploadStep(data))
+            ;
     }
     
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+    const unsigned char* SkyBoxData::FacePixels(size_t level, size_t face) const
     {
-        shader.useShaderProgram();
-        
-        //set the view and projection matrices
-        glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+        return cache.IsOpen() ? cache.Face(level, face) : images[face].LevelPixels(level);
+    }
+    
+    void SkyBox::Decode(std::vector<const GLchar*> cubeMapFaces, SkyBoxData& data)
+    {
+        typedef std::chrono::high_resolution_clock clock;
+        clock::time_point decodeStart = clock::now();
+        data.faces.assign(cubeMapFaces.begin(), cubeMapFaces.end());
         
-        glDepthFunc(GL_LEQUAL);
+        if (data.cache.Open(data.faces))
+        {
+            //fault the pages in here rather than in glTexImage2D on the render thread
+            data.cache.Prefetch();
+            data.size = data.cache.Size();
+            data.levelCount = data.cache.LevelCount();
+            double mapTime = std::chrono::duration<double, std::milli>(clock::now() - decodeStart).count();
+            printf("skybox: mapped %s (%.1f MB) in %.1f ms\n", gps::CubeMapCache::PathFor(data.faces).c_str(),
+                   data.cache.DataSize() / (1024.0 * 1024.0), mapTime);
+            return;
+        }
         
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
+        if (!DecodeFaces(data.faces, data.images, 0))
+        {
+            //the cube map is left empty
+            data.images.clear();
+            return;
+        }
+        data.size = data.images[0].Width();
+        data.levelCount = data.images[0].LevelCount();
+        double decodeTime = std::chrono::duration<double, std::milli>(clock::now() - decodeStart).count();
         
-        glDepthFunc(GL_LESS);
+        clock::time_point writeStart = clock::now();
+        bool written = gps::CubeMapCache::Write(data.faces, data.images);
+        double writeTime = std::chrono::duration<double, std::milli>(clock::now() - writeStart).count();
+        printf("skybox: %u faces decoded in %.1f ms, cache %s in %.1f ms\n", GLuint(data.images.size()), decodeTime,
+               written ? "written" : "NOT written", writeTime);
     }
     
-    GLuint SkyBox::LoadSkyBoxTextures(std::vector<const GLchar*> skyBoxFaces)
+    bool SkyBox::DecodeFaces(const std::vector<std::string>& faces, std::vector<gps::Image>& images, unsigned int threadCount)
     {
-        GLuint textureID;
-        glGenTextures(1, &textureID);
-        glActiveTexture(GL_TEXTURE0);
+        if (threadCount == 0)
+            threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        threadCount = std::min(threadCount, GLuint(faces.size()));
+        
+        //RGBA rows are 4-byte aligned and upload without a driver-side conversion
+        int force_channels = 4;
         
-        int width,height, n;
-        unsigned char* image;
-        int force_channels = 3;
+        typedef std::chrono::high_resolution_clock clock;
+        images.clear();
+        images.resize(faces.size());
+        std::vector<double> faceTimes(faces.size(), 0.0);
+        std::atomic<size_t> nextFace(0);
+        auto decodeFaces = [&]()
+        {
+            for (size_t i = nextFace++; i < faces.size(); i = nextFace++)
+            {
+                clock::time_point faceStart = clock::now();
+                if (images[i].Load(faces[i], force_channels))
+                    images[i].GenerateMipChain();
+                faceTimes[i] = std::chrono::duration<double, std::milli>(clock::now() - faceStart).count();
+            }
+        };
         
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-        for(GLuint i = 0; i < skyBoxFaces.size(); i++)
+        std::vector<std::thread> threads;
+        for (unsigned int t = 1; t < threadCount; t++)
+            threads.push_back(std::thread(decodeFaces));
+        decodeFaces();
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+        
+        bool complete = true;
+        for (size_t i = 0; i < faces.size(); i++)
         {
-            image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
-            if (!image) {
-                fprintf(stderr, "ERROR: could not load %s\n", skyBoxFaces[i]);
-                return false;
+            if (!images[i].IsLoaded()) {
+                fprintf(stderr, "ERROR: could not load %s\n", faces[i].c_str());
+                complete = false;
+            }
+            else if (images[i].Width() != images[0].Width() || images[i].Height() != images[i].Width()) {
+                fprintf(stderr, "ERROR: cube map face %s is not square or not the size of the others\n", faces[i].c_str());
+                complete = false;
+            }
+            else {
+                printf("%s: decoded in %.1f ms\n", faces[i].c_str(), faceTimes[i]);
             }
+        }
+        return complete && faces.size() == gps::CUBEMAP_FACES;
+    }
+    
+    bool SkyBox::UploadStep(SkyBoxData& data)
+    {
+        if (data.levelCount == 0)
+        {
+            //no faces: same as a failed load, there is no cube map
+            cubemapTexture = 0;
+            InitSkyBox();
+            return true;
+        }
+        
+        GLStateCache& state = GLStateCache::Instance();
+        state.ActiveTexture(GL_TEXTURE0);
+        if (data.uploadedLevels == 0 && data.nextFace == 0)
+        {
+            glGenTextures(1, &cubemapTexture);
+            state.BindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, GLint(data.levelCount) - 1);
+        }
+        else
+        {
+            state.BindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        }
+        
+        //levels up to 512x512 go in one step, larger ones one face per step
+        const GLint level = GLint(data.levelCount - 1 - data.uploadedLevels);
+        const int levelSize = std::max(data.size >> level, 1);
+        const size_t faceCount = levelSize <= 512 ? gps::CUBEMAP_FACES - data.nextFace : 1;
+        for (size_t i = 0; i < faceCount; i++, data.nextFace++)
+        {
             glTexImage2D(
-                         GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0,
-                         GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image
+                         GL_TEXTURE_CUBE_MAP_POSITIVE_X + GLenum(data.nextFace), level,
+                         GL_RGB, levelSize, levelSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, data.FacePixels(level, data.nextFace)
                          );
         }
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
-        
-        return textureID;
+        
+        if (data.nextFace == gps::CUBEMAP_FACES)
+        {
+            //the level is complete, sampling can start from it
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, level);
+            data.nextFace = 0;
+            data.uploadedLevels++;
+            if (skyboxVAO == 0)
+                InitSkyBox();
+        }
+        state.BindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        
+        if (data.uploadedLevels < data.levelCount)
+            return false;
+        
+        data.images.clear();
+        data.cache.Close();
+        return true;
+    }
+    
+    void SkyBox::Draw(const gps::Shader& shader)
+    {
+        //not uploaded yet
+        if (skyboxVAO == 0)
+            return;
+        
+        //view and projection come from the frame uniform block, the shader drops the translation
+        shader.useShaderProgram();
+        
+        GLStateCache& state = GLStateCache::Instance();
+        state.DepthFunc(GL_LEQUAL);
+        
+        state.BindVertexArray(skyboxVAO);
+        shader.setInt("skybox", 0);
+        state.BindTextureUnit(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+        
+        state.DepthFunc(GL_LESS);
     }
     
     void SkyBox::InitSkyBox()
@@ -124,14 +247,14 @@ namespace gps {
         glGenVertexArrays(1, &(this->skyboxVAO));
         glGenBuffers(1, &skyboxVBO);
         
-        glBindVertexArray(skyboxVAO);
+        GLStateCache::Instance().BindVertexArray(skyboxVAO);
         glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
         
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
         
-        glBindVertexArray(0);
+        GLStateCache::Instance().BindVertexArray(0);
     }
     
     GLuint SkyBox::GetTextureId()
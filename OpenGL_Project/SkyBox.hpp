@@ -16,20 +16,51 @@
 #include "stb_image.h"
 #include "glm/glm.hpp"
 #include "glm/gtc/type_ptr.hpp"
+#include "Image.hpp"
+#include "CubeMapCache.hpp"
 
 namespace gps {
+    // CPU side of a skybox, produced by SkyBox::Decode and consumed by SkyBox::UploadStep.
+    // The faces come either from the mapped cube map cache or from the decoded images.
+    struct SkyBoxData
+    {
+        SkyBoxData() : size(0), levelCount(0), uploadedLevels(0), nextFace(0) {}
+
+        const unsigned char* FacePixels(size_t level, size_t face) const;
+
+        std::vector<std::string> faces;
+        std::vector<gps::Image> images;
+        gps::CubeMapCache cache;
+        int size;
+        size_t levelCount;
+        //levels are uploaded from the smallest
+        size_t uploadedLevels;
+        size_t nextFace;
+
+    private:
+        SkyBoxData(const SkyBoxData&) = delete;
+        SkyBoxData& operator=(const SkyBoxData&) = delete;
+    };
+
     class SkyBox
     {
     public:
         SkyBox();
         void Load(std::vector<const GLchar*> cubeMapFaces);
-        void Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+        // Maps the cached cube map, or decodes the faces in parallel and writes the cache - touches no GL state
+        static void Decode(std::vector<const GLchar*> cubeMapFaces, SkyBoxData& data);
+        // Decodes the faces as RGBA with their mip chains on up to threadCount threads (0: one per hardware thread)
+        static bool DecodeFaces(const std::vector<std::string>& faces, std::vector<gps::Image>& images, unsigned int threadCount);
+        // Uploads one face (or one whole small level) of the decoded data, smallest levels first, and returns
+        // true once every level is resident. The skybox can be drawn from the first step on, at low resolution.
+        bool UploadStep(SkyBoxData& data);
+        bool IsDrawable() const { return skyboxVAO != 0; }
+        void Draw(const gps::Shader& shader);
         GLuint GetTextureId();
     private:
         GLuint skyboxVAO;
         GLuint skyboxVBO;
         GLuint cubemapTexture;
-        GLuint LoadSkyBoxTextures(std::vector<const GLchar*> cubeMapFaces);
         void InitSkyBox();
     };
 }
@@ -0,0 +1,177 @@
+#include "TextureBaker.hpp"
+#include "FileUtils.hpp"
+#include "KtxFile.hpp"
+#include "ImageKernels.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace gps
+{
+	void BuildMipChain(const Image& image, std::vector<std::vector<unsigned char> >& levels)
+	{
+		int width = image.Width();
+		int height = image.Height();
+		levels.clear();
+		levels.push_back(std::vector<unsigned char>(image.Pixels(), image.Pixels() + size_t(width) * height * 4));
+
+		//Kaiser-filtered in linear space - baking is offline, so the sharper filter is affordable
+		while (width > 1 || height > 1)
+		{
+			int nextWidth = width > 1 ? width / 2 : 1;
+			int nextHeight = height > 1 ? height / 2 : 1;
+			std::vector<unsigned char> level(size_t(nextWidth) * nextHeight * 4);
+			DownsampleKaiserSRGB(levels.back().data(), width, height, level.data());
+
+			levels.push_back(std::move(level));
+			width = nextWidth;
+			height = nextHeight;
+		}
+	}
+
+	//peak signal to noise ratio over the channels the format keeps
+	static double ComputePSNR(const unsigned char* a, const unsigned char* b, size_t pixelCount, int channels)
+	{
+		double squaredError = 0.0;
+		for (size_t i = 0; i < pixelCount; i++)
+		{
+			for (int c = 0; c < channels; c++)
+			{
+				double difference = double(a[i * 4 + c]) - double(b[i * 4 + c]);
+				squaredError += difference * difference;
+			}
+		}
+		double meanSquaredError = squaredError / (double(pixelCount) * channels);
+		if (meanSquaredError == 0.0)
+			return 99.0;
+		return 10.0 * log10(255.0 * 255.0 / meanSquaredError);
+	}
+
+	static int KeptChannels(CompressedFormat format)
+	{
+		switch (format)
+		{
+		case COMPRESSED_BC1: return 3;
+		case COMPRESSED_BC3: return 4;
+		case COMPRESSED_BC4: return 1;
+		default: return 2;
+		}
+	}
+
+	bool BakeTexture(const std::string& imageFileName, BakedTexture& result)
+	{
+		FileStamp sourceStamp;
+		Image image;
+		if (!GetFileStamp(imageFileName, sourceStamp, true) || !image.Load(imageFileName, 4))
+		{
+			fprintf(stderr, "ERROR: could not load %s\n", imageFileName.c_str());
+			return false;
+		}
+		image.FlipVertically();
+
+		std::vector<std::vector<unsigned char> > mips;
+		BuildMipChain(image, mips);
+
+		result.width = image.Width();
+		result.height = image.Height();
+		result.format = ChooseCompressedFormat(image.Pixels(), image.Width(), image.Height());
+		result.levelCount = mips.size();
+		result.uncompressedSize = 0;
+		result.compressedSize = 0;
+
+		std::vector<std::vector<unsigned char> > blocks(mips.size());
+		std::vector<CompressedLevel> levels(mips.size());
+		int width = image.Width();
+		int height = image.Height();
+		for (size_t i = 0; i < mips.size(); i++)
+		{
+			blocks[i].resize(CompressedLevelSize(result.format, width, height));
+			CompressImage(mips[i].data(), width, height, result.format, blocks[i].data());
+
+			levels[i].width = width;
+			levels[i].height = height;
+			levels[i].data = blocks[i].data();
+			levels[i].size = blocks[i].size();
+			result.uncompressedSize += mips[i].size();
+			result.compressedSize += blocks[i].size();
+
+			width = width > 1 ? width / 2 : 1;
+			height = height > 1 ? height / 2 : 1;
+		}
+
+		std::vector<unsigned char> decoded(mips[0].size());
+		DecompressImage(blocks[0].data(), image.Width(), image.Height(), result.format, decoded.data());
+		result.psnr = ComputePSNR(mips[0].data(), decoded.data(), size_t(image.Width()) * image.Height(), KeptChannels(result.format));
+
+		std::string ktxFileName = KtxFile::PathFor(imageFileName);
+		if (!KtxFile::Write(ktxFileName, result.format, levels, sourceStamp))
+		{
+			fprintf(stderr, "ERROR: could not write %s\n", ktxFileName.c_str());
+			return false;
+		}
+
+		//the container must give back exactly what was encoded
+		KtxFile written;
+		FileStamp writtenStamp;
+		bool same = written.Open(ktxFileName) && written.Format() == result.format && written.LevelCount() == levels.size() &&
+			written.GetSourceStamp(writtenStamp) && memcmp(&writtenStamp, &sourceStamp, sizeof(FileStamp)) == 0;
+		for (size_t i = 0; same && i < levels.size(); i++)
+		{
+			const CompressedLevel& level = written.Level(i);
+			same = level.width == levels[i].width && level.height == levels[i].height && level.size == levels[i].size &&
+				memcmp(level.data, levels[i].data, level.size) == 0;
+		}
+		if (!same)
+		{
+			fprintf(stderr, "ERROR: %s does not round-trip\n", ktxFileName.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	static const char* FormatName(CompressedFormat format)
+	{
+		switch (format)
+		{
+		case COMPRESSED_BC1: return "BC1";
+		case COMPRESSED_BC3: return "BC3";
+		case COMPRESSED_BC4: return "BC4";
+		default: return "BC5";
+		}
+	}
+
+	void BakeTextures(const std::string& directory)
+	{
+		std::vector<std::string> files;
+		ListFiles(directory, ".jpg", files);
+		ListFiles(directory, ".png", files);
+		ListFiles(directory, ".tga", files);
+
+		size_t totalUncompressed = 0;
+		size_t totalCompressed = 0;
+		int failed = 0;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+			BakedTexture result;
+			if (!BakeTexture(files[i], result))
+			{
+				failed++;
+				continue;
+			}
+			double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+			printf("%-50s %4dx%-4d %s %2d levels %6zu KB -> %5zu KB (%.1fx) PSNR %.1f dB, %.0f ms\n", files[i].c_str(),
+				result.width, result.height, FormatName(result.format), int(result.levelCount), result.uncompressedSize / 1024,
+				result.compressedSize / 1024, double(result.uncompressedSize) / result.compressedSize, result.psnr, time);
+			totalUncompressed += result.uncompressedSize;
+			totalCompressed += result.compressedSize;
+		}
+
+		printf("%d textures baked, %d failed: %zu KB -> %zu KB of video memory\n", int(files.size()) - failed, failed,
+			totalUncompressed / 1024, totalCompressed / 1024);
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include "BlockCompression.hpp"
+#include "Image.hpp"
+
+namespace gps
+{
+	// Result of baking one image
+	struct BakedTexture
+	{
+		int width;
+		int height;
+		CompressedFormat format;
+		size_t levelCount;
+		size_t uncompressedSize; // RGBA8 with the full mip chain, as uploaded before baking
+		size_t compressedSize;
+		double psnr; // of the largest level, decoded back on the CPU
+	};
+
+	// Builds the full mip chain of an RGBA8 image with the Kaiser filter - level 0 is the image itself
+	void BuildMipChain(const Image& image, std::vector<std::vector<unsigned char> >& levels);
+
+	// Decodes an image, flips it for OpenGL, builds its mip chain and writes every level block-compressed
+	// to "<image>.ktx". Reads the file back to check the container round-trips. No GL calls.
+	bool BakeTexture(const std::string& imageFileName, BakedTexture& result);
+
+	// Bakes every .jpg, .png and .tga under the directory and prints the savings
+	void BakeTextures(const std::string& directory);
+}
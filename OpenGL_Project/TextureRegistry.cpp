@@ -0,0 +1,165 @@
+#include "TextureRegistry.hpp"
+#include "GLStateCache.hpp"
+#include "FileUtils.hpp"
+#include <cstdio>
+#include <iostream>
+
+namespace gps
+{
+	TextureRegistry& TextureRegistry::Instance()
+	{
+		//never destroyed: the model globals release their textures during static destruction, after main returns,
+		//and a function-local static would already be gone by then
+		static TextureRegistry* registry = new TextureRegistry;
+		return *registry;
+	}
+
+	TextureRegistry::TextureRegistry()
+		: residentBytes(0), peakBytes(0), savedBytes(0), hits(0), skippedDecodes(0), compressedLoads(0), compressedTextures(false)
+	{
+	}
+
+	//the size is part of the key, so a hash collision also needs equal sizes
+	static uint64_t ContentKey(uint64_t contentHash, uint64_t size)
+	{
+		return HashBytes(&size, sizeof(size), contentHash);
+	}
+
+	bool TextureRegistry::Prepare(const std::string& path, int channels, uint64_t& hash, Image& image, std::unique_ptr<KtxFile>& compressed)
+	{
+		bool known;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::unordered_map<std::string, uint64_t>::const_iterator it = hashByPath.find(path);
+			known = it != hashByPath.end();
+			if (known)
+			{
+				hash = it->second;
+				if (entries.count(hash))
+				{
+					skippedDecodes++;
+					return true;
+				}
+			}
+		}
+
+		//a baked texture stores the stamp of its source, which also gives the content hash without reading the image
+		if (compressedTextures)
+		{
+			std::unique_ptr<KtxFile> baked(new KtxFile());
+			FileStamp stamp;
+			if (baked->Open(KtxFile::PathFor(path)) && baked->GetSourceStamp(stamp) && IsFileStampCurrent(path, stamp))
+			{
+				hash = ContentKey(stamp.hash, stamp.size);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				hashByPath[path] = hash;
+				if (entries.count(hash))
+				{
+					skippedDecodes++;
+					return true;
+				}
+				compressedLoads++;
+				compressed = std::move(baked);
+				return true;
+			}
+		}
+
+		MappedFile file;
+		if (!file.Open(path))
+			return false;
+
+		if (!known)
+		{
+			hash = ContentKey(HashBytes(file.Data(), file.Size()), file.Size());
+
+			std::lock_guard<std::mutex> lock(mutex);
+			hashByPath[path] = hash;
+			if (entries.count(hash))
+			{
+				skippedDecodes++;
+				return true;
+			}
+		}
+
+		return image.LoadFromMemory(file.Data(), file.Size(), channels);
+	}
+
+	GLuint TextureRegistry::Acquire(uint64_t hash)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<uint64_t, Entry>::iterator it = entries.find(hash);
+		if (it == entries.end())
+			return 0;
+
+		it->second.references++;
+		hits++;
+		savedBytes += it->second.bytes;
+		return it->second.id;
+	}
+
+	void TextureRegistry::Insert(uint64_t hash, GLuint id, size_t bytes, const std::string& path, int layers)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Entry& entry = entries[hash];
+		entry.id = id;
+		entry.references = 1;
+		entry.bytes = bytes;
+		entry.layers = layers;
+		entry.path = path;
+		hashById[id] = hash;
+
+		residentBytes += bytes;
+		if (residentBytes > peakBytes)
+			peakBytes = residentBytes;
+	}
+
+	void TextureRegistry::Retain(GLuint id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<GLuint, uint64_t>::iterator it = hashById.find(id);
+		if (it != hashById.end())
+			entries[it->second].references++;
+	}
+
+	void TextureRegistry::Release(GLuint id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::unordered_map<GLuint, uint64_t>::iterator it = hashById.find(id);
+		//textures that failed to load, or were already cleared
+		if (it == hashById.end())
+			return;
+
+		Entry& entry = entries[it->second];
+		if (--entry.references > 0)
+			return;
+
+		GLStateCache::Instance().DeleteTexture(entry.id);
+		residentBytes -= entry.bytes;
+		entries.erase(it->second);
+		hashById.erase(it);
+	}
+
+	void TextureRegistry::Clear()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::unordered_map<uint64_t, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+			GLStateCache::Instance().DeleteTexture(it->second.id);
+		entries.clear();
+		hashById.clear();
+		residentBytes = 0;
+	}
+
+	void TextureRegistry::PrintReport()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		int layers = 0;
+		for (std::unordered_map<uint64_t, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			layers += it->second.layers;
+		std::cout << "texture registry: " << entries.size() << " texture arrays holding " << layers << " textures, "
+			<< residentBytes / 1024 << " KB resident ("
+			<< peakBytes / 1024 << " KB peak)" << std::endl;
+		std::cout << "texture registry: " << hits << " shared references, " << skippedDecodes.load() << " decodes skipped, "
+			<< savedBytes / 1024 << " KB of video memory saved, " << compressedLoads.load() << " loaded block-compressed" << std::endl;
+	}
+}
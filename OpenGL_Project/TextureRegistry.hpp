@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "GLEW/glew.h"
+#include "Image.hpp"
+#include "KtxFile.hpp"
+
+namespace gps
+{
+	// Process-wide cache of model textures, keyed by the hash of the image file content, so
+	// identical files shipped under different paths are decoded and uploaded once. Model textures are
+	// texture arrays - a texture alone in its array is keyed by its content, an array of several by its layers.
+	// Textures are reference counted and deleted when the last model releases them. The instance lives until the
+	// process ends, so models released at exit still find it.
+	class TextureRegistry
+	{
+	public:
+		static TextureRegistry& Instance();
+
+		// Any thread - hashes the file (once per path) and, unless the content is already resident, maps its
+		// baked .ktx when it is current and compression is enabled, or decodes the image otherwise.
+		// Returns false if the file cannot be read.
+		bool Prepare(const std::string& path, int channels, uint64_t& hash, Image& image, std::unique_ptr<KtxFile>& compressed);
+
+		// Baked textures are only used when the GL implementation supports their formats
+		void EnableCompressedTextures(bool enable) { compressedTextures = enable; }
+
+		// Render thread - takes a reference on a resident texture, 0 if there is none for this content
+		GLuint Acquire(uint64_t hash);
+		// Render thread - registers a freshly uploaded texture array with one reference
+		void Insert(uint64_t hash, GLuint id, size_t bytes, const std::string& path, int layers = 1);
+		// Render thread - takes another reference on a texture returned by Acquire or registered by Insert
+		void Retain(GLuint id);
+		// Render thread - drops a reference, deleting the texture with the last one
+		void Release(GLuint id);
+
+		// Deletes every texture - call while the GL context is still alive
+		void Clear();
+
+		void PrintReport();
+
+	private:
+		TextureRegistry();
+		TextureRegistry(const TextureRegistry&) = delete;
+		TextureRegistry& operator=(const TextureRegistry&) = delete;
+
+		struct Entry
+		{
+			GLuint id;
+			int references;
+			size_t bytes;
+			int layers;
+			std::string path;
+		};
+
+		std::mutex mutex;
+		std::unordered_map<uint64_t, Entry> entries;
+		std::unordered_map<GLuint, uint64_t> hashById;
+		std::unordered_map<std::string, uint64_t> hashByPath;
+
+		size_t residentBytes;
+		size_t peakBytes;
+		size_t savedBytes;
+		int hits;
+		std::atomic<int> skippedDecodes;
+		std::atomic<int> compressedLoads;
+		std::atomic<bool> compressedTextures;
+	};
+}
@@ -1,7 +1,6 @@
 #include "TreeCluster.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 #include <ctime>
-#include <gtc/matrix_inverse.hpp>
 
 
 namespace gps
@@ -13,9 +12,9 @@ namespace gps
 	{
 	}
 
-	TreeCluster::TreeCluster(std::string filename, std::string basePath, int size)
+	TreeCluster::TreeCluster(AssetHandle<Model3D> model, int size)
 	{
-		initCluster(filename, basePath, size);
+		initCluster(model, size);
 	}
 
 	void TreeCluster::translate(glm::vec3 t)
@@ -25,6 +24,7 @@ namespace gps
 		{
 			this->modelMatrices[i] = glm::translate(this->modelMatrices[i], t);
 		}
+		instancesDirty = true;
 	}
 
 	void TreeCluster::scale(glm::vec3 s)
@@ -34,6 +34,7 @@ namespace gps
 		{
 			this->modelMatrices[i] = glm::scale(this->modelMatrices[i], s);
 		}
+		instancesDirty = true;
 	}
 
 	void TreeCluster::rotate(float angle, glm::vec3 r)
@@ -43,17 +44,19 @@ namespace gps
 		{
 			this->modelMatrices[i] = glm::rotate(this->modelMatrices[i], glm::radians(angle), r);
 		}
+		instancesDirty = true;
 	}
 
 
-	void TreeCluster::initCluster(std::string filename, std::string basePath, int size)
+	void TreeCluster::initCluster(AssetHandle<Model3D> model, int size)
 	{
+		this->model = model;
+		this->modelMatrices.reserve(size);
 		for (int i = 0; i < size; ++i)
 		{
-			
-			this->model = Model3D(filename, basePath);
 			this->modelMatrices.emplace_back(1.0f);
 		}
+		instancesDirty = true;
 	}
 
 	void TreeCluster::randomize(int maxXOffset, int maxYOffset, float minScaleOffset, float maxScaleOffset)
@@ -73,17 +76,113 @@ namespace gps
 			this->modelMatrices[i] = glm::translate(this->modelMatrices[i], glm::vec3(randPosX, 0.0f, randPosZ));
 			this->modelMatrices[i] = glm::rotate(this->modelMatrices[i], glm::radians(randRot), glm::vec3(0.0f, 1.0f, 0.0f));
 		}
+		instancesDirty = true;
 	}
 
-	void TreeCluster::draw(Shader shader, glm::mat4 view)
+	BoundingBox TreeCluster::treeBounds(int tree) const
 	{
-		shader.useShaderProgram();
-		int size = this->modelMatrices.size();
-		for (int i = 0; i < size; ++i)
+		if (!model.IsReady())
+			return BoundingBox();
+		return model->Bounds().Transformed(modelMatrices[tree]);
+	}
+
+	void TreeCluster::enqueue(RenderQueue& queue, RenderPass pass, int program, const std::vector<uint32_t>* visibleTrees)
+	{
+		//nothing to draw until the model is uploaded
+		if (!model.IsReady())
+			return;
+
+		updateInstances();
+		if (!instanced)
+		{
+			int size = this->modelMatrices.size();
+			if (visibleTrees == NULL)
+			{
+				for (int i = 0; i < size; ++i)
+					model->Enqueue(queue, pass, program, this->modelMatrices[i]);
+			}
+			else
+			{
+				for (size_t i = 0; i < visibleTrees->size(); ++i)
+					model->Enqueue(queue, pass, program, this->modelMatrices[(*visibleTrees)[i]]);
+			}
+			return;
+		}
+
+		size_t count = modelMatrices.size();
+		if (visibleTrees != NULL)
+		{
+			//every frame, the visible trees change with the camera
+			visibleMatrices.resize(visibleTrees->size());
+			for (size_t i = 0; i < visibleTrees->size(); ++i)
+				visibleMatrices[i] = modelMatrices[(*visibleTrees)[i]];
+			count = visibleMatrices.size();
+			uploadInstances(pass, visibleMatrices.empty() ? NULL : &visibleMatrices[0], count);
+			passesDirty[pass] = true;
+		}
+		else if (passesDirty[pass])
+		{
+			uploadInstances(pass, modelMatrices.empty() ? NULL : &modelMatrices[0], count);
+			passesDirty[pass] = false;
+		}
+		if (count == 0)
+			return;
+
+		const std::vector<Mesh>& meshes = model->Meshes();
+		for (size_t i = 0; i < meshes.size(); ++i)
+			queue.AddInstanced(pass, program, meshes[i], instancedVAOs[pass][i], GLsizei(count), instancesCenter);
+	}
+
+	void TreeCluster::updateInstances()
+	{
+		const std::vector<Mesh>& meshes = model->Meshes();
+		for (int pass = 0; pass < PASS_COUNT && instanced; ++pass)
 		{
-			shader.setMat4("model", this->modelMatrices[i]);
-			shader.setMat3("normalMatrix", glm::mat3(glm::inverseTranspose(view * this->modelMatrices[i])));
-			model.Draw(shader);
+			if (instanceBuffers[pass] == 0)
+			{
+				glGenBuffers(1, &instanceBuffers[pass]);
+			}
+
+			//the VAOs point at the instance buffer, which keeps its name when refilled
+			while (instancedVAOs[pass].size() < meshes.size())
+			{
+				const Mesh& mesh = meshes[instancedVAOs[pass].size()];
+				instancedVAOs[pass].push_back(IsShadowPass(RenderPass(pass)) ? mesh.CreateInstancedDepthVertexArray(instanceBuffers[pass])
+					: mesh.CreateInstancedVertexArray(instanceBuffers[pass]));
+			}
 		}
+
+		if (!instancesDirty)
+			return;
+
+		glm::vec3 sum(0.0f);
+		glm::vec3 center = model->Bounds().IsEmpty() ? glm::vec3(0.0f) : model->Bounds().Center();
+		for (size_t i = 0; i < modelMatrices.size(); ++i)
+			sum += glm::vec3(modelMatrices[i] * glm::vec4(center, 1.0f));
+		instancesCenter = modelMatrices.empty() ? center : sum / float(modelMatrices.size());
+
+		for (int pass = 0; pass < PASS_COUNT; ++pass)
+			passesDirty[pass] = true;
+		instancesDirty = false;
+	}
+
+	void TreeCluster::uploadInstances(RenderPass pass, const glm::mat4* matrices, size_t count)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffers[pass]);
+		//orphaned, the draws of the last frame may still read the old storage
+		glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+		if (count > 0)
+			glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::mat4), matrices);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void TreeCluster::drawPlaceholders(const Shader& shader, BoundsPlaceholder& placeholder)
+	{
+		if (model.IsReady())
+			return;
+
+		int size = this->modelMatrices.size();
+		for (int i = 0; i < size; ++i)
+			placeholder.Draw(shader, *model, false, this->modelMatrices[i]);
 	}
 }
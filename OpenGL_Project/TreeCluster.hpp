@@ -1,5 +1,7 @@
 #pragma once
 #include "Model3D.hpp"
+#include "AssetLoader.hpp"
+#include "Placeholder.hpp"
 #include "Shader.hpp"
 
 namespace gps {
@@ -10,7 +12,7 @@ namespace gps {
 
 		TreeCluster();
 
-		TreeCluster(std::string filename, std::string basePath, int size);
+		TreeCluster(AssetHandle<Model3D> model, int size);
 		
 
 		void translate(glm::vec3 t);
@@ -19,14 +21,46 @@ namespace gps {
 
 		void randomize(int maxXOffset = 10, int maxYOffset = 10, float minScaleOffset = 0.9f, float maxScaleOffset = 1.2f);
 		
-		void draw(Shader shader, glm::mat4 view);
+		// Queues every tree of the cluster once the model is uploaded. Instanced, the program has to take the
+		// model matrix from the instance attributes (shaders/*Instanced.vert) - one draw per mesh for all the trees.
+		// Otherwise it is the plain program and every tree is a separate draw.
+		// With a visible list (tree indices, ascending), only those trees are queued.
+		void enqueue(RenderQueue& queue, RenderPass pass, int program, const std::vector<uint32_t>* visibleTrees);
 
-		Model3D model;
+		void setInstanced(bool instanced) { this->instanced = instanced; }
+		bool isInstanced() const { return instanced; }
+		int size() const { return int(modelMatrices.size()); }
+
+		// World space box of a tree, empty until the model is uploaded
+		BoundingBox treeBounds(int tree) const;
+
+		// Call after changing modelMatrices directly - the transforms are uploaded again before the next draw
+		void invalidateInstances() { instancesDirty = true; }
+
+		// Bounding boxes of the trees while the model is loading
+		void drawPlaceholders(const Shader& shader, BoundsPlaceholder& placeholder);
+
+		AssetHandle<Model3D> model;
 		std::vector<glm::mat4> modelMatrices;
 
 	private:
 
-		void initCluster(std::string filename, std::string basePath, int size);
+		bool instanced = true;
+		// Model matrices of the trees each pass draws, read by the instanced VAOs - one buffer per pass, as both
+		// passes of a frame are queued before either is drawn
+		GLuint instanceBuffers[PASS_COUNT] = {};
+		// Per pass, one per mesh of the model, created once it is uploaded
+		std::vector<GLuint> instancedVAOs[PASS_COUNT];
+		// Per pass, true until every tree is uploaded again - culled uploads only hold the visible ones
+		bool passesDirty[PASS_COUNT] = {};
+		bool instancesDirty = true;
+		std::vector<glm::mat4> visibleMatrices;
+		// World space center of the trees, orders the instanced draws
+		glm::vec3 instancesCenter = glm::vec3(0.0f);
+
+		void initCluster(AssetHandle<Model3D> model, int size);
+		void updateInstances();
+		void uploadInstances(RenderPass pass, const glm::mat4* matrices, size_t count);
 			
 	};
 
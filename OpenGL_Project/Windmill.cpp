@@ -1,5 +1,4 @@
 #include "Windmill.hpp"
-#include <gtc/matrix_inverse.hpp>
 
 namespace gps
 {
@@ -32,25 +31,22 @@ namespace gps
 	}
 
 
-	void Windmill::draw(gps::Shader shader, glm::mat4 viewMatrix)
+	void Windmill::enqueue(gps::RenderQueue& queue, gps::RenderPass pass, int program)
 	{
-		shader.useShaderProgram();
-		shader.setMat4("model", this->bladesModelMatrix);
-		glm::mat3 normalMatrix = glm::mat3(glm::inverseTranspose(viewMatrix * this->bladesModelMatrix));
-		shader.setMat3("normalMatrix", normalMatrix);
-		blades.Draw(shader);
-
-		shader.useShaderProgram();
-		shader.setMat4("model", this->windmillModelMatrix);
-		normalMatrix = glm::mat3(glm::inverseTranspose(viewMatrix * this->windmillModelMatrix));
-		shader.setMat3("normalMatrix", normalMatrix);
-		windmill.Draw(shader);
+		blades->Enqueue(queue, pass, program, this->bladesModelMatrix);
+		windmill->Enqueue(queue, pass, program, this->windmillModelMatrix);
 	}
 
-	void Windmill::init(std::string windmill, std::string blades, std::string baseDir)
+	void Windmill::drawPlaceholders(const gps::Shader& shader, BoundsPlaceholder& placeholder)
 	{
-		this->windmill = Model3D(windmill, baseDir);
-		this->blades = Model3D(blades, baseDir);
+		placeholder.Draw(shader, *blades, blades.IsReady(), this->bladesModelMatrix);
+		placeholder.Draw(shader, *windmill, windmill.IsReady(), this->windmillModelMatrix);
+	}
+
+	void Windmill::init(AssetHandle<Model3D> windmill, AssetHandle<Model3D> blades)
+	{
+		this->windmill = windmill;
+		this->blades = blades;
 
 		this->windmillModelMatrix = glm::mat4(1.0f);
 		this->bladesModelMatrix = glm::mat4(1.0f);
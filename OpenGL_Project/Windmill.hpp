@@ -2,6 +2,8 @@
 #include "Camera.hpp"
 #include "Shader.hpp"
 #include "Model3D.hpp"
+#include "AssetLoader.hpp"
+#include "Placeholder.hpp"
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 
@@ -16,9 +18,9 @@ namespace gps
 			
 		}
 
-		Windmill(std::string windmill, std::string blades, std::string baseDir)
+		Windmill(AssetHandle<Model3D> windmill, AssetHandle<Model3D> blades)
 		{
-			this->init(windmill, blades, baseDir);
+			this->init(windmill, blades);
 		}
 
 		void translate(glm::vec3 t);
@@ -29,20 +31,29 @@ namespace gps
 
 		void rotateBlades(float deltaTime);
 
-		void draw(gps::Shader shader, glm::mat4 viewMatrix);
+		static const int PART_COUNT = 2;
+
+		// The blades (0) turn, the mill (1) does not
+		const AssetHandle<Model3D>& partModel(int part) const { return part == 0 ? blades : windmill; }
+		const glm::mat4& partMatrix(int part) const { return part == 0 ? bladesModelMatrix : windmillModelMatrix; }
+
+		void enqueue(gps::RenderQueue& queue, gps::RenderPass pass, int program);
+
+		// Bounding boxes of the parts that are still loading
+		void drawPlaceholders(const gps::Shader& shader, BoundsPlaceholder& placeholder);
 
 	private:
 				
 		float bladesRotationAngle = 0.0f;
 		float bladesRotationAngleStep = 0.001f;
 
-		gps::Model3D windmill;
-		gps::Model3D blades;
+		AssetHandle<Model3D> windmill;
+		AssetHandle<Model3D> blades;
 
 		glm::mat4 windmillModelMatrix;
 		glm::mat4 bladesModelMatrix;
 
-		void init(std::string windmill, std::string blades, std::string baseDir);
+		void init(AssetHandle<Model3D> windmill, AssetHandle<Model3D> blades);
 
 	public:
 		void set_blades_rotation_angle(float blades_rotation_angle)
@@ -6,9 +6,38 @@ layout(location=2) in vec2 vTexCoords;
 
 out vec4 fragPosEye;
 
+//per-frame data shared by every program - must match gps::FrameUniforms (FrameUniforms.hpp), std140 layout
+//directional light
+struct DirLight{
+    vec3 direction;
+    vec3 color;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout(std140) uniform FrameUniforms{
+    mat4 view;
+    mat4 projection;
+    //light space of each shadow cascade, nearest first
+    mat4 cascadeMatrices[4];
+    mat4 lightDirMatrix;
+    //view distance where each cascade ends
+    vec4 cascadeSplits;
+
+    DirLight dirLight;
+    //see gps::LightClusters
+    vec4 clusterParams;
+    ivec4 clusterGrid;
+
+    vec3 fogColor;
+    float fogDensity;
+    bool fogEnabled;
+    int cascadeCount;
+};
+
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main() 
 {
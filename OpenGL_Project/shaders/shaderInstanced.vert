@@ -0,0 +1,62 @@
+#version 400 core
+
+layout(location=0) in vec3 vPosition;
+layout(location=1) in vec3 vNormal;
+layout(location=2) in vec2 vTexCoords;
+//per-instance model matrix, locations 3-6 (see Mesh::CreateInstancedVertexArray)
+layout(location=3) in mat4 instanceModel;
+//material layers of the draw, location 7 (Mesh::MATERIAL_LAYERS_ATTRIBUTE)
+layout(location=7) in vec4 instanceMaterialLayers;
+
+out vec3 normal;
+out vec3 normalEye;
+out vec4 fragPosEye;
+//world position, projected into the shadow cascade the fragment falls in
+out vec4 fragPosWorld;
+out vec2 fTexCoords;
+flat out vec4 fMaterialLayers;
+
+//per-frame data shared by every program - must match gps::FrameUniforms (FrameUniforms.hpp), std140 layout
+//directional light
+struct DirLight{
+    vec3 direction;
+    vec3 color;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout(std140) uniform FrameUniforms{
+    mat4 view;
+    mat4 projection;
+    //light space of each shadow cascade, nearest first
+    mat4 cascadeMatrices[4];
+    mat4 lightDirMatrix;
+    //view distance where each cascade ends
+    vec4 cascadeSplits;
+
+    DirLight dirLight;
+    //see gps::LightClusters
+    vec4 clusterParams;
+    ivec4 clusterGrid;
+
+    vec3 fogColor;
+    float fogDensity;
+    bool fogEnabled;
+    int cascadeCount;
+};
+
+void main() 
+{
+	//the normal matrix is derived here instead of being sent per tree
+	mat3 modelView = mat3(view * instanceModel);
+	//compute eye space coordinates
+	fragPosEye = view * instanceModel * vec4(vPosition, 1.0f);
+	normal = vNormal;
+	normalEye = transpose(inverse(modelView)) * vNormal;
+	fTexCoords = vTexCoords;
+	fMaterialLayers = instanceMaterialLayers;
+	fragPosWorld = instanceModel * vec4(vPosition, 1.0f);
+	gl_Position = projection * fragPosEye;
+}
@@ -1,12 +1,16 @@
 #version 400 core
 
 in vec3 normal;
+in vec3 normalEye;
 in vec4 fragPosEye;
-in vec4 fragPosLightSpace;
+in vec4 fragPosWorld;
 in vec2 fTexCoords;
+//layers of the ambient, diffuse and specular textures in their arrays
+flat in vec4 fMaterialLayers;
 
 out vec4 fColor;
 
+//per-frame data shared by every program - must match gps::FrameUniforms (FrameUniforms.hpp), std140 layout
 //directional light
 struct DirLight{
     vec3 direction;
@@ -17,25 +21,47 @@ struct DirLight{
     vec3 specular;
 };
 
-//posiitional light
+layout(std140) uniform FrameUniforms{
+    mat4 view;
+    mat4 projection;
+    //light space of each shadow cascade, nearest first
+    mat4 cascadeMatrices[4];
+    mat4 lightDirMatrix;
+    //view distance where each cascade ends
+    vec4 cascadeSplits;
+
+    DirLight dirLight;
+    //see gps::LightClusters
+    vec4 clusterParams;
+    ivec4 clusterGrid;
+
+    vec3 fogColor;
+    float fogDensity;
+    bool fogEnabled;
+    int cascadeCount;
+};
+
+//positional light, read from clusterLights
 struct PointLight{
     vec3 position;
-    vec3 color;
-
+    float range;
     float constant;
+    vec3 color;
     float linear;
-    float quadratic;
 
     vec3 ambient;
+    float quadratic;
     vec3 diffuse;
     vec3 specular;
+    //light of its shadow in the PointShadows block, -1 without one
+    int shadow;
 };
 
 //MAterial components
 struct Material{
-    sampler2D ambient;
-    sampler2D diffuse;
-    sampler2D specular;
+    sampler2DArray ambient;
+    sampler2DArray diffuse;
+    sampler2DArray specular;
 };
 
 //Phong shading components
@@ -47,22 +73,30 @@ struct Phong{
 
 float shininess = 64.0f;
 
-//fog attributes
-uniform bool fogEnabled;
-uniform vec3 fogColor;
-uniform float fogDensity;
-
 uniform Material material;
 
-//lights
-uniform DirLight dirLight;
-uniform PointLight pointLights[2];
+//one layer per cascade, compared in hardware
+uniform sampler2DArrayShadow shadowMap;
+
+//point light shadows - must match gps::PointShadowUniforms (PointShadows.hpp), std140 layout
+layout(std140) uniform PointShadows{
+    //light * 6 + face, faces +x -x +y -y +z -z
+    mat4 pointFaceMatrices[12];
+    //x, y and size of each face in the atlas, in texture coordinates, then 1 / its size in texels
+    vec4 pointFaceRects[12];
+    ivec4 pointShadowEnabled;
+};
 
-uniform	mat3 normalMatrix;
-uniform mat3 lightDirMatrix;
-uniform mat4 view;
+//every face of every point light is a tile of this one, compared in hardware
+uniform sampler2DShadow pointShadowMap;
 
-uniform sampler2D shadowMap;
+//clustered point lights - see gps::LightClusters (LightClusters.hpp)
+//five texels per light: position and range, color and constant, ambient and linear, diffuse and quadratic,
+//specular and shadow
+uniform samplerBuffer clusterLights;
+//offset in clusterIndices and count of the lights of every cluster
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
 
 //function declarations
 Phong calculateDirLight(DirLight lightD, vec3 normal, vec3 viewDir);
@@ -71,47 +105,51 @@ Phong calculatePointLight(PointLight lightP, vec3 normal, vec3 fragPos, vec3 vie
 
 float computeShadow();
 
+float computePointShadow(int light, vec3 lightPosition);
+
+int computeCluster();
+
+PointLight fetchPointLight(int light);
+
 float computeFog();
 
 void main() 
 {
-    vec4 diffTex = texture(material.diffuse, fTexCoords);
+    vec4 diffTex = texture(material.diffuse, vec3(fTexCoords, fMaterialLayers.y));
     if (diffTex.a < 0.1){
         discard;    
     }
 
     vec3 cameraPosEye = vec3(0.0f);// in eye coordinates the camera is at the origin
 
-    vec3 normalEye = normalize(normalMatrix * normal);
+    vec3 normalEyeN = normalize(normalEye);
 
     vec3 viewDirN = normalize(cameraPosEye - fragPosEye.xyz);
 
-    Phong directional = calculateDirLight(dirLight, normalEye, viewDirN);
+    Phong directional = calculateDirLight(dirLight, normalEyeN, viewDirN);
 
     float shadow = computeShadow();
 
     vec3 directionalC = directional.ambient + (1.0f - shadow) * directional.diffuse + (1.0f - shadow) * directional.specular;
 
-    Phong positional[2];
-    
-    positional[0] = calculatePointLight(pointLights[0], normalEye, fragPosEye.xyz, viewDirN);
-    positional[1] = calculatePointLight(pointLights[1], normalEye, fragPosEye.xyz, viewDirN);
-
-    vec3 positional0 = positional[0].ambient + positional[0].diffuse + positional[0].specular;
-    vec3 positional1 = positional[1].ambient + positional[1].diffuse + positional[1].specular;
+    //only the lights reaching the cluster of the fragment
+    vec3 positionalC = vec3(0.0f);
+    uvec2 lightRange = texelFetch(clusterRanges, computeCluster()).xy;
+    for (uint i = 0u; i < lightRange.y; i++)
+    {
+        PointLight pointLight = fetchPointLight(int(texelFetch(clusterIndices, int(lightRange.x + i)).r));
+        Phong positional = calculatePointLight(pointLight, normalEyeN, fragPosEye.xyz, viewDirN);
+        float pointShadow = pointLight.shadow >= 0 ? computePointShadow(pointLight.shadow, pointLight.position) : 0.0f;
+        positionalC += positional.ambient + (1.0f - pointShadow) * (positional.diffuse + positional.specular);
+    }
 
     //vec3 color = directionalC;
-    //vec3 color = positional0;
-    // vec3 color = positional1;
-    // vec3 color = directionalC + positional0;
-    // vec3 color = directionalC + positional1;
-    // vec3 l = (view * vec4(pointLights[0].position, 1.0f)).xyz;
-    // vec3 color = normalize(pointLights[0].position - fragPosEye.xyz);
-    vec3 color = directionalC + positional0 + positional1;
+    //vec3 color = positionalC;
+    vec3 color = directionalC + positionalC;
 
     fColor = vec4(color, 1.0f);
-    //fColor = vec4(normalEye, 1.0f);
-    //fColor = vec4(normalize(lightDirMatrix * dirLight.direction), 1.0f);
+    //fColor = vec4(normalEyeN, 1.0f);
+    //fColor = vec4(normalize(mat3(lightDirMatrix) * dirLight.direction), 1.0f);
     if (fogEnabled){      
         float fogFactor = computeFog();
         fColor = vec4(fogColor, 1.0f) * (1 - fogFactor) + vec4(color, 1.0f) *  fogFactor;
@@ -122,7 +160,7 @@ Phong calculateDirLight(DirLight lightD, vec3 normalN, vec3 viewDir){
 
     Phong phong;
 
-    vec3 lightDir = normalize(lightDirMatrix * lightD.direction);
+    vec3 lightDir = normalize(mat3(lightDirMatrix) * lightD.direction);
     //vec3 lightDir = normalize((view * vec4(lightD.direction, 1.0f)).xyz);
 
     //diffuse shading
@@ -132,9 +170,9 @@ Phong calculateDirLight(DirLight lightD, vec3 normalN, vec3 viewDir){
     vec3 halfVector = normalize(lightDir + viewDir);
     float spec = pow(max(dot(halfVector, normalN), 0.0f), shininess);
 
-    phong.ambient = vec3(texture(material.diffuse, fTexCoords));
-    phong.diffuse = vec3(texture(material.diffuse, fTexCoords));
-    phong.specular = vec3(texture(material.specular, fTexCoords));
+    phong.ambient = vec3(texture(material.diffuse, vec3(fTexCoords, fMaterialLayers.y)));
+    phong.diffuse = vec3(texture(material.diffuse, vec3(fTexCoords, fMaterialLayers.y)));
+    phong.specular = vec3(texture(material.specular, vec3(fTexCoords, fMaterialLayers.z)));
 
     phong.ambient *= lightD.ambient * lightD.color;
     phong.diffuse *= lightD.diffuse * diff * lightD.color;
@@ -160,7 +198,9 @@ Phong calculatePointLight(PointLight lightP, vec3 normalN, vec3 fragPos, vec3 vi
 
     float dist = length(lightPosEye - fragPos);
 
-    float att = 1.0/(lightP.constant + lightP.linear * dist + lightP.quadratic * (dist * dist));
+    //faded out towards the range, past which the light is in no cluster
+    float falloff = clamp(1.0f - pow(dist / lightP.range, 4.0f), 0.0f, 1.0f);
+    float att = falloff * falloff / (lightP.constant + lightP.linear * dist + lightP.quadratic * (dist * dist));
 
     //float attenuation = 1.0f;
     
@@ -168,30 +208,121 @@ Phong calculatePointLight(PointLight lightP, vec3 normalN, vec3 fragPos, vec3 vi
     phong.diffuse = att * lightP.diffuse * diff * lightP.color;
     phong.specular = att * lightP.specular * spec * lightP.color;
     
-    phong.ambient *= vec3(texture(material.diffuse, fTexCoords));
-    phong.diffuse *= vec3(texture(material.diffuse, fTexCoords));
-    phong.specular *= vec3(texture(material.specular, fTexCoords));
+    phong.ambient *= vec3(texture(material.diffuse, vec3(fTexCoords, fMaterialLayers.y)));
+    phong.diffuse *= vec3(texture(material.diffuse, vec3(fTexCoords, fMaterialLayers.y)));
+    phong.specular *= vec3(texture(material.specular, vec3(fTexCoords, fMaterialLayers.z)));
 
     return phong;
 }
 
 float computeShadow()
 {
+    //the nearest cascade reaching the fragment, none past the shadow distance
+    float viewDepth = -fragPosEye.z;
+    if (viewDepth > cascadeSplits[cascadeCount - 1])
+        return 0.0f;
+    int cascade = 0;
+    while (cascade < cascadeCount - 1 && viewDepth > cascadeSplits[cascade])
+        cascade++;
+
     // perform perspective divide
+    vec4 fragPosLightSpace = cascadeMatrices[cascade] * fragPosWorld;
     vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    if(normalizedCoords.z > 1.0f)
-        return 0.0f;
     // Transform to [0,1] range
     normalizedCoords = normalizedCoords * 0.5f + 0.5f;
-    // Get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, normalizedCoords.xy).r;    
-    // Get depth of current fragment from light's perspective
-    float currentDepth = normalizedCoords.z;
-    //float bias = 0.005;
-    float bias = max(0.05 * (1.0 - dot(normal, dirLight.direction)), 0.0005);
-    float shadow = currentDepth - bias> closestDepth ? 1.0f : 0.0f;
-	
-    return shadow;	
+    if(normalizedCoords.z > 1.0f)
+        return 0.0f;
+    float bias = max(0.002 * (1.0 - dot(normal, dirLight.direction)), 0.0002);
+
+    //3x3 compared lookups, each one already a bilinear blend of 4 texels
+    vec2 texelSize = 1.0f / vec2(textureSize(shadowMap, 0).xy);
+    float lit = 0.0f;
+    for (int y = -1; y <= 1; y++)
+    {
+        for (int x = -1; x <= 1; x++)
+        {
+            lit += texture(shadowMap, vec4(normalizedCoords.xy + vec2(x, y) * texelSize, float(cascade), normalizedCoords.z - bias));
+        }
+    }
+    return 1.0f - lit / 9.0f;
+}
+
+int computeCluster()
+{
+    //the first slice ends at the near split, the others are exponential from there
+    float viewDepth = -fragPosEye.z;
+    int slice = 0;
+    if (viewDepth > clusterParams.w)
+        slice = min(1 + int(log(viewDepth / clusterParams.w) * clusterParams.z), clusterGrid.z - 1);
+    ivec2 tile = min(ivec2(gl_FragCoord.xy * clusterParams.xy), clusterGrid.xy - 1);
+    return (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x;
+}
+
+PointLight fetchPointLight(int light)
+{
+    int texel = light * 5;
+    vec4 positionRange = texelFetch(clusterLights, texel);
+    vec4 colorConstant = texelFetch(clusterLights, texel + 1);
+    vec4 ambientLinear = texelFetch(clusterLights, texel + 2);
+    vec4 diffuseQuadratic = texelFetch(clusterLights, texel + 3);
+    vec4 specularShadow = texelFetch(clusterLights, texel + 4);
+
+    PointLight pointLight;
+    pointLight.position = positionRange.xyz;
+    pointLight.range = positionRange.w;
+    pointLight.color = colorConstant.rgb;
+    pointLight.constant = colorConstant.w;
+    pointLight.ambient = ambientLinear.rgb;
+    pointLight.linear = ambientLinear.w;
+    pointLight.diffuse = diffuseQuadratic.rgb;
+    pointLight.quadratic = diffuseQuadratic.w;
+    pointLight.specular = specularShadow.rgb;
+    pointLight.shadow = int(specularShadow.w);
+    return pointLight;
+}
+
+float computePointShadow(int light, vec3 lightPosition)
+{
+    if (pointShadowEnabled[light] == 0)
+        return 0.0f;
+
+    //the cube face the fragment falls in - the major axis of the direction from the light
+    vec3 fromLight = fragPosWorld.xyz - lightPosition;
+    vec3 axes = abs(fromLight);
+    int face;
+    float axisDistance;
+    if (axes.x >= axes.y && axes.x >= axes.z)
+    {
+        face = fromLight.x > 0.0f ? 0 : 1;
+        axisDistance = axes.x;
+    }
+    else if (axes.y >= axes.z)
+    {
+        face = fromLight.y > 0.0f ? 2 : 3;
+        axisDistance = axes.y;
+    }
+    else
+    {
+        face = fromLight.z > 0.0f ? 4 : 5;
+        axisDistance = axes.z;
+    }
+    int index = light * 6 + face;
+    vec4 rect = pointFaceRects[index];
+
+    //the depth is not linear in a perspective face - the bias is a world offset of about a texel at that
+    //distance, along the normal and towards the light
+    float texelWorld = 2.0f * axisDistance * rect.w;
+    vec3 normalWorld = normalize(normalEye * mat3(view));
+    vec3 offsetPos = fragPosWorld.xyz + normalWorld * texelWorld * 1.5f - normalize(fromLight) * texelWorld;
+
+    vec4 fragPosLightSpace = pointFaceMatrices[index] * vec4(offsetPos, 1.0f);
+    vec3 normalizedCoords = fragPosLightSpace.xyz / fragPosLightSpace.w * 0.5f + 0.5f;
+    if (normalizedCoords.z > 1.0f)
+        return 0.0f;
+
+    //half a texel inside the face, so the filter never reads the tile next to it
+    vec2 faceCoords = clamp(normalizedCoords.xy, vec2(0.5f * rect.w), vec2(1.0f - 0.5f * rect.w));
+    return 1.0f - texture(pointShadowMap, vec3(rect.xy + faceCoords * rect.z, normalizedCoords.z));
 }
 
 float computeFog(){
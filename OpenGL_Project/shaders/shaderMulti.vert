@@ -5,21 +5,57 @@ layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
 
 out vec3 normal;
+out vec3 normalEye;
 out vec4 fragPosEye;
-out vec4 fragPosLightSpace;
+//world position, projected into the shadow cascade the fragment falls in
+out vec4 fragPosWorld;
 out vec2 fTexCoords;
+//layers of the ambient, diffuse and specular textures in their arrays
+flat out vec4 fMaterialLayers;
+
+//per-frame data shared by every program - must match gps::FrameUniforms (FrameUniforms.hpp), std140 layout
+//directional light
+struct DirLight{
+    vec3 direction;
+    vec3 color;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout(std140) uniform FrameUniforms{
+    mat4 view;
+    mat4 projection;
+    //light space of each shadow cascade, nearest first
+    mat4 cascadeMatrices[4];
+    mat4 lightDirMatrix;
+    //view distance where each cascade ends
+    vec4 cascadeSplits;
+
+    DirLight dirLight;
+    //see gps::LightClusters
+    vec4 clusterParams;
+    ivec4 clusterGrid;
+
+    vec3 fogColor;
+    float fogDensity;
+    bool fogEnabled;
+    int cascadeCount;
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceTrMatrix;
+uniform vec4 materialLayers;
+uniform	mat3 normalMatrix;
 
 void main() 
 {
 	//compute eye space coordinates
 	fragPosEye = view * model * vec4(vPosition, 1.0f);
 	normal = vNormal;
+	normalEye = normalMatrix * vNormal;
 	fTexCoords = vTexCoords;
-	fragPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	fMaterialLayers = materialLayers;
+	fragPosWorld = model * vec4(vPosition, 1.0f);
 	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
 }
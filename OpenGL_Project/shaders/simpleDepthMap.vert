@@ -2,7 +2,12 @@
 
 layout(location=0) in vec3 vPosition;
 
-uniform mat4 lightSpaceTrMatrix;
+//light space of the shadow cascade or point light face being drawn, one slot of the cascade buffer
+//(see gps::ShadowCascades) or of the face buffer (gps::PointShadows)
+layout(std140) uniform ShadowCascade{
+    mat4 lightSpaceTrMatrix;
+};
+
 uniform mat4 model;
 
 void main()
@@ -0,0 +1,16 @@
+#version 400 core
+
+layout(location=0) in vec3 vPosition;
+//per-instance model matrix, locations 3-6 (see Mesh::CreateInstancedVertexArray)
+layout(location=3) in mat4 instanceModel;
+
+//light space of the shadow cascade or point light face being drawn, one slot of the cascade buffer
+//(see gps::ShadowCascades) or of the face buffer (gps::PointShadows)
+layout(std140) uniform ShadowCascade{
+    mat4 lightSpaceTrMatrix;
+};
+
+void main()
+{
+    gl_Position = lightSpaceTrMatrix * instanceModel * vec4(vPosition, 1.0f);
+}
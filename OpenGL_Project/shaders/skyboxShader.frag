@@ -5,14 +5,41 @@ out vec4 fColor;
 
 uniform samplerCube skybox;
 
-uniform bool fogEnabled;
-uniform vec3 fogColor;
-uniform vec3 lightColor;
+//per-frame data shared by every program - must match gps::FrameUniforms (FrameUniforms.hpp), std140 layout
+//directional light
+struct DirLight{
+    vec3 direction;
+    vec3 color;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout(std140) uniform FrameUniforms{
+    mat4 view;
+    mat4 projection;
+    //light space of each shadow cascade, nearest first
+    mat4 cascadeMatrices[4];
+    mat4 lightDirMatrix;
+    //view distance where each cascade ends
+    vec4 cascadeSplits;
+
+    DirLight dirLight;
+    //see gps::LightClusters
+    vec4 clusterParams;
+    ivec4 clusterGrid;
+
+    vec3 fogColor;
+    float fogDensity;
+    bool fogEnabled;
+    int cascadeCount;
+};
 
 void main()
 {
     fColor = texture(skybox, textureCoordinates);
-	fColor *= vec4(lightColor, 1.0f);
+	fColor *= vec4(dirLight.color, 1.0f);
     if  (fogEnabled){
         fColor = vec4(fogColor, 1.0f);
     }
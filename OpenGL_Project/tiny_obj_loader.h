@@ -33,6 +33,9 @@
 //   #define TINYOBJLOADER_IMPLEMENTATION
 //   #include "tiny_obj_loader.h"
 //
+// Numbers are read with an exact float parser. Define TINYOBJLOADER_FAST_FLOAT
+// to 0 before the implementation to use the original double parser instead.
+//
 
 #ifndef TINY_OBJ_LOADER_H_
 #define TINY_OBJ_LOADER_H_
@@ -228,6 +231,23 @@ namespace tinyobj {
                  std::istream *inStream, MaterialReader *readMatFn = NULL,
                  bool triangulate = true);
     
+    /// Loads .obj from a file like LoadObj(), but tokenizes `v`, `vn`, `vt` and
+    /// `f` records on several threads. The file is split into line-aligned
+    /// chunks, and the per-chunk results are merged in file order, so the output
+    /// is identical to LoadObj().
+    /// 'num_threads' = 0 uses std::thread::hardware_concurrency().
+    bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+                         std::vector<material_t> *materials, std::string *err,
+                         const char *filename, const char *mtl_basepath = NULL,
+                         bool triangulate = true, unsigned int num_threads = 0);
+    
+    /// Parses a number token as the .obj/.mtl readers do. The token ends at the
+    /// first space, tab, '\r' or '\0'.
+    /// 'legacy' selects the original double parser (narrowed to float) instead
+    /// of the exact float parser, e.g. to compare the two.
+    /// Returns false when there is no number.
+    bool ParseFloat(const char *token, float *result, bool legacy = false);
+    
     /// Loads materials into std::map
     void LoadMtl(std::map<std::string, int> *material_map,
                  std::vector<material_t> *materials, std::istream *inStream);
@@ -241,10 +261,12 @@ namespace tinyobj {
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 #include <utility>
 
 #include <fstream>
 #include <sstream>
+#include <thread>
 
 namespace tinyobj {
     
@@ -252,6 +274,10 @@ namespace tinyobj {
     
 #define TINYOBJ_SSCANF_BUFFER_SIZE (4096)
     
+#ifndef TINYOBJLOADER_FAST_FLOAT
+#define TINYOBJLOADER_FAST_FLOAT 1
+#endif
+    
     struct vertex_index {
         int v_idx, vt_idx, vn_idx;
         vertex_index() : v_idx(-1), vt_idx(-1), vn_idx(-1) {}
@@ -481,7 +507,153 @@ namespace tinyobj {
         return false;
     }
     
+    // Correctly rounded fallback for the numbers the fast paths cannot handle
+    static float parseFloatSlow(const char *s, const char *s_end) {
+        std::string number(s, s_end);
+        return strtof(number.c_str(), NULL);
+    }
+    
+    // Exact counterpart of tryParseDouble() for float results. It accepts the
+    // same grammar and returns the correctly rounded float (the same as strtof).
+    //
+    // Scans from *token without a precomputed end: the number stops at the
+    // first character outside the grammar, which for the .obj/.mtl readers is
+    // the whitespace or '\0' that ends the token. *token is left there.
+    //
+    // The decimal digits are read into a 64-bit integer and scaled by a power
+    // of ten. In the common cases a single float or double operation on exact
+    // operands gives the answer (Clinger's fast path); strtof handles the rest.
+    static bool tryParseFloat(const char **token, float *result) {
+        static const float float_pow10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                            1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+        static const double double_pow10[] = {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+            1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+        const unsigned long long max_mantissa = 1000000000000000000ULL;
+        
+        const char *s = *token;
+        const char *curr = s;
+        bool negative = false;
+        unsigned long long mantissa = 0;
+        int dropped = 0;  // digits that did not fit in the mantissa
+        int scale = 0;    // value = mantissa * 10^scale
+        
+        if (*curr == '+' || *curr == '-') {
+            negative = (*curr == '-');
+            curr++;
+        }
+        
+        // Integer part, at least one digit
+        if (!IS_DIGIT(*curr)) {
+            return false;
+        }
+        do {
+            if (mantissa < max_mantissa) {
+                mantissa = mantissa * 10 + static_cast<unsigned int>(*curr - '0');
+            } else {
+                dropped++;
+                scale++;
+            }
+            curr++;
+        } while (IS_DIGIT(*curr));
+        
+        // Decimal part
+        if (*curr == '.') {
+            curr++;
+            while (IS_DIGIT(*curr)) {
+                if (mantissa < max_mantissa) {
+                    mantissa = mantissa * 10 + static_cast<unsigned int>(*curr - '0');
+                    scale--;
+                } else {
+                    dropped++;
+                }
+                curr++;
+            }
+        }
+        
+        // Exponent part, which must have digits
+        if (*curr == 'e' || *curr == 'E') {
+            curr++;
+            bool exp_negative = false;
+            if (*curr == '+' || *curr == '-') {
+                exp_negative = (*curr == '-');
+                curr++;
+            }
+            if (!IS_DIGIT(*curr)) {
+                return false;
+            }
+            int exponent = 0;
+            do {
+                if (exponent < 100000) exponent = exponent * 10 + (*curr - '0');
+                curr++;
+            } while (IS_DIGIT(*curr));
+            scale += exp_negative ? -exponent : exponent;
+        }
+        
+        *token = curr;
+        
+        float value;
+        if (mantissa == 0) {
+            value = 0.0f;
+        } else if (dropped == 0 && mantissa <= (1ULL << 24) && scale >= -10 &&
+                   scale <= 10) {
+            // Both operands are exact floats, so the single rounding is correct
+            value = static_cast<float>(mantissa);
+            value = scale < 0 ? value / float_pow10[-scale]
+                              : value * float_pow10[scale];
+        } else {
+            if (dropped != 0 || mantissa > (1ULL << 53) || scale < -22 ||
+                scale > 22) {
+                *result = parseFloatSlow(s, curr);
+                return true;
+            }
+            
+            double d = static_cast<double>(mantissa);
+            d = scale < 0 ? d / double_pow10[-scale] : d * double_pow10[scale];
+            
+            // Narrowing rounds a second time, which is only wrong when the
+            // double sits exactly halfway between two floats. Subnormal and
+            // out of range results are left to strtof as well.
+            unsigned long long bits;
+            memcpy(&bits, &d, sizeof(bits));
+            if ((bits & 0x1FFFFFFFULL) == 0x10000000ULL || d < 1.17549435e-38 ||
+                d > 3.40282347e+38) {
+                *result = parseFloatSlow(s, curr);
+                return true;
+            }
+            value = static_cast<float>(d);
+        }
+        
+        *result = negative ? -value : value;
+        return true;
+    }
+    
+    bool ParseFloat(const char *token, float *result, bool legacy) {
+        if (!legacy) {
+            return tryParseFloat(&token, result);
+        }
+        double val;
+        if (!tryParseDouble(token, token + strcspn(token, " \t\r"), &val)) {
+            return false;
+        }
+        *result = static_cast<float>(val);
+        return true;
+    }
+    
     static inline float parseFloat(const char **token, double default_value = 0.0) {
+#if TINYOBJLOADER_FAST_FLOAT
+        while (IS_SPACE(**token)) (*token)++;
+        float f = static_cast<float>(default_value);
+        const char *end = *token;
+        tryParseFloat(&end, &f);
+        // Skip whatever follows the number up to the end of the token, as the
+        // original parser does
+        if (!IS_SPACE(*end) && !IS_NEW_LINE(*end)) {
+            end += strcspn(end, " \t\r");
+        }
+        (*token) = end;
+        return f;
+#else
         (*token) += strspn((*token), " \t");
         const char *end = (*token) + strcspn((*token), " \t\r");
         double val = default_value;
@@ -489,6 +661,7 @@ namespace tinyobj {
         float f = static_cast<float>(val);
         (*token) = end;
         return f;
+#endif
     }
     
     static inline void parseFloat2(float *x, float *y, const char **token) {
@@ -638,6 +811,52 @@ namespace tinyobj {
         material->unknown_parameter.clear();
     }
     
+    static tag_t parseTag(const char *token) {
+        tag_t tag;
+        
+        char namebuf[4096];
+        token += 2;
+#ifdef _MSC_VER
+        sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+        sscanf(token, "%s", namebuf);
+#endif
+        tag.name = std::string(namebuf);
+        
+        token += tag.name.size() + 1;
+        
+        tag_sizes ts = parseTagTriple(&token);
+        
+        tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+        
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
+            tag.intValues[i] = atoi(token);
+            token += strcspn(token, "/ \t\r") + 1;
+        }
+        
+        tag.floatValues.resize(static_cast<size_t>(ts.num_floats));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_floats); ++i) {
+            tag.floatValues[i] = parseFloat(&token);
+            token += strcspn(token, "/ \t\r") + 1;
+        }
+        
+        tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
+            char stringValueBuffer[4096];
+            
+#ifdef _MSC_VER
+            sscanf_s(token, "%s", stringValueBuffer,
+                     (unsigned)_countof(stringValueBuffer));
+#else
+            sscanf(token, "%s", stringValueBuffer);
+#endif
+            tag.stringValues[i] = stringValueBuffer;
+            token += tag.stringValues[i].size() + 1;
+        }
+        
+        return tag;
+    }
+    
     static bool exportFaceGroupToShape(
                                        shape_t *shape, const std::vector<std::vector<vertex_index> > &faceGroup,
                                        const std::vector<tag_t> &tags, const int material_id,
@@ -1307,73 +1526,502 @@ namespace tinyobj {
             }
             
             if (token[0] == 't' && IS_SPACE(token[1])) {
-                tag_t tag;
-                
-                char namebuf[4096];
+                tags.push_back(parseTag(token));
+            }
+            
+            // Ignore unknown command.
+        }
+        
+        bool ret = exportFaceGroupToShape(&shape, faceGroup, tags, material, name,
+                                          triangulate);
+        // exportFaceGroupToShape return false when `usemtl` is called in the last
+        // line.
+        // we also add `shape` to `shapes` when `shape.mesh` has already some
+        // faces(indices)
+        if (ret || shape.mesh.indices.size()) {
+            shapes->push_back(shape);
+        }
+        faceGroup.clear();  // for safety
+        
+        if (err) {
+            (*err) += errss.str();
+        }
+        
+        attrib->vertices.swap(v);
+        attrib->normals.swap(vn);
+        attrib->texcoords.swap(vt);
+        
+        return true;
+    }
+    
+    // Output of one chunk of the parallel parser.
+    // Face indices are zero-based; a negative (relative) index is resolved
+    // against the chunk's own attribute counts and flagged in `relative`, so
+    // it can be shifted by the counts of the preceding chunks when merging.
+    struct obj_chunk {
+        const char *begin;
+        const char *end;
+        
+        std::vector<float> v;
+        std::vector<float> vn;
+        std::vector<float> vt;
+        std::vector<vertex_index> corners;
+        std::vector<unsigned char> relative;  // bit 0 = v, 1 = vn, 2 = vt
+        std::vector<size_t> face_sizes;
+        
+        // Lines other than v/vn/vt/f, replayed serially in file order.
+        // `face` is the number of faces of this chunk that precede the line.
+        std::vector<std::pair<const char *, size_t> > commands;
+        
+        // Where this chunk's data starts in the merged arrays
+        size_t v_offset, vn_offset, vt_offset, corner_offset, face_offset;
+    };
+    
+    static vertex_index parseChunkTriple(const char **token, int vsize,
+                                         int vnsize, int vtsize,
+                                         unsigned char *relative) {
+        vertex_index vi(-1);
+        *relative = 0;
+        
+        int idx = atoi((*token));
+        if (idx < 0) *relative |= 1;
+        vi.v_idx = fixIndex(idx, vsize);
+        (*token) += strcspn((*token), "/ \t\r");
+        if ((*token)[0] != '/') {
+            return vi;
+        }
+        (*token)++;
+        
+        // i//k
+        if ((*token)[0] == '/') {
+            (*token)++;
+            idx = atoi((*token));
+            if (idx < 0) *relative |= 2;
+            vi.vn_idx = fixIndex(idx, vnsize);
+            (*token) += strcspn((*token), "/ \t\r");
+            return vi;
+        }
+        
+        // i/j/k or i/j
+        idx = atoi((*token));
+        if (idx < 0) *relative |= 4;
+        vi.vt_idx = fixIndex(idx, vtsize);
+        (*token) += strcspn((*token), "/ \t\r");
+        if ((*token)[0] != '/') {
+            return vi;
+        }
+        
+        // i/j/k
+        (*token)++;  // skip '/'
+        idx = atoi((*token));
+        if (idx < 0) *relative |= 2;
+        vi.vn_idx = fixIndex(idx, vnsize);
+        (*token) += strcspn((*token), "/ \t\r");
+        return vi;
+    }
+    
+    // Tokenizes the lines of a chunk. Line endings are overwritten with '\0' so
+    // the existing token parsers can be used on the shared buffer in place.
+    static void parseObjChunk(obj_chunk *chunk) {
+        char *line = const_cast<char *>(chunk->begin);
+        char *chunk_end = const_cast<char *>(chunk->end);
+        
+        while (line < chunk_end) {
+            char *line_end = static_cast<char *>(
+                memchr(line, '\n', static_cast<size_t>(chunk_end - line)));
+            if (!line_end) line_end = chunk_end;
+            *line_end = '\0';
+            if (line_end > line && line_end[-1] == '\r') line_end[-1] = '\0';
+            
+            const char *token = line;
+            line = line_end + 1;
+            
+            token += strspn(token, " \t");
+            if (token[0] == '\0') continue;  // empty line
+            if (token[0] == '#') continue;   // comment line
+            
+            // vertex
+            if (token[0] == 'v' && IS_SPACE((token[1]))) {
                 token += 2;
-#ifdef _MSC_VER
-                sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
-#else
-                sscanf(token, "%s", namebuf);
-#endif
-                tag.name = std::string(namebuf);
+                float x, y, z;
+                parseFloat3(&x, &y, &z, &token);
+                chunk->v.push_back(x);
+                chunk->v.push_back(y);
+                chunk->v.push_back(z);
+                continue;
+            }
+            
+            // normal
+            if (token[0] == 'v' && token[1] == 'n' && IS_SPACE((token[2]))) {
+                token += 3;
+                float x, y, z;
+                parseFloat3(&x, &y, &z, &token);
+                chunk->vn.push_back(x);
+                chunk->vn.push_back(y);
+                chunk->vn.push_back(z);
+                continue;
+            }
+            
+            // texcoord
+            if (token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2]))) {
+                token += 3;
+                float x, y;
+                parseFloat2(&x, &y, &token);
+                chunk->vt.push_back(x);
+                chunk->vt.push_back(y);
+                continue;
+            }
+            
+            // face
+            if (token[0] == 'f' && IS_SPACE((token[1]))) {
+                token += 2;
+                token += strspn(token, " \t");
                 
-                token += tag.name.size() + 1;
+                size_t num_corners = 0;
+                while (!IS_NEW_LINE(token[0])) {
+                    unsigned char relative;
+                    vertex_index vi = parseChunkTriple(
+                        &token, static_cast<int>(chunk->v.size() / 3),
+                        static_cast<int>(chunk->vn.size() / 3),
+                        static_cast<int>(chunk->vt.size() / 2), &relative);
+                    chunk->corners.push_back(vi);
+                    chunk->relative.push_back(relative);
+                    num_corners++;
+                    size_t n = strspn(token, " \t\r");
+                    token += n;
+                }
+                chunk->face_sizes.push_back(num_corners);
+                continue;
+            }
+            
+            chunk->commands.push_back(
+                std::make_pair(token, chunk->face_sizes.size()));
+        }
+    }
+    
+    // Copies a chunk into the merged arrays, shifting its relative indices
+    static void mergeObjChunk(const obj_chunk &chunk, attrib_t *attrib,
+                              std::vector<vertex_index> *corners,
+                              std::vector<size_t> *face_offsets) {
+        if (!chunk.v.empty())
+            memcpy(&attrib->vertices[chunk.v_offset * 3], &chunk.v[0],
+                   chunk.v.size() * sizeof(float));
+        if (!chunk.vn.empty())
+            memcpy(&attrib->normals[chunk.vn_offset * 3], &chunk.vn[0],
+                   chunk.vn.size() * sizeof(float));
+        if (!chunk.vt.empty())
+            memcpy(&attrib->texcoords[chunk.vt_offset * 2], &chunk.vt[0],
+                   chunk.vt.size() * sizeof(float));
+        
+        const int v_offset = static_cast<int>(chunk.v_offset);
+        const int vn_offset = static_cast<int>(chunk.vn_offset);
+        const int vt_offset = static_cast<int>(chunk.vt_offset);
+        for (size_t i = 0; i < chunk.corners.size(); i++) {
+            vertex_index vi = chunk.corners[i];
+            unsigned char relative = chunk.relative[i];
+            if (relative & 1) vi.v_idx += v_offset;
+            if (relative & 2) vi.vn_idx += vn_offset;
+            if (relative & 4) vi.vt_idx += vt_offset;
+            (*corners)[chunk.corner_offset + i] = vi;
+        }
+        
+        size_t corner = chunk.corner_offset;
+        for (size_t i = 0; i < chunk.face_sizes.size(); i++) {
+            (*face_offsets)[chunk.face_offset + i] = corner;
+            corner += chunk.face_sizes[i];
+        }
+    }
+    
+    // Same as exportFaceGroupToShape(), for the faces [face_begin, face_end)
+    // of the merged arrays
+    static bool exportFaceRangeToShape(
+        shape_t *shape, const std::vector<vertex_index> &corners,
+        const std::vector<size_t> &face_offsets, size_t face_begin,
+        size_t face_end, const std::vector<tag_t> &tags, const int material_id,
+        const std::string &name, bool triangulate) {
+        if (face_begin >= face_end) {
+            return false;
+        }
+        
+        for (size_t f = face_begin; f < face_end; f++) {
+            const vertex_index *face = &corners[face_offsets[f]];
+            size_t npolys = face_offsets[f + 1] - face_offsets[f];
+            if (npolys == 0) continue;
+            
+            if (triangulate) {
+                // Polygon -> triangle fan conversion
+                for (size_t k = 2; k < npolys; k++) {
+                    const vertex_index *tri[3] = { &face[0], &face[k - 1], &face[k] };
+                    for (int c = 0; c < 3; c++) {
+                        index_t idx;
+                        idx.vertex_index = tri[c]->v_idx;
+                        idx.normal_index = tri[c]->vn_idx;
+                        idx.texcoord_index = tri[c]->vt_idx;
+                        shape->mesh.indices.push_back(idx);
+                    }
+                    
+                    shape->mesh.num_face_vertices.push_back(3);
+                    shape->mesh.material_ids.push_back(material_id);
+                }
+            } else {
+                for (size_t k = 0; k < npolys; k++) {
+                    index_t idx;
+                    idx.vertex_index = face[k].v_idx;
+                    idx.normal_index = face[k].vn_idx;
+                    idx.texcoord_index = face[k].vt_idx;
+                    shape->mesh.indices.push_back(idx);
+                }
                 
-                tag_sizes ts = parseTagTriple(&token);
+                shape->mesh.num_face_vertices.push_back(
+                                                        static_cast<unsigned char>(npolys));
+                shape->mesh.material_ids.push_back(material_id);  // per face
+            }
+        }
+        
+        shape->name = name;
+        shape->mesh.tags = tags;
+        
+        return true;
+    }
+    
+    // Runs fn(0) ... fn(count - 1), each on its own thread
+    template <typename Fn>
+    static void runOnThreads(size_t count, Fn fn) {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < count; i++) {
+            workers.push_back(std::thread(fn, i));
+        }
+        if (count > 0) fn(0);
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+    
+    bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+                         std::vector<material_t> *materials, std::string *err,
+                         const char *filename, const char *mtl_basepath,
+                         bool triangulate, unsigned int num_threads) {
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+        
+        std::stringstream errss;
+        
+        std::ifstream ifs(filename, std::ios::in | std::ios::binary);
+        if (!ifs) {
+            errss << "Cannot open file [" << filename << "]" << std::endl;
+            if (err) {
+                (*err) = errss.str();
+            }
+            return false;
+        }
+        
+        std::string basePath;
+        if (mtl_basepath) {
+            basePath = mtl_basepath;
+        }
+        MaterialFileReader matFileReader(basePath);
+        
+        ifs.seekg(0, std::ios::end);
+        size_t size = static_cast<size_t>(ifs.tellg());
+        ifs.seekg(0, std::ios::beg);
+        
+        // One spare byte so the last line can always be terminated in place
+        std::vector<char> buffer(size + 1, '\0');
+        if (size > 0) ifs.read(&buffer[0], static_cast<std::streamsize>(size));
+        
+        if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+        if (num_threads == 0) num_threads = 1;
+        
+        // Small files are not worth a thread each
+        const size_t min_chunk_size = 64 * 1024;
+        size_t num_chunks = std::min(static_cast<size_t>(num_threads),
+                                     size / min_chunk_size + 1);
+        
+        // Split at line boundaries
+        std::vector<obj_chunk> chunks(num_chunks);
+        const char *data = &buffer[0];
+        const char *cursor = data;
+        for (size_t c = 0; c < num_chunks; c++) {
+            const char *end = data + size;
+            if (c + 1 < num_chunks) {
+                end = std::max(cursor, data + size * (c + 1) / num_chunks);
+                const char *newline = static_cast<const char *>(
+                    memchr(end, '\n', static_cast<size_t>(data + size - end)));
+                end = newline ? newline + 1 : data + size;
+            }
+            chunks[c].begin = cursor;
+            chunks[c].end = end;
+            cursor = end;
+        }
+        
+        runOnThreads(num_chunks, [&chunks](size_t c) { parseObjChunk(&chunks[c]); });
+        
+        size_t num_v = 0, num_vn = 0, num_vt = 0, num_corners = 0, num_faces = 0;
+        for (size_t c = 0; c < num_chunks; c++) {
+            chunks[c].v_offset = num_v;
+            chunks[c].vn_offset = num_vn;
+            chunks[c].vt_offset = num_vt;
+            chunks[c].corner_offset = num_corners;
+            chunks[c].face_offset = num_faces;
+            num_v += chunks[c].v.size() / 3;
+            num_vn += chunks[c].vn.size() / 3;
+            num_vt += chunks[c].vt.size() / 2;
+            num_corners += chunks[c].corners.size();
+            num_faces += chunks[c].face_sizes.size();
+        }
+        
+        attrib->vertices.resize(num_v * 3);
+        attrib->normals.resize(num_vn * 3);
+        attrib->texcoords.resize(num_vt * 2);
+        std::vector<vertex_index> corners(num_corners);
+        std::vector<size_t> face_offsets(num_faces + 1);
+        face_offsets[num_faces] = num_corners;
+        
+        runOnThreads(num_chunks, [&](size_t c) {
+            mergeObjChunk(chunks[c], attrib, &corners, &face_offsets);
+        });
+        
+        // Replay the remaining commands in file order, as LoadObj() does
+        std::vector<tag_t> tags;
+        std::string name;
+        std::map<std::string, int> material_map;
+        int material = -1;
+        size_t group_begin = 0;
+        
+        shape_t shape;
+        
+        for (size_t c = 0; c < num_chunks; c++) {
+            for (size_t i = 0; i < chunks[c].commands.size(); i++) {
+                const char *token = chunks[c].commands[i].first;
+                size_t face = chunks[c].face_offset + chunks[c].commands[i].second;
                 
-                tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+                // use mtl
+                if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
+                    char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+                    token += 7;
+#ifdef _MSC_VER
+                    sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+                    sscanf(token, "%s", namebuf);
+#endif
+                    
+                    int newMaterialId = -1;
+                    if (material_map.find(namebuf) != material_map.end()) {
+                        newMaterialId = material_map[namebuf];
+                    }
+                    
+                    if (newMaterialId != material) {
+                        exportFaceRangeToShape(&shape, corners, face_offsets,
+                                               group_begin, face, tags, material,
+                                               name, triangulate);
+                        group_begin = face;
+                        material = newMaterialId;
+                    }
+                    
+                    continue;
+                }
                 
-                for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
-                    tag.intValues[i] = atoi(token);
-                    token += strcspn(token, "/ \t\r") + 1;
+                // load mtl
+                if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
+                    char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+                    token += 7;
+#ifdef _MSC_VER
+                    sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+                    sscanf(token, "%s", namebuf);
+#endif
+                    
+                    std::string err_mtl;
+                    bool ok = matFileReader(namebuf, materials, &material_map, &err_mtl);
+                    if (err) {
+                        (*err) += err_mtl;
+                    }
+                    
+                    if (!ok) {
+                        return false;
+                    }
+                    
+                    continue;
                 }
                 
-                tag.floatValues.resize(static_cast<size_t>(ts.num_floats));
-                for (size_t i = 0; i < static_cast<size_t>(ts.num_floats); ++i) {
-                    tag.floatValues[i] = parseFloat(&token);
-                    token += strcspn(token, "/ \t\r") + 1;
+                // group name
+                if (token[0] == 'g' && IS_SPACE((token[1]))) {
+                    // flush previous face group.
+                    bool ret = exportFaceRangeToShape(&shape, corners, face_offsets,
+                                                      group_begin, face, tags,
+                                                      material, name, triangulate);
+                    if (ret) {
+                        shapes->push_back(shape);
+                    }
+                    
+                    shape = shape_t();
+                    group_begin = face;
+                    
+                    std::vector<std::string> names;
+                    names.reserve(2);
+                    
+                    while (!IS_NEW_LINE(token[0])) {
+                        std::string str = parseString(&token);
+                        names.push_back(str);
+                        token += strspn(token, " \t\r");  // skip tag
+                    }
+                    
+                    // names[0] must be 'g', so skip the 0th element.
+                    if (names.size() > 1) {
+                        name = names[1];
+                    } else {
+                        name = "";
+                    }
+                    
+                    continue;
                 }
                 
-                tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
-                for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
-                    char stringValueBuffer[4096];
+                // object name
+                if (token[0] == 'o' && IS_SPACE((token[1]))) {
+                    // flush previous face group.
+                    bool ret = exportFaceRangeToShape(&shape, corners, face_offsets,
+                                                      group_begin, face, tags,
+                                                      material, name, triangulate);
+                    if (ret) {
+                        shapes->push_back(shape);
+                    }
                     
+                    group_begin = face;
+                    shape = shape_t();
+                    
+                    char namebuf[TINYOBJ_SSCANF_BUFFER_SIZE];
+                    token += 2;
 #ifdef _MSC_VER
-                    sscanf_s(token, "%s", stringValueBuffer,
-                             (unsigned)_countof(stringValueBuffer));
+                    sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
 #else
-                    sscanf(token, "%s", stringValueBuffer);
+                    sscanf(token, "%s", namebuf);
 #endif
-                    tag.stringValues[i] = stringValueBuffer;
-                    token += tag.stringValues[i].size() + 1;
+                    name = std::string(namebuf);
+                    
+                    continue;
                 }
                 
-                tags.push_back(tag);
+                if (token[0] == 't' && IS_SPACE(token[1])) {
+                    tags.push_back(parseTag(token));
+                }
+                
+                // Ignore unknown command.
             }
-            
-            // Ignore unknown command.
         }
         
-        bool ret = exportFaceGroupToShape(&shape, faceGroup, tags, material, name,
-                                          triangulate);
-        // exportFaceGroupToShape return false when `usemtl` is called in the last
-        // line.
-        // we also add `shape` to `shapes` when `shape.mesh` has already some
-        // faces(indices)
+        bool ret = exportFaceRangeToShape(&shape, corners, face_offsets,
+                                          group_begin, num_faces, tags, material,
+                                          name, triangulate);
         if (ret || shape.mesh.indices.size()) {
             shapes->push_back(shape);
         }
-        faceGroup.clear();  // for safety
         
         if (err) {
             (*err) += errss.str();
         }
         
-        attrib->vertices.swap(v);
-        attrib->normals.swap(vn);
-        attrib->texcoords.swap(vt);
-        
         return true;
     }
     